@@ -0,0 +1,109 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+import thrift from 'thrift';
+
+// Magic bytes of a batch envelope, see include/bda/ThriftBatchEnvelope.hh
+const cBatchEnvelopeMagic = [0x42, 0x44, 0x41, 0x42];
+const cBatchEnvelopeHeaderSize = 8;
+
+function isBatchEnvelope(aBuffer) {
+  return aBuffer.length >= cBatchEnvelopeHeaderSize &&
+    cBatchEnvelopeMagic.every((aByte, aIdx) => aBuffer[aIdx] === aByte);
+}
+
+/**
+ * A thrift WSConnection that packs all calls issued during the same turn of
+ * the event loop into a single batch envelope, and unpacks the batched
+ * responses of the server. The server must enable the batch mode with
+ * bda::ThriftHTTPWSServer::setBatchMode(). Use it like a WSConnection:
+ * @example
+ *     const connection = new TBatchWSConnection(HOST, WSPORT, { transport, protocol });
+ *     connection.open();
+ *     const client = thrift.createWSClient(TestThriftAPI, connection);
+ *     for (let i = 0; i < 200; ++i) {
+ *       client.fetchData(2, callback); // all 200 calls are sent in one message
+ *     }
+ */
+export default class TBatchWSConnection extends thrift.WSConnection {
+  constructor(host, port, options) {
+    super(host, port, options);
+    this.maxBatchSize = (options && options.maxBatchSize) || 256;
+    this.batch_pending = [];
+    this.batch_scheduled = false;
+  }
+
+  write(data) {
+    this.batch_pending.push(data);
+    if (this.batch_pending.length >= this.maxBatchSize) {
+      this.flush();
+    } else if (!this.batch_scheduled) {
+      this.batch_scheduled = true;
+      Promise.resolve().then(() => this.flush());
+    }
+  }
+
+  /**
+   * Send all pending calls now in a single batch envelope.
+   */
+  flush() {
+    this.batch_scheduled = false;
+    if (this.batch_pending.length === 0) {
+      return;
+    }
+    const vMessages = this.batch_pending;
+    this.batch_pending = [];
+
+    const vEnvelopeSize = vMessages.reduce((aSize, aMessage) => aSize + 4 + aMessage.length, cBatchEnvelopeHeaderSize);
+    const vEnvelope = Buffer.alloc(vEnvelopeSize);
+    cBatchEnvelopeMagic.forEach((aByte, aIdx) => { vEnvelope[aIdx] = aByte; });
+    vEnvelope.writeUInt32BE(vMessages.length, 4);
+    let vOffset = cBatchEnvelopeHeaderSize;
+    vMessages.forEach((aMessage) => {
+      vEnvelope.writeUInt32BE(aMessage.length, vOffset);
+      vOffset += 4;
+      Buffer.from(aMessage).copy(vEnvelope, vOffset);
+      vOffset += aMessage.length;
+    });
+
+    super.write(vEnvelope);
+  }
+
+  __onData(data) {
+    if (Object.prototype.toString.call(data) === "[object ArrayBuffer]") {
+      data = new Uint8Array(data);
+    }
+    const vBuffer = Buffer.from(data);
+    if (!isBatchEnvelope(vBuffer)) {
+      return super.__onData(vBuffer);
+    }
+
+    // Hand every response to the regular decoder, empty entries belong to oneway calls
+    const vCount = vBuffer.readUInt32BE(4);
+    let vOffset = cBatchEnvelopeHeaderSize;
+    for (let vIdx = 0; vIdx < vCount; ++vIdx) {
+      const vSize = vBuffer.readUInt32BE(vOffset);
+      vOffset += 4;
+      if (vSize > 0) {
+        super.__onData(vBuffer.slice(vOffset, vOffset + vSize));
+      }
+      vOffset += vSize;
+    }
+  }
+}
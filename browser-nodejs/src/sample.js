@@ -2,6 +2,7 @@ import thrift from 'thrift';
 
 import TTypes from './gen-nodejs/TestThriftAPI_types';
 import TestThriftAPI from './gen-nodejs/TestThriftAPI';
+import TBatchWSConnection from './batch_ws_connection';
 import assert from 'assert';
 
 const HOST = 'localhost';
@@ -127,6 +128,47 @@ export default function browserNodeJSThriftClient() {
   }
 
 
+  /****************************************************************
+   * Batch benchmark, all calls of a round are sent in one message.
+   * Needs a server with batch mode, e.g. the demo server with --batch
+   ****************************************************************/
+  const cBatchRounds = 50;
+  const cCallsPerBatch = 200;
+  function benchBatch(aName, aDataSizeIdx) {
+      const vBatchConnection = new TBatchWSConnection(HOST, WSPORT, {
+        transport : transport,
+        protocol : protocol
+      });
+      vBatchConnection.open();
+      vBatchConnection.on('error', function(err) {
+        assert(false, err);
+      });
+      const vBatchClient = thrift.createWSClient(TestThriftAPI, vBatchConnection);
+
+      var vRound = 0;
+      const vBenchStartTime = performance.now();
+      function sendRound() {
+          var vPendingCalls = cCallsPerBatch;
+          for (var vIdx = 0; vIdx < cCallsPerBatch; ++vIdx) {
+              vBatchClient.fetchData(aDataSizeIdx, function(err, aResponse) {
+                  if (--vPendingCalls > 0) {
+                      return;
+                  }
+                  if (++vRound < cBatchRounds) {
+                      sendRound();
+                  } else {
+                      const vDurationMilliSec = performance.now() - vBenchStartTime;
+                      logPerformance(aName, cBatchRounds * cCallsPerBatch, vDurationMilliSec, aResponse.length);
+                      vBatchConnection.close();
+                      console.log('benchmark completed.');
+                  }
+              });
+          }
+      }
+      vBatchConnection.on('open', sendRound);
+  }
+
+
   /****************************************************************
    * Orchestrator for benchmark execution
    ****************************************************************/
@@ -135,6 +177,8 @@ export default function browserNodeJSThriftClient() {
       if (vDataSizeIdx < 8) {
           benchmarkSpeedEstimator('Binary;Buffered', vDataSizeIdx);
           ++vDataSizeIdx;
+      } else if (typeof window !== 'undefined' && new URLSearchParams(window.location.search).has('batch')) {
+          benchBatch('Binary;Buffered;Batch', 0);
       } else {
           console.log('benchmark completed.');
       }
@@ -0,0 +1,187 @@
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements. See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership. The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License. You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied. See the License for the
+# specific language governing permissions and limitations
+# under the License.
+
+# bda_embed_document_root(<target> <name> DIRECTORY <dir> [FILES <globs>...]
+#                         [PRECOMPRESS] [DEPENDS <targets>...])
+#
+# Compiles the files of the document root <dir> into <target>, as a read-only
+# bda::ThriftEmbeddedDocumentRoot that the function <name>() of the generated
+# header <name>.hh returns, see bda/ThriftEmbeddedDocumentRoot.hh. FILES
+# selects the files with globs relative to <dir>, all files by default. The
+# files are collected when <target> is built, so that the output of other
+# build steps, e.g. a webpack bundle of the targets in DEPENDS, can be
+# embedded. With PRECOMPRESS, files that gzip makes smaller are also embedded
+# compressed. Every file gets an ETag from its SHA-256 hash.
+
+set(BDA_EMBED_DOCUMENT_ROOT_SCRIPT "${CMAKE_CURRENT_LIST_FILE}")
+
+function(bda_embed_document_root TARGET NAME)
+    cmake_parse_arguments(EMBED "PRECOMPRESS" "DIRECTORY" "FILES;DEPENDS" ${ARGN})
+    if(NOT EMBED_DIRECTORY)
+        message(FATAL_ERROR "bda_embed_document_root(): DIRECTORY is required")
+    endif()
+    get_filename_component(EMBED_DIRECTORY "${EMBED_DIRECTORY}" ABSOLUTE)
+    if(NOT EMBED_FILES)
+        set(EMBED_FILES "*")
+    endif()
+
+    set(EMBED_GZIP "")
+    if(EMBED_PRECOMPRESS)
+        find_program(BDA_GZIP_EXECUTABLE gzip)
+        if(BDA_GZIP_EXECUTABLE)
+            set(EMBED_GZIP "${BDA_GZIP_EXECUTABLE}")
+        else()
+            message(WARNING "bda_embed_document_root(): gzip was not found, ${NAME} is embedded uncompressed")
+        endif()
+    endif()
+
+    # The globs are passed as one argument to the script:
+    string(REPLACE ";" "|" EMBED_FILES "${EMBED_FILES}")
+
+    set(EMBED_OUTPUT_DIR "${CMAKE_CURRENT_BINARY_DIR}/embedded")
+    add_custom_target(${NAME}Embedded
+        COMMAND "${CMAKE_COMMAND}"
+            "-DBDA_EMBED_NAME=${NAME}"
+            "-DBDA_EMBED_DIRECTORY=${EMBED_DIRECTORY}"
+            "-DBDA_EMBED_FILES=${EMBED_FILES}"
+            "-DBDA_EMBED_GZIP=${EMBED_GZIP}"
+            "-DBDA_EMBED_OUTPUT_DIR=${EMBED_OUTPUT_DIR}"
+            -P "${BDA_EMBED_DOCUMENT_ROOT_SCRIPT}"
+        BYPRODUCTS "${EMBED_OUTPUT_DIR}/${NAME}.cc" "${EMBED_OUTPUT_DIR}/${NAME}.hh"
+        COMMENT "Embedding ${EMBED_DIRECTORY} as ${NAME}()"
+        VERBATIM)
+    if(EMBED_DEPENDS)
+        add_dependencies(${NAME}Embedded ${EMBED_DEPENDS})
+    endif()
+
+    add_dependencies(${TARGET} ${NAME}Embedded)
+    target_sources(${TARGET} PRIVATE "${EMBED_OUTPUT_DIR}/${NAME}.cc" "${EMBED_OUTPUT_DIR}/${NAME}.hh")
+    target_include_directories(${TARGET} PRIVATE "${EMBED_OUTPUT_DIR}")
+endfunction()
+
+# Writes aContent to aFile unless it has this content already, so that
+# unchanged files are not compiled again:
+function(bda_embed_write_if_changed aFile aContent)
+    if(EXISTS "${aFile}")
+        file(READ "${aFile}" vOldContent)
+        if(vOldContent STREQUAL aContent)
+            return()
+        endif()
+    endif()
+    file(WRITE "${aFile}" "${aContent}")
+endfunction()
+
+# Sets aVariable to the C array initializer of the bytes of aFile:
+function(bda_embed_bytes aVariable aSize aFile)
+    file(READ "${aFile}" vHex HEX)
+    string(LENGTH "${vHex}" vLength)
+    math(EXPR vSize "${vLength} / 2")
+    if(vSize EQUAL 0)
+        set(vBytes "0x00")
+    else()
+        string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," vBytes "${vHex}")
+        # 16 bytes per line:
+        set(vLine "")
+        foreach(vIndex RANGE 15)
+            string(APPEND vLine "0x[0-9a-f][0-9a-f],")
+        endforeach()
+        string(REGEX REPLACE "(${vLine})" "\\1\n    " vBytes "${vBytes}")
+    endif()
+    set(${aVariable} "${vBytes}" PARENT_SCOPE)
+    set(${aSize} ${vSize} PARENT_SCOPE)
+endfunction()
+
+if(CMAKE_SCRIPT_MODE_FILE AND BDA_EMBED_NAME)
+    string(REPLACE "|" ";" vGlobs "${BDA_EMBED_FILES}")
+    set(vPatterns "")
+    foreach(vGlob ${vGlobs})
+        list(APPEND vPatterns "${BDA_EMBED_DIRECTORY}/${vGlob}")
+    endforeach()
+    file(GLOB_RECURSE vFiles LIST_DIRECTORIES false RELATIVE "${BDA_EMBED_DIRECTORY}" ${vPatterns})
+    list(REMOVE_DUPLICATES vFiles)
+    # The table is searched by path, in byte order:
+    list(SORT vFiles)
+
+    file(MAKE_DIRECTORY "${BDA_EMBED_OUTPUT_DIR}")
+    set(vArrays "")
+    set(vTable "")
+    set(vIndex 0)
+    foreach(vFile ${vFiles})
+        set(vPath "${BDA_EMBED_DIRECTORY}/${vFile}")
+        bda_embed_bytes(vBytes vSize "${vPath}")
+        file(SHA256 "${vPath}" vHash)
+        string(SUBSTRING "${vHash}" 0 32 vHash)
+        string(APPEND vArrays "// /${vFile}\nconst unsigned char cFile${vIndex}[] = {\n    ${vBytes}\n};\n\n")
+
+        set(vGzip "nullptr, 0, nullptr")
+        if(BDA_EMBED_GZIP AND vSize GREATER 0)
+            set(vGzipPath "${BDA_EMBED_OUTPUT_DIR}/${BDA_EMBED_NAME}.gz")
+            execute_process(COMMAND "${BDA_EMBED_GZIP}" -9 -n -c "${vPath}"
+                            OUTPUT_FILE "${vGzipPath}" RESULT_VARIABLE vResult)
+            if(NOT vResult EQUAL 0)
+                message(FATAL_ERROR "bda_embed_document_root(): gzip failed for ${vPath}")
+            endif()
+            bda_embed_bytes(vGzipBytes vGzipSize "${vGzipPath}")
+            file(REMOVE "${vGzipPath}")
+            if(vGzipSize LESS vSize)
+                string(APPEND vArrays "const unsigned char cFile${vIndex}Gzip[] = {\n    ${vGzipBytes}\n};\n\n")
+                set(vGzip "cFile${vIndex}Gzip, ${vGzipSize}, \"\\\"${vHash}-gzip\\\"\"")
+            endif()
+        endif()
+
+        string(REPLACE "\\" "\\\\" vName "/${vFile}")
+        string(REPLACE "\"" "\\\"" vName "${vName}")
+        string(APPEND vTable "    { \"${vName}\", cFile${vIndex}, ${vSize}, \"\\\"${vHash}\\\"\", ${vGzip} },\n")
+        math(EXPR vIndex "${vIndex} + 1")
+    endforeach()
+    if(vIndex EQUAL 0)
+        message(WARNING "bda_embed_document_root(): No files found in ${BDA_EMBED_DIRECTORY}")
+        set(vTable "    { \"\", nullptr, 0, nullptr, nullptr, 0, nullptr },\n")
+    endif()
+
+    string(TOUPPER "${BDA_EMBED_NAME}" vGuard)
+    bda_embed_write_if_changed("${BDA_EMBED_OUTPUT_DIR}/${BDA_EMBED_NAME}.hh"
+"// Generated by bda_embed_document_root() from ${BDA_EMBED_DIRECTORY}, do not edit.
+
+#ifndef ${vGuard}_HH
+#define ${vGuard}_HH
+
+#include \"bda/ThriftEmbeddedDocumentRoot.hh\"
+
+/** @brief The files of ${BDA_EMBED_DIRECTORY}, embedded at build time. */
+const bda::ThriftEmbeddedDocumentRoot& ${BDA_EMBED_NAME}();
+
+#endif
+")
+    bda_embed_write_if_changed("${BDA_EMBED_OUTPUT_DIR}/${BDA_EMBED_NAME}.cc"
+"// Generated by bda_embed_document_root() from ${BDA_EMBED_DIRECTORY}, do not edit.
+
+#include \"${BDA_EMBED_NAME}.hh\"
+
+namespace {
+
+${vArrays}const bda::ThriftEmbeddedFile cFiles[] = {
+${vTable}};
+
+}
+
+const bda::ThriftEmbeddedDocumentRoot& ${BDA_EMBED_NAME}() {
+    static const bda::ThriftEmbeddedDocumentRoot vDocumentRoot(cFiles, ${vIndex});
+    return vDocumentRoot;
+}
+")
+endif()
@@ -0,0 +1,209 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTACCESSMANAGER_HH
+#define THRIFTACCESSMANAGER_HH
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bda {
+
+/** @brief What the authentication backend knows about a valid token. */
+struct ThriftCredentials {
+    // The user or service the token belongs to:
+    std::string mPrincipal;
+
+    // The restricted methods (see ThriftAccessManager::setRestricted()) that
+    // the principal may call:
+    std::vector<std::string> mMethods;
+
+    // When the token stops being valid:
+    std::chrono::steady_clock::time_point mExpiry = std::chrono::steady_clock::time_point::max();
+};
+
+/**
+ * @brief An authenticated token, shared by all sessions that presented it.
+ * It holds the permissions of the principal as a bitmap over the
+ * restricted methods, so that every call is checked without a lookup in
+ * the authentication backend.
+ */
+class ThriftAccessGrant {
+public:
+    const std::string& principal() const {
+        return mPrincipal;
+    }
+
+    /** @brief Returns false once the token was revoked or expired. */
+    bool isValid() const {
+        return !mRevoked.load(std::memory_order_relaxed) &&
+               (mExpiry == std::chrono::steady_clock::time_point::max() || std::chrono::steady_clock::now() < mExpiry);
+    }
+
+    /** @brief Returns true if the restricted method with the index is permitted. */
+    bool permits(const std::size_t aMethodIndex) const {
+        return (mPermissions[aMethodIndex / 64] >> (aMethodIndex % 64)) & 1;
+    }
+
+protected:
+    friend class ThriftAccessManager;
+
+    std::string mToken;
+    std::string mPrincipal;
+    std::vector<std::uint64_t> mPermissions;
+    std::chrono::steady_clock::time_point mExpiry;
+    std::atomic<bool> mRevoked{ false };
+};
+
+/**
+ * @brief Authenticates the sessions of the server with tokens, and checks
+ * every call before it is processed. A WebSocket session authenticates
+ * once at the upgrade, with an "Authorization: Bearer <token>" header or
+ * the token cookie, and an HTTP/2 request with every request. Sessions
+ * without a token, e.g. framed thrift and local clients, can call public
+ * methods, and authenticate with loginThriftSession() from the handler of
+ * a login method.
+ *
+ * Public methods can be called by everyone, restricted methods only by
+ * principals whose credentials list them, and all other methods by every
+ * authenticated session. Denied calls are answered with a
+ * TApplicationException. The backend is only asked once per token, until
+ * the token is revoked:
+ * @code
+ * auto vAccessManager = std::make_shared<bda::ThriftAccessManager>(
+ *     [](const std::string& aToken, bda::ThriftCredentials& aCredentials) {
+ *         return lookupToken(aToken, aCredentials.mPrincipal, aCredentials.mMethods);
+ *     });
+ * vAccessManager->setPublic("ping");
+ * vAccessManager->setPublic("login");
+ * vAccessManager->setRestricted("deleteData");
+ * vServer.setAccessManager(vAccessManager);
+ * ...
+ * vAccessManager->revoke(vToken);
+ * @endcode
+ */
+class ThriftAccessManager {
+public:
+    /**
+     * @brief Asks the authentication backend about a token, and fills in
+     * the credentials if it is valid. Runs on the server threads, or on the
+     * thread of the login call, and may be called concurrently.
+     */
+    using Authenticator = std::function<bool(const std::string& aToken, bda::ThriftCredentials& aCredentials)>;
+
+    explicit ThriftAccessManager(Authenticator aAuthenticator);
+    virtual ~ThriftAccessManager() = default;
+
+    /** @brief Allow everyone to call the method. Must be called before the server is started. */
+    void setPublic(const std::string& aMethodName);
+
+    /**
+     * @brief Allow only the principals whose credentials list the method to
+     * call it. Must be called before the server is started.
+     */
+    void setRestricted(const std::string& aMethodName);
+
+    /**
+     * @brief Also accept the token from the cookie with this name, e.g. for
+     * browsers, which cannot set headers on WebSocket upgrades.
+     */
+    void setTokenCookie(const std::string& aCookieName);
+
+    const std::string& tokenCookie() const {
+        return mTokenCookie;
+    }
+
+    /**
+     * @brief Returns the grant of the token, from the cache or from the
+     * authentication backend, or nullptr if the token is not valid.
+     */
+    std::shared_ptr<const bda::ThriftAccessGrant> authenticate(const std::string& aToken);
+
+    /** @brief Returns true if a session with aGrant, or without a grant if nullptr, may call the method. */
+    bool isPermitted(const bda::ThriftAccessGrant* aGrant, const std::string& aMethodName) const;
+
+    /** @brief Deny all further calls of the sessions that authenticated with the token. */
+    void revoke(const std::string& aToken);
+
+    /** @brief Revoke all tokens of the principal. */
+    void revokePrincipal(const std::string& aPrincipal);
+
+    /** @brief Revoke all tokens, e.g. after the permissions changed. */
+    void revokeAll();
+
+    /** @brief Number of tokens that were checked by the authentication backend. */
+    std::uint64_t authentications() const {
+        return mAuthentications;
+    }
+
+    /** @brief Number of calls that were denied. */
+    std::uint64_t deniedCalls() const {
+        return mDeniedCalls;
+    }
+
+protected:
+    struct Method {
+        bool mPublic = false;
+        std::size_t mIndex = 0;
+    };
+
+    // Remove a grant from the cache and deny its calls, the mutex must be
+    // locked:
+    void revokeLocked(std::unordered_map<std::string, std::shared_ptr<bda::ThriftAccessGrant>>::iterator aGrant);
+
+    Authenticator mAuthenticator;
+    std::unordered_map<std::string, Method> mMethods;
+    std::size_t mRestrictedMethods = 0;
+    std::string mTokenCookie;
+
+    // The grants of all valid tokens that were presented so far, and the
+    // number of revocations:
+    mutable std::mutex mMutex;
+    std::unordered_map<std::string, std::shared_ptr<bda::ThriftAccessGrant>> mGrants;
+    std::uint64_t mRevocations = 0;
+
+    std::atomic<std::uint64_t> mAuthentications{ 0 };
+    mutable std::atomic<std::uint64_t> mDeniedCalls{ 0 };
+};
+
+/**
+ * @brief Authenticate the session of the current call with aToken, for the
+ * handler of a public login method. The session keeps the grant for its
+ * following calls. Returns false if the token is not valid, or if there is
+ * no current call, e.g. in the callback of an asynchronous handler.
+ */
+bool loginThriftSession(const std::string& aToken);
+
+/**
+ * @brief Returns the principal of the session of the current call, or an
+ * empty string if the session is not authenticated.
+ */
+std::string currentThriftPrincipal();
+
+}
+
+#endif
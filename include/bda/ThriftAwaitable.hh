@@ -0,0 +1,106 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTAWAITABLE_HH
+#define THRIFTAWAITABLE_HH
+
+#include <thrift/Thrift.h>
+
+// Both headers are empty unless the compiler supports coroutines:
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/co_spawn.hpp>
+
+#include <exception>
+#include <functional>
+#include <utility>
+
+namespace bda {
+
+/**
+ * @brief A delayed exception for the exn_cob of an asynchronous thrift
+ * handler that rethrows any std::exception_ptr. The processor catches the
+ * rethrown exception like one thrown by a synchronous handler, so that the
+ * exceptions declared in the IDL reach the client.
+ */
+class ThriftDelayedException : public apache::thrift::TDelayedException {
+public:
+    explicit ThriftDelayedException(std::exception_ptr aException)
+        : mException(std::move(aException)) {
+    }
+
+    void throw_it() override {
+        std::exception_ptr vException = mException;
+        delete this;
+        std::rethrow_exception(vException);
+    }
+
+private:
+    std::exception_ptr mException;
+};
+
+}
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+
+namespace bda {
+
+/**
+ * @brief Complete an asynchronous thrift call with the result of a C++20
+ * coroutine. The coroutine runs on aExecutor and only occupies a thread
+ * while it is not suspended:
+ * @code
+ * void fetchData(std::function<void(const std::string&)> cob,
+ *                std::function<void(apache::thrift::TDelayedException*)> exn_cob,
+ *                const int64_t aDataSizeIdx) override {
+ *     bda::completeThriftCall(mExecutor, loadData(aDataSizeIdx), cob, exn_cob);
+ * }
+ * @endcode
+ */
+template<class Executor, class T>
+void completeThriftCall(const Executor& aExecutor, boost::asio::awaitable<T> aAwaitable,
+                        std::function<void(const T&)> aCob,
+                        std::function<void(apache::thrift::TDelayedException*)> aExnCob) {
+    boost::asio::co_spawn(aExecutor, std::move(aAwaitable),
+        [aCob, aExnCob](std::exception_ptr aException, T aResult) {
+            if (aException) {
+                return aExnCob(new bda::ThriftDelayedException(aException));
+            }
+            aCob(aResult);
+        });
+}
+
+/** @brief Complete an asynchronous thrift call without result, see above. */
+template<class Executor>
+void completeThriftCall(const Executor& aExecutor, boost::asio::awaitable<void> aAwaitable,
+                        std::function<void()> aCob,
+                        std::function<void(apache::thrift::TDelayedException*)> aExnCob) {
+    boost::asio::co_spawn(aExecutor, std::move(aAwaitable),
+        [aCob, aExnCob](std::exception_ptr aException) {
+            if (aException) {
+                return aExnCob(new bda::ThriftDelayedException(aException));
+            }
+            aCob();
+        });
+}
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTBATCHENVELOPE_HH
+#define THRIFTBATCHENVELOPE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bda {
+
+/**
+ * @brief A batch envelope packs multiple serialized thrift messages into a
+ * single WebSocket message. All integers are unsigned 32 bit big endian:
+ * @code
+ * 'B' 'D' 'A' 'B' | count | size_0 | message_0 | ... | size_n | message_n
+ * @endcode
+ * The four magic bytes can not start a valid thrift message in any of the
+ * supported protocols, so envelopes and plain messages can be mixed on the
+ * same connection. The response to a batch is again a batch envelope with
+ * one entry per request in the same order. Oneway calls produce an empty
+ * entry.
+ */
+static constexpr uint8_t cBatchEnvelopeMagic[4] = { 'B', 'D', 'A', 'B' };
+
+/** @brief Size of the envelope header, i.e. the magic bytes and the count. */
+static constexpr std::size_t cBatchEnvelopeHeaderSize = 8;
+
+/** @brief Returns true if the data starts with the batch envelope magic. */
+bool isBatchEnvelope(const uint8_t* aData, const std::size_t aSize);
+
+/**
+ * @brief Split a batch envelope into its messages. The returned pointers
+ * reference the memory of aData and do not copy the messages. Throws a
+ * std::runtime_error if the envelope is malformed.
+ */
+void parseBatchEnvelope(const uint8_t* aData, const std::size_t aSize,
+                        std::vector<std::pair<const uint8_t*, uint32_t>>& aMessages);
+
+/** @brief Start a new batch envelope in aEnvelope for aCount messages. */
+void beginBatchEnvelope(std::string& aEnvelope, const uint32_t aCount);
+
+/** @brief Append a single message to a batch envelope. */
+void appendBatchEnvelopeMessage(std::string& aEnvelope, const uint8_t* aData, const uint32_t aSize);
+
+/**
+ * @brief Append only the size prefix of a message to a batch envelope. The
+ * caller must append exactly aSize bytes of message data afterwards.
+ */
+void appendBatchEnvelopeSize(std::string& aEnvelope, const uint32_t aSize);
+
+}
+
+#endif
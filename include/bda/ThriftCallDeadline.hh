@@ -0,0 +1,117 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTCALLDEADLINE_HH
+#define THRIFTCALLDEADLINE_HH
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace bda {
+
+/**
+ * @brief A deadline envelope attaches a timeout to a single serialized
+ * thrift message. All integers are unsigned 32 bit big endian:
+ * @code
+ * 'B' 'D' 'A' 'D' | timeout in milliseconds | message
+ * @endcode
+ * The timeout counts from the moment the server received the message. A
+ * call that is still waiting to be processed when its deadline expired is
+ * answered with a TApplicationException instead of being processed. The
+ * response itself is a plain thrift message without envelope. Inside a
+ * batch envelope, every call can carry its own deadline envelope.
+ *
+ * Alternatively, a client can set the same timeout for all calls of a
+ * WebSocket connection with the HTTP header cCallTimeoutHeader in the
+ * upgrade request. A deadline envelope overrides it for a single call.
+ */
+static constexpr uint8_t cDeadlineEnvelopeMagic[4] = { 'B', 'D', 'A', 'D' };
+
+/** @brief Size of the envelope header, i.e. the magic bytes and the timeout. */
+static constexpr std::size_t cDeadlineEnvelopeHeaderSize = 8;
+
+/** @brief The HTTP header with the call timeout of a connection in milliseconds. */
+static constexpr const char* cCallTimeoutHeader = "X-Thrift-Call-Timeout";
+
+/**
+ * @brief Parse the value of the cCallTimeoutHeader, which must be a decimal
+ * number of milliseconds that fits into 32 bits, like the timeout of a
+ * deadline envelope. Returns false, and leaves aTimeout unchanged, if the
+ * value is invalid.
+ */
+bool parseCallTimeout(const std::string& aValue, std::chrono::milliseconds& aTimeout);
+
+/** @brief Returns true if the data starts with the deadline envelope magic. */
+bool isDeadlineEnvelope(const uint8_t* aData, const std::size_t aSize);
+
+/**
+ * @brief Split a deadline envelope into the timeout and the message. The
+ * returned pointer references the memory of aData and does not copy the
+ * message. Throws a std::runtime_error if the envelope is malformed.
+ */
+void parseDeadlineEnvelope(const uint8_t* aData, const std::size_t aSize, std::chrono::milliseconds& aTimeout,
+                           const uint8_t*& aMessage, uint32_t& aMessageSize);
+
+/** @brief Wrap a single message into a deadline envelope in aEnvelope. */
+void makeDeadlineEnvelope(std::string& aEnvelope, const std::chrono::milliseconds aTimeout,
+                          const uint8_t* aData, const uint32_t aSize);
+
+/**
+ * @brief Makes a deadline the deadline of the call that the current thread
+ * processes, for as long as the scope exists. The server sets the scope
+ * around the thrift processor, so that handlers can query their budget
+ * with remainingCallBudget().
+ */
+class ThriftCallDeadlineScope {
+public:
+    explicit ThriftCallDeadlineScope(const std::chrono::steady_clock::time_point aDeadline);
+    ~ThriftCallDeadlineScope();
+
+    ThriftCallDeadlineScope(const ThriftCallDeadlineScope&) = delete;
+    ThriftCallDeadlineScope& operator=(const ThriftCallDeadlineScope&) = delete;
+
+private:
+    std::chrono::steady_clock::time_point mPreviousDeadline;
+};
+
+/**
+ * @brief The deadline of the call that the current thread processes, or
+ * std::chrono::steady_clock::time_point::max() if it has none.
+ */
+std::chrono::steady_clock::time_point currentCallDeadline();
+
+/** @brief Returns true if the call that the current thread processes has a deadline. */
+bool hasCallDeadline();
+
+/**
+ * @brief The time that is left until the deadline of the current call,
+ * which is zero once it expired, and std::chrono::milliseconds::max() if
+ * the call has no deadline. Long running handlers can check it to stop
+ * early, since nobody will read their response after the deadline.
+ */
+std::chrono::milliseconds remainingCallBudget();
+
+/** @brief Returns true if the deadline of the current call has expired. */
+bool isCallExpired();
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTEMBEDDEDDOCUMENTROOT_HH
+#define THRIFTEMBEDDEDDOCUMENTROOT_HH
+
+#include <cstddef>
+
+namespace bda {
+
+/**
+ * @brief A file of a document root that was compiled into the binary, see
+ * bda_embed_document_root() in cmake/BDAEmbedDocumentRoot.cmake.
+ */
+struct ThriftEmbeddedFile {
+    // The HTTP path of the file, e.g. "/index.html":
+    const char* mPath;
+    const unsigned char* mData;
+    std::size_t mSize;
+    const char* mETag;
+
+    // The gzip compressed file, or nullptr if it was not precompressed or
+    // compression would not make it smaller:
+    const unsigned char* mGzipData;
+    std::size_t mGzipSize;
+    const char* mGzipETag;
+};
+
+/**
+ * @brief A read-only table of the files of a document root that were
+ * compiled into the binary at build time, sorted by their paths. The server
+ * serves them from memory instead of reading files from disk.
+ * @code
+ * #include "demoDocumentRoot.hh" // generated by bda_embed_document_root()
+ * vServer.setEmbeddedDocumentRoot(demoDocumentRoot());
+ * @endcode
+ */
+class ThriftEmbeddedDocumentRoot {
+public:
+    ThriftEmbeddedDocumentRoot(const ThriftEmbeddedFile* aFiles, const std::size_t aCount)
+        : mFiles(aFiles), mCount(aCount) {
+    }
+
+    /** @brief The file with the HTTP path aPath, e.g. "/index.html", or nullptr if there is none. */
+    const ThriftEmbeddedFile* find(const char* aPath, const std::size_t aLength) const;
+
+    std::size_t size() const {
+        return mCount;
+    }
+
+    const ThriftEmbeddedFile* begin() const {
+        return mFiles;
+    }
+
+    const ThriftEmbeddedFile* end() const {
+        return mFiles + mCount;
+    }
+
+private:
+    const ThriftEmbeddedFile* mFiles;
+    std::size_t mCount;
+};
+
+}
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTEXECUTIONPOOL_HH
+#define THRIFTEXECUTIONPOOL_HH
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bda {
+
+/**
+ * @brief A pool of threads that runs the thrift processor, with a separate
+ * run queue for every priority class. When the server uses an execution
+ * pool, the io threads only read and write messages, and the handlers run
+ * on the pool threads.
+ *
+ * Idle threads pick the next call by smooth weighted round robin over the
+ * non-empty queues, so a class with weight 8 is served eight times as
+ * often as a class with weight 1 while both have work. A class can also be
+ * limited to fewer threads than the pool has, which keeps threads free for
+ * the other classes while it is saturated:
+ * @code
+ * auto vPool = std::make_shared<bda::ThriftExecutionPool>(8);
+ * const std::size_t vHigh = vPool->addPriorityClass("high", 8);
+ * const std::size_t vLow = vPool->addPriorityClass("low", 1, 6);
+ * vPool->setMethodPriority("ping", vHigh);
+ * vPool->setMethodPriority("fetchData", vLow);
+ * vServer.setExecutionPool(vPool);
+ * @endcode
+ * Methods without a configured priority use the class 0, "default".
+ */
+class ThriftExecutionPool {
+public:
+    using Task = std::function<void()>;
+
+    /** @brief Start a pool with the given number of threads. */
+    explicit ThriftExecutionPool(const std::size_t aThreads);
+
+    /** @brief Stops the pool. Queued tasks that did not start are dropped. */
+    virtual ~ThriftExecutionPool();
+
+    /**
+     * @brief Add a priority class and return its index.
+     * @param aWeight The relative share of the pool threads, must be > 0.
+     * @param aMaxThreads The maximum number of threads that run tasks of
+     * this class at the same time, or 0 for no limit.
+     */
+    std::size_t addPriorityClass(const std::string& aName, const unsigned aWeight, const std::size_t aMaxThreads = 0);
+
+    /** @brief Assign a method to a priority class, also while the server is running. */
+    void setMethodPriority(const std::string& aMethodName, const std::size_t aPriorityClass);
+
+    /** @brief Returns the priority class of the method. */
+    std::size_t priorityOf(const std::string& aMethodName) const;
+
+    /** @brief Queue a task in the run queue of the priority class. */
+    void submit(const std::size_t aPriorityClass, Task aTask);
+
+    /** @brief Stop all threads after their current task, and drop the queued tasks. */
+    void stop();
+
+    /** @brief The number of tasks that wait in the run queue of the priority class. */
+    std::size_t queuedTasks(const std::size_t aPriorityClass) const;
+
+protected:
+    struct PriorityClass {
+        std::string mName;
+        int mWeight = 1;
+        std::size_t mMaxThreads = 0;
+
+        std::deque<Task> mQueue;
+        std::size_t mRunning = 0;
+        int mCurrentWeight = 0;
+    };
+
+    void run();
+
+    // Select the class of the next task, or return false if no class has a
+    // runnable task. The mutex must be locked.
+    bool selectPriorityClass(std::size_t& aPriorityClass);
+
+    std::map<std::string, std::size_t> mMethodPriorities;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::vector<PriorityClass> mPriorityClasses;
+    bool mStopped = false;
+
+    std::vector<std::thread> mThreads;
+};
+
+}
+
+#endif
@@ -30,7 +30,10 @@
 
 #include "bda/ThriftHelper.hh"
 
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <thread>
@@ -40,6 +43,9 @@
 namespace apache {
 namespace thrift {
 class TProcessor;
+namespace async {
+class TAsyncProcessor;
+}
 namespace protocol {
 class TProtocolFactory;
 }
@@ -55,6 +61,18 @@ class context;
 }
 namespace bda {
 class HTTPConnectListener;
+class HTTPLocalListener;
+class SocketHandoffListener;
+class ThriftAccessManager;
+class ThriftEmbeddedDocumentRoot;
+class ThriftExecutionPool;
+class ThriftProfiler;
+class ThriftRequestCoalescer;
+class ThriftResponseCache;
+struct ThriftSessionContext;
+class ThriftSlowCallLog;
+class ThriftTracer;
+class ThriftTrafficCapture;
 }
 
 namespace bda {
@@ -65,8 +83,217 @@ public:
                      const std::string& aHTTPDocumentRoot, const int aThreads,
                      std::shared_ptr<apache::thrift::TProcessor> aThriftProcessor,
                      const bda::ProtocolType aProtocolType);
+
+    /**
+     * @brief Construct a server for an asynchronous processor, e.g. one that
+     * the thrift compiler generated with the cob_style option. Its handlers
+     * complete calls through callbacks, so that calls that wait for I/O do
+     * not block a server thread. See bda/ThriftAwaitable.hh for handlers
+     * that are C++20 coroutines.
+     */
+    ThriftHTTPWSServer(const std::string& aServerURL, const unsigned short aPort,
+                     const std::string& aHTTPDocumentRoot, const int aThreads,
+                     std::shared_ptr<apache::thrift::async::TAsyncProcessor> aAsyncProcessor,
+                     const bda::ProtocolType aProtocolType);
     virtual ~ThriftHTTPWSServer() = default;
 
+    /**
+     * @brief Accept batch envelopes on WebSocket connections. A client may
+     * then pack multiple serialized thrift calls into a single WebSocket
+     * message (see bda/ThriftBatchEnvelope.hh) and receives all responses
+     * in a single message. Must be called before asyncRun().
+     * @param aParallel Process the calls of a batch concurrently on the
+     * server threads instead of one after the other.
+     */
+    void setBatchMode(const bool aEnabled, const bool aParallel = false);
+
+    /**
+     * @brief Also serve thrift clients that use TFramedTransport directly
+     * over TCP, e.g. native C++ or Java services, on the same port as HTTP
+     * and WebSocket. The server tells them apart by their first bytes, the
+     * size of a frame followed by the start of a message in the protocol of
+     * the server. Their calls skip the HTTP upgrade and the WebSocket
+     * framing, and are served by the default processor. Frames are not
+     * accepted inside SSL connections. Must be called before asyncRun().
+     */
+    void setFramedThriftMode(const bool aEnabled);
+
+    /**
+     * @brief Authenticate the sessions with the tokens of the access manager,
+     * and check every call against the grant of its session before it is
+     * processed or answered from the response cache. Upgrade requests with
+     * an invalid token are rejected. Must be called before asyncRun().
+     */
+    void setAccessManager(std::shared_ptr<bda::ThriftAccessManager> aAccessManager);
+
+    /**
+     * @brief Answer calls to cacheable methods from the given response cache.
+     * Responses of methods that the cache marks as cacheable are stored, and
+     * identical calls are answered without running the processor. Must be
+     * called before asyncRun().
+     */
+    void setResponseCache(std::shared_ptr<bda::ThriftResponseCache> aResponseCache);
+
+    /**
+     * @brief Coalesce identical concurrent calls to the methods that the
+     * coalescer marks as coalescible. Only the first call runs the processor,
+     * all others receive its response. Must be called before asyncRun().
+     */
+    void setRequestCoalescer(std::shared_ptr<bda::ThriftRequestCoalescer> aRequestCoalescer);
+
+    /**
+     * @brief Run the thrift processor on the threads of the given pool
+     * instead of the server threads. The pool schedules the calls by the
+     * priority classes of their methods. Must be called before asyncRun().
+     */
+    void setExecutionPool(std::shared_ptr<bda::ThriftExecutionPool> aExecutionPool);
+
+    /**
+     * @brief Serve another thrift processor on the WebSocket upgrade path
+     * aPath, e.g. "/api/storage". The processor given to the constructor
+     * serves all paths without a service of their own. A service with its
+     * own execution pool is isolated from the load of the other services,
+     * and upgrades beyond aMaxConnections (0 for no limit) are rejected with
+     * 503 Service Unavailable. Must be called before asyncRun().
+     */
+    void addService(const std::string& aPath, std::shared_ptr<apache::thrift::TProcessor> aThriftProcessor,
+                    std::shared_ptr<bda::ThriftExecutionPool> aExecutionPool = nullptr, const std::size_t aMaxConnections = 0);
+
+    /** @brief Serve an asynchronous processor on the WebSocket upgrade path aPath, see above. */
+    void addService(const std::string& aPath, std::shared_ptr<apache::thrift::async::TAsyncProcessor> aAsyncProcessor,
+                    std::shared_ptr<bda::ThriftExecutionPool> aExecutionPool = nullptr, const std::size_t aMaxConnections = 0);
+
+    /**
+     * @brief Accept call deadlines, either per WebSocket connection or per
+     * call (see bda/ThriftCallDeadline.hh). Calls whose deadline expired
+     * before processing are answered with an exception. Must be called
+     * before asyncRun().
+     */
+    void setDeadlineMode(const bool aEnabled);
+
+    /** @brief The number of calls that were dropped because their deadline expired. */
+    uint64_t expiredCalls() const;
+
+    /**
+     * @brief Record the stages of every WebSocket message and HTTP request
+     * with the given tracer, see bda/ThriftTracer.hh. Must be called before
+     * asyncRun().
+     */
+    void setTracer(std::shared_ptr<bda::ThriftTracer> aTracer);
+
+    /**
+     * @brief Record every message that WebSocket clients send, with its
+     * time and connection, into aTrafficCapture, see
+     * bda/ThriftTrafficCapture.hh. The capture is flushed when the server
+     * stops. Must be called before asyncRun().
+     */
+    void setTrafficCapture(std::shared_ptr<bda::ThriftTrafficCapture> aTrafficCapture);
+
+    /**
+     * @brief Record the WebSocket calls whose time from read to write
+     * completion exceeds the threshold of the slow-call log, see
+     * bda/ThriftSlowCallLog.hh. If aHTTPPath is not empty, the stored calls
+     * are served as JSON on this path, e.g. "/slowcalls". With an access
+     * manager, the requests need an access token that permits aHTTPPath like
+     * a method. Must be called before asyncRun().
+     */
+    void setSlowCallLog(std::shared_ptr<bda::ThriftSlowCallLog> aSlowCallLog, const std::string& aHTTPPath = std::string());
+
+    /**
+     * @brief Profile the server on request: a GET of aHTTPPath, e.g.
+     * "/debug/profile?type=cpu&seconds=10", is answered with the profile when
+     * it is complete, see bda/ThriftProfiler.hh. The query selects the type
+     * (cpu or heap), the duration in seconds (10 by default) and the format
+     * (folded or pprof). With an access manager, the requests need an access
+     * token that permits aHTTPPath like a method. Must be called before
+     * asyncRun().
+     */
+    void setProfiler(std::shared_ptr<bda::ThriftProfiler> aProfiler, const std::string& aHTTPPath);
+
+    /**
+     * @brief Serve the files that were compiled into the binary with
+     * bda_embed_document_root() (see cmake/BDAEmbedDocumentRoot.cmake) from
+     * memory, instead of reading them from the HTTP document root. Paths
+     * that are not embedded are served from the document root on disk if
+     * aFallbackToDisk, and are not found otherwise. aDocumentRoot must
+     * outlive the server. Must be called before asyncRun().
+     */
+    void setEmbeddedDocumentRoot(const bda::ThriftEmbeddedDocumentRoot& aDocumentRoot, const bool aFallbackToDisk = true);
+
+    /**
+     * @brief Limit the memory that all sessions hold in their message
+     * buffers and responses to about aBytes. While they hold more, sessions
+     * stop reading further messages from their connections until memory is
+     * released, and idle sessions shrink buffers that grew for large
+     * messages. Shared memory clients are not counted, their rings have a
+     * fixed size. Must be called before asyncRun().
+     */
+    void setMemoryBudget(const std::size_t aBytes);
+
+    /** @brief The bytes that the sessions hold in message buffers and responses, if there is a memory budget. */
+    std::size_t bufferedBytes() const;
+
+    /** @brief The number of reads that waited for memory of the budget so far. */
+    uint64_t throttledReads() const;
+
+    /** @brief The number of sessions that wait for memory of the budget now. */
+    std::size_t throttledSessions() const;
+
+    /**
+     * @brief Also listen on the Unix domain socket aSocketPath, e.g. for a
+     * local reverse proxy. The socket serves the same HTTP, WebSocket and
+     * thrift paths as the TCP port, without SSL. The socket file gets the
+     * permissions aPermissions, so that only its owner and group may connect
+     * by default. A socket file left at aSocketPath by a previous run is
+     * replaced. Must be called before asyncRun().
+     */
+    void addLocalEndpoint(const std::string& aSocketPath, const uint32_t aPermissions = 0660);
+
+    /**
+     * @brief Accept clients of bda::ThriftSharedMemoryTransport on the Unix
+     * domain socket aSocketPath, e.g. local workers that fetch large
+     * responses. Their messages bypass the socket and are exchanged through
+     * rings in shared memory, and they are served by the default processor.
+     * Linux only. Must be called before asyncRun().
+     */
+    void addSharedMemoryEndpoint(const std::string& aSocketPath, const uint32_t aPermissions = 0660);
+
+    /**
+     * @brief Accept a successor process on the Unix domain socket
+     * aSocketPath, e.g. a new version of the binary that calls
+     * bda::receiveListeningSockets() before it constructs its server. The
+     * listening sockets are handed to the successor, which keeps accepting
+     * on them, and this server stops accepting and calls aHandedOff, e.g. to
+     * make the main thread drain() and stop(). Connections that wait in the
+     * backlog are not lost. Linux only. Must be called before asyncRun().
+     */
+    void enableSocketHandoff(const std::string& aSocketPath, std::function<void()> aHandedOff);
+
+    /**
+     * @brief Stop accepting connections, and block until the open thrift
+     * connections ended and the HTTP requests in flight were answered, or
+     * aTimeout passed. Returns false on timeout. Idle HTTP keep-alive
+     * connections are not waited for, stop() closes them. Call stop()
+     * afterwards.
+     */
+    bool drain(const std::chrono::milliseconds aTimeout);
+
+    /** @brief The number of open WebSocket, framed and shared memory thrift connections. */
+    std::size_t connections() const;
+
+    /**
+     * @brief The number of HTTP/1.1 and HTTP/2 requests in flight, including
+     * thrift calls that wait in an execution pool, until their response was
+     * written.
+     */
+    std::size_t requests() const;
+
+    /**
+     * @brief The TCP port the server listens on, e.g. the one that the
+     * operating system chose if the server was constructed with port 0.
+     */
+    unsigned short port() const;
+
     /**
      * @brief Start the server in the background. This is a non-blocking
      * method that will perform the actual start asynchronously in the
@@ -95,12 +322,18 @@ private:
      */
     void backgroundRun();
 
+    /** @brief Close the listeners, but not the sockets that were handed off. */
+    void stopAccepting(const bool aHandedOff);
+
 
     const int mThreads = 0;
     std::shared_ptr<std::thread> mMainServerThread;
     std::vector<std::thread> mWebServerThreads;
 
+    std::shared_ptr<bda::ThriftSessionContext> mSessionContext = nullptr;
     std::shared_ptr<bda::HTTPConnectListener> mConnectionListener = nullptr;
+    std::vector<std::shared_ptr<bda::HTTPLocalListener>> mLocalListeners;
+    std::shared_ptr<bda::SocketHandoffListener> mSocketHandoffListener;
     std::shared_ptr<boost::asio::io_context> mIOContext = nullptr;
 };
 
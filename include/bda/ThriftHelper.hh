@@ -40,7 +40,8 @@ namespace bda {
 
 enum class ProtocolType {
     BINARY,
-    JSON
+    JSON,
+    COMPACT
 };
 
 /**
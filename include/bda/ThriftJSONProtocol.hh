@@ -0,0 +1,145 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTJSONPROTOCOL_HH
+#define THRIFTJSONPROTOCOL_HH
+
+#include <thrift/protocol/TVirtualProtocol.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bda {
+
+/**
+ * @brief A thrift JSON protocol that reads and writes the same messages as
+ * apache::thrift::protocol::TJSONProtocol, e.g. for browser clients. Unlike
+ * TJSONProtocol, it writes every JSON value with a single transport call,
+ * escapes and scans strings 16 bytes at a time with SSE2, and encodes and
+ * decodes the base64 of binary fields with SSSE3 if the compiler targets
+ * it. Strings are read directly from the buffer of transports that allow
+ * borrowing, e.g. TMemoryBuffer.
+ */
+class ThriftJSONProtocol : public apache::thrift::protocol::TVirtualProtocol<ThriftJSONProtocol> {
+public:
+    explicit ThriftJSONProtocol(std::shared_ptr<apache::thrift::transport::TTransport> aTransport);
+    virtual ~ThriftJSONProtocol() = default;
+
+    uint32_t writeMessageBegin(const std::string& name, const apache::thrift::protocol::TMessageType messageType, const int32_t seqid);
+    uint32_t writeMessageEnd();
+    uint32_t writeStructBegin(const char* name);
+    uint32_t writeStructEnd();
+    uint32_t writeFieldBegin(const char* name, const apache::thrift::protocol::TType fieldType, const int16_t fieldId);
+    uint32_t writeFieldEnd();
+    uint32_t writeFieldStop();
+    uint32_t writeMapBegin(const apache::thrift::protocol::TType keyType, const apache::thrift::protocol::TType valType, const uint32_t size);
+    uint32_t writeMapEnd();
+    uint32_t writeListBegin(const apache::thrift::protocol::TType elemType, const uint32_t size);
+    uint32_t writeListEnd();
+    uint32_t writeSetBegin(const apache::thrift::protocol::TType elemType, const uint32_t size);
+    uint32_t writeSetEnd();
+    uint32_t writeBool(const bool value);
+    uint32_t writeByte(const int8_t byte);
+    uint32_t writeI16(const int16_t i16);
+    uint32_t writeI32(const int32_t i32);
+    uint32_t writeI64(const int64_t i64);
+    uint32_t writeDouble(const double dub);
+    uint32_t writeString(const std::string& str);
+    uint32_t writeBinary(const std::string& str);
+
+    uint32_t readMessageBegin(std::string& name, apache::thrift::protocol::TMessageType& messageType, int32_t& seqid);
+    uint32_t readMessageEnd();
+    uint32_t readStructBegin(std::string& name);
+    uint32_t readStructEnd();
+    uint32_t readFieldBegin(std::string& name, apache::thrift::protocol::TType& fieldType, int16_t& fieldId);
+    uint32_t readFieldEnd();
+    uint32_t readMapBegin(apache::thrift::protocol::TType& keyType, apache::thrift::protocol::TType& valType, uint32_t& size);
+    uint32_t readMapEnd();
+    uint32_t readListBegin(apache::thrift::protocol::TType& elemType, uint32_t& size);
+    uint32_t readListEnd();
+    uint32_t readSetBegin(apache::thrift::protocol::TType& elemType, uint32_t& size);
+    uint32_t readSetEnd();
+    uint32_t readBool(bool& value);
+    uint32_t readBool(std::vector<bool>::reference value);
+    uint32_t readByte(int8_t& byte);
+    uint32_t readI16(int16_t& i16);
+    uint32_t readI32(int32_t& i32);
+    uint32_t readI64(int64_t& i64);
+    uint32_t readDouble(double& dub);
+    uint32_t readString(std::string& str);
+    uint32_t readBinary(std::string& str);
+
+    /** @brief The minimum number of bytes of a value of the given type, as in TJSONProtocol. */
+    int getMinSerializedSize(apache::thrift::protocol::TType type);
+
+protected:
+    // The separators of the nested JSON arrays and objects, see TJSONProtocol:
+    struct Context {
+        bool mPair = false;
+        bool mFirst = true;
+        bool mColon = true;
+    };
+
+    void pushContext(const bool aPair);
+    void popContext();
+
+    // The writers append to mWriteBuffer, which every public method writes
+    // to the transport at once. The separator of the current context returns
+    // whether a number must be quoted because it is an object key:
+    bool appendSeparator();
+    void appendInteger(const int64_t aValue);
+    void appendString(const char* aData, const std::size_t aSize);
+    void appendStart(const char aChar, const bool aPair);
+    void appendEnd(const char aChar);
+    uint32_t flushWriteBuffer();
+
+    // The reader peeks at one byte ahead, like TJSONProtocol's LookaheadReader:
+    uint8_t peekByte();
+    uint8_t readByteFromTransport();
+
+    bool readSeparator(uint32_t& aResult);
+    uint32_t readStart(const uint8_t aChar, const bool aPair);
+    uint32_t readEnd(const uint8_t aChar);
+    uint32_t readJSONSyntaxChar(const uint8_t aChar);
+    uint32_t readJSONString(std::string& aString, const bool aSkipContext = false);
+    uint32_t readJSONNumericChars(std::string& aString);
+    uint32_t readJSONInteger(int64_t& aValue);
+    uint32_t readJSONDouble(double& aValue);
+    uint32_t readContainerSize(uint32_t& aSize);
+
+    apache::thrift::transport::TTransport* mTransport = nullptr;
+    std::vector<Context> mContexts;
+    std::string mWriteBuffer;
+    std::string mReadBuffer;
+    bool mHasLookahead = false;
+    uint8_t mLookahead = 0;
+};
+
+/** @brief Creates bda::ThriftJSONProtocol instances. */
+class ThriftJSONProtocolFactory : public apache::thrift::protocol::TProtocolFactory {
+public:
+    std::shared_ptr<apache::thrift::protocol::TProtocol> getProtocol(std::shared_ptr<apache::thrift::transport::TTransport> aTransport) override;
+};
+
+}
+
+#endif
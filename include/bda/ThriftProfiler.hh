@@ -0,0 +1,129 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTPROFILER_HH
+#define THRIFTPROFILER_HH
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace bda {
+
+/**
+ * @brief Profiles the running process for a limited time, e.g. a live node
+ * that shows latency problems. CPU profiles sample the stacks of the threads
+ * that use CPU time with SIGPROF, heap profiles sample the stacks of the
+ * allocations that an application reports with sampleAllocation(), e.g. from
+ * its replacement of the global operator new. Profiles are written as folded
+ * stacks, one "outer;...;inner count" line per stack, which flamegraph.pl and
+ * speedscope display. Built with gperftools (BDA_ENABLE_GPERFTOOLS), CPU
+ * profiles are also available in the pprof format. Only one profile runs in
+ * the process at a time, and nothing is sampled while none runs. Linux only.
+ * @code
+ * vServer.setProfiler(std::make_shared<bda::ThriftProfiler>(), "/debug/profile");
+ * @endcode
+ * and fetch a 10 second CPU profile with
+ * @code
+ * curl -o cpu.folded "http://localhost:9090/debug/profile?type=cpu&seconds=10"
+ * @endcode
+ */
+class ThriftProfiler {
+public:
+    enum class Type {
+        CPU,
+        Heap
+    };
+
+    enum class Format {
+        Folded,
+        PProf
+    };
+
+    /**
+     * @param aMaxDuration The longest profile a caller may request.
+     * @param aSamplesPerSecond The frequency of CPU samples, per second of CPU time.
+     * @param aHeapSampleBytes The distance of heap samples, in allocated bytes of a thread.
+     */
+    explicit ThriftProfiler(const std::chrono::seconds aMaxDuration = std::chrono::seconds(60),
+                            const unsigned aSamplesPerSecond = 99, const std::size_t aHeapSampleBytes = 512 * 1024);
+    virtual ~ThriftProfiler();
+
+    ThriftProfiler(const ThriftProfiler&) = delete;
+    ThriftProfiler& operator=(const ThriftProfiler&) = delete;
+
+    /** @brief Whether profiles of this type can be written in this format by this build. */
+    static bool supports(const Type aType, const Format aFormat);
+
+    /**
+     * @brief Start a profile of aDuration, at most the maximum duration, and
+     * call aDone with the profile from a thread of the profiler when it is
+     * complete. Returns false if a profile is already running in the
+     * process, or the profiler was stopped. Throws std::invalid_argument if
+     * the type is not supported in this format.
+     */
+    bool start(const Type aType, const Format aFormat, std::chrono::milliseconds aDuration,
+               std::function<void(const bool aSuccess, std::string aProfile)> aDone);
+
+    /** @brief Complete a running profile early, and start no further profiles. */
+    void stop();
+
+    /**
+     * @brief Report an allocation of aSize bytes to a running heap profile.
+     * This costs a relaxed atomic load while no heap profile runs.
+     */
+    static void sampleAllocation(const std::size_t aSize) noexcept {
+        if (sHeapSampling.load(std::memory_order_relaxed)) {
+            recordAllocation(aSize);
+        }
+    }
+
+protected:
+    static void recordAllocation(const std::size_t aSize) noexcept;
+
+    std::string profileCPU(const Format aFormat, const std::chrono::milliseconds aDuration);
+    std::string profileHeap(const std::chrono::milliseconds aDuration);
+
+    // Wait for aDuration, or until the profiler is destroyed:
+    void sleepFor(const std::chrono::milliseconds aDuration);
+
+    static std::atomic<bool> sHeapSampling;
+
+    const std::chrono::seconds mMaxDuration;
+    const unsigned mSamplesPerSecond;
+    const std::size_t mHeapSampleBytes;
+
+    std::mutex mMutex;
+    std::condition_variable mStopCondition;
+    bool mStopping = false;
+
+    // The thread of the running or last profile:
+    std::mutex mThreadMutex;
+    std::thread mThread;
+};
+
+}
+
+#endif
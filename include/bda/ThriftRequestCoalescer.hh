@@ -0,0 +1,100 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTREQUESTCOALESCER_HH
+#define THRIFTREQUESTCOALESCER_HH
+
+#include "bda/ThriftResponseCache.hh"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bda {
+
+/**
+ * @brief Single-flight deduplication of identical concurrent calls. While a
+ * call to a coalescible method is processed, identical calls (same method
+ * name and serialized arguments) do not run the processor again. They wait
+ * without blocking a thread, and receive the response of the first call
+ * with their own sequence id.
+ * @code
+ * auto vCoalescer = std::make_shared<bda::ThriftRequestCoalescer>();
+ * vCoalescer->setCoalescible("fetchData");
+ * vServer.setRequestCoalescer(vCoalescer);
+ * @endcode
+ */
+class ThriftRequestCoalescer {
+public:
+    /**
+     * @brief Receives the shared response of the first call, or nullptr if
+     * that call could not be processed.
+     */
+    using Waiter = std::function<void(std::shared_ptr<const bda::ThriftSerializedResponse>)>;
+
+    ThriftRequestCoalescer() = default;
+    virtual ~ThriftRequestCoalescer() = default;
+
+    /** @brief Mark a method as coalescible, also while the server is running. */
+    void setCoalescible(const std::string& aMethodName);
+
+    /** @brief Returns true if identical concurrent calls of the method may be coalesced. */
+    bool isCoalescible(const std::string& aMethodName) const;
+
+    /**
+     * @brief Register a call. Returns true if no identical call is in flight,
+     * the caller must then process the call and pass the result to complete().
+     * Otherwise the waiter is stored and called upon completion of the first
+     * call, and false is returned.
+     */
+    bool join(const std::string& aMethodName, const std::string& aArguments, Waiter aWaiter);
+
+    /** @brief Hand the response of a call that join() returned true for to all waiters. */
+    void complete(const std::string& aMethodName, const std::string& aArguments,
+                  std::shared_ptr<const bda::ThriftSerializedResponse> aResponse);
+
+    /** @brief Number of calls that were processed, i.e. that did not wait. */
+    std::uint64_t processedCalls() const {
+        return mProcessedCalls;
+    }
+
+    /** @brief Number of calls that were answered with the response of another call. */
+    std::uint64_t coalescedCalls() const {
+        return mCoalescedCalls;
+    }
+
+protected:
+    std::set<std::string> mCoalescibleMethods;
+
+    mutable std::mutex mMutex;
+    std::unordered_map<std::string, std::vector<Waiter>> mInFlight;
+
+    std::atomic<std::uint64_t> mProcessedCalls{ 0 };
+    std::atomic<std::uint64_t> mCoalescedCalls{ 0 };
+};
+
+}
+
+#endif
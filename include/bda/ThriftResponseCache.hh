@@ -0,0 +1,147 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTRESPONSECACHE_HH
+#define THRIFTRESPONSECACHE_HH
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace bda {
+
+/**
+ * @brief A complete serialized thrift response that can be sent to more
+ * than one caller. Every caller receives the data with its own sequence id
+ * patched in at the given location.
+ */
+struct ThriftSerializedResponse {
+    std::string mData;
+    std::size_t mSeqIdOffset = 0;
+    std::size_t mSeqIdSize = 0;
+};
+
+/**
+ * @brief Cache for the responses of idempotent thrift methods. The server
+ * looks up every call to a cacheable method before running the processor,
+ * using the method name and the serialized arguments (without the sequence
+ * id) as key. The cache is bounded by a byte budget and evicts the least
+ * recently used responses first.
+ *
+ * Handlers that modify data must invalidate the affected methods. Calls
+ * that were already processing when their method was invalidated do not
+ * store their response, which may be stale:
+ * @code
+ * auto vCache = std::make_shared<bda::ThriftResponseCache>(64 * 1024 * 1024);
+ * vCache->setCacheable("fetchData", std::chrono::seconds(30));
+ * vServer.setResponseCache(vCache);
+ * ...
+ * vCache->invalidate("fetchData");
+ * @endcode
+ * Derived classes can replace the storage by overriding lookup(), store(),
+ * invalidate() and clear().
+ */
+class ThriftResponseCache {
+public:
+    explicit ThriftResponseCache(const std::size_t aMaxBytes);
+    virtual ~ThriftResponseCache() = default;
+
+    /**
+     * @brief Mark a method as cacheable. Its responses are kept for at most
+     * aTimeToLive. Can also be called while the server is running.
+     */
+    void setCacheable(const std::string& aMethodName, const std::chrono::milliseconds aTimeToLive);
+
+    /** @brief Returns true if responses of the method may be cached. */
+    bool isCacheable(const std::string& aMethodName) const;
+
+    /** @brief Returns the cached response, or nullptr if there is no valid entry. */
+    virtual std::shared_ptr<const bda::ThriftSerializedResponse> lookup(const std::string& aMethodName, const std::string& aArguments);
+
+    /**
+     * @brief The invalidation generation of the method, which changes with
+     * every invalidate() of the method and every clear(). The server takes
+     * it before the lookup of a call.
+     */
+    std::uint64_t generation(const std::string& aMethodName) const;
+
+    /**
+     * @brief Store the response of a cacheable method, unless the generation
+     * of the method changed since aGeneration was taken.
+     */
+    virtual void store(const std::string& aMethodName, const std::string& aArguments,
+                       std::shared_ptr<const bda::ThriftSerializedResponse> aResponse, const std::uint64_t aGeneration);
+
+    /** @brief Drop all cached responses of the method. */
+    virtual void invalidate(const std::string& aMethodName);
+
+    /** @brief Drop all cached responses. */
+    virtual void clear();
+
+    /** @brief The number of bytes currently held by the cache. */
+    std::size_t sizeBytes() const;
+
+    std::uint64_t hits() const {
+        return mHits;
+    }
+
+    std::uint64_t misses() const {
+        return mMisses;
+    }
+
+protected:
+    struct Entry {
+        std::string mKey;
+        std::size_t mMethodNameSize = 0;
+        std::shared_ptr<const bda::ThriftSerializedResponse> mResponse;
+        std::chrono::steady_clock::time_point mExpiry;
+    };
+
+    // Remove an entry, the mutex must be locked:
+    void erase(std::list<Entry>::iterator aEntry);
+
+    // The generation of the method, the mutex must be locked:
+    std::uint64_t lockedGeneration(const std::string& aMethodName) const;
+
+    const std::size_t mMaxBytes;
+    std::map<std::string, std::chrono::milliseconds> mTimeToLive;
+
+    mutable std::mutex mMutex;
+    std::size_t mBytes = 0;
+    // Entries in least recently used order, the most recent one at the front:
+    std::list<Entry> mEntries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> mIndex;
+    // The invalidations of every method, and of the whole cache:
+    std::map<std::string, std::uint64_t> mInvalidations;
+    std::uint64_t mClears = 0;
+
+    std::atomic<std::uint64_t> mHits{ 0 };
+    std::atomic<std::uint64_t> mMisses{ 0 };
+};
+
+}
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTSHAREDBINARY_HH
+#define THRIFTSHAREDBINARY_HH
+
+#include <memory>
+#include <string>
+
+namespace bda {
+
+/**
+ * @brief Respond with the immutable aBlob as the binary value aValue,
+ * without copying it. The server then serializes everything around the
+ * value as usual, and sends the blob from its own memory, e.g. a large
+ * array that the handler keeps cached:
+ * @code
+ * void fetchData(std::string& _return, const int64_t aDataSizeIdx) override {
+ *     bda::shareBinary(_return, mData[aDataSizeIdx]);
+ * }
+ * @endcode
+ * aValue must be the return value of a synchronous handler, or a binary
+ * field of it, which the processor serializes from the same object after
+ * the handler returned. aValue stays empty then, and the blob is kept
+ * until the response was sent. Otherwise, i.e. outside of a call, in
+ * asynchronous handlers and with the JSON protocol, which encodes binary
+ * values, the blob is copied into aValue and false is returned.
+ */
+bool shareBinary(std::string& aValue, std::shared_ptr<const std::string> aBlob);
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTSHAREDMEMORYTRANSPORT_HH
+#define THRIFTSHAREDMEMORYTRANSPORT_HH
+
+#include <thrift/transport/TVirtualTransport.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bda {
+
+/**
+ * @brief A client transport for a local ThriftHTTPWSServer that exchanges
+ * the messages through two rings in shared memory instead of a socket, see
+ * ThriftHTTPWSServer::addSharedMemoryEndpoint(). The transport creates the
+ * shared memory and hands it to the server over the Unix domain socket
+ * aSocketPath, which stays open until the transport is closed. A message may
+ * be larger than a ring, it is then streamed through the ring. Linux only.
+ * @code
+ * auto vTransport = std::make_shared<bda::ThriftSharedMemoryTransport>("/run/myservice/thrift.shm");
+ * TestThriftAPI::TestThriftAPIClient vClient(std::make_shared<apache::thrift::protocol::TBinaryProtocol>(vTransport));
+ * vTransport->open();
+ * @endcode
+ */
+class ThriftSharedMemoryTransport : public apache::thrift::transport::TVirtualTransport<ThriftSharedMemoryTransport> {
+public:
+    /** @param aRingCapacity The size of each ring in bytes, a power of two. */
+    explicit ThriftSharedMemoryTransport(const std::string& aSocketPath, const uint64_t aRingCapacity = 16 * 1024 * 1024);
+    virtual ~ThriftSharedMemoryTransport();
+
+    bool isOpen() const override;
+    void open() override;
+    void close() override;
+
+    uint32_t read(uint8_t* buf, uint32_t len);
+    void write(const uint8_t* buf, uint32_t len);
+
+    /** @brief Send the message written since the last flush to the server. */
+    void flush() override;
+
+protected:
+    // Move between the ring and the buffer, and sleep on the eventfd of this
+    // side while the ring is full or empty:
+    void writeToRing(const uint8_t* aData, std::size_t aSize);
+    void readFromRing(uint8_t* aData, std::size_t aSize);
+    void waitForServer();
+
+    struct Connection;
+
+    const std::string mSocketPath;
+    const uint64_t mRingCapacity;
+    std::unique_ptr<Connection> mConnection;
+
+    std::vector<uint8_t> mWriteBuffer;
+    std::vector<uint8_t> mReadBuffer;
+    std::size_t mReadOffset = 0;
+};
+
+}
+
+#endif
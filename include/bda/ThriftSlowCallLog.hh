@@ -0,0 +1,105 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTSLOWCALLLOG_HH
+#define THRIFTSLOWCALLLOG_HH
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace bda {
+
+/**
+ * @brief Keeps the latest calls whose time from reading the request to
+ * completing the write of the response exceeded a threshold, with the time
+ * they spent in each stage. Slow calls are also logged, at most
+ * aMaxLoggedPerSecond per second, so that an incident does not flood the log.
+ * @code
+ * auto vSlowCallLog = std::make_shared<bda::ThriftSlowCallLog>(std::chrono::milliseconds(100));
+ * vServer.setSlowCallLog(vSlowCallLog, "/slowcalls");
+ * @endcode
+ */
+class ThriftSlowCallLog {
+public:
+    struct Entry {
+        std::chrono::system_clock::time_point mTime;
+        std::string mMethod;
+        std::string mPeer;
+        std::size_t mRequestSize = 0;
+        std::size_t mResponseSize = 0;
+
+        // The time from reading the request to writing the response, and
+        // its stages. Stages that a call skipped, e.g. processing for a
+        // cached response, take no time:
+        std::chrono::microseconds mTotal{ 0 };
+        std::chrono::microseconds mDispatch{ 0 };
+        std::chrono::microseconds mQueue{ 0 };
+        std::chrono::microseconds mProcess{ 0 };
+        std::chrono::microseconds mRespond{ 0 };
+        std::chrono::microseconds mWrite{ 0 };
+    };
+
+    explicit ThriftSlowCallLog(const std::chrono::microseconds aThreshold, const std::size_t aCapacity = 256,
+                               const unsigned aMaxLoggedPerSecond = 10);
+    virtual ~ThriftSlowCallLog() = default;
+
+    std::chrono::microseconds threshold() const {
+        return mThreshold;
+    }
+
+    /** @brief Store a call that exceeded the threshold, and log it unless the rate limit is reached. */
+    void record(Entry aEntry);
+
+    /** @brief The stored calls, oldest first. */
+    std::vector<Entry> entries() const;
+
+    /** @brief Write the stored calls as a JSON array, newest first. */
+    void writeJSON(std::ostream& aStream) const;
+
+    /** @brief The number of calls that exceeded the threshold, including the ones no longer stored. */
+    uint64_t slowCalls() const {
+        return mSlowCalls;
+    }
+
+protected:
+    const std::chrono::microseconds mThreshold;
+    const std::size_t mCapacity;
+    const unsigned mMaxLoggedPerSecond;
+
+    mutable std::mutex mMutex;
+    std::deque<Entry> mEntries;
+
+    // The rate limit of the log, per second of the steady clock:
+    std::chrono::steady_clock::time_point mLogSecond;
+    unsigned mLoggedInSecond = 0;
+    uint64_t mSuppressed = 0;
+
+    std::atomic<uint64_t> mSlowCalls{ 0 };
+};
+
+}
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTSOCKETHANDOFF_HH
+#define THRIFTSOCKETHANDOFF_HH
+
+#include <cstddef>
+#include <string>
+
+namespace bda {
+
+/**
+ * @brief Take over the listening sockets of a running server that accepts
+ * handoffs on the Unix domain socket aSocketPath (see
+ * ThriftHTTPWSServer::enableSocketHandoff()), e.g. when a new version of
+ * the binary starts. The servers that are constructed afterwards in this
+ * process adopt the sockets with their address instead of binding new
+ * ones, so that no connection is refused while the old process drains:
+ * @code
+ * bda::receiveListeningSockets("/run/myservice/handoff.sock");
+ * bda::ThriftHTTPWSServer vServer("0.0.0.0", 9090, ...);
+ * vServer.enableSocketHandoff("/run/myservice/handoff.sock", ...);
+ * @endcode
+ * Returns the number of sockets received, or 0 if no server accepts
+ * handoffs on aSocketPath, e.g. at the first start. Sockets passed by
+ * systemd socket activation (LISTEN_FDS) are adopted the same way, without
+ * calling this function. Linux only.
+ */
+std::size_t receiveListeningSockets(const std::string& aSocketPath);
+
+}
+
+#endif
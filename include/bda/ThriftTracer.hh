@@ -0,0 +1,133 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTTRACER_HH
+#define THRIFTTRACER_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+namespace bda {
+
+/** @brief The stages of a message on its way through the server. */
+enum class ThriftTraceStage : uint8_t {
+    ReadComplete,
+    Dispatch,
+    ProcessStart,
+    ProcessEnd,
+    WriteStart,
+    WriteComplete
+};
+
+/**
+ * @brief Identifies a message on a connection. Connection ids are unique
+ * within the server, message numbers count the messages of a connection.
+ */
+struct ThriftTraceId {
+    uint64_t mConnection = 0;
+    uint64_t mMessage = 0;
+};
+
+/**
+ * @brief Records high-resolution timestamps of the stages of every message
+ * into a ring buffer per thread, and writes them as Chrome trace JSON, which
+ * chrome://tracing and https://ui.perfetto.dev display. Each thread only
+ * locks its own buffer, and the oldest events are overwritten when it is
+ * full. Without a tracer, the server does not record anything.
+ * @code
+ * auto vTracer = std::make_shared<bda::ThriftTracer>();
+ * vServer.setTracer(vTracer);
+ * ...
+ * std::ofstream vTraceFile("trace.json");
+ * vTracer->writeChromeTrace(vTraceFile);
+ * @endcode
+ */
+class ThriftTracer {
+public:
+    /** @param aEventsPerThread The capacity of the ring buffer of every thread. */
+    explicit ThriftTracer(const std::size_t aEventsPerThread = 65536);
+    virtual ~ThriftTracer() = default;
+
+    /** @brief Pause or resume recording, e.g. to trace only a time window. */
+    void setEnabled(const bool aEnabled) {
+        mEnabled.store(aEnabled, std::memory_order_relaxed);
+    }
+
+    bool isEnabled() const {
+        return mEnabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Record that the message aId reached aStage now. The method
+     * name is truncated to fit into the event, and is empty where it is
+     * not known yet, e.g. when the message was just read.
+     */
+    void record(const bda::ThriftTraceStage aStage, const bda::ThriftTraceId& aId,
+                const std::string& aMethod = std::string(), const int32_t aSeqId = 0);
+
+    /**
+     * @brief Write the recorded events as Chrome trace JSON. Every stage is
+     * an instant event on the thread that recorded it, and every message is
+     * an async span from its first to its last stage.
+     */
+    void writeChromeTrace(std::ostream& aStream) const;
+
+    /** @brief Drop all recorded events. */
+    void clear();
+
+protected:
+    struct Event {
+        uint64_t mTimeNS = 0;
+        uint64_t mConnection = 0;
+        uint64_t mMessage = 0;
+        int32_t mSeqId = 0;
+        bda::ThriftTraceStage mStage = bda::ThriftTraceStage::ReadComplete;
+        char mMethod[35] = {};
+    };
+
+    struct ThreadBuffer {
+        std::mutex mMutex;
+        std::unique_ptr<Event[]> mEvents;
+        std::size_t mNext = 0;
+        std::size_t mSize = 0;
+        std::size_t mThreadIdx = 0;
+    };
+
+    ThreadBuffer& threadBuffer();
+
+    const std::size_t mEventsPerThread;
+    const uint64_t mTracerId;
+    std::atomic<bool> mEnabled{ true };
+
+    // The buffers outlive their threads, so that a dump contains the events
+    // of threads that ended:
+    mutable std::mutex mMutex;
+    std::map<std::thread::id, std::unique_ptr<ThreadBuffer>> mThreadBuffers;
+};
+
+}
+
+#endif
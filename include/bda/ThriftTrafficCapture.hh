@@ -0,0 +1,124 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTTRAFFICCAPTURE_HH
+#define THRIFTTRAFFICCAPTURE_HH
+
+#include "bda/ThriftHelper.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <mutex>
+#include <string>
+
+namespace bda {
+
+/**
+ * @brief Records the messages that WebSocket clients send to the server,
+ * with the time they were read and the connection they came from, into a
+ * compact binary file. ThriftHTTPWSReplay replays such a capture against a
+ * server, to benchmark it with the calls of real clients. The capture stops
+ * recording when the file reaches aMaxBytes. Access tokens of the upgrade
+ * requests are not recorded.
+ * @code
+ * vServer.setTrafficCapture(std::make_shared<bda::ThriftTrafficCapture>("traffic.capture"));
+ * @endcode
+ */
+class ThriftTrafficCapture {
+public:
+    enum class RecordType : uint8_t {
+        // A connection was opened, the data is its upgrade target:
+        Open,
+        Message,
+        Close
+    };
+
+    struct Record {
+        RecordType mType = RecordType::Message;
+        // The time since the capture started:
+        std::chrono::microseconds mTime{ 0 };
+        uint64_t mConnection = 0;
+        // The protocol of the connection, for Open records:
+        bda::ProtocolType mProtocolType = bda::ProtocolType::BINARY;
+        // Whether the message was sent as a binary WebSocket message:
+        bool mBinary = true;
+        std::string mData;
+    };
+
+    /** @brief Create the capture file aFilePath, throws std::runtime_error if it cannot be created. */
+    explicit ThriftTrafficCapture(const std::string& aFilePath, const uint64_t aMaxBytes = uint64_t(1) << 30);
+    virtual ~ThriftTrafficCapture() = default;
+
+    void recordOpen(const uint64_t aConnection, const std::string& aTarget, const bda::ProtocolType aProtocolType);
+    void recordMessage(const uint64_t aConnection, const void* aData, const std::size_t aSize, const bool aBinary);
+    void recordClose(const uint64_t aConnection);
+
+    /** @brief Write the buffered records to the file. */
+    void flush();
+
+    /** @brief The bytes that were written to the file so far. */
+    uint64_t bytesWritten() const;
+
+    /**
+     * @brief The number of records that were not written, because the file
+     * reached its maximum size. The capture stops at the first record that
+     * does not fit, so the file holds the complete traffic up to that point.
+     */
+    uint64_t droppedRecords() const {
+        return mDroppedRecords.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Reads the records of a capture file one after the other. */
+    class Reader {
+    public:
+        /** @brief Check the header of the capture, throws std::runtime_error if aStream is no capture. */
+        explicit Reader(std::istream& aStream);
+
+        /** @brief Read the next record, returns false at the end of the capture. */
+        bool next(Record& aRecord);
+
+    private:
+        std::istream& mStream;
+        std::chrono::microseconds mTime{ 0 };
+    };
+
+private:
+    void record(const RecordType aType, const uint64_t aConnection, const uint8_t aFlags, const void* aData, const std::size_t aSize);
+
+    const uint64_t mMaxBytes;
+    const std::chrono::steady_clock::time_point mStartTime;
+
+    mutable std::mutex mMutex;
+    std::ofstream mFile;
+    uint64_t mBytesWritten = 0;
+    // The time of the last record, records store the difference to it:
+    std::chrono::microseconds mLastTime{ 0 };
+    std::string mRecord;
+    bool mFull = false;
+
+    std::atomic<uint64_t> mDroppedRecords{ 0 };
+};
+
+}
+
+#endif
@@ -0,0 +1,235 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTWSCLIENTTRANSPORT_HH
+#define THRIFTWSCLIENTTRANSPORT_HH
+
+#include "bda/ThriftHelper.hh"
+
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TVirtualTransport.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace bda {
+
+/** @brief Where and how a ThriftWSConnectionPool connects. */
+struct ThriftWSClientOptions {
+    std::string mHost = "127.0.0.1";
+    unsigned short mPort = 9090;
+
+    // The WebSocket upgrade path of the service:
+    std::string mPath = "/";
+
+    // The protocol of the server:
+    bda::ProtocolType mProtocolType = bda::ProtocolType::BINARY;
+
+    // Connect with TLS, and verify the certificate and the host name of the
+    // server against the CAs in mCAFile, or the default CAs if it is empty:
+    bool mTLS = false;
+    bool mVerifyPeer = true;
+    std::string mCAFile;
+
+    // Offer permessage-deflate, which the server may accept or decline:
+    bool mCompression = false;
+
+    // Authenticate every connection with this token, if it is not empty
+    // (see bda/ThriftAccessManager.hh):
+    std::string mAccessToken;
+
+    // Another connection is opened when every connection has at least
+    // mMaxCallsPerConnection calls in flight, up to mMaxConnections:
+    std::size_t mMaxConnections = 4;
+    std::size_t mMaxCallsPerConnection = 16;
+
+    // The threads that run the connections, and the largest response:
+    unsigned mThreads = 1;
+    std::size_t mMaxMessageSize = 64 * 1024 * 1024;
+};
+
+/**
+ * @brief A pool of WebSocket connections to a ThriftHTTPWSServer that is
+ * shared by any number of threads. Each connection carries multiple calls
+ * at a time: the pool numbers the calls of a connection with its own
+ * sequence ids and gives every response the sequence id of its call back.
+ * Connections are opened on demand, and a connection that fails fails the
+ * calls in flight on it with a TTransportException; calls are not retried,
+ * the next call opens a new connection. The pool runs its own I/O threads,
+ * which also run the response handlers.
+ * @code
+ * bda::ThriftWSClientOptions vOptions;
+ * vOptions.mHost = "analysis.example.com";
+ * vOptions.mTLS = true;
+ * auto vPool = std::make_shared<bda::ThriftWSConnectionPool>(vOptions);
+ *
+ * std::future<std::string> vData = vPool->asyncCall<TestThriftAPI::TestThriftAPIClient>(
+ *     [](TestThriftAPI::TestThriftAPIClient& aClient) { aClient.send_fetchData(6); },
+ *     [](TestThriftAPI::TestThriftAPIClient& aClient) { std::string vData; aClient.recv_fetchData(vData); return vData; });
+ * @endcode
+ */
+class ThriftWSConnectionPool {
+public:
+    /**
+     * @brief Receives the serialized response to a call, or the exception
+     * that failed the call. A oneway call completes with an empty response
+     * once it was sent.
+     */
+    using ResponseHandler = std::function<void(std::exception_ptr aError, std::string aResponse)>;
+
+    explicit ThriftWSConnectionPool(const ThriftWSClientOptions& aOptions);
+
+    /** @brief Close all connections, and fail the calls in flight. */
+    virtual ~ThriftWSConnectionPool();
+
+    ThriftWSConnectionPool(const ThriftWSConnectionPool&) = delete;
+    ThriftWSConnectionPool& operator=(const ThriftWSConnectionPool&) = delete;
+
+    /** @brief Send a serialized call, and pass its response to aHandler. */
+    void asyncSend(std::string aMessage, ResponseHandler aHandler);
+
+    /** @brief Send a serialized call, and return the future of its response. */
+    std::future<std::string> asyncSend(std::string aMessage);
+
+    /**
+     * @brief Call a method with a generated thrift client: aSend writes the
+     * call with a send_ method, and aReceive reads the response with the
+     * recv_ method, on an I/O thread of the pool. The future holds the
+     * result of aReceive, or the exception of the call.
+     */
+    template<class Client, class Send, class Receive>
+    auto asyncCall(Send aSend, Receive aReceive) -> std::future<decltype(aReceive(std::declval<Client&>()))>;
+
+    /** @brief The number of open connections. */
+    std::size_t connections() const;
+
+    const bda::ThriftWSClientOptions& options() const {
+        return mOptions;
+    }
+
+    std::shared_ptr<apache::thrift::protocol::TProtocolFactory> protocolFactory() const {
+        return mProtocolFactory;
+    }
+
+protected:
+    template<class Result>
+    struct Completion;
+
+    class Connection;
+    struct State;
+
+    const bda::ThriftWSClientOptions mOptions;
+    std::shared_ptr<apache::thrift::protocol::TProtocolFactory> mProtocolFactory;
+    std::unique_ptr<State> mState;
+};
+
+/**
+ * @brief A thrift transport for generated clients that sends every call
+ * through a ThriftWSConnectionPool and waits for its response. A transport,
+ * like a client, belongs to one thread at a time, but the clients of all
+ * threads share the connections of the pool.
+ * @code
+ * auto vTransport = std::make_shared<bda::ThriftWSClientTransport>(vPool);
+ * TestThriftAPI::TestThriftAPIClient vClient(std::make_shared<apache::thrift::protocol::TBinaryProtocol>(vTransport));
+ * vClient.ping(1);
+ * @endcode
+ */
+class ThriftWSClientTransport : public apache::thrift::transport::TVirtualTransport<ThriftWSClientTransport> {
+public:
+    explicit ThriftWSClientTransport(std::shared_ptr<bda::ThriftWSConnectionPool> aPool);
+
+    /** @brief The pool opens its connections on demand, so the transport is always open. */
+    bool isOpen() const override;
+    void open() override;
+    void close() override;
+
+    uint32_t read(uint8_t* buf, uint32_t len);
+    void write(const uint8_t* buf, uint32_t len);
+
+    /** @brief Send the call written since the last flush, and wait for its response. */
+    void flush() override;
+
+protected:
+    std::shared_ptr<bda::ThriftWSConnectionPool> mPool;
+
+    std::string mWriteBuffer;
+    std::string mReadBuffer;
+    std::size_t mReadOffset = 0;
+};
+
+// Fulfills the promise of asyncCall() with the result of aReceive:
+template<class Result>
+struct ThriftWSConnectionPool::Completion {
+    template<class Receive, class Client>
+    static void complete(std::promise<Result>& aPromise, Receive& aReceive, Client& aClient) {
+        aPromise.set_value(aReceive(aClient));
+    }
+};
+
+template<>
+struct ThriftWSConnectionPool::Completion<void> {
+    template<class Receive, class Client>
+    static void complete(std::promise<void>& aPromise, Receive& aReceive, Client& aClient) {
+        aReceive(aClient);
+        aPromise.set_value();
+    }
+};
+
+template<class Client, class Send, class Receive>
+auto ThriftWSConnectionPool::asyncCall(Send aSend, Receive aReceive) -> std::future<decltype(aReceive(std::declval<Client&>()))> {
+    using Result = decltype(aReceive(std::declval<Client&>()));
+
+    auto vRequestTransport = std::make_shared<apache::thrift::transport::TMemoryBuffer>();
+    {
+        Client vClient(mProtocolFactory->getProtocol(vRequestTransport));
+        aSend(vClient);
+    }
+
+    auto vPromise = std::make_shared<std::promise<Result>>();
+    std::future<Result> vFuture = vPromise->get_future();
+    std::shared_ptr<apache::thrift::protocol::TProtocolFactory> vProtocolFactory = mProtocolFactory;
+    asyncSend(vRequestTransport->getBufferAsString(),
+        [vPromise, vProtocolFactory, aReceive](std::exception_ptr aError, std::string aResponse) mutable {
+            if (aError) {
+                vPromise->set_exception(aError);
+                return;
+            }
+            try {
+                // The transport only observes the response:
+                auto vResponseTransport = std::make_shared<apache::thrift::transport::TMemoryBuffer>(
+                    reinterpret_cast<uint8_t*>(&aResponse[0]), static_cast<uint32_t>(aResponse.size()));
+                Client vClient(vProtocolFactory->getProtocol(vResponseTransport));
+                Completion<Result>::complete(*vPromise, aReceive, vClient);
+            } catch (...) {
+                vPromise->set_exception(std::current_exception());
+            }
+        });
+    return vFuture;
+}
+
+}
+
+#endif
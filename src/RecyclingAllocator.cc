@@ -0,0 +1,98 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "RecyclingAllocator.hh"
+
+#include <new>
+
+namespace bda {
+
+namespace {
+
+// Blocks of 64 bytes up to 16 kB are recycled, in one size class per power
+// of two. Every thread keeps at most cMaxCachedBlocks free blocks per class.
+constexpr std::size_t cMinBlockShift = 6;
+constexpr std::size_t cMaxBlockShift = 14;
+constexpr std::size_t cSizeClasses = cMaxBlockShift - cMinBlockShift + 1;
+constexpr std::size_t cMaxCachedBlocks = 64;
+
+std::size_t sizeClassOf(const std::size_t aSize) {
+    std::size_t vSizeClass = 0;
+    while ((std::size_t(1) << (cMinBlockShift + vSizeClass)) < aSize) {
+        ++vSizeClass;
+    }
+    return vSizeClass;
+}
+
+// Blocks can still be freed while the thread exits, after its cache was
+// destroyed. The flag is trivially destructible, so it remains valid then.
+thread_local bool tThreadCacheAlive = false;
+
+struct ThreadCache {
+    void* mBlocks[cSizeClasses][cMaxCachedBlocks];
+    std::size_t mCounts[cSizeClasses] = {};
+
+    ThreadCache() {
+        tThreadCacheAlive = true;
+    }
+
+    ~ThreadCache() {
+        tThreadCacheAlive = false;
+        for (std::size_t vSizeClass = 0; vSizeClass < cSizeClasses; ++vSizeClass) {
+            for (std::size_t vIdx = 0; vIdx < mCounts[vSizeClass]; ++vIdx) {
+                ::operator delete(mBlocks[vSizeClass][vIdx]);
+            }
+        }
+    }
+};
+
+thread_local ThreadCache tThreadCache;
+
+}
+
+void* recyclingAllocate(const std::size_t aSize) {
+    if (aSize > (std::size_t(1) << cMaxBlockShift)) {
+        return ::operator new(aSize);
+    }
+
+    const std::size_t vSizeClass = sizeClassOf(aSize);
+    ThreadCache& vThreadCache = tThreadCache;
+    if (vThreadCache.mCounts[vSizeClass] > 0) {
+        return vThreadCache.mBlocks[vSizeClass][--vThreadCache.mCounts[vSizeClass]];
+    }
+    return ::operator new(std::size_t(1) << (cMinBlockShift + vSizeClass));
+}
+
+void recyclingDeallocate(void* aPointer, const std::size_t aSize) noexcept {
+    if (aSize > (std::size_t(1) << cMaxBlockShift) || !tThreadCacheAlive) {
+        return ::operator delete(aPointer);
+    }
+
+    // A block may be freed on another thread than it was allocated on, it
+    // then simply moves to the cache of that thread:
+    const std::size_t vSizeClass = sizeClassOf(aSize);
+    ThreadCache& vThreadCache = tThreadCache;
+    if (vThreadCache.mCounts[vSizeClass] < cMaxCachedBlocks) {
+        vThreadCache.mBlocks[vSizeClass][vThreadCache.mCounts[vSizeClass]++] = aPointer;
+        return;
+    }
+    ::operator delete(aPointer);
+}
+
+}
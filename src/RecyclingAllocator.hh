@@ -0,0 +1,111 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef RECYCLINGALLOCATOR_HH
+#define RECYCLINGALLOCATOR_HH
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace bda {
+
+/**
+ * @brief Allocate a block of at least aSize bytes from the recycling cache
+ * of the calling thread. Small blocks are rounded up to a power of two and
+ * reused after they were freed, so that a thread that repeatedly allocates
+ * and frees objects of similar size, like sessions and completion handlers,
+ * does not call the global allocator in steady state.
+ */
+void* recyclingAllocate(const std::size_t aSize);
+
+/** @brief Return a block of aSize bytes to the recycling cache of the calling thread. */
+void recyclingDeallocate(void* aPointer, const std::size_t aSize) noexcept;
+
+/**
+ * @brief A stateless standard allocator on top of recyclingAllocate(). It
+ * is used with std::allocate_shared() for the sessions, and as associated
+ * allocator of the asynchronous completion handlers.
+ */
+template<class T>
+class RecyclingAllocator {
+public:
+    using value_type = T;
+
+    RecyclingAllocator() noexcept = default;
+
+    template<class U>
+    RecyclingAllocator(const RecyclingAllocator<U>&) noexcept {
+    }
+
+    T* allocate(const std::size_t aCount) {
+        return static_cast<T*>(bda::recyclingAllocate(sizeof(T) * aCount));
+    }
+
+    void deallocate(T* aPointer, const std::size_t aCount) noexcept {
+        bda::recyclingDeallocate(aPointer, sizeof(T) * aCount);
+    }
+};
+
+template<class T, class U>
+bool operator==(const RecyclingAllocator<T>&, const RecyclingAllocator<U>&) noexcept {
+    return true;
+}
+
+template<class T, class U>
+bool operator!=(const RecyclingAllocator<T>&, const RecyclingAllocator<U>&) noexcept {
+    return false;
+}
+
+/**
+ * @brief Wraps a completion handler so that Asio and Beast allocate the
+ * memory of the pending operation with the RecyclingAllocator, through the
+ * associated allocator hook (the nested allocator_type).
+ */
+template<class Handler>
+class RecyclingHandler {
+public:
+    using allocator_type = RecyclingAllocator<void>;
+
+    explicit RecyclingHandler(Handler aHandler)
+        : mHandler(std::move(aHandler)) {
+    }
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type();
+    }
+
+    template<class... Args>
+    void operator()(Args&&... aArgs) {
+        mHandler(std::forward<Args>(aArgs)...);
+    }
+
+private:
+    Handler mHandler;
+};
+
+/** @brief Wrap a completion handler into a RecyclingHandler. */
+template<class Handler>
+RecyclingHandler<typename std::decay<Handler>::type> bindRecyclingAllocator(Handler&& aHandler) {
+    return RecyclingHandler<typename std::decay<Handler>::type>(std::forward<Handler>(aHandler));
+}
+
+}
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftAccessManager.hh"
+
+#include "ThriftSessionAccess.hh"
+
+#include <bda/Helpers.hh>
+
+#include <stdexcept>
+#include <utility>
+
+namespace bda {
+
+namespace {
+
+// The access manager and the session of the call that runs on this thread:
+thread_local bda::ThriftAccessManager* tAccessManager = nullptr;
+thread_local bda::ThriftSessionAccess* tSessionAccess = nullptr;
+
+}
+
+ThriftAccessManager::ThriftAccessManager(Authenticator aAuthenticator)
+    : mAuthenticator(std::move(aAuthenticator)) {
+    if (!mAuthenticator) {
+        throw(std::runtime_error("bda::ThriftAccessManager::ThriftAccessManager(): An authenticator is required"));
+    }
+}
+
+void ThriftAccessManager::setPublic(const std::string& aMethodName) {
+    mMethods[aMethodName].mPublic = true;
+}
+
+void ThriftAccessManager::setRestricted(const std::string& aMethodName) {
+    Method& vMethod = mMethods[aMethodName];
+    vMethod.mPublic = false;
+    vMethod.mIndex = mRestrictedMethods++;
+}
+
+void ThriftAccessManager::setTokenCookie(const std::string& aCookieName) {
+    mTokenCookie = aCookieName;
+}
+
+std::shared_ptr<const bda::ThriftAccessGrant> ThriftAccessManager::authenticate(const std::string& aToken) {
+    if (aToken.empty()) {
+        return nullptr;
+    }
+    std::uint64_t vRevocations = 0;
+    {
+        std::lock_guard<std::mutex> vLock(mMutex);
+        vRevocations = mRevocations;
+        const auto vGrantIt = mGrants.find(aToken);
+        if (vGrantIt != mGrants.end()) {
+            if (vGrantIt->second->isValid()) {
+                return vGrantIt->second;
+            }
+            revokeLocked(vGrantIt);
+        }
+    }
+
+    // Ask the backend without holding the lock, concurrent first uses of the
+    // same token may both ask it:
+    ++mAuthentications;
+    bda::ThriftCredentials vCredentials;
+    if (!mAuthenticator(aToken, vCredentials)) {
+        BDAMessage(9, "bda::ThriftAccessManager::authenticate(): Rejecting an invalid token.\n");
+        return nullptr;
+    }
+
+    auto vGrant = std::make_shared<bda::ThriftAccessGrant>();
+    vGrant->mToken = aToken;
+    vGrant->mPrincipal = std::move(vCredentials.mPrincipal);
+    vGrant->mExpiry = vCredentials.mExpiry;
+    vGrant->mPermissions.assign((mRestrictedMethods + 63) / 64, 0);
+    for (const std::string& vMethodName : vCredentials.mMethods) {
+        const auto vMethodIt = mMethods.find(vMethodName);
+        if (vMethodIt != mMethods.end() && !vMethodIt->second.mPublic) {
+            vGrant->mPermissions[vMethodIt->second.mIndex / 64] |= std::uint64_t(1) << (vMethodIt->second.mIndex % 64);
+        }
+    }
+    BDAMessage(9, "bda::ThriftAccessManager::authenticate(): Authenticated '" + vGrant->mPrincipal + "'.\n");
+
+    // A grant that may have been revoked in the meantime is not cached, so
+    // that the next use of the token asks the backend again:
+    std::lock_guard<std::mutex> vLock(mMutex);
+    if (mRevocations == vRevocations) {
+        mGrants[aToken] = vGrant;
+    }
+    return vGrant;
+}
+
+bool ThriftAccessManager::isPermitted(const bda::ThriftAccessGrant* aGrant, const std::string& aMethodName) const {
+    const auto vMethodIt = mMethods.find(aMethodName);
+    const bool vPublic = vMethodIt != mMethods.end() && vMethodIt->second.mPublic;
+    bool vPermitted = vPublic;
+    if (!vPublic && aGrant && aGrant->isValid()) {
+        vPermitted = vMethodIt == mMethods.end() || aGrant->permits(vMethodIt->second.mIndex);
+    }
+    if (!vPermitted) {
+        ++mDeniedCalls;
+    }
+    return vPermitted;
+}
+
+void ThriftAccessManager::revoke(const std::string& aToken) {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    ++mRevocations;
+    const auto vGrantIt = mGrants.find(aToken);
+    if (vGrantIt != mGrants.end()) {
+        revokeLocked(vGrantIt);
+    }
+}
+
+void ThriftAccessManager::revokePrincipal(const std::string& aPrincipal) {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    ++mRevocations;
+    for (auto vGrantIt = mGrants.begin(); vGrantIt != mGrants.end();) {
+        if (vGrantIt->second->mPrincipal == aPrincipal) {
+            revokeLocked(vGrantIt++);
+        } else {
+            ++vGrantIt;
+        }
+    }
+}
+
+void ThriftAccessManager::revokeAll() {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    ++mRevocations;
+    while (!mGrants.empty()) {
+        revokeLocked(mGrants.begin());
+    }
+}
+
+void ThriftAccessManager::revokeLocked(std::unordered_map<std::string, std::shared_ptr<bda::ThriftAccessGrant>>::iterator aGrant) {
+    aGrant->second->mRevoked = true;
+    mGrants.erase(aGrant);
+}
+
+ThriftSessionAccessScope::ThriftSessionAccessScope(bda::ThriftAccessManager* aAccessManager, bda::ThriftSessionAccess* aAccess)
+    : mPreviousAccessManager(tAccessManager), mPreviousAccess(tSessionAccess) {
+    tAccessManager = aAccessManager;
+    tSessionAccess = aAccess;
+}
+
+ThriftSessionAccessScope::~ThriftSessionAccessScope() {
+    tAccessManager = mPreviousAccessManager;
+    tSessionAccess = mPreviousAccess;
+}
+
+bool loginThriftSession(const std::string& aToken) {
+    if (!tAccessManager || !tSessionAccess) {
+        return false;
+    }
+    std::shared_ptr<const bda::ThriftAccessGrant> vGrant = tAccessManager->authenticate(aToken);
+    if (!vGrant) {
+        return false;
+    }
+    tSessionAccess->setGrant(std::move(vGrant));
+    return true;
+}
+
+std::string currentThriftPrincipal() {
+    if (!tSessionAccess) {
+        return std::string();
+    }
+    std::shared_ptr<const bda::ThriftAccessGrant> vGrant = tSessionAccess->grant();
+    return vGrant && vGrant->isValid() ? vGrant->principal() : std::string();
+}
+
+}
@@ -0,0 +1,97 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftBatchEnvelope.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace bda {
+
+namespace {
+
+uint32_t readUInt32(const uint8_t* aData) {
+    return (static_cast<uint32_t>(aData[0]) << 24) | (static_cast<uint32_t>(aData[1]) << 16) |
+           (static_cast<uint32_t>(aData[2]) << 8) | static_cast<uint32_t>(aData[3]);
+}
+
+void appendUInt32(std::string& aBuffer, const uint32_t aValue) {
+    const char vBytes[4] = { static_cast<char>((aValue >> 24) & 0xFF), static_cast<char>((aValue >> 16) & 0xFF),
+                             static_cast<char>((aValue >> 8) & 0xFF), static_cast<char>(aValue & 0xFF) };
+    aBuffer.append(vBytes, sizeof(vBytes));
+}
+
+}
+
+bool isBatchEnvelope(const uint8_t* aData, const std::size_t aSize) {
+    return aSize >= cBatchEnvelopeHeaderSize && std::equal(std::begin(cBatchEnvelopeMagic), std::end(cBatchEnvelopeMagic), aData);
+}
+
+void parseBatchEnvelope(const uint8_t* aData, const std::size_t aSize,
+                        std::vector<std::pair<const uint8_t*, uint32_t>>& aMessages) {
+    if (!isBatchEnvelope(aData, aSize)) {
+        throw(std::runtime_error("bda::parseBatchEnvelope(): Data is not a batch envelope"));
+    }
+
+    const uint32_t vCount = readUInt32(aData + 4);
+    std::size_t vOffset = cBatchEnvelopeHeaderSize;
+
+    // Every message needs at least its size prefix, which bounds the count:
+    if (vCount > (aSize - vOffset) / 4) {
+        throw(std::runtime_error("bda::parseBatchEnvelope(): Message count " + std::to_string(vCount) + " exceeds the envelope size"));
+    }
+
+    aMessages.clear();
+    aMessages.reserve(vCount);
+    for (uint32_t vIdx = 0; vIdx < vCount; ++vIdx) {
+        if (aSize - vOffset < 4) {
+            throw(std::runtime_error("bda::parseBatchEnvelope(): Truncated size of message " + std::to_string(vIdx)));
+        }
+        const uint32_t vMessageSize = readUInt32(aData + vOffset);
+        vOffset += 4;
+        if (aSize - vOffset < vMessageSize) {
+            throw(std::runtime_error("bda::parseBatchEnvelope(): Truncated message " + std::to_string(vIdx)));
+        }
+        aMessages.emplace_back(aData + vOffset, vMessageSize);
+        vOffset += vMessageSize;
+    }
+
+    if (vOffset != aSize) {
+        throw(std::runtime_error("bda::parseBatchEnvelope(): Trailing data after message " + std::to_string(vCount)));
+    }
+}
+
+void beginBatchEnvelope(std::string& aEnvelope, const uint32_t aCount) {
+    aEnvelope.assign(reinterpret_cast<const char*>(cBatchEnvelopeMagic), sizeof(cBatchEnvelopeMagic));
+    appendUInt32(aEnvelope, aCount);
+}
+
+void appendBatchEnvelopeMessage(std::string& aEnvelope, const uint8_t* aData, const uint32_t aSize) {
+    appendBatchEnvelopeSize(aEnvelope, aSize);
+    if (aSize > 0) {
+        aEnvelope.append(reinterpret_cast<const char*>(aData), aSize);
+    }
+}
+
+void appendBatchEnvelopeSize(std::string& aEnvelope, const uint32_t aSize) {
+    appendUInt32(aEnvelope, aSize);
+}
+
+}
@@ -0,0 +1,113 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftCallDeadline.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace bda {
+
+namespace {
+
+thread_local std::chrono::steady_clock::time_point tCallDeadline = std::chrono::steady_clock::time_point::max();
+
+}
+
+bool isDeadlineEnvelope(const uint8_t* aData, const std::size_t aSize) {
+    return aSize >= cDeadlineEnvelopeHeaderSize && std::equal(std::begin(cDeadlineEnvelopeMagic), std::end(cDeadlineEnvelopeMagic), aData);
+}
+
+void parseDeadlineEnvelope(const uint8_t* aData, const std::size_t aSize, std::chrono::milliseconds& aTimeout,
+                           const uint8_t*& aMessage, uint32_t& aMessageSize) {
+    if (!isDeadlineEnvelope(aData, aSize)) {
+        throw(std::runtime_error("bda::parseDeadlineEnvelope(): Data is not a deadline envelope"));
+    }
+
+    const uint32_t vTimeout = (static_cast<uint32_t>(aData[4]) << 24) | (static_cast<uint32_t>(aData[5]) << 16) |
+                              (static_cast<uint32_t>(aData[6]) << 8) | static_cast<uint32_t>(aData[7]);
+    aTimeout = std::chrono::milliseconds(vTimeout);
+    aMessage = aData + cDeadlineEnvelopeHeaderSize;
+    aMessageSize = static_cast<uint32_t>(aSize - cDeadlineEnvelopeHeaderSize);
+}
+
+bool parseCallTimeout(const std::string& aValue, std::chrono::milliseconds& aTimeout) {
+    if (aValue.empty() || aValue.size() > 10) {
+        return false;
+    }
+    uint64_t vTimeout = 0;
+    for (const char vChar : aValue) {
+        if (vChar < '0' || vChar > '9') {
+            return false;
+        }
+        vTimeout = vTimeout * 10 + static_cast<uint64_t>(vChar - '0');
+    }
+    if (vTimeout > 0xFFFFFFFFu) {
+        return false;
+    }
+    aTimeout = std::chrono::milliseconds(vTimeout);
+    return true;
+}
+
+void makeDeadlineEnvelope(std::string& aEnvelope, const std::chrono::milliseconds aTimeout,
+                          const uint8_t* aData, const uint32_t aSize) {
+    const uint32_t vTimeout = static_cast<uint32_t>(std::max<std::chrono::milliseconds::rep>(0, aTimeout.count()));
+    const char vTimeoutBytes[4] = { static_cast<char>((vTimeout >> 24) & 0xFF), static_cast<char>((vTimeout >> 16) & 0xFF),
+                                    static_cast<char>((vTimeout >> 8) & 0xFF), static_cast<char>(vTimeout & 0xFF) };
+    aEnvelope.assign(reinterpret_cast<const char*>(cDeadlineEnvelopeMagic), sizeof(cDeadlineEnvelopeMagic));
+    aEnvelope.append(vTimeoutBytes, sizeof(vTimeoutBytes));
+    if (aSize > 0) {
+        aEnvelope.append(reinterpret_cast<const char*>(aData), aSize);
+    }
+}
+
+ThriftCallDeadlineScope::ThriftCallDeadlineScope(const std::chrono::steady_clock::time_point aDeadline)
+    : mPreviousDeadline(tCallDeadline) {
+    tCallDeadline = aDeadline;
+}
+
+ThriftCallDeadlineScope::~ThriftCallDeadlineScope() {
+    tCallDeadline = mPreviousDeadline;
+}
+
+std::chrono::steady_clock::time_point currentCallDeadline() {
+    return tCallDeadline;
+}
+
+bool hasCallDeadline() {
+    return tCallDeadline != std::chrono::steady_clock::time_point::max();
+}
+
+std::chrono::milliseconds remainingCallBudget() {
+    if (!hasCallDeadline()) {
+        return std::chrono::milliseconds::max();
+    }
+    const std::chrono::steady_clock::time_point vNow = std::chrono::steady_clock::now();
+    if (vNow >= tCallDeadline) {
+        return std::chrono::milliseconds(0);
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(tCallDeadline - vNow);
+}
+
+bool isCallExpired() {
+    return hasCallDeadline() && std::chrono::steady_clock::now() >= tCallDeadline;
+}
+
+}
@@ -0,0 +1,42 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTCALLKEY_HH
+#define THRIFTCALLKEY_HH
+
+#include <string>
+
+namespace bda {
+
+/**
+ * @brief The key of a call in the response cache and the request
+ * coalescer: the method name, a zero byte, and the serialized arguments.
+ */
+inline std::string makeThriftCallKey(const std::string& aMethodName, const std::string& aArguments) {
+    std::string vKey;
+    vKey.reserve(aMethodName.size() + 1 + aArguments.size());
+    vKey.append(aMethodName);
+    vKey.push_back('\0');
+    vKey.append(aArguments);
+    return vKey;
+}
+
+}
+
+#endif
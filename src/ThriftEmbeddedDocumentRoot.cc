@@ -0,0 +1,52 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftEmbeddedDocumentRoot.hh"
+
+#include <algorithm>
+#include <cstring>
+
+namespace bda {
+
+namespace {
+
+// Compares a path of the table with aPath of aLength bytes, in the byte
+// order that the generated tables are sorted in:
+int comparePath(const char* aFilePath, const char* aPath, const std::size_t aLength) {
+    const std::size_t vFileLength = std::strlen(aFilePath);
+    const int vResult = std::memcmp(aFilePath, aPath, std::min(vFileLength, aLength));
+    if (vResult != 0) {
+        return vResult;
+    }
+    return vFileLength < aLength ? -1 : (vFileLength > aLength ? 1 : 0);
+}
+
+}
+
+const ThriftEmbeddedFile* ThriftEmbeddedDocumentRoot::find(const char* aPath, const std::size_t aLength) const {
+    const ThriftEmbeddedFile* vFile = std::lower_bound(begin(), end(), aPath, [aLength](const ThriftEmbeddedFile& aFile, const char* aValue) {
+        return comparePath(aFile.mPath, aValue, aLength) < 0;
+    });
+    if (vFile != end() && comparePath(vFile->mPath, aPath, aLength) == 0) {
+        return vFile;
+    }
+    return nullptr;
+}
+
+}
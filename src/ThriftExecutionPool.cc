@@ -0,0 +1,168 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftExecutionPool.hh"
+
+#include <bda/Helpers.hh>
+
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace bda {
+
+ThriftExecutionPool::ThriftExecutionPool(const std::size_t aThreads) {
+    if (aThreads == 0) {
+        throw(std::runtime_error("bda::ThriftExecutionPool::ThriftExecutionPool(): The pool needs at least one thread"));
+    }
+    addPriorityClass("default", 1);
+
+    mThreads.reserve(aThreads);
+    for (std::size_t vIdx = 0; vIdx < aThreads; ++vIdx) {
+        mThreads.emplace_back(&ThriftExecutionPool::run, this);
+    }
+}
+
+ThriftExecutionPool::~ThriftExecutionPool() {
+    stop();
+}
+
+std::size_t ThriftExecutionPool::addPriorityClass(const std::string& aName, const unsigned aWeight, const std::size_t aMaxThreads) {
+    if (aWeight == 0) {
+        throw(std::runtime_error("bda::ThriftExecutionPool::addPriorityClass(): The weight of '" + aName + "' must be positive"));
+    }
+
+    std::lock_guard<std::mutex> vLock(mMutex);
+    PriorityClass vPriorityClass;
+    vPriorityClass.mName = aName;
+    vPriorityClass.mWeight = static_cast<int>(aWeight);
+    vPriorityClass.mMaxThreads = aMaxThreads;
+    mPriorityClasses.push_back(std::move(vPriorityClass));
+    return mPriorityClasses.size() - 1;
+}
+
+void ThriftExecutionPool::setMethodPriority(const std::string& aMethodName, const std::size_t aPriorityClass) {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    if (aPriorityClass >= mPriorityClasses.size()) {
+        throw(std::runtime_error("bda::ThriftExecutionPool::setMethodPriority(): Unknown priority class " + std::to_string(aPriorityClass)));
+    }
+    mMethodPriorities[aMethodName] = aPriorityClass;
+}
+
+std::size_t ThriftExecutionPool::priorityOf(const std::string& aMethodName) const {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    const auto vPriorityIt = mMethodPriorities.find(aMethodName);
+    return vPriorityIt != mMethodPriorities.end() ? vPriorityIt->second : 0;
+}
+
+void ThriftExecutionPool::submit(const std::size_t aPriorityClass, Task aTask) {
+    {
+        std::lock_guard<std::mutex> vLock(mMutex);
+        const std::size_t vPriorityClass = aPriorityClass < mPriorityClasses.size() ? aPriorityClass : 0;
+        mPriorityClasses[vPriorityClass].mQueue.push_back(std::move(aTask));
+    }
+    mCondition.notify_one();
+}
+
+void ThriftExecutionPool::stop() {
+    {
+        std::lock_guard<std::mutex> vLock(mMutex);
+        if (mStopped) {
+            return;
+        }
+        mStopped = true;
+        for (PriorityClass& vPriorityClass : mPriorityClasses) {
+            vPriorityClass.mQueue.clear();
+        }
+    }
+    mCondition.notify_all();
+
+    for (std::thread& vThread : mThreads) {
+        vThread.join();
+    }
+}
+
+std::size_t ThriftExecutionPool::queuedTasks(const std::size_t aPriorityClass) const {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    return aPriorityClass < mPriorityClasses.size() ? mPriorityClasses[aPriorityClass].mQueue.size() : 0;
+}
+
+bool ThriftExecutionPool::selectPriorityClass(std::size_t& aPriorityClass) {
+    // Smooth weighted round robin over the classes that have a runnable task:
+    int vTotalWeight = 0;
+    bool vSelected = false;
+    for (std::size_t vIdx = 0; vIdx < mPriorityClasses.size(); ++vIdx) {
+        PriorityClass& vPriorityClass = mPriorityClasses[vIdx];
+        const bool vRunnable = !vPriorityClass.mQueue.empty() &&
+                               (vPriorityClass.mMaxThreads == 0 || vPriorityClass.mRunning < vPriorityClass.mMaxThreads);
+        if (!vRunnable) {
+            continue;
+        }
+        vPriorityClass.mCurrentWeight += vPriorityClass.mWeight;
+        vTotalWeight += vPriorityClass.mWeight;
+        if (!vSelected || vPriorityClass.mCurrentWeight > mPriorityClasses[aPriorityClass].mCurrentWeight) {
+            aPriorityClass = vIdx;
+            vSelected = true;
+        }
+    }
+
+    if (vSelected) {
+        mPriorityClasses[aPriorityClass].mCurrentWeight -= vTotalWeight;
+    }
+    return vSelected;
+}
+
+void ThriftExecutionPool::run() {
+    std::unique_lock<std::mutex> vLock(mMutex);
+    while (true) {
+        std::size_t vPriorityClass = 0;
+        mCondition.wait(vLock, [this, &vPriorityClass]() {
+            return mStopped || selectPriorityClass(vPriorityClass);
+        });
+        if (mStopped) {
+            return;
+        }
+
+        PriorityClass& vSelectedClass = mPriorityClasses[vPriorityClass];
+        Task vTask = std::move(vSelectedClass.mQueue.front());
+        vSelectedClass.mQueue.pop_front();
+        ++vSelectedClass.mRunning;
+
+        vLock.unlock();
+        try {
+            vTask();
+        } catch (const std::exception& vException) {
+            BDAMessage(2, "ThriftExecutionPool::run(): A task failed: '" + std::string(vException.what()) + "'.\n");
+        } catch (...) {
+            BDAMessage(2, "ThriftExecutionPool::run(): A task failed with an unknown exception.\n");
+        }
+        vLock.lock();
+
+        // A class that was at its thread limit may be runnable again:
+        const bool vWasAtLimit = mPriorityClasses[vPriorityClass].mMaxThreads > 0 &&
+                                 mPriorityClasses[vPriorityClass].mRunning == mPriorityClasses[vPriorityClass].mMaxThreads;
+        --mPriorityClasses[vPriorityClass].mRunning;
+        if (vWasAtLimit && !mPriorityClasses[vPriorityClass].mQueue.empty()) {
+            mCondition.notify_one();
+        }
+    }
+}
+
+}
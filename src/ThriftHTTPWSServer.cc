@@ -8,6 +8,15 @@
 //
 
 #include "bda/ThriftHTTPWSServer.hh"
+#include "bda/ThriftBatchEnvelope.hh"
+#include "bda/ThriftCallDeadline.hh"
+#include "RecyclingAllocator.hh"
+#include "ThriftInheritedSockets.hh"
+#include "ThriftMemoryBudget.hh"
+#include "ThriftMessageDispatcher.hh"
+#include "ThriftSessionAccess.hh"
+#include "ThriftSessionContext.hh"
+#include "ThriftSharedMemoryRing.hh"
 
 #include <bda/Helpers.hh>
 
@@ -19,6 +28,13 @@
 
 #include <boost/asio/bind_executor.hpp>
 #include <boost/asio/buffer.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/post.hpp>
+#if defined(BOOST_ASIO_HAS_IO_URING)
+#include <boost/asio/random_access_file.hpp>
+#endif
 #include <boost/asio/signal_set.hpp>
 #include <boost/asio/ssl/context.hpp>
 #include <boost/asio/steady_timer.hpp>
@@ -32,17 +48,30 @@
 #include <boost/optional.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdlib>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <vector>
 
 #include <bda/bdanetworkservice_export.h>
 
+#if defined(BDA_HAS_HTTP2)
+#include <nghttp2/nghttp2.h>
+#endif
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 
 namespace bda {
 
@@ -207,12 +236,90 @@ std::string path_cat(const boost::beast::string_view base,
     return result;
 }
 
+#if defined(BOOST_ASIO_HAS_IO_URING)
+
+// Files up to this size are read with io_uring into memory, larger files are
+// streamed from a file_body to limit the memory of a response:
+constexpr uint64_t cIoUringMaxFileSize = 16 * 1024 * 1024;
+
+// Whether the kernel supports io_uring, e.g. it may be too old or a seccomp
+// profile may block it. Asio sets up the ring with the first file object.
+bool isIoUringAvailable() {
+    static const bool vAvailable = []() {
+        try {
+            boost::asio::io_context vIOContext;
+            boost::asio::random_access_file vFile(vIOContext);
+            return true;
+        } catch (const std::exception& vException) {
+            BDAMessage(2, "bda::isIoUringAvailable(): io_uring is not available, will fall back to blocking file reads: '" + std::string(vException.what()) + "'.\n");
+            return false;
+        }
+    }();
+    return vAvailable;
+}
+
+#endif
+
+// Returns true if an Accept-Encoding header accepts gzip
+bool accepts_gzip(const boost::beast::string_view aAcceptEncoding) {
+    for (const auto& vEncoding : boost::beast::http::ext_list(aAcceptEncoding)) {
+        if (!boost::beast::iequals(vEncoding.first, "gzip")) {
+            continue;
+        }
+        for (const auto& vParameter : vEncoding.second) {
+            if (boost::beast::iequals(vParameter.first, "q")) {
+                return std::strtod(std::string(vParameter.second).c_str(), nullptr) > 0.0;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+// Returns the response with a file that was embedded at build time. It
+// refers to the memory of the file instead of copying it, is compressed if
+// the file was precompressed and the client accepts gzip, and has no body if
+// the client has the file already.
+template<class Body, class Allocator>
+boost::beast::http::response<boost::beast::http::span_body<char const>> embedded_file_response(
+    const boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>& aHTTPRequest,
+    const bda::ThriftEmbeddedFile& aFile, const boost::beast::string_view aMimeType) {
+    const bool vGzip = aFile.mGzipData && accepts_gzip(aHTTPRequest[boost::beast::http::field::accept_encoding]);
+    const char* vETag = vGzip ? aFile.mGzipETag : aFile.mETag;
+
+    boost::beast::http::response<boost::beast::http::span_body<char const>> res{ boost::beast::http::status::ok, aHTTPRequest.version() };
+    res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(boost::beast::http::field::etag, vETag);
+    res.set(boost::beast::http::field::cache_control, "no-cache");
+    if (aFile.mGzipData) {
+        res.set(boost::beast::http::field::vary, "Accept-Encoding");
+    }
+    res.keep_alive(aHTTPRequest.keep_alive());
+
+    const boost::beast::string_view vIfNoneMatch = aHTTPRequest[boost::beast::http::field::if_none_match];
+    if (vIfNoneMatch == "*" || vIfNoneMatch.find(vETag) != boost::beast::string_view::npos) {
+        res.result(boost::beast::http::status::not_modified);
+        return res;
+    }
+
+    res.set(boost::beast::http::field::content_type, aMimeType);
+    if (vGzip) {
+        res.set(boost::beast::http::field::content_encoding, "gzip");
+    }
+    const std::size_t vSize = vGzip ? aFile.mGzipSize : aFile.mSize;
+    res.content_length(vSize);
+    if (aHTTPRequest.method() != boost::beast::http::verb::head) {
+        res.body() = boost::beast::span<char const>(reinterpret_cast<const char*>(vGzip ? aFile.mGzipData : aFile.mData), vSize);
+    }
+    return res;
+}
+
 // This function produces an HTTP response for the given
 // request. The type of the response object depends on the
 // contents of the request, so the interface requires the
 // caller to pass a generic lambda for receiving the response.
 template<class Body, class Allocator, class Send>
-void handle_request(boost::beast::string_view aHTTPDocumentRoot,
+void handle_request(const bda::ThriftSessionContext& aContext,
                     boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>&& aHTTPRequest,
                     Send&& send) {
     // Returns a bad request response
@@ -266,8 +373,24 @@ void handle_request(boost::beast::string_view aHTTPDocumentRoot,
         return send(bad_request("Illegal request-target"));
     }
 
+    // Serve the files that were embedded at build time from memory, and
+    // only fall back to the document root on disk if allowed:
+    if (aContext.mEmbeddedDocumentRoot) {
+        std::string vPath(aHTTPRequest.target().substr(0, aHTTPRequest.target().find('?')));
+        if (vPath.back() == '/') {
+            vPath.append("index.html");
+        }
+        if (const bda::ThriftEmbeddedFile* vFile = aContext.mEmbeddedDocumentRoot->find(vPath.data(), vPath.size())) {
+            return send(embedded_file_response(aHTTPRequest, *vFile, mime_type(vPath)));
+        }
+        if (!aContext.mEmbeddedFallbackToDisk) {
+            BDAMessage(2, "handle_request(): The resource '" + vPath + "' is not embedded.\n");
+            return send(not_found(aHTTPRequest.target()));
+        }
+    }
+
     // Build the path to the requested file
-    std::string path = path_cat(aHTTPDocumentRoot, aHTTPRequest.target());
+    std::string path = path_cat(aContext.mHTTPDocumentRoot, aHTTPRequest.target());
     if (aHTTPRequest.target().back() == '/') {
         path.append("index.html");
     }
@@ -302,6 +425,21 @@ void handle_request(boost::beast::string_view aHTTPDocumentRoot,
         return send(std::move(res));
     }
 
+#if defined(BOOST_ASIO_HAS_IO_URING)
+    // Read the file with io_uring instead of blocking the server thread,
+    // once the response is the next one to send:
+    if (size <= cIoUringMaxFileSize && isIoUringAvailable()) {
+        body.close();
+        boost::beast::http::response<boost::beast::http::vector_body<char>> res{ boost::beast::http::status::ok, aHTTPRequest.version() };
+        res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(boost::beast::http::field::content_type, mime_type(path));
+        res.content_length(size);
+        res.keep_alive(aHTTPRequest.keep_alive());
+        res.body().resize(static_cast<std::size_t>(size));
+        return send.send_file(std::move(path), std::move(res));
+    }
+#endif
+
     // Respond to GET request
     boost::beast::http::response<boost::beast::http::file_body> res{
         std::piecewise_construct,
@@ -317,6 +455,141 @@ void handle_request(boost::beast::string_view aHTTPDocumentRoot,
     return send(std::move(res));
 }
 
+// Returns a response with the JSON document of an endpoint of the server
+template<class Body, class Allocator>
+boost::beast::http::response<boost::beast::http::string_body> json_response(
+    const boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>& aHTTPRequest,
+    std::string aDocument) {
+    boost::beast::http::response<boost::beast::http::string_body> res{ boost::beast::http::status::ok, aHTTPRequest.version() };
+    res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(boost::beast::http::field::content_type, "application/json");
+    res.set(boost::beast::http::field::cache_control, "no-store");
+    res.keep_alive(aHTTPRequest.keep_alive());
+    res.body() = std::move(aDocument);
+    res.prepare_payload();
+    return res;
+}
+
+// Returns the access token of a request, from its "Authorization: Bearer"
+// header or the cookie aCookieName, or an empty string if there is none:
+std::string find_access_token(const boost::beast::string_view aAuthorization, boost::beast::string_view aCookies,
+                              const std::string& aCookieName) {
+    const boost::beast::string_view cBearer = "Bearer ";
+    if (aAuthorization.size() > cBearer.size() && boost::beast::iequals(aAuthorization.substr(0, cBearer.size()), cBearer)) {
+        return std::string(aAuthorization.substr(cBearer.size()));
+    }
+    while (!aCookieName.empty() && !aCookies.empty()) {
+        const std::size_t vSeparator = aCookies.find(';');
+        boost::beast::string_view vCookie = aCookies.substr(0, vSeparator);
+        aCookies = vSeparator == boost::beast::string_view::npos ? boost::beast::string_view() : aCookies.substr(vSeparator + 1);
+        while (!vCookie.empty() && vCookie.front() == ' ') {
+            vCookie.remove_prefix(1);
+        }
+        if (vCookie.size() > aCookieName.size() && vCookie.substr(0, aCookieName.size()) == aCookieName && vCookie[aCookieName.size()] == '=') {
+            return std::string(vCookie.substr(aCookieName.size() + 1));
+        }
+    }
+    return std::string();
+}
+
+// Returns a response that rejects a request with an invalid access token
+template<class Body, class Allocator>
+boost::beast::http::response<boost::beast::http::string_body> unauthorized_response(
+    const boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>& aHTTPRequest) {
+    boost::beast::http::response<boost::beast::http::string_body> res{ boost::beast::http::status::unauthorized, aHTTPRequest.version() };
+    res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(boost::beast::http::field::content_type, "text/html");
+    res.set(boost::beast::http::field::www_authenticate, "Bearer");
+    res.keep_alive(false);
+    res.body() = "The access token is not valid.";
+    res.prepare_payload();
+    return res;
+}
+
+// Returns the value of the parameter aName in the query of aTarget, or an
+// empty string if there is none:
+std::string query_parameter(const boost::beast::string_view aTarget, const boost::beast::string_view aName) {
+    const std::size_t vQuery = aTarget.find('?');
+    boost::beast::string_view vParameters = vQuery == boost::beast::string_view::npos ? boost::beast::string_view() : aTarget.substr(vQuery + 1);
+    while (!vParameters.empty()) {
+        const std::size_t vSeparator = vParameters.find('&');
+        const boost::beast::string_view vParameter = vParameters.substr(0, vSeparator);
+        vParameters = vSeparator == boost::beast::string_view::npos ? boost::beast::string_view() : vParameters.substr(vSeparator + 1);
+        if (vParameter.size() > aName.size() && vParameter.substr(0, aName.size()) == aName && vParameter[aName.size()] == '=') {
+            return std::string(vParameter.substr(aName.size() + 1));
+        }
+    }
+    return std::string();
+}
+
+// Returns true if a request with the access token aToken may get the
+// diagnostics on aPath, which an access manager permits like a method:
+bool is_diagnostics_permitted(bda::ThriftSessionContext& aContext, const std::string& aPath, const std::string& aToken) {
+    if (!aContext.mAccessManager) {
+        return true;
+    }
+    std::shared_ptr<const bda::ThriftAccessGrant> vGrant = aContext.mAccessManager->authenticate(aToken);
+    return aContext.mAccessManager->isPermitted(vGrant.get(), aPath);
+}
+
+// Receives the status, content type and body of the response to a profile
+// request:
+using profile_handler = std::function<void(boost::beast::http::status, std::string, std::string)>;
+
+// Starts the profile that the query of aTarget requests from the profiler of
+// the context, e.g. "?type=heap&seconds=30", and calls aRespond when it is
+// complete, or right away if it could not start:
+void start_profile(bda::ThriftSessionContext& aContext, const boost::beast::string_view aTarget, const std::string& aToken,
+                   profile_handler aRespond) {
+    if (!is_diagnostics_permitted(aContext, aContext.mProfilerPath, aToken)) {
+        return aRespond(boost::beast::http::status::unauthorized, "text/plain", "The access token does not permit profiles.");
+    }
+
+    const std::string vType = query_parameter(aTarget, "type");
+    const std::string vFormat = query_parameter(aTarget, "format");
+    const std::string vSeconds = query_parameter(aTarget, "seconds");
+    if ((!vType.empty() && vType != "cpu" && vType != "heap") || (!vFormat.empty() && vFormat != "folded" && vFormat != "pprof") ||
+        vSeconds.find_first_not_of("0123456789") != std::string::npos || vSeconds.size() > 6) {
+        return aRespond(boost::beast::http::status::bad_request, "text/plain", "Expected type=cpu|heap, format=folded|pprof and seconds.");
+    }
+    const bda::ThriftProfiler::Type vProfileType = vType == "heap" ? bda::ThriftProfiler::Type::Heap : bda::ThriftProfiler::Type::CPU;
+    const bda::ThriftProfiler::Format vProfileFormat = vFormat == "pprof" ? bda::ThriftProfiler::Format::PProf : bda::ThriftProfiler::Format::Folded;
+    const std::chrono::seconds vDuration(vSeconds.empty() ? 10 : std::stoul(vSeconds));
+    if (!bda::ThriftProfiler::supports(vProfileType, vProfileFormat)) {
+        return aRespond(boost::beast::http::status::not_implemented, "text/plain", "This profile is not available in this format.");
+    }
+
+    const std::string vContentType = vProfileFormat == bda::ThriftProfiler::Format::PProf ? "application/octet-stream" : "text/plain";
+    const bool vStarted = aContext.mProfiler->start(vProfileType, vProfileFormat, vDuration, [aRespond, vContentType](const bool aSuccess, std::string aProfile) {
+        if (aSuccess) {
+            aRespond(boost::beast::http::status::ok, vContentType, std::move(aProfile));
+        } else {
+            aRespond(boost::beast::http::status::internal_server_error, "text/plain", "The profile failed.");
+        }
+    });
+    if (!vStarted) {
+        aRespond(boost::beast::http::status::conflict, "text/plain", "Another profile is running.");
+    }
+}
+
+// Returns the response to a profile request
+template<class Body, class Allocator>
+boost::beast::http::response<boost::beast::http::string_body> profile_response(
+    const boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>& aHTTPRequest,
+    const boost::beast::http::status aStatus, const std::string& aContentType, std::string aBody) {
+    boost::beast::http::response<boost::beast::http::string_body> res{ aStatus, aHTTPRequest.version() };
+    res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(boost::beast::http::field::content_type, aContentType);
+    res.set(boost::beast::http::field::cache_control, "no-store");
+    if (aStatus == boost::beast::http::status::unauthorized) {
+        res.set(boost::beast::http::field::www_authenticate, "Bearer");
+    }
+    res.keep_alive(aHTTPRequest.keep_alive());
+    res.body() = std::move(aBody);
+    res.prepare_payload();
+    return res;
+}
+
 // Report a failure
 void fail(const boost::beast::error_code ec, char const* what) {
     // boost::asio::ssl::error::stream_truncated, also known as an SSL
@@ -339,24 +612,115 @@ void fail(const boost::beast::error_code ec, char const* what) {
     std::cerr << what << ": " << ec.message() << "\n";
 }
 
+// Buffers that grew beyond this capacity for a large message are shrunk
+// when they are empty, if there is a memory budget:
+constexpr std::size_t cIdleBufferCapacity = 64 * 1024;
+
+// Returns true if a session may read the next message now. Otherwise aRead
+// is posted to aExecutor once the sessions hold less memory than the budget:
+template<class Executor, class Handler>
+bool admit_read(bda::ThriftSessionContext& aContext, const Executor& aExecutor, Handler aRead) {
+    if (!aContext.mMemoryBudget) {
+        return true;
+    }
+    return aContext.mMemoryBudget->admitRead([aExecutor, aRead]() {
+        boost::asio::post(aExecutor, aRead);
+    });
+}
+
+// Release the memory of an empty buffer that grew for a large message, or
+// of any empty buffer while the sessions hold more memory than the budget,
+// so that the sessions that wait for memory do not hold it:
+void shrink_idle_buffer(const bda::ThriftSessionContext& aContext, boost::beast::flat_buffer& aBuffer) {
+    const bda::ThriftMemoryBudget* vBudget = aContext.mMemoryBudget.get();
+    if (vBudget && aBuffer.size() == 0 && (aBuffer.capacity() > cIdleBufferCapacity || vBudget->used() >= vBudget->limit())) {
+        aBuffer.shrink_to_fit();
+    }
+}
+
 // This uses the Curiously Recurring Template Pattern so that
 // the same code works with both SSL streams and regular sockets.
 template<class Derived>
 class thrift_websocket_session {
     boost::beast::flat_buffer buffer_;
 
-    std::shared_ptr<apache::thrift::protocol::TProtocolFactory> mThriftProtocolFactory;
-    std::shared_ptr<apache::thrift::TProcessor> mThriftProcessor;
+    std::shared_ptr<bda::ThriftSessionContext> mContext;
+
+    // The service on the upgrade path of this connection:
+    std::shared_ptr<bda::ThriftService> mService;
+
+    // The grant of this connection, if the context has an access manager:
+    std::shared_ptr<bda::ThriftSessionAccess> mAccess;
+
+    // The timeout of every call of this connection, or zero for none:
+    std::chrono::milliseconds mCallTimeout{ 0 };
+
+    // The connection and the current message in the trace:
+    bda::ThriftTraceId mTraceId;
 
-    // Construct an in-memory-transport backed by real memory for storing the response.
-    std::shared_ptr<apache::thrift::transport::TTransport> mOutputTransport;
-    std::shared_ptr<apache::thrift::protocol::TProtocol> mOutputProtocol;
+    // The peer, and when the current message was read and its response
+    // started writing, for the slow-call log:
+    std::string mPeer;
+    std::size_t mRequestSize = 0;
+    std::chrono::steady_clock::time_point mReadTime;
+    std::chrono::steady_clock::time_point mWriteStartTime;
+
+    // The response to the current message, and the buffers to send it:
+    bda::ThriftResponse mResponse;
+    std::vector<boost::asio::const_buffer> mOutputBuffers;
+
+    // The responses of the calls of a batch envelope, and the envelope
+    // that is sent back to the client:
+    std::vector<bda::ThriftResponse> mBatchResponses;
+    std::vector<char> mBatchSucceeded;
+    std::string mBatchResponse;
+
+    // The memory of the buffers and the response, if there is a budget:
+    bda::ThriftMemoryReservation mReservation;
 
     // Access the derived class (this is the Curiously Recurring Template Pattern).
     Derived& derived() {
         return static_cast<Derived&>(*this);
     }
 
+    void trace(const bda::ThriftTraceStage aStage) {
+        if (mContext->mTracer) {
+            mContext->mTracer->record(aStage, mTraceId);
+        }
+    }
+
+    // Add the message that was just written to the slow-call log, if it
+    // exceeded the threshold:
+    void record_slow_call(const std::size_t aResponseSize) {
+        const std::chrono::steady_clock::time_point vNow = std::chrono::steady_clock::now();
+        if (vNow - mReadTime < mContext->mSlowCallLog->threshold()) {
+            return;
+        }
+        const auto vMicroseconds = [](const std::chrono::steady_clock::duration aDuration) {
+            return std::chrono::duration_cast<std::chrono::microseconds>(aDuration);
+        };
+        const bool vDispatched = mResponse.mDispatchTime != std::chrono::steady_clock::time_point();
+        const bool vProcessed = mResponse.mProcessStartTime != std::chrono::steady_clock::time_point();
+
+        bda::ThriftSlowCallLog::Entry vEntry;
+        vEntry.mTime = std::chrono::system_clock::now();
+        vEntry.mMethod = mResponse.mMethod;
+        vEntry.mPeer = mPeer;
+        vEntry.mRequestSize = mRequestSize;
+        vEntry.mResponseSize = aResponseSize;
+        vEntry.mTotal = vMicroseconds(vNow - mReadTime);
+        if (vDispatched) {
+            vEntry.mDispatch = vMicroseconds(mResponse.mDispatchTime - mReadTime);
+        }
+        if (vProcessed) {
+            vEntry.mQueue = vMicroseconds(mResponse.mProcessStartTime - mResponse.mDispatchTime);
+            vEntry.mProcess = vMicroseconds(mResponse.mProcessEndTime - mResponse.mProcessStartTime);
+        }
+        vEntry.mRespond = vMicroseconds(mWriteStartTime - (vProcessed ? mResponse.mProcessEndTime : vDispatched ? mResponse.mDispatchTime : mReadTime));
+        vEntry.mWrite = vMicroseconds(vNow - mWriteStartTime);
+        mContext->mSlowCallLog->record(std::move(vEntry));
+    }
+
     // Start the asynchronous operation
     template<class Body, class Allocator>
     void do_accept(const boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>> aHTTPRequest) {
@@ -403,10 +767,18 @@ class thrift_websocket_session {
     }
 
     void do_read() {
+        // Wait while the sessions hold more memory than the budget:
+        shrink_idle_buffer(*mContext, buffer_);
+        mReservation.resize(buffer_.capacity() + mBatchResponse.capacity());
+        auto vSelf = derived().shared_from_this();
+        if (!admit_read(*mContext, derived().ws().get_executor(), [this, vSelf]() { do_read(); })) {
+            BDAMessage(12, "thrift_websocket_session::do_read(): Waiting for memory.\n");
+            return;
+        }
         BDAMessage(12, "thrift_websocket_session::do_read(): Reading websocket message.\n");
 
         // Read a message into our buffer
-        derived().ws().async_read(buffer_, boost::beast::bind_front_handler(&thrift_websocket_session::on_read, derived().shared_from_this()));
+        derived().ws().async_read(buffer_, bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&thrift_websocket_session::on_read, derived().shared_from_this())));
     }
 
     void on_read(const boost::beast::error_code ec, const std::size_t bytes_transferred) {
@@ -420,61 +792,134 @@ class thrift_websocket_session {
 
         if (ec) {
             BDAMessage(2, "thrift_websocket_session::on_read(): Failed to read.\n");
-            fail(ec, "read");
+            return fail(ec, "read");
         }
 
+        ++mTraceId.mMessage;
+        trace(bda::ThriftTraceStage::ReadComplete);
+        if (mContext->mSlowCallLog) {
+            mReadTime = std::chrono::steady_clock::now();
+            mRequestSize = bytes_transferred;
+        }
+        mReservation.resize(buffer_.capacity());
 
-        // Construct a temporary in-memory-transport as a shallow copy of the
-        // input boost::beast::flat_buffer data, to avoid copying the data
+        // The input data is processed in place, without copying it
         boost::beast::flat_buffer::mutable_data_type vBufferData = buffer_.data();
-        std::shared_ptr<apache::thrift::transport::TTransport> vInputTransport;
-        vInputTransport = std::make_shared<apache::thrift::transport::TMemoryBuffer>(reinterpret_cast<uint8_t*>(vBufferData.data()), vBufferData.size());
-        std::shared_ptr<apache::thrift::protocol::TProtocol> vInputProtocol = mThriftProtocolFactory->getProtocol(vInputTransport);
+        const uint8_t* vMessageData = reinterpret_cast<const uint8_t*>(vBufferData.data());
+        const std::size_t vMessageSize = vBufferData.size();
+
+        if (mContext->mTrafficCapture) {
+            mContext->mTrafficCapture->recordMessage(mTraceId.mConnection, vMessageData, vMessageSize, derived().ws().got_binary());
+        }
 
+        const std::chrono::steady_clock::time_point vReceiveTime = std::chrono::steady_clock::now();
+        if (mContext->mBatchEnabled && bda::isBatchEnvelope(vMessageData, vMessageSize)) {
+            return process_batch(vMessageData, vMessageSize, vReceiveTime);
+        }
 
-        /** @todo fixme: Due to issue https://issues.apache.org/jira/browse/THRIFT-5108 we need to re-create the
-         * Transport after every write operation. This is quite inefficient, but how to improve it? We can not
-         * just "clear" the Tranport, and consume() does not free it.
-         */
-        mOutputTransport = std::make_shared<apache::thrift::transport::TMemoryBuffer>();
-        mOutputProtocol = mThriftProtocolFactory->getProtocol(mOutputTransport);
+        // The response may be completed on another thread, e.g. when the
+        // call waits for an identical call, so get back onto our strand:
+        auto vSelf = derived().shared_from_this();
+        bda::dispatchThriftMessage(*mContext, *mService, vMessageData, static_cast<uint32_t>(vMessageSize), vReceiveTime, mCallTimeout, mTraceId, mAccess,
+            [this, vSelf](const bool aSuccess, bda::ThriftResponse aResponse) {
+                boost::asio::dispatch(derived().ws().get_executor(), bda::bindRecyclingAllocator([this, vSelf, aSuccess, aResponse]() {
+                    on_processed(aSuccess, aResponse);
+                }));
+            });
+    }
 
+    void on_processed(const bool aSuccess, const bda::ThriftResponse& aResponse) {
+        if (!aSuccess) {
+            return;
+        }
+        // A oneway call has no answer, and the client does not wait for one:
+        if (aResponse.size() == 0) {
+            BDAMessage(12, "thrift_websocket_session::on_processed(): Processed a oneway call.\n");
+            buffer_.consume(buffer_.size());
+            return do_read();
+        }
+        mResponse = aResponse;
+        BDAMessage(12, "thrift_websocket_session::on_processed(): Generated answer of " + std::to_string(mResponse.size()) + " bytes.\n");
+        mReservation.resize(buffer_.capacity() + mResponse.size());
+
+        mOutputBuffers.clear();
+        mResponse.appendBuffers(mOutputBuffers);
+        trace(bda::ThriftTraceStage::WriteStart);
+        if (mContext->mSlowCallLog) {
+            mWriteStartTime = std::chrono::steady_clock::now();
+        }
+        derived().ws().async_write(mOutputBuffers, bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&thrift_websocket_session::on_write, derived().shared_from_this())));
+    }
 
+    // Process all calls of a batch envelope, either one after the other on
+    // the strand of this session, or concurrently on the server threads.
+    void process_batch(const uint8_t* aData, const std::size_t aSize, const std::chrono::steady_clock::time_point aReceiveTime) {
+        std::vector<std::pair<const uint8_t*, uint32_t>> vMessages;
         try {
-            // Have the thrift processor process the message and respond to it
-            void* vProcessorConnectionContext = nullptr;
-            if (!mThriftProcessor->process(vInputProtocol, mOutputProtocol, vProcessorConnectionContext)) {
-                return;
-            }
-        } catch (const apache::thrift::transport::TTransportException& ttx) {
-            switch (ttx.getType()) {
-                case apache::thrift::transport::TTransportException::END_OF_FILE:
-                case apache::thrift::transport::TTransportException::INTERRUPTED:
-                case apache::thrift::transport::TTransportException::TIMED_OUT:
-                    // Client disconnected or was interrupted or did not respond within the receive timeout.
-                    // No logging needed.  Done.
-                    return;
-                default: {
-                    // All other transport exceptions are logged.
-                    // State of connection is unknown.  Done.
-                    std::cerr << "TConnectedClient died: " << ttx.what() << std::endl;
-                    return;
-                }
-            }
-        } catch (const apache::thrift::TException& tex) {
-            std::cerr << "TConnectedClient processing exception: " << tex.what() << std::endl;
+            bda::parseBatchEnvelope(aData, aSize, vMessages);
+        } catch (const std::exception& vException) {
+            BDAMessage(2, "thrift_websocket_session::process_batch(): " + std::string(vException.what()) + "\n");
+            // The calls of a malformed batch cannot be answered one by one:
+            derived().ws().async_close(boost::beast::websocket::close_code::protocol_error,
+                bda::bindRecyclingAllocator([vSelf = derived().shared_from_this()](const boost::beast::error_code) {}));
             return;
         }
+        BDAMessage(12, "thrift_websocket_session::process_batch(): Received batch of " + std::to_string(vMessages.size()) + " messages.\n");
+
+        mBatchResponses.assign(vMessages.size(), bda::ThriftResponse());
+        mBatchSucceeded.assign(vMessages.size(), 0);
+        if (vMessages.empty()) {
+            return on_batch_processed();
+        }
 
+        // Every call writes only to its own response. The last call to
+        // complete hands the batch back to the strand of this session:
+        auto vPendingMessages = std::make_shared<std::atomic<std::size_t>>(vMessages.size());
+        auto vSelf = derived().shared_from_this();
+        for (std::size_t vIdx = 0; vIdx < vMessages.size(); ++vIdx) {
+            const std::pair<const uint8_t*, uint32_t> vMessage = vMessages[vIdx];
+            auto vDispatch = [this, vSelf, vPendingMessages, vIdx, vMessage, aReceiveTime]() {
+                bda::dispatchThriftMessage(*mContext, *mService, vMessage.first, vMessage.second, aReceiveTime, mCallTimeout, mTraceId, mAccess,
+                    [this, vSelf, vPendingMessages, vIdx](const bool aSuccess, bda::ThriftResponse aResponse) {
+                        mBatchSucceeded[vIdx] = aSuccess;
+                        mBatchResponses[vIdx] = std::move(aResponse);
+                        if (--(*vPendingMessages) == 0) {
+                            boost::asio::dispatch(derived().ws().get_executor(), bda::bindRecyclingAllocator([this, vSelf]() {
+                                on_batch_processed();
+                            }));
+                        }
+                    });
+            };
+
+            if (mContext->mBatchParallel && vMessages.size() > 1) {
+                boost::asio::post(mContext->mWorkExecutor, vDispatch);
+            } else {
+                vDispatch();
+            }
+        }
+    }
+
+    void on_batch_processed() {
+        if (std::find(mBatchSucceeded.begin(), mBatchSucceeded.end(), 0) != mBatchSucceeded.end()) {
+            BDAMessage(2, "thrift_websocket_session::on_batch_processed(): Failed to process a message of the batch.\n");
+            return;
+        }
 
-        // Get the size and pointer to the output buffer. NOTE: We must ask
-        // borrow() for at least one byte, in order for it to work correctly:
-        uint32_t vThriftProcessorOutputSize = 1;
-        const uint8_t* vThriftProcessorOutputPtr = mOutputTransport->borrow(nullptr, &vThriftProcessorOutputSize);
-        BDAMessage(12, "thrift_websocket_session::on_read(): Generated answer of " + std::to_string(vThriftProcessorOutputSize) + " bytes.\n");
+        bda::beginBatchEnvelope(mBatchResponse, static_cast<uint32_t>(mBatchResponses.size()));
+        for (const bda::ThriftResponse& vResponse : mBatchResponses) {
+            bda::appendBatchEnvelopeSize(mBatchResponse, static_cast<uint32_t>(vResponse.size()));
+            vResponse.appendTo(mBatchResponse);
+        }
+        mBatchResponses.clear();
+        BDAMessage(12, "thrift_websocket_session::on_batch_processed(): Generated batch answer of " + std::to_string(mBatchResponse.size()) + " bytes.\n");
+        mReservation.resize(buffer_.capacity() + mBatchResponse.capacity());
+        trace(bda::ThriftTraceStage::WriteStart);
+        if (mContext->mSlowCallLog) {
+            mResponse.mMethod = "batch of " + std::to_string(mBatchSucceeded.size()) + " calls";
+            mWriteStartTime = std::chrono::steady_clock::now();
+        }
 
-        ::boost::asio::const_buffer vOutputBufferWrapper(vThriftProcessorOutputPtr, vThriftProcessorOutputSize);
-        derived().ws().async_write(vOutputBufferWrapper, boost::beast::bind_front_handler(&thrift_websocket_session::on_write, derived().shared_from_this()));
+        derived().ws().async_write(boost::asio::buffer(mBatchResponse), bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&thrift_websocket_session::on_write, derived().shared_from_this())));
     }
 
     void on_write(const boost::beast::error_code ec, const std::size_t bytes_transferred) {
@@ -484,46 +929,87 @@ class thrift_websocket_session {
             BDAMessage(2, "thrift_websocket_session::on_write(): Failed to write.\n");
             return fail(ec, "write");
         }
+        trace(bda::ThriftTraceStage::WriteComplete);
+        if (mContext->mSlowCallLog) {
+            record_slow_call(bytes_transferred);
+        }
 
         // Clear the input buffer:
         buffer_.consume(buffer_.size());
 
         // Clear the output buffer:
-        mOutputProtocol.reset();
-        mOutputTransport.reset();
+        mResponse.reset();
+        mOutputBuffers.clear();
+        mBatchResponse.clear();
+        if (mContext->mMemoryBudget && mBatchResponse.capacity() > cIdleBufferCapacity) {
+            mBatchResponse.shrink_to_fit();
+        }
 
         // Do another read
         do_read();
     }
 
 public:
-    // Start the asynchronous operation
+    ~thrift_websocket_session() {
+        if (mService) {
+            mService->releaseConnection();
+        }
+        if (mContext && mContext->mTrafficCapture) {
+            mContext->mTrafficCapture->recordClose(mTraceId.mConnection);
+        }
+    }
+
+    // Start the asynchronous operation. The connection must already be
+    // counted by the service, and authenticated if there is an access manager.
     template<class Body, class Allocator>
     void run(boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>> aHTTPRequest,
-             std::shared_ptr<apache::thrift::protocol::TProtocolFactory> aThriftProtocolFactory,
-             std::shared_ptr<apache::thrift::TProcessor> aThriftProcessor) {
-        mThriftProtocolFactory = aThriftProtocolFactory;
-        mThriftProcessor = aThriftProcessor;
+             std::shared_ptr<bda::ThriftSessionContext> aContext, std::shared_ptr<bda::ThriftService> aService,
+             std::shared_ptr<bda::ThriftSessionAccess> aAccess) {
+        mContext = aContext;
+        mService = aService;
+        mAccess = aAccess;
+        mReservation = bda::ThriftMemoryReservation(mContext->mMemoryBudget);
+        if (mContext->mTracer || mContext->mTrafficCapture) {
+            mTraceId.mConnection = mContext->mNextConnectionId++;
+        }
+        if (mContext->mTrafficCapture) {
+            mContext->mTrafficCapture->recordOpen(mTraceId.mConnection, std::string(aHTTPRequest.target()), mContext->mProtocolType);
+        }
+        if (mContext->mSlowCallLog) {
+            boost::beast::error_code ec;
+            std::ostringstream vPeer;
+            vPeer << boost::beast::get_lowest_layer(derived().ws()).socket().remote_endpoint(ec);
+            mPeer = vPeer.str();
+        }
+
+        // The client may set a timeout for all calls of this connection:
+        const auto vCallTimeoutIt = aHTTPRequest.find(bda::cCallTimeoutHeader);
+        if (mContext->mDeadlinesEnabled && vCallTimeoutIt != aHTTPRequest.end()) {
+            if (!bda::parseCallTimeout(std::string(vCallTimeoutIt->value()), mCallTimeout)) {
+                BDAMessage(2, "thrift_websocket_session::run(): Ignoring invalid " + std::string(bda::cCallTimeoutHeader) + " header.\n");
+            }
+        }
 
         // Accept the WebSocket upgrade request
         do_accept(std::move(aHTTPRequest));
     }
 };
 
-// Handles a plain WebSocket connection
+// Handles a plain WebSocket connection, over TCP or a local socket
+template<class Stream>
 class plain_websocket_session
-    : public thrift_websocket_session<plain_websocket_session>,
-      public std::enable_shared_from_this<plain_websocket_session> {
-    boost::beast::websocket::stream<boost::beast::tcp_stream> ws_;
+    : public thrift_websocket_session<plain_websocket_session<Stream>>,
+      public std::enable_shared_from_this<plain_websocket_session<Stream>> {
+    boost::beast::websocket::stream<Stream> ws_;
 
 public:
     // Create the session
-    explicit plain_websocket_session(boost::beast::tcp_stream&& stream)
+    explicit plain_websocket_session(Stream&& stream)
         : ws_(std::move(stream)) {
     }
 
     // Called by the base class
-    boost::beast::websocket::stream<boost::beast::tcp_stream>& ws() {
+    boost::beast::websocket::stream<Stream>& ws() {
         return ws_;
     }
 };
@@ -546,144 +1032,759 @@ public:
     }
 };
 
-// Handles an HTTP server connection.
-// This uses the Curiously Recurring Template Pattern so that
-// the same code works with both SSL streams and regular sockets.
-template<class Derived>
-class http_session {
-    // Access the derived class, this is part of
-    // the Curiously Recurring Template Pattern idiom.
-    Derived& derived() {
-        return static_cast<Derived&>(*this);
+#if defined(BDA_HAS_HTTP2)
+
+// The connection preface of HTTP/2 clients, which h2c clients with prior
+// knowledge send instead of an HTTP/1.1 request:
+constexpr char cHTTP2Preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr std::size_t cHTTP2PrefaceSize = sizeof(cHTTP2Preface) - 1;
+
+// Select h2 if the client offers it, otherwise http/1.1 (ALPN, RFC 7301)
+int select_alpn_protocol(SSL*, const unsigned char** out, unsigned char* outlen,
+                         const unsigned char* in, unsigned int inlen, void*) {
+    const unsigned char* vHTTP1 = nullptr;
+    for (unsigned int vOffset = 0; vOffset < inlen; vOffset += 1 + in[vOffset]) {
+        const boost::beast::string_view vProtocol(reinterpret_cast<const char*>(in + vOffset + 1), std::min<unsigned int>(in[vOffset], inlen - vOffset - 1));
+        if (vProtocol == "h2") {
+            *out = in + vOffset + 1;
+            *outlen = in[vOffset];
+            return SSL_TLSEXT_ERR_OK;
+        }
+        if (vProtocol == "http/1.1") {
+            vHTTP1 = in + vOffset;
+        }
     }
+    if (vHTTP1) {
+        *out = vHTTP1 + 1;
+        *outlen = vHTTP1[0];
+        return SSL_TLSEXT_ERR_OK;
+    }
+    return SSL_TLSEXT_ERR_NOACK;
+}
 
-    // This queue is used for HTTP pipelining.
-    class queue {
-        enum {
-            // Maximum number of responses we will queue
-            limit = 8
-        };
+// Returns true if ALPN selected h2 during the handshake of the stream
+bool is_http2_negotiated(boost::beast::ssl_stream<boost::beast::tcp_stream>& stream) {
+    const unsigned char* vProtocol = nullptr;
+    unsigned int vProtocolSize = 0;
+    SSL_get0_alpn_selected(stream.native_handle(), &vProtocol, &vProtocolSize);
+    return vProtocolSize == 2 && vProtocol[0] == 'h' && vProtocol[1] == '2';
+}
 
-        // The type-erased, saved work item
-        struct work {
-            virtual ~work() = default;
-            virtual void operator()() = 0;
-        };
+// Handles an HTTP/2 connection over TLS or plain TCP. The nghttp2 session
+// does the framing, HPACK and flow control, and every request stream is
+// answered on its own, so that a slow response does not block the others.
+// Files are served like over HTTP/1.1, and POST requests are thrift calls
+// to the service of their path.
+template<class Stream>
+class http2_session : public std::enable_shared_from_this<http2_session<Stream>> {
+    // The state of a request stream:
+    struct stream_state {
+        std::string method_;
+        std::string path_;
+        std::string call_timeout_;
+        std::string authorization_;
+        std::string cookies_;
+        std::shared_ptr<std::string> request_body_ = std::make_shared<std::string>();
+        std::string response_body_;
+        boost::beast::http::file_body::value_type response_file_;
+        std::size_t response_offset_ = 0;
+
+        // The memory of the bodies, if there is a budget:
+        bda::ThriftMemoryReservation reservation_;
+
+        // Counts the stream until it is closed, for drain():
+        bda::ThriftRequestGuard request_;
+    };
 
-        http_session& self_;
-        std::vector<std::unique_ptr<work>> items_;
+    // Receives the responses that handle_request() produces for a stream
+    struct sender {
+        http2_session& self_;
+        int32_t stream_id_;
 
-    public:
-        explicit queue(http_session& self)
-            : self_(self) {
-            static_assert(limit > 0, "queue limit must be positive");
-            items_.reserve(limit);
+        template<bool isRequest, class Body, class Fields>
+        void operator()(boost::beast::http::message<isRequest, Body, Fields>&& msg) {
+            self_.submit_response(stream_id_, msg.result_int(), headers_of(msg), body_of(msg));
         }
 
-        // Returns true if we have reached the queue limit
-        bool is_full() const {
-            return items_.size() >= limit;
+        // Files are streamed from disk instead of being read into memory
+        template<bool isRequest, class Fields>
+        void operator()(boost::beast::http::message<isRequest, boost::beast::http::file_body, Fields>&& msg) {
+            self_.submit_response(stream_id_, msg.result_int(), headers_of(msg), std::move(msg.body()));
         }
 
-        // Called when a message finishes sending
-        // Returns true if the caller should initiate a read
-        bool on_write() {
-            BOOST_ASSERT(!items_.empty());
-            auto const was_full = is_full();
-            items_.erase(items_.begin());
-            if (!items_.empty()) {
-                (*items_.front())();
+#if defined(BOOST_ASIO_HAS_IO_URING)
+        void send_file(std::string path, boost::beast::http::response<boost::beast::http::vector_body<char>>&& msg) {
+            boost::beast::error_code ec;
+            boost::beast::file vFile;
+            vFile.open(path.c_str(), boost::beast::file_mode::scan, ec);
+            if (!ec) {
+                vFile.read(msg.body().data(), msg.body().size(), ec);
             }
-            return was_full;
+            if (ec) {
+                msg.result(boost::beast::http::status::internal_server_error);
+                msg.body().clear();
+                msg.prepare_payload();
+            }
+            (*this)(std::move(msg));
         }
+#endif
 
-        // Called by the HTTP handler to send a response.
         template<bool isRequest, class Body, class Fields>
-        void operator()(boost::beast::http::message<isRequest, Body, Fields>&& msg) {
-            // This holds a work item
-            struct work_impl : work {
-                http_session& self_;
-                boost::beast::http::message<isRequest, Body, Fields> msg_;
+        static std::vector<std::pair<std::string, std::string>> headers_of(const boost::beast::http::message<isRequest, Body, Fields>& msg) {
+            std::vector<std::pair<std::string, std::string>> vHeaders;
+            for (const auto& vField : msg) {
+                vHeaders.emplace_back(std::string(vField.name_string()), std::string(vField.value()));
+            }
+            return vHeaders;
+        }
 
-                work_impl(http_session& self, boost::beast::http::message<isRequest, Body, Fields>&& msg)
-                    : self_(self), msg_(std::move(msg)) {
-                }
+        template<bool isRequest, class Fields>
+        static std::string body_of(boost::beast::http::message<isRequest, boost::beast::http::string_body, Fields>& msg) {
+            return std::move(msg.body());
+        }
 
-                void operator()() {
-                    boost::beast::http::async_write(
-                        self_.derived().stream(),
-                        msg_,
-                        boost::beast::bind_front_handler(
-                            &http_session::on_write,
-                            self_.derived().shared_from_this(),
-                            msg_.need_eof()));
-                }
-            };
+        template<bool isRequest, class Fields>
+        static std::string body_of(boost::beast::http::message<isRequest, boost::beast::http::empty_body, Fields>&) {
+            return std::string();
+        }
 
-            // Allocate and store the work
-            items_.push_back(boost::make_unique<work_impl>(self_, std::move(msg)));
+        template<bool isRequest, class Fields>
+        static std::string body_of(boost::beast::http::message<isRequest, boost::beast::http::vector_body<char>, Fields>& msg) {
+            return std::string(msg.body().begin(), msg.body().end());
+        }
 
-            // If there was no previous work, start this one
-            if (items_.size() == 1) {
-                (*items_.front())();
-            }
+        template<bool isRequest, class Fields>
+        static std::string body_of(boost::beast::http::message<isRequest, boost::beast::http::span_body<char const>, Fields>& msg) {
+            return std::string(msg.body().data(), msg.body().size());
         }
     };
 
-    const std::string& mHTTPDocumentRoot;
-    queue queue_;
-
-    // The parser is stored in an optional container so we can
-    // construct it from scratch at the beginning of each new message.
-    boost::optional<boost::beast::http::request_parser<boost::beast::http::string_body>> parser_;
-
-protected:
+    Stream stream_;
     boost::beast::flat_buffer buffer_;
+    std::string write_buffer_;
+    bool writing_ = false;
 
-    std::shared_ptr<apache::thrift::protocol::TProtocolFactory> mThriftProtocolFactory;
-    std::shared_ptr<apache::thrift::TProcessor> mThriftProcessor;
+    std::shared_ptr<bda::ThriftSessionContext> mContext;
+    nghttp2_session* mSession = nullptr;
+    std::map<int32_t, stream_state> mStreams;
 
-    template<class Body, class Allocator>
-    void make_websocket_session(boost::beast::tcp_stream stream,
-                                boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>> aHTTPRequest) {
-        std::make_shared<plain_websocket_session>(std::move(stream))->run(std::move(aHTTPRequest), mThriftProtocolFactory, mThriftProcessor);
+public:
+    // Take ownership of the stream, and of the bytes already read from it
+    http2_session(Stream&& stream, boost::beast::flat_buffer&& buffer, std::shared_ptr<bda::ThriftSessionContext> aContext)
+        : stream_(std::move(stream)), buffer_(std::move(buffer)), mContext(aContext) {
     }
 
-    template<class Body, class Allocator>
-    void make_websocket_session(boost::beast::ssl_stream<boost::beast::tcp_stream> stream,
-                                boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>> aHTTPRequest) {
-        std::make_shared<ssl_websocket_session>(std::move(stream))->run(std::move(aHTTPRequest), mThriftProtocolFactory, mThriftProcessor);
+    ~http2_session() {
+        if (mSession) {
+            nghttp2_session_del(mSession);
+        }
     }
 
-public:
-    // Construct the session
-    http_session(boost::beast::flat_buffer buffer, const std::string& aHTTPDocumentRoot,
-                 std::shared_ptr<apache::thrift::protocol::TProtocolFactory> aThriftProtocolFactory,
-                 std::shared_ptr<apache::thrift::TProcessor> aThriftProcessor)
-        : mHTTPDocumentRoot(aHTTPDocumentRoot), queue_(*this), buffer_(std::move(buffer)) {
-        mThriftProtocolFactory = aThriftProtocolFactory;
-        mThriftProcessor = aThriftProcessor;
+    void run() {
+        nghttp2_session_callbacks* vCallbacks = nullptr;
+        nghttp2_session_callbacks_new(&vCallbacks);
+        nghttp2_session_callbacks_set_on_begin_headers_callback(vCallbacks, &http2_session::on_begin_headers);
+        nghttp2_session_callbacks_set_on_header_callback(vCallbacks, &http2_session::on_header);
+        nghttp2_session_callbacks_set_on_data_chunk_recv_callback(vCallbacks, &http2_session::on_data_chunk_recv);
+        nghttp2_session_callbacks_set_on_frame_recv_callback(vCallbacks, &http2_session::on_frame_recv);
+        nghttp2_session_callbacks_set_on_stream_close_callback(vCallbacks, &http2_session::on_stream_close);
+        const int vResult = nghttp2_session_server_new(&mSession, vCallbacks, this);
+        nghttp2_session_callbacks_del(vCallbacks);
+        if (vResult != 0) {
+            BDAMessage(2, "http2_session::run(): Could not create the HTTP/2 session: '" + std::string(nghttp2_strerror(vResult)) + "'.\n");
+            mSession = nullptr;
+            return;
+        }
+
+        const nghttp2_settings_entry vSettings[] = { { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 100 } };
+        nghttp2_submit_settings(mSession, NGHTTP2_FLAG_NONE, vSettings, sizeof(vSettings) / sizeof(vSettings[0]));
+
+        // The detection of the protocol may already have read the preface:
+        on_read(boost::beast::error_code(), 0);
     }
 
+private:
     void do_read() {
-        // Construct a new parser for each message
-        parser_.emplace();
-
-        // Apply a reasonable limit to the allowed size
-        // of the body in bytes to prevent abuse.
-        parser_->body_limit(11 * 1024 * 1024);
+        // Wait while the sessions hold more memory than the budget:
+        auto vSelf = this->shared_from_this();
+        if (!admit_read(*mContext, stream_.get_executor(), [this, vSelf]() { do_read(); })) {
+            return;
+        }
+        boost::beast::get_lowest_layer(stream_).expires_after(std::chrono::seconds(300));
+        stream_.async_read_some(buffer_.prepare(16384), bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&http2_session::on_read, this->shared_from_this())));
+    }
 
-        // Set the timeout.
-        boost::beast::get_lowest_layer(derived().stream()).expires_after(std::chrono::seconds(300));
+    void on_read(const boost::beast::error_code ec, std::size_t bytes_transferred) {
+        if (ec) {
+            return fail(ec, "read");
+        }
+        buffer_.commit(bytes_transferred);
+
+        const auto vBufferData = buffer_.data();
+        const ssize_t vConsumed = nghttp2_session_mem_recv(mSession, static_cast<const uint8_t*>(vBufferData.data()), vBufferData.size());
+        if (vConsumed < 0) {
+            BDAMessage(2, "http2_session::on_read(): Closing the connection: '" + std::string(nghttp2_strerror(static_cast<int>(vConsumed))) + "'.\n");
+            return;
+        }
+        buffer_.consume(buffer_.size());
+
+        do_write();
+        if (nghttp2_session_want_read(mSession)) {
+            do_read();
+        }
+    }
+
+    void do_write() {
+        if (writing_) {
+            return;
+        }
+
+        // Collect the pending frames into a single write:
+        write_buffer_.clear();
+        while (write_buffer_.size() < 65536) {
+            const uint8_t* vData = nullptr;
+            const ssize_t vSize = nghttp2_session_mem_send(mSession, &vData);
+            if (vSize <= 0) {
+                break;
+            }
+            write_buffer_.append(reinterpret_cast<const char*>(vData), static_cast<std::size_t>(vSize));
+        }
+        if (write_buffer_.empty()) {
+            return;
+        }
+
+        writing_ = true;
+        boost::asio::async_write(stream_, boost::asio::buffer(write_buffer_), bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&http2_session::on_write, this->shared_from_this())));
+    }
+
+    void on_write(const boost::beast::error_code ec, std::size_t) {
+        writing_ = false;
+        if (ec) {
+            return fail(ec, "write");
+        }
+        do_write();
+    }
+
+    // Answer a stream whose request is complete
+    void handle_stream(const int32_t aStreamId) {
+        const auto vStreamIt = mStreams.find(aStreamId);
+        if (vStreamIt == mStreams.end()) {
+            return;
+        }
+        stream_state& vStream = vStreamIt->second;
+
+        if (vStream.method_ == "POST") {
+            return handle_thrift_call(aStreamId, vStream);
+        }
+
+        // Serve files exactly like HTTP/1.1 does:
+        boost::beast::http::request<boost::beast::http::string_body> vRequest;
+        vRequest.method_string(vStream.method_);
+        vRequest.target(vStream.path_);
+        vRequest.version(11);
+        vRequest.keep_alive(true);
+        const boost::beast::string_view vPath = boost::beast::string_view(vStream.path_).substr(0, vStream.path_.find('?'));
+        if (mContext->mProfiler && vPath == mContext->mProfilerPath && vStream.method_ == "GET") {
+            return handle_profile(aStreamId, vStream);
+        }
+        const auto vEndpointIt = mContext->mJSONEndpoints.find(std::string(vPath));
+        if (vEndpointIt != mContext->mJSONEndpoints.end() && vRequest.method() == boost::beast::http::verb::get) {
+            const std::string vToken = mContext->mAccessManager
+                ? find_access_token(vStream.authorization_, vStream.cookies_, mContext->mAccessManager->tokenCookie())
+                : std::string();
+            if (!is_diagnostics_permitted(*mContext, vEndpointIt->first, vToken)) {
+                return sender{ *this, aStreamId }(profile_response(vRequest, boost::beast::http::status::unauthorized, "text/plain",
+                                                                   "The access token does not permit this endpoint."));
+            }
+            return sender{ *this, aStreamId }(json_response(vRequest, vEndpointIt->second()));
+        }
+        handle_request(*mContext, std::move(vRequest), sender{ *this, aStreamId });
+    }
+
+    // Answer a profile request when the profile is complete
+    void handle_profile(const int32_t aStreamId, stream_state& aStream) {
+        const std::string vToken = mContext->mAccessManager
+            ? find_access_token(aStream.authorization_, aStream.cookies_, mContext->mAccessManager->tokenCookie())
+            : std::string();
+        auto vSelf = this->shared_from_this();
+        bda::ThriftRequestGuard vRequest(mContext);
+        start_profile(*mContext, aStream.path_, vToken,
+            [this, vSelf, vRequest, aStreamId](const boost::beast::http::status aStatus, std::string aContentType, std::string aBody) {
+                auto vBody = std::make_shared<std::string>(std::move(aBody));
+                boost::asio::post(stream_.get_executor(), [this, vSelf, aStreamId, aStatus, aContentType, vBody]() {
+                    std::vector<std::pair<std::string, std::string>> vHeaders;
+                    vHeaders.emplace_back("content-type", aContentType);
+                    vHeaders.emplace_back("cache-control", "no-store");
+                    vHeaders.emplace_back("content-length", std::to_string(vBody->size()));
+                    submit_response(aStreamId, static_cast<unsigned>(aStatus), std::move(vHeaders), std::move(*vBody));
+                    do_write();
+                });
+            });
+    }
+
+    // Dispatch the body of a POST request as a thrift message to the
+    // service of the path, and respond with the serialized response
+    void handle_thrift_call(const int32_t aStreamId, stream_state& aStream) {
+        std::shared_ptr<bda::ThriftService> vService = mContext->findService(aStream.path_);
+        const std::chrono::steady_clock::time_point vReceiveTime = std::chrono::steady_clock::now();
+        std::chrono::milliseconds vCallTimeout(0);
+        if (mContext->mDeadlinesEnabled && !aStream.call_timeout_.empty() && !bda::parseCallTimeout(aStream.call_timeout_, vCallTimeout)) {
+            BDAMessage(2, "http2_session::handle_thrift_call(): Ignoring invalid " + std::string(bda::cCallTimeoutHeader) + " header.\n");
+        }
+
+        // Every request is authenticated with its own token, which is cheap
+        // once the access manager cached its grant:
+        std::shared_ptr<bda::ThriftSessionAccess> vAccess;
+        if (mContext->mAccessManager) {
+            const std::string vToken = find_access_token(aStream.authorization_, aStream.cookies_, mContext->mAccessManager->tokenCookie());
+            std::shared_ptr<const bda::ThriftAccessGrant> vGrant = mContext->mAccessManager->authenticate(vToken);
+            if (!vToken.empty() && !vGrant) {
+                BDAMessage(2, "http2_session::handle_thrift_call(): Rejecting a request to '" + aStream.path_ + "', the access token is not valid.\n");
+                std::vector<std::pair<std::string, std::string>> vHeaders;
+                vHeaders.emplace_back("www-authenticate", "Bearer");
+                vHeaders.emplace_back("content-length", "0");
+                return submit_response(aStreamId, 401, std::move(vHeaders), std::string());
+            }
+            vAccess = std::make_shared<bda::ThriftSessionAccess>(std::move(vGrant));
+        }
+
+        // The handler keeps the request body and this session alive, and
+        // gets back onto the strand of this session. It counts the call
+        // until it completed, even if the client reset the stream:
+        auto vSelf = this->shared_from_this();
+        std::shared_ptr<std::string> vRequestBody = aStream.request_body_;
+        bda::ThriftRequestGuard vRequest(mContext);
+        bda::dispatchThriftMessage(*mContext, *vService, reinterpret_cast<const uint8_t*>(vRequestBody->data()),
+                                   static_cast<uint32_t>(vRequestBody->size()), vReceiveTime, vCallTimeout, bda::ThriftTraceId(), vAccess,
+            [this, vSelf, vRequestBody, vRequest, aStreamId](const bool aSuccess, bda::ThriftResponse aResponse) {
+                boost::asio::dispatch(stream_.get_executor(), bda::bindRecyclingAllocator([this, vSelf, aStreamId, aSuccess, aResponse]() {
+                    std::string vBody;
+                    aResponse.appendTo(vBody);
+                    std::vector<std::pair<std::string, std::string>> vHeaders;
+                    vHeaders.emplace_back("content-type", "application/x-thrift");
+                    vHeaders.emplace_back("content-length", std::to_string(vBody.size()));
+                    submit_response(aStreamId, aSuccess ? 200 : 500, std::move(vHeaders), aSuccess ? std::move(vBody) : std::string());
+                    do_write();
+                }));
+            });
+    }
+
+    void submit_response(const int32_t aStreamId, const unsigned aStatus,
+                         std::vector<std::pair<std::string, std::string>> aHeaders, std::string aBody) {
+        // The stream may have been reset by the client in the meantime:
+        const auto vStreamIt = mStreams.find(aStreamId);
+        if (vStreamIt == mStreams.end()) {
+            return;
+        }
+        vStreamIt->second.response_body_ = std::move(aBody);
+        vStreamIt->second.response_offset_ = 0;
+        vStreamIt->second.reservation_.resize(vStreamIt->second.request_body_->size() + vStreamIt->second.response_body_.size());
+        submit_headers(aStreamId, aStatus, std::move(aHeaders), !vStreamIt->second.response_body_.empty());
+    }
+
+    // The data provider reads the file in chunks as far as flow control
+    // allows, so a large file does not take memory
+    void submit_response(const int32_t aStreamId, const unsigned aStatus,
+                         std::vector<std::pair<std::string, std::string>> aHeaders, boost::beast::http::file_body::value_type aFile) {
+        const auto vStreamIt = mStreams.find(aStreamId);
+        if (vStreamIt == mStreams.end()) {
+            return;
+        }
+        vStreamIt->second.response_file_ = std::move(aFile);
+        vStreamIt->second.response_offset_ = 0;
+        vStreamIt->second.reservation_.resize(vStreamIt->second.request_body_->size());
+        submit_headers(aStreamId, aStatus, std::move(aHeaders), vStreamIt->second.response_file_.size() > 0);
+    }
+
+    void submit_headers(const int32_t aStreamId, const unsigned aStatus,
+                        std::vector<std::pair<std::string, std::string>> aHeaders, const bool aHasBody) {
+        // HTTP/2 header names are lowercase, and there are no
+        // connection-specific headers:
+        const std::string vStatus = std::to_string(aStatus);
+        std::vector<nghttp2_nv> vNameValues;
+        vNameValues.push_back(make_nv(":status", vStatus));
+        for (std::pair<std::string, std::string>& vHeader : aHeaders) {
+            std::transform(vHeader.first.begin(), vHeader.first.end(), vHeader.first.begin(), [](const char aChar) {
+                return static_cast<char>(std::tolower(static_cast<unsigned char>(aChar)));
+            });
+            if (vHeader.first == "connection" || vHeader.first == "keep-alive" || vHeader.first == "transfer-encoding" ||
+                vHeader.first == "upgrade" || vHeader.first == "proxy-connection") {
+                continue;
+            }
+            vNameValues.push_back(make_nv(vHeader.first, vHeader.second));
+        }
+
+        nghttp2_data_provider vDataProvider;
+        vDataProvider.source.ptr = nullptr;
+        vDataProvider.read_callback = &http2_session::on_data_source_read;
+        nghttp2_submit_response(mSession, aStreamId, vNameValues.data(), vNameValues.size(), aHasBody ? &vDataProvider : nullptr);
+    }
+
+    static nghttp2_nv make_nv(const std::string& aName, const std::string& aValue) {
+        // nghttp2 copies the names and values when the response is submitted
+        nghttp2_nv vNameValue;
+        vNameValue.name = reinterpret_cast<uint8_t*>(const_cast<char*>(aName.data()));
+        vNameValue.value = reinterpret_cast<uint8_t*>(const_cast<char*>(aValue.data()));
+        vNameValue.namelen = aName.size();
+        vNameValue.valuelen = aValue.size();
+        vNameValue.flags = NGHTTP2_NV_FLAG_NONE;
+        return vNameValue;
+    }
+
+    static int on_begin_headers(nghttp2_session*, const nghttp2_frame* frame, void* user_data) {
+        if (frame->hd.type == NGHTTP2_HEADERS && frame->headers.cat == NGHTTP2_HCAT_REQUEST) {
+            http2_session& self = *static_cast<http2_session*>(user_data);
+            stream_state& vStream = self.mStreams[frame->hd.stream_id];
+            vStream.reservation_ = bda::ThriftMemoryReservation(self.mContext->mMemoryBudget);
+            vStream.request_ = bda::ThriftRequestGuard(self.mContext);
+        }
+        return 0;
+    }
+
+    static int on_header(nghttp2_session*, const nghttp2_frame* frame, const uint8_t* name, size_t namelen,
+                         const uint8_t* value, size_t valuelen, uint8_t, void* user_data) {
+        http2_session& self = *static_cast<http2_session*>(user_data);
+        const auto vStreamIt = self.mStreams.find(frame->hd.stream_id);
+        if (frame->hd.type != NGHTTP2_HEADERS || vStreamIt == self.mStreams.end()) {
+            return 0;
+        }
+        const boost::beast::string_view vName(reinterpret_cast<const char*>(name), namelen);
+        const std::string vValue(reinterpret_cast<const char*>(value), valuelen);
+        if (vName == ":method") {
+            vStreamIt->second.method_ = vValue;
+        } else if (vName == ":path") {
+            vStreamIt->second.path_ = vValue;
+        } else if (boost::beast::iequals(vName, bda::cCallTimeoutHeader)) {
+            vStreamIt->second.call_timeout_ = vValue;
+        } else if (vName == "authorization") {
+            vStreamIt->second.authorization_ = vValue;
+        } else if (vName == "cookie") {
+            // HTTP/2 clients may split the cookies into several headers:
+            std::string& vCookies = vStreamIt->second.cookies_;
+            vCookies.append(vCookies.empty() ? "" : "; ").append(vValue);
+        }
+        return 0;
+    }
+
+    static int on_data_chunk_recv(nghttp2_session* session, uint8_t, int32_t stream_id, const uint8_t* data, size_t len, void* user_data) {
+        http2_session& self = *static_cast<http2_session*>(user_data);
+        const auto vStreamIt = self.mStreams.find(stream_id);
+        if (vStreamIt == self.mStreams.end()) {
+            return 0;
+        }
+
+        // Apply the same body limit as HTTP/1.1:
+        std::string& vBody = *vStreamIt->second.request_body_;
+        if (vBody.size() + len > 11 * 1024 * 1024) {
+            nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_REFUSED_STREAM);
+            self.mStreams.erase(vStreamIt);
+            return 0;
+        }
+        vBody.append(reinterpret_cast<const char*>(data), len);
+        vStreamIt->second.reservation_.resize(vBody.size());
+        return 0;
+    }
+
+    static int on_frame_recv(nghttp2_session*, const nghttp2_frame* frame, void* user_data) {
+        if ((frame->hd.type == NGHTTP2_HEADERS || frame->hd.type == NGHTTP2_DATA) && (frame->hd.flags & NGHTTP2_FLAG_END_STREAM)) {
+            static_cast<http2_session*>(user_data)->handle_stream(frame->hd.stream_id);
+        }
+        return 0;
+    }
+
+    static int on_stream_close(nghttp2_session*, int32_t stream_id, uint32_t, void* user_data) {
+        static_cast<http2_session*>(user_data)->mStreams.erase(stream_id);
+        return 0;
+    }
+
+    // Copy the next part of the response body, as far as flow control allows
+    static ssize_t on_data_source_read(nghttp2_session*, int32_t stream_id, uint8_t* buf, size_t length,
+                                       uint32_t* data_flags, nghttp2_data_source*, void* user_data) {
+        http2_session& self = *static_cast<http2_session*>(user_data);
+        const auto vStreamIt = self.mStreams.find(stream_id);
+        if (vStreamIt == self.mStreams.end()) {
+            return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+        }
+        stream_state& vStream = vStreamIt->second;
+        if (vStream.response_file_.is_open()) {
+            // A file that fails to read resets the stream:
+            const std::size_t vFileSize = static_cast<std::size_t>(vStream.response_file_.size());
+            boost::beast::error_code ec;
+            const std::size_t vSize = vStream.response_file_.file().read(buf, std::min(length, vFileSize - vStream.response_offset_), ec);
+            if (ec || (vSize == 0 && vStream.response_offset_ < vFileSize)) {
+                return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+            }
+            vStream.response_offset_ += vSize;
+            if (vStream.response_offset_ == vFileSize) {
+                *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+            }
+            return static_cast<ssize_t>(vSize);
+        }
+
+        const std::size_t vSize = std::min(length, vStream.response_body_.size() - vStream.response_offset_);
+        std::memcpy(buf, vStream.response_body_.data() + vStream.response_offset_, vSize);
+        vStream.response_offset_ += vSize;
+        if (vStream.response_offset_ == vStream.response_body_.size()) {
+            *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+        }
+        return static_cast<ssize_t>(vSize);
+    }
+};
+
+#endif
+
+// Handles an HTTP server connection.
+// This uses the Curiously Recurring Template Pattern so that
+// the same code works with both SSL streams and regular sockets.
+template<class Derived>
+class http_session {
+    // Access the derived class, this is part of
+    // the Curiously Recurring Template Pattern idiom.
+    Derived& derived() {
+        return static_cast<Derived&>(*this);
+    }
+
+    // This queue is used for HTTP pipelining.
+    class queue {
+        enum {
+            // Maximum number of responses we will queue
+            limit = 8
+        };
+
+        // The type-erased, saved work item
+        struct work {
+            // The request that this is the response to, in the trace:
+            bda::ThriftTraceId trace_id_;
+
+            // Counts the response until it was written, for drain():
+            bda::ThriftRequestGuard request_;
+
+            virtual ~work() = default;
+            virtual void operator()() = 0;
+        };
+
+        http_session& self_;
+        std::vector<std::unique_ptr<work>> items_;
+
+    public:
+        explicit queue(http_session& self)
+            : self_(self) {
+            static_assert(limit > 0, "queue limit must be positive");
+            items_.reserve(limit);
+        }
+
+        // Returns true if we have reached the queue limit
+        bool is_full() const {
+            return items_.size() >= limit;
+        }
+
+        // Called when a message finishes sending
+        // Returns true if the caller should initiate a read
+        bool on_write() {
+            BOOST_ASSERT(!items_.empty());
+            self_.trace(bda::ThriftTraceStage::WriteComplete, items_.front()->trace_id_);
+            auto const was_full = is_full();
+            items_.erase(items_.begin());
+            if (!items_.empty()) {
+                (*items_.front())();
+            }
+            return was_full;
+        }
+
+        // Called by the HTTP handler to send a response.
+        template<bool isRequest, class Body, class Fields>
+        void operator()(boost::beast::http::message<isRequest, Body, Fields>&& msg) {
+            // This holds a work item
+            struct work_impl : work {
+                http_session& self_;
+                boost::beast::http::message<isRequest, Body, Fields> msg_;
+
+                work_impl(http_session& self, boost::beast::http::message<isRequest, Body, Fields>&& msg)
+                    : self_(self), msg_(std::move(msg)) {
+                    this->trace_id_ = self.mTraceId;
+                    this->request_ = bda::ThriftRequestGuard(self.mContext);
+                }
+
+                void operator()() {
+                    self_.trace(bda::ThriftTraceStage::WriteStart, this->trace_id_);
+                    boost::beast::http::async_write(
+                        self_.derived().stream(),
+                        msg_,
+                        bda::bindRecyclingAllocator(boost::beast::bind_front_handler(
+                            &http_session::on_write,
+                            self_.derived().shared_from_this(),
+                            msg_.need_eof())));
+                }
+            };
+
+            // Allocate and store the work
+            items_.push_back(boost::make_unique<work_impl>(self_, std::move(msg)));
+
+            // If there was no previous work, start this one
+            if (items_.size() == 1) {
+                (*items_.front())();
+            }
+        }
+
+#if defined(BOOST_ASIO_HAS_IO_URING)
+        // Called by the HTTP handler to send a file. The file is read into
+        // the body of msg with io_uring when the response is the next one to
+        // send, which keeps the order of pipelined responses.
+        void send_file(std::string path, boost::beast::http::response<boost::beast::http::vector_body<char>>&& msg) {
+            // This holds a work item
+            struct file_work_impl : work {
+                http_session& self_;
+                boost::beast::http::response<boost::beast::http::vector_body<char>> msg_;
+                std::string path_;
+                boost::asio::random_access_file file_;
+                std::size_t offset_ = 0;
+
+                file_work_impl(http_session& self, std::string&& path, boost::beast::http::response<boost::beast::http::vector_body<char>>&& msg)
+                    : self_(self), msg_(std::move(msg)), path_(std::move(path)),
+                      file_(boost::beast::get_lowest_layer(self.derived().stream()).get_executor()) {
+                    this->trace_id_ = self.mTraceId;
+                    this->request_ = bda::ThriftRequestGuard(self.mContext);
+                }
+
+                void operator()() {
+                    boost::beast::error_code ec;
+                    file_.open(path_, boost::asio::file_base::read_only, ec);
+                    if (ec) {
+                        return on_read(ec, 0);
+                    }
+                    do_read();
+                }
+
+                void do_read() {
+                    if (offset_ >= msg_.body().size()) {
+                        return do_write();
+                    }
+                    file_.async_read_some_at(
+                        offset_,
+                        boost::asio::buffer(msg_.body().data() + offset_, msg_.body().size() - offset_),
+                        bda::bindRecyclingAllocator(boost::beast::bind_front_handler(
+                            &file_work_impl::on_read_some,
+                            this,
+                            self_.derived().shared_from_this())));
+                }
+
+                // The session pointer keeps the queue and this work item alive
+                void on_read_some(std::shared_ptr<Derived>, const boost::beast::error_code ec, std::size_t bytes_transferred) {
+                    on_read(ec, bytes_transferred);
+                }
+
+                void on_read(const boost::beast::error_code ec, std::size_t bytes_transferred) {
+                    if (ec) {
+                        // The file changed or vanished since it was opened
+                        BDAMessage(2, "http_session::queue::send_file(): Could not read '" + path_ + "': '" + ec.message() + "'.\n");
+                        msg_.result(boost::beast::http::status::internal_server_error);
+                        msg_.body().clear();
+                        msg_.prepare_payload();
+                        return do_write();
+                    }
+                    offset_ += bytes_transferred;
+                    do_read();
+                }
+
+                void do_write() {
+                    boost::beast::error_code ec;
+                    file_.close(ec);
+                    self_.trace(bda::ThriftTraceStage::WriteStart, this->trace_id_);
+                    boost::beast::http::async_write(
+                        self_.derived().stream(),
+                        msg_,
+                        bda::bindRecyclingAllocator(boost::beast::bind_front_handler(
+                            &http_session::on_write,
+                            self_.derived().shared_from_this(),
+                            msg_.need_eof())));
+                }
+            };
+
+            // Allocate and store the work
+            items_.push_back(boost::make_unique<file_work_impl>(self_, std::move(path), std::move(msg)));
+
+            // If there was no previous work, start this one
+            if (items_.size() == 1) {
+                (*items_.front())();
+            }
+        }
+#endif
+    };
+
+    queue queue_;
+
+    // The parser is stored in an optional container so we can
+    // construct it from scratch at the beginning of each new message.
+    boost::optional<boost::beast::http::request_parser<boost::beast::http::string_body>> parser_;
+
+protected:
+    boost::beast::flat_buffer buffer_;
+
+    std::shared_ptr<bda::ThriftSessionContext> mContext;
+
+    // The connection and the current request in the trace:
+    bda::ThriftTraceId mTraceId;
+
+    // The memory of the buffer and the current request, if there is a budget:
+    bda::ThriftMemoryReservation mReservation;
+
+    void trace(const bda::ThriftTraceStage aStage, const bda::ThriftTraceId& aTraceId, const std::string& aMethod = std::string()) {
+        if (mContext->mTracer) {
+            mContext->mTracer->record(aStage, aTraceId, aMethod);
+        }
+    }
+
+    template<class Stream, class Body, class Allocator>
+    void make_websocket_session(Stream stream,
+                                boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>> aHTTPRequest,
+                                std::shared_ptr<bda::ThriftService> aService, std::shared_ptr<bda::ThriftSessionAccess> aAccess) {
+        using session_type = plain_websocket_session<Stream>;
+        std::allocate_shared<session_type>(bda::RecyclingAllocator<session_type>(), std::move(stream))->run(std::move(aHTTPRequest), mContext, aService, aAccess);
+    }
+
+    template<class Body, class Allocator>
+    void make_websocket_session(boost::beast::ssl_stream<boost::beast::tcp_stream> stream,
+                                boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>> aHTTPRequest,
+                                std::shared_ptr<bda::ThriftService> aService, std::shared_ptr<bda::ThriftSessionAccess> aAccess) {
+        std::allocate_shared<ssl_websocket_session>(bda::RecyclingAllocator<ssl_websocket_session>(), std::move(stream))->run(std::move(aHTTPRequest), mContext, aService, aAccess);
+    }
+
+public:
+    // Construct the session
+    http_session(boost::beast::flat_buffer buffer, std::shared_ptr<bda::ThriftSessionContext> aContext)
+        : queue_(*this), buffer_(std::move(buffer)), mContext(aContext), mReservation(aContext->mMemoryBudget) {
+        if (mContext->mTracer) {
+            mTraceId.mConnection = mContext->mNextConnectionId++;
+        }
+    }
+
+    void do_read() {
+        // Wait while the sessions hold more memory than the budget:
+        shrink_idle_buffer(*mContext, buffer_);
+        mReservation.resize(buffer_.capacity());
+        auto vSelf = derived().shared_from_this();
+        if (!admit_read(*mContext, derived().stream().get_executor(), [this, vSelf]() { do_read(); })) {
+            return;
+        }
+
+        // Construct a new parser for each message
+        parser_.emplace();
+
+        // Apply a reasonable limit to the allowed size
+        // of the body in bytes to prevent abuse.
+        parser_->body_limit(11 * 1024 * 1024);
+
+        // Set the timeout.
+        boost::beast::get_lowest_layer(derived().stream()).expires_after(std::chrono::seconds(300));
 
         // Read a request using the parser-oriented interface
         boost::beast::http::async_read(
             derived().stream(),
             buffer_,
             *parser_,
-            boost::beast::bind_front_handler(
+            bda::bindRecyclingAllocator(boost::beast::bind_front_handler(
                 &http_session::on_read,
-                derived().shared_from_this()));
+                derived().shared_from_this())));
     }
 
     void on_read(const boost::beast::error_code ec, std::size_t bytes_transferred) {
@@ -698,19 +1799,79 @@ public:
             return fail(ec, "read");
         }
 
+        mReservation.resize(buffer_.capacity() + parser_->get().body().size());
+
+        // Requests are traced by their target, e.g. "GET /index.html":
+        ++mTraceId.mMessage;
+        if (mContext->mTracer) {
+            trace(bda::ThriftTraceStage::ReadComplete, mTraceId, std::string(parser_->get().method_string()) + " " + std::string(parser_->get().target()));
+        }
+
         // See if it is a WebSocket Upgrade
         if (boost::beast::websocket::is_upgrade(parser_->get())) {
+            // Authenticate the connection once, if it presents a token:
+            std::shared_ptr<bda::ThriftSessionAccess> vAccess;
+            if (mContext->mAccessManager) {
+                const std::string vToken = find_access_token(parser_->get()[boost::beast::http::field::authorization],
+                                                             parser_->get()[boost::beast::http::field::cookie],
+                                                             mContext->mAccessManager->tokenCookie());
+                std::shared_ptr<const bda::ThriftAccessGrant> vGrant = mContext->mAccessManager->authenticate(vToken);
+                if (!vToken.empty() && !vGrant) {
+                    BDAMessage(2, "http_session::on_read(): Rejecting connection to '" + std::string(parser_->get().target()) + "', the access token is not valid.\n");
+                    return queue_(unauthorized_response(parser_->get()));
+                }
+                vAccess = std::make_shared<bda::ThriftSessionAccess>(std::move(vGrant));
+            }
+
+            // Route the connection to the service of the upgrade path, unless
+            // the service is at its connection limit:
+            std::shared_ptr<bda::ThriftService> vService = mContext->findService(parser_->get().target());
+            if (!vService->tryAcquireConnection()) {
+                BDAMessage(2, "http_session::on_read(): Rejecting connection to '" + std::string(parser_->get().target()) + "', the service is at its connection limit.\n");
+                boost::beast::http::response<boost::beast::http::string_body> res{ boost::beast::http::status::service_unavailable, parser_->get().version() };
+                res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+                res.set(boost::beast::http::field::content_type, "text/html");
+                res.keep_alive(false);
+                res.body() = "The service is at its connection limit.";
+                res.prepare_payload();
+                return queue_(std::move(res));
+            }
+
             // Disable the timeout.
             // The boost::beast::websocket::stream uses its own timeout settings.
             boost::beast::get_lowest_layer(derived().stream()).expires_never();
 
             // Create a websocket session, transferring ownership
             // of both the socket and the HTTP request.
-            return make_websocket_session(derived().release_stream(), parser_->release());
+            return make_websocket_session(derived().release_stream(), parser_->release(), vService, vAccess);
+        }
+
+        // A POST request is a thrift call, like over HTTP/2:
+        if (parser_->get().method() == boost::beast::http::verb::post) {
+            return handle_thrift_call();
         }
 
-        // Send the response
-        handle_request(mHTTPDocumentRoot, parser_->release(), queue_);
+        // Send the response, either from a JSON endpoint or a file
+        const boost::beast::string_view vTarget = parser_->get().target();
+        const std::string vPath(vTarget.substr(0, vTarget.find('?')));
+        if (mContext->mProfiler && vPath == mContext->mProfilerPath && parser_->get().method() == boost::beast::http::verb::get) {
+            return handle_profile();
+        }
+        const auto vEndpointIt = mContext->mJSONEndpoints.find(vPath);
+        if (vEndpointIt != mContext->mJSONEndpoints.end() && parser_->get().method() == boost::beast::http::verb::get) {
+            const std::string vToken = mContext->mAccessManager
+                ? find_access_token(parser_->get()[boost::beast::http::field::authorization], parser_->get()[boost::beast::http::field::cookie],
+                                    mContext->mAccessManager->tokenCookie())
+                : std::string();
+            if (is_diagnostics_permitted(*mContext, vPath, vToken)) {
+                queue_(json_response(parser_->get(), vEndpointIt->second()));
+            } else {
+                queue_(profile_response(parser_->get(), boost::beast::http::status::unauthorized, "text/plain",
+                                        "The access token does not permit this endpoint."));
+            }
+        } else {
+            handle_request(*mContext, parser_->release(), queue_);
+        }
 
         // If we aren't at the queue limit, try to pipeline another request
         if (!queue_.is_full()) {
@@ -718,6 +1879,85 @@ public:
         }
     }
 
+    // Answer a profile request when the profile is complete. Pipelined
+    // requests are only read afterwards, to keep the responses in order.
+    void handle_profile() {
+        auto vSelf = derived().shared_from_this();
+        auto vExecutor = derived().stream().get_executor();
+        auto vRequest = std::make_shared<boost::beast::http::request<boost::beast::http::string_body>>(parser_->release());
+        bda::ThriftRequestGuard vInFlight(mContext);
+        const std::string vToken = mContext->mAccessManager
+            ? find_access_token((*vRequest)[boost::beast::http::field::authorization], (*vRequest)[boost::beast::http::field::cookie],
+                                mContext->mAccessManager->tokenCookie())
+            : std::string();
+        start_profile(*mContext, vRequest->target(), vToken,
+            [this, vSelf, vExecutor, vRequest, vInFlight](const boost::beast::http::status aStatus, std::string aContentType, std::string aBody) {
+                auto vBody = std::make_shared<std::string>(std::move(aBody));
+                boost::asio::post(vExecutor, [this, vSelf, vRequest, vInFlight, aStatus, aContentType, vBody]() {
+                    queue_(profile_response(*vRequest, aStatus, aContentType, std::move(*vBody)));
+                    if (!queue_.is_full()) {
+                        do_read();
+                    }
+                });
+            });
+    }
+
+    // Dispatch the body of a POST request as a thrift message to the
+    // service of the path, and respond with the serialized response.
+    // Pipelined requests are only read afterwards, to keep the responses in
+    // order.
+    void handle_thrift_call() {
+        auto vRequest = std::make_shared<boost::beast::http::request<boost::beast::http::string_body>>(parser_->release());
+        std::shared_ptr<bda::ThriftService> vService = mContext->findService(vRequest->target());
+        const std::chrono::steady_clock::time_point vReceiveTime = std::chrono::steady_clock::now();
+        std::chrono::milliseconds vCallTimeout(0);
+        const auto vCallTimeoutIt = vRequest->find(bda::cCallTimeoutHeader);
+        if (mContext->mDeadlinesEnabled && vCallTimeoutIt != vRequest->end() &&
+            !bda::parseCallTimeout(std::string(vCallTimeoutIt->value()), vCallTimeout)) {
+            BDAMessage(2, "http_session::handle_thrift_call(): Ignoring invalid " + std::string(bda::cCallTimeoutHeader) + " header.\n");
+        }
+
+        // Every request is authenticated with its own token, which is cheap
+        // once the access manager cached its grant:
+        std::shared_ptr<bda::ThriftSessionAccess> vAccess;
+        if (mContext->mAccessManager) {
+            const std::string vToken = find_access_token((*vRequest)[boost::beast::http::field::authorization], (*vRequest)[boost::beast::http::field::cookie],
+                                                         mContext->mAccessManager->tokenCookie());
+            std::shared_ptr<const bda::ThriftAccessGrant> vGrant = mContext->mAccessManager->authenticate(vToken);
+            if (!vToken.empty() && !vGrant) {
+                BDAMessage(2, "http_session::handle_thrift_call(): Rejecting a request to '" + std::string(vRequest->target()) + "', the access token is not valid.\n");
+                return queue_(unauthorized_response(*vRequest));
+            }
+            vAccess = std::make_shared<bda::ThriftSessionAccess>(std::move(vGrant));
+        }
+
+        // The handler keeps the request body and this session alive, and
+        // gets back onto the strand of this session. It counts the call
+        // until its response is queued, which counts it until it was written:
+        auto vSelf = derived().shared_from_this();
+        auto vExecutor = derived().stream().get_executor();
+        bda::ThriftRequestGuard vInFlight(mContext);
+        bda::dispatchThriftMessage(*mContext, *vService, reinterpret_cast<const uint8_t*>(vRequest->body().data()),
+                                   static_cast<uint32_t>(vRequest->body().size()), vReceiveTime, vCallTimeout, mTraceId, vAccess,
+            [this, vSelf, vExecutor, vRequest, vInFlight](const bool aSuccess, bda::ThriftResponse aResponse) {
+                boost::asio::dispatch(vExecutor, bda::bindRecyclingAllocator([this, vSelf, vRequest, vInFlight, aSuccess, aResponse]() {
+                    boost::beast::http::response<boost::beast::http::string_body> res{
+                        aSuccess ? boost::beast::http::status::ok : boost::beast::http::status::internal_server_error, vRequest->version() };
+                    res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+                    res.set(boost::beast::http::field::content_type, "application/x-thrift");
+                    res.keep_alive(vRequest->keep_alive());
+                    if (aSuccess) {
+                        aResponse.appendTo(res.body());
+                    }
+                    res.prepare_payload();
+                    queue_(std::move(res));
+                    if (!queue_.is_full()) {
+                        do_read();
+                    }
+                }));
+            });
+    }
+
     void on_write(bool close, boost::beast::error_code ec, std::size_t bytes_transferred) {
         boost::ignore_unused(bytes_transferred);
 
@@ -739,44 +1979,72 @@ public:
     }
 };
 
-// Handles a plain HTTP connection
+// Handles a plain HTTP connection, over TCP or a local socket
+template<class Stream>
 class plain_http_session
-    : public http_session<plain_http_session>,
-      public std::enable_shared_from_this<plain_http_session> {
-    boost::beast::tcp_stream stream_;
+    : public http_session<plain_http_session<Stream>>,
+      public std::enable_shared_from_this<plain_http_session<Stream>> {
+    Stream stream_;
 
 public:
     // Create the session
     plain_http_session(
-        boost::beast::tcp_stream&& stream,
+        Stream&& stream,
         boost::beast::flat_buffer&& buffer,
-        const std::string& aHTTPDocumentRoot,
-        std::shared_ptr<apache::thrift::protocol::TProtocolFactory> aThriftProtocolFactory,
-        std::shared_ptr<apache::thrift::TProcessor> aThriftProcessor)
-        : http_session<plain_http_session>(std::move(buffer), aHTTPDocumentRoot, aThriftProtocolFactory, aThriftProcessor),
+        std::shared_ptr<bda::ThriftSessionContext> aContext)
+        : http_session<plain_http_session<Stream>>(std::move(buffer), aContext),
           stream_(std::move(stream)) {
     }
 
     // Start the session
     void run() {
+#if defined(BDA_HAS_HTTP2)
+        detect_h2c(boost::beast::error_code(), 0);
+#else
         this->do_read();
+#endif
     }
 
     // Called by the base class
-    boost::beast::tcp_stream& stream() {
+    Stream& stream() {
         return stream_;
     }
 
     // Called by the base class
-    boost::beast::tcp_stream release_stream() {
+    Stream release_stream() {
         return std::move(stream_);
     }
 
+#if defined(BDA_HAS_HTTP2)
+    // Hand the connection to an HTTP/2 session if the client starts with the
+    // HTTP/2 preface (h2c with prior knowledge), otherwise serve HTTP/1.1.
+    void detect_h2c(const boost::beast::error_code ec, std::size_t bytes_transferred) {
+        if (ec) {
+            return fail(ec, "detect_h2c");
+        }
+        this->buffer_.commit(bytes_transferred);
+
+        const auto vBufferData = this->buffer_.data();
+        const std::size_t vSize = std::min(vBufferData.size(), cHTTP2PrefaceSize);
+        if (!std::equal(cHTTP2Preface, cHTTP2Preface + vSize, static_cast<const char*>(vBufferData.data()))) {
+            return this->do_read();
+        }
+        if (vSize == cHTTP2PrefaceSize) {
+            using session_type = http2_session<Stream>;
+            return std::allocate_shared<session_type>(bda::RecyclingAllocator<session_type>(), std::move(stream_), std::move(this->buffer_), this->mContext)->run();
+        }
+
+        stream_.expires_after(std::chrono::seconds(300));
+        stream_.async_read_some(this->buffer_.prepare(cHTTP2PrefaceSize - vSize),
+            bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&plain_http_session::detect_h2c, this->shared_from_this())));
+    }
+#endif
+
     // Called by the base class
     void do_eof() {
         // Send a TCP shutdown
         boost::beast::error_code ec;
-        stream_.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+        stream_.socket().shutdown(boost::asio::socket_base::shutdown_send, ec);
 
         // At this point the connection is closed gracefully
     }
@@ -792,13 +2060,10 @@ public:
     // Create the http_session
     ssl_http_session(
         boost::beast::tcp_stream&& stream,
-        boost::asio::ssl::context& aSSLContext,
         boost::beast::flat_buffer&& buffer,
-        const std::string& aHTTPDocumentRoot,
-        std::shared_ptr<apache::thrift::protocol::TProtocolFactory> aThriftProtocolFactory,
-        std::shared_ptr<apache::thrift::TProcessor> aThriftProcessor)
-        : http_session<ssl_http_session>(std::move(buffer), aHTTPDocumentRoot, aThriftProtocolFactory, aThriftProcessor),
-          stream_(std::move(stream), aSSLContext) {
+        std::shared_ptr<bda::ThriftSessionContext> aContext)
+        : http_session<ssl_http_session>(std::move(buffer), aContext),
+          stream_(std::move(stream), *aContext->mSSLContext) {
     }
 
     // Start the session
@@ -831,124 +2096,751 @@ public:
         // Set the timeout.
         boost::beast::get_lowest_layer(stream_).expires_after(std::chrono::seconds(300));
 
-        // Perform the SSL shutdown
-        stream_.async_shutdown(boost::beast::bind_front_handler(&ssl_http_session::on_shutdown, shared_from_this()));
+        // Perform the SSL shutdown
+        stream_.async_shutdown(boost::beast::bind_front_handler(&ssl_http_session::on_shutdown, shared_from_this()));
+    }
+
+private:
+    void on_handshake(const boost::beast::error_code ec, std::size_t bytes_used) {
+        if (ec) {
+            return fail(ec, "handshake");
+        }
+
+        // Consume the portion of the buffer used by the handshake
+        buffer_.consume(bytes_used);
+
+#if defined(BDA_HAS_HTTP2)
+        if (is_http2_negotiated(stream_)) {
+            using session_type = http2_session<boost::beast::ssl_stream<boost::beast::tcp_stream>>;
+            return std::allocate_shared<session_type>(bda::RecyclingAllocator<session_type>(), std::move(stream_), std::move(buffer_), mContext)->run();
+        }
+#endif
+
+        do_read();
+    }
+
+    void on_shutdown(const boost::beast::error_code ec) {
+        if (ec) {
+            return fail(ec, "shutdown");
+        }
+
+        // At this point the connection is closed gracefully
+    }
+};
+
+// The largest frame that a framed thrift client may send:
+constexpr uint32_t cFramedThriftMaxFrameSize = 64 * 1024 * 1024;
+
+// Returns true if the data starts like a TFramedTransport frame with a
+// message in the given protocol, i.e. with the size of the frame as a
+// big-endian 32-bit integer, and the first byte of the message. HTTP
+// requests start with a method name and TLS with 0x16, so neither starts
+// with the high byte of a frame size below cFramedThriftMaxFrameSize.
+bool is_framed_thrift(const bda::ProtocolType aProtocolType, const uint8_t* aData, const std::size_t aSize) {
+    if (aSize < 5) {
+        return false;
+    }
+    const uint32_t vFrameSize = (static_cast<uint32_t>(aData[0]) << 24) | (static_cast<uint32_t>(aData[1]) << 16) |
+                                (static_cast<uint32_t>(aData[2]) << 8) | static_cast<uint32_t>(aData[3]);
+    if (vFrameSize == 0 || vFrameSize > cFramedThriftMaxFrameSize) {
+        return false;
+    }
+    switch (aProtocolType) {
+        case bda::ProtocolType::BINARY:
+            return aData[4] == 0x80;
+        case bda::ProtocolType::COMPACT:
+            return aData[4] == 0x82;
+        case bda::ProtocolType::JSON:
+            return aData[4] == '[';
+        default:
+            return false;
+    }
+}
+
+// Serves a thrift client that sends TFramedTransport frames directly over
+// TCP, without HTTP and WebSocket. Every frame holds one message after its
+// size. The default service processes the calls of a connection one after
+// the other, and a oneway call is not answered.
+class framed_thrift_session : public std::enable_shared_from_this<framed_thrift_session> {
+    boost::beast::tcp_stream stream_;
+    boost::beast::flat_buffer buffer_;
+
+    std::shared_ptr<bda::ThriftSessionContext> mContext;
+    std::shared_ptr<bda::ThriftService> mService;
+
+    // The grant of this connection, which only a login call can set:
+    std::shared_ptr<bda::ThriftSessionAccess> mAccess;
+
+    // The connection and the current message in the trace:
+    bda::ThriftTraceId mTraceId;
+
+    // The size of the frame that is processed, which stays at the front of
+    // the buffer until its response was written:
+    uint32_t mFrameSize = 0;
+
+    // The response to the current message, and the buffers to send it after
+    // its size:
+    uint8_t mResponseSize[4];
+    bda::ThriftResponse mResponse;
+    std::vector<boost::asio::const_buffer> mOutputBuffers;
+
+    // The memory of the buffer and the response, if there is a budget:
+    bda::ThriftMemoryReservation mReservation;
+
+    void trace(const bda::ThriftTraceStage aStage) {
+        if (mContext->mTracer) {
+            mContext->mTracer->record(aStage, mTraceId);
+        }
+    }
+
+public:
+    framed_thrift_session(boost::beast::tcp_stream&& stream,
+                          boost::beast::flat_buffer&& buffer,
+                          std::shared_ptr<bda::ThriftSessionContext> aContext)
+        : stream_(std::move(stream)), buffer_(std::move(buffer)), mContext(aContext) {
+    }
+
+    ~framed_thrift_session() {
+        if (mService) {
+            mService->releaseConnection();
+        }
+    }
+
+    void run() {
+        if (!mContext->mDefaultService->tryAcquireConnection()) {
+            BDAMessage(2, "framed_thrift_session::run(): Rejected the connection, the default service has too many connections.\n");
+            return;
+        }
+        mService = mContext->mDefaultService;
+        if (mContext->mAccessManager) {
+            mAccess = std::make_shared<bda::ThriftSessionAccess>();
+        }
+        if (mContext->mTracer) {
+            mTraceId.mConnection = mContext->mNextConnectionId++;
+        }
+        mReservation = bda::ThriftMemoryReservation(mContext->mMemoryBudget);
+        do_read();
+    }
+
+private:
+    // Process the next frame if the buffer holds all of it, or read more.
+    // Frames that a client sent ahead are already in the buffer.
+    void do_read() {
+        const auto vBufferData = buffer_.data();
+        const uint8_t* vData = static_cast<const uint8_t*>(vBufferData.data());
+        const std::size_t vSize = vBufferData.size();
+
+        std::size_t vMissing = 4 - std::min<std::size_t>(vSize, 4);
+        if (vSize >= 4) {
+            mFrameSize = (static_cast<uint32_t>(vData[0]) << 24) | (static_cast<uint32_t>(vData[1]) << 16) |
+                         (static_cast<uint32_t>(vData[2]) << 8) | static_cast<uint32_t>(vData[3]);
+            if (mFrameSize == 0 || mFrameSize > cFramedThriftMaxFrameSize) {
+                BDAMessage(2, "framed_thrift_session::do_read(): Closing the connection, invalid frame size " + std::to_string(mFrameSize) + ".\n");
+                return;
+            }
+            if (vSize - 4 >= mFrameSize) {
+                return process_frame(vData + 4);
+            }
+            vMissing = 4 + mFrameSize - vSize;
+        }
+
+        // Read at least the rest of the frame, and whatever else the
+        // client sent in the meantime, unless the sessions hold more memory
+        // than the budget:
+        shrink_idle_buffer(*mContext, buffer_);
+        mReservation.resize(buffer_.capacity());
+        auto vSelf = shared_from_this();
+        if (!admit_read(*mContext, stream_.get_executor(), [this, vSelf]() { do_read(); })) {
+            return;
+        }
+        stream_.expires_after(std::chrono::seconds(300));
+        stream_.async_read_some(buffer_.prepare(std::max<std::size_t>(vMissing, 64 * 1024)),
+            bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&framed_thrift_session::on_read, shared_from_this())));
+    }
+
+    void on_read(const boost::beast::error_code ec, const std::size_t bytes_transferred) {
+        if (ec == boost::asio::error::eof) {
+            BDAMessage(9, "framed_thrift_session::on_read(): Connection closed.\n");
+            return;
+        }
+        if (ec) {
+            return fail(ec, "framed read");
+        }
+        buffer_.commit(bytes_transferred);
+        mReservation.resize(buffer_.capacity());
+        do_read();
+    }
+
+    void process_frame(const uint8_t* aMessageData) {
+        ++mTraceId.mMessage;
+        trace(bda::ThriftTraceStage::ReadComplete);
+        stream_.expires_never();
+
+        // The message is processed in place in the buffer, and the response
+        // gets back onto our strand:
+        auto vSelf = shared_from_this();
+        bda::dispatchThriftMessage(*mContext, *mService, aMessageData, mFrameSize, std::chrono::steady_clock::now(), std::chrono::milliseconds(0), mTraceId, mAccess,
+            [this, vSelf](const bool aSuccess, bda::ThriftResponse aResponse) {
+                boost::asio::dispatch(stream_.get_executor(), bda::bindRecyclingAllocator([this, vSelf, aSuccess, aResponse]() {
+                    on_processed(aSuccess, aResponse);
+                }));
+            });
+    }
+
+    void on_processed(const bool aSuccess, const bda::ThriftResponse& aResponse) {
+        if (!aSuccess) {
+            BDAMessage(2, "framed_thrift_session::on_processed(): Failed to process a message, closing the connection.\n");
+            return;
+        }
+
+        mResponse = aResponse;
+        const std::size_t vResponseSize = mResponse.size();
+        mReservation.resize(buffer_.capacity() + vResponseSize);
+        if (vResponseSize == 0) {
+            // A oneway call, continue through the strand so that pipelined
+            // oneway frames do not recurse:
+            return boost::asio::post(stream_.get_executor(), bda::bindRecyclingAllocator(
+                boost::beast::bind_front_handler(&framed_thrift_session::on_write, shared_from_this(), boost::beast::error_code(), 0)));
+        }
+
+        mResponseSize[0] = static_cast<uint8_t>(vResponseSize >> 24);
+        mResponseSize[1] = static_cast<uint8_t>(vResponseSize >> 16);
+        mResponseSize[2] = static_cast<uint8_t>(vResponseSize >> 8);
+        mResponseSize[3] = static_cast<uint8_t>(vResponseSize);
+        mOutputBuffers.clear();
+        mOutputBuffers.emplace_back(mResponseSize, sizeof(mResponseSize));
+        mResponse.appendBuffers(mOutputBuffers);
+        trace(bda::ThriftTraceStage::WriteStart);
+
+        stream_.expires_after(std::chrono::seconds(300));
+        boost::asio::async_write(stream_, mOutputBuffers,
+            bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&framed_thrift_session::on_write, shared_from_this())));
+    }
+
+    void on_write(const boost::beast::error_code ec, const std::size_t) {
+        if (ec) {
+            return fail(ec, "framed write");
+        }
+        if (!mOutputBuffers.empty()) {
+            trace(bda::ThriftTraceStage::WriteComplete);
+        }
+
+        // Drop the frame and its response, and continue with the next one:
+        buffer_.consume(4 + static_cast<std::size_t>(mFrameSize));
+        mResponse.reset();
+        mOutputBuffers.clear();
+        mReservation.resize(buffer_.capacity());
+        do_read();
+    }
+};
+
+// Detects SSL handshakes
+class detect_session : public std::enable_shared_from_this<detect_session> {
+    boost::beast::tcp_stream stream_;
+    boost::beast::flat_buffer buffer_;
+
+    std::shared_ptr<bda::ThriftSessionContext> mContext;
+
+public:
+    explicit detect_session(boost::asio::ip::tcp::socket&& socket,
+                            std::shared_ptr<bda::ThriftSessionContext> aContext)
+        : stream_(std::move(socket)), mContext(aContext) {
+    }
+
+    // Launch the detector
+    void run() {
+        // Set the timeout.
+        stream_.expires_after(std::chrono::seconds(300));
+
+        boost::beast::async_detect_ssl(stream_, buffer_, bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&detect_session::on_detect, this->shared_from_this())));
+    }
+
+    void on_detect(const boost::beast::error_code ec, bool result) {
+        if (ec) {
+            return fail(ec, "detect");
+        }
+
+        if (result) {
+            // Launch SSL session
+            std::allocate_shared<ssl_http_session>(bda::RecyclingAllocator<ssl_http_session>(), std::move(stream_), std::move(buffer_), mContext)->run();
+        } else if (mContext->mFramedThriftEnabled) {
+            detect_framed(boost::beast::error_code(), 0);
+        } else {
+            launch_plain();
+        }
+    }
+
+private:
+    // Hand the connection to a framed thrift session if it starts with a
+    // frame, otherwise serve HTTP. The SSL detection may have read only the
+    // first byte, which already tells HTTP apart.
+    void detect_framed(const boost::beast::error_code ec, const std::size_t bytes_transferred) {
+        if (ec) {
+            return fail(ec, "detect_framed");
+        }
+        buffer_.commit(bytes_transferred);
+
+        const auto vBufferData = buffer_.data();
+        const uint8_t* vData = static_cast<const uint8_t*>(vBufferData.data());
+        const std::size_t vSize = vBufferData.size();
+        if (vSize > 0 && vData[0] <= (cFramedThriftMaxFrameSize >> 24) && vSize < 5) {
+            stream_.async_read_some(buffer_.prepare(5 - vSize),
+                bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&detect_session::detect_framed, this->shared_from_this())));
+            return;
+        }
+
+        if (is_framed_thrift(mContext->mProtocolType, vData, vSize)) {
+            std::allocate_shared<framed_thrift_session>(bda::RecyclingAllocator<framed_thrift_session>(), std::move(stream_), std::move(buffer_), mContext)->run();
+        } else {
+            launch_plain();
+        }
+    }
+
+    void launch_plain() {
+        std::allocate_shared<plain_http_session<boost::beast::tcp_stream>>(bda::RecyclingAllocator<plain_http_session<boost::beast::tcp_stream>>(), std::move(stream_), std::move(buffer_), mContext)->run();
+    }
+};
+
+// Accepts incoming connections and launches the sessions
+class HTTPConnectListener : public std::enable_shared_from_this<HTTPConnectListener> {
+    std::shared_ptr<boost::asio::io_context> mIOContext;
+    boost::asio::ip::tcp::acceptor acceptor_;
+
+    std::shared_ptr<bda::ThriftSessionContext> mContext;
+
+public:
+    HTTPConnectListener(std::shared_ptr<boost::asio::io_context> aIOContext,
+                        boost::asio::ip::tcp::endpoint endpoint,
+                        std::shared_ptr<bda::ThriftSessionContext> aContext)
+        : mIOContext(aIOContext), acceptor_(boost::asio::make_strand(*aIOContext)), mContext(aContext) {
+        boost::beast::error_code ec;
+
+        // Adopt the socket that a previous process or systemd already bound,
+        // with the connections that wait in its backlog:
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        const int vInheritedSocket = bda::takeInheritedSocket(endpoint);
+        if (vInheritedSocket >= 0) {
+            acceptor_.assign(endpoint.protocol(), vInheritedSocket, ec);
+            if (!ec) {
+                BDAMessage(8, "HTTPConnectListener::HTTPConnectListener(): Adopted the inherited listening socket.\n");
+                return;
+            }
+            // Bind a fresh socket instead:
+            ::close(vInheritedSocket);
+            fail(ec, "assign");
+            ec.clear();
+        }
+#endif
+
+        // Open the acceptor
+        acceptor_.open(endpoint.protocol(), ec);
+        if (ec) {
+            fail(ec, "open");
+            return;
+        }
+
+        // Allow address reuse
+        acceptor_.set_option(boost::asio::socket_base::reuse_address(true), ec);
+        if (ec) {
+            fail(ec, "set_option");
+            return;
+        }
+
+        // Bind to the server address
+        acceptor_.bind(endpoint, ec);
+        if (ec) {
+            fail(ec, "bind");
+            return;
+        }
+
+        // Start listening for connections
+        acceptor_.listen(boost::asio::socket_base::max_listen_connections, ec);
+        if (ec) {
+            fail(ec, "listen");
+            return;
+        }
+    }
+
+    // Start accepting incoming connections
+    void run() {
+        do_accept();
+    }
+
+    // The port the acceptor is bound to, or 0 if binding failed
+    unsigned short port() const {
+        boost::beast::error_code ec;
+        const boost::asio::ip::tcp::endpoint vEndpoint = acceptor_.local_endpoint(ec);
+        return ec ? 0 : vEndpoint.port();
+    }
+
+    // The listening socket, e.g. to hand it to another process
+    int native_handle() {
+        return acceptor_.native_handle();
+    }
+
+    // Stop accepting connections. The socket stays open in other processes
+    // that it was handed to.
+    void close() {
+        boost::asio::post(acceptor_.get_executor(), [self = shared_from_this()]() {
+            boost::beast::error_code ec;
+            self->acceptor_.close(ec);
+        });
+    }
+
+private:
+    void do_accept() {
+        // The new connection gets its own strand
+        acceptor_.async_accept(boost::asio::make_strand(*mIOContext), bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&HTTPConnectListener::on_accept, shared_from_this())));
+    }
+
+    void on_accept(const boost::beast::error_code ec, boost::asio::ip::tcp::socket socket) {
+        if (!acceptor_.is_open()) {
+            return;
+        }
+        if (ec) {
+            fail(ec, "accept");
+        } else {
+            // Create the detector http_session and run it
+            std::allocate_shared<detect_session>(bda::RecyclingAllocator<detect_session>(), std::move(socket), mContext)->run();
+        }
+
+        // Accept another connection
+        do_accept();
+    }
+};
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS) && defined(__linux__)
+
+// Exchanges thrift messages with a local client through the rings in the
+// shared memory that the client hands over when it connects (see
+// bda::ThriftSharedMemoryTransport). The client and this session wake each
+// other through one eventfd per side, and only when the other side announced
+// that it sleeps. The socket only tells when the client goes away. The calls
+// of a client are processed one after the other, like on a WebSocket.
+class shared_memory_session : public std::enable_shared_from_this<shared_memory_session> {
+    boost::asio::local::stream_protocol::socket socket_;
+    boost::asio::posix::stream_descriptor notify_;
+    uint64_t notify_value_ = 0;
+    bool closed_ = false;
+
+    std::shared_ptr<bda::ThriftSessionContext> mContext;
+    std::shared_ptr<bda::ThriftService> mService;
+
+    // The grant of this client, which only a login call can set:
+    std::shared_ptr<bda::ThriftSessionAccess> mAccess;
+
+    bda::FileDescriptor mClientNotify;
+    std::unique_ptr<bda::SharedMemoryMapping> mMapping;
+    bda::SharedMemoryRing mRequestRing;
+    bda::SharedMemoryRing mResponseRing;
+
+    // The request that is read from the ring, after its size:
+    uint32_t mRequestSize = 0;
+    std::size_t mRequestSizeRead = 0;
+    std::vector<uint8_t> mRequest;
+    std::size_t mRequestRead = 0;
+    bool mProcessing = false;
+
+    // The response that is written to the ring, after its size:
+    uint32_t mResponseSize = 0;
+    bda::ThriftResponse mResponse;
+    std::vector<boost::asio::const_buffer> mOutputBuffers;
+    std::size_t mOutputBuffer = 0;
+    std::size_t mOutputOffset = 0;
+
+public:
+    shared_memory_session(boost::asio::local::stream_protocol::socket&& socket, std::shared_ptr<bda::ThriftSessionContext> aContext)
+        : socket_(std::move(socket)), notify_(socket_.get_executor()), mContext(aContext) {
+        if (mContext->mAccessManager) {
+            mAccess = std::make_shared<bda::ThriftSessionAccess>();
+        }
+    }
+
+    ~shared_memory_session() {
+        if (mService) {
+            mService->releaseConnection();
+        }
+    }
+
+    void run() {
+        if (!mContext->mDefaultService->tryAcquireConnection()) {
+            BDAMessage(2, "shared_memory_session::run(): Rejected the client, the default service has too many connections.\n");
+            return;
+        }
+        mService = mContext->mDefaultService;
+        socket_.async_wait(boost::asio::socket_base::wait_read, bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&shared_memory_session::on_handshake, shared_from_this())));
     }
 
 private:
-    void on_handshake(const boost::beast::error_code ec, std::size_t bytes_used) {
+    void on_handshake(const boost::beast::error_code ec) {
         if (ec) {
-            return fail(ec, "handshake");
+            return fail(ec, "shared memory handshake");
         }
 
-        // Consume the portion of the buffer used by the handshake
-        buffer_.consume(bytes_used);
+        try {
+            // The client sends the memory, and the eventfds of both sides:
+            bda::FileDescriptor vFds[3];
+            if (bda::receiveFileDescriptors(socket_.native_handle(), vFds, 3) != 3) {
+                throw(std::runtime_error("Expected the shared memory and two eventfds"));
+            }
+            // A client that could still shrink the memory would make the
+            // server crash with SIGBUS on its next access:
+            const int vSeals = ::fcntl(vFds[0].get(), F_GET_SEALS);
+            if (vSeals < 0 || (vSeals & (F_SEAL_SHRINK | F_SEAL_GROW)) != (F_SEAL_SHRINK | F_SEAL_GROW)) {
+                throw(std::runtime_error("The size of the shared memory is not sealed"));
+            }
+            struct stat vStat;
+            if (::fstat(vFds[0].get(), &vStat) != 0 || static_cast<std::size_t>(vStat.st_size) < bda::cSharedMemoryDataOffset) {
+                throw(std::runtime_error("The shared memory is too small"));
+            }
 
-        do_read();
-    }
+            // Trust only the size of the memory, not the capacity in its header:
+            const std::size_t vSize = static_cast<std::size_t>(vStat.st_size);
+            mMapping.reset(new bda::SharedMemoryMapping(vFds[0].get(), vSize));
+            const bda::SharedMemoryHeader* vHeader = mMapping->header();
+            const uint64_t vCapacity = vHeader->mRingCapacity;
+            if (vHeader->mMagic != bda::cSharedMemoryMagic || vHeader->mVersion != bda::cSharedMemoryVersion ||
+                vCapacity < 4096 || (vCapacity & (vCapacity - 1)) != 0 || bda::sharedMemorySize(vCapacity) != vSize) {
+                throw(std::runtime_error("The shared memory has an unknown layout"));
+            }
+            mRequestRing = mMapping->requestRing();
+            mResponseRing = mMapping->responseRing();
 
-    void on_shutdown(const boost::beast::error_code ec) {
-        if (ec) {
-            return fail(ec, "shutdown");
+            notify_.assign(vFds[1].release());
+            mClientNotify = std::move(vFds[2]);
+
+            const char vAcknowledge = 1;
+            boost::asio::write(socket_, boost::asio::buffer(&vAcknowledge, 1));
+        } catch (const std::exception& vException) {
+            BDAMessage(2, "shared_memory_session::on_handshake(): Rejected the client: '" + std::string(vException.what()) + "'.\n");
+            return;
         }
 
-        // At this point the connection is closed gracefully
+        // The client never writes to the socket again, so it only becomes
+        // readable when the client closes it:
+        socket_.async_wait(boost::asio::socket_base::wait_read, bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&shared_memory_session::on_client_closed, shared_from_this())));
+        process();
     }
-};
 
-// Detects SSL handshakes
-class detect_session : public std::enable_shared_from_this<detect_session> {
-    boost::beast::tcp_stream stream_;
-    boost::asio::ssl::context& mSSLContext;
-    const std::string& mHTTPDocumentRoot;
-    boost::beast::flat_buffer buffer_;
+    void on_client_closed(const boost::beast::error_code) {
+        close();
+    }
+
+    void close() {
+        if (closed_) {
+            return;
+        }
+        closed_ = true;
+        boost::beast::error_code ec;
+        notify_.close(ec);
+        socket_.close(ec);
+    }
 
-    std::shared_ptr<apache::thrift::protocol::TProtocolFactory> mThriftProtocolFactory;
-    std::shared_ptr<apache::thrift::TProcessor> mThriftProcessor;
+    // Write the pending response and read the next request as far as the
+    // rings allow, and sleep until the client wakes us otherwise
+    void process() {
+        try {
+            while (!closed_ && !mProcessing) {
+                if (mOutputBuffer < mOutputBuffers.size()) {
+                    if (write_response()) {
+                        continue;
+                    }
+                    if (!mResponseRing.prepareWriterWait()) {
+                        continue;
+                    }
+                } else {
+                    if (read_request()) {
+                        dispatch_request();
+                        return;
+                    }
+                    if (!mRequestRing.prepareReaderWait()) {
+                        continue;
+                    }
+                }
+                notify_.async_read_some(boost::asio::buffer(&notify_value_, sizeof(notify_value_)),
+                    bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&shared_memory_session::on_notify, shared_from_this())));
+                return;
+            }
+        } catch (const std::exception& vException) {
+            BDAMessage(2, "shared_memory_session::process(): Closing the session: '" + std::string(vException.what()) + "'.\n");
+            close();
+        }
+    }
 
-public:
-    explicit detect_session(boost::asio::ip::tcp::socket&& socket,
-                            boost::asio::ssl::context& aSSLContext,
-                            const std::string& aHTTPDocumentRoot,
-                            std::shared_ptr<apache::thrift::protocol::TProtocolFactory> aThriftProtocolFactory,
-                            std::shared_ptr<apache::thrift::TProcessor> aThriftProcessor)
-        : stream_(std::move(socket)), mSSLContext(aSSLContext), mHTTPDocumentRoot(aHTTPDocumentRoot) {
-        mThriftProtocolFactory = aThriftProtocolFactory;
-        mThriftProcessor = aThriftProcessor;
+    void on_notify(const boost::beast::error_code ec, std::size_t) {
+        if (ec) {
+            if (ec != boost::asio::error::operation_aborted) {
+                fail(ec, "shared memory notify");
+            }
+            return close();
+        }
+        process();
     }
 
-    // Launch the detector
-    void run() {
-        // Set the timeout.
-        stream_.expires_after(std::chrono::seconds(300));
+    // Read from the request ring, and return true once a request is complete
+    bool read_request() {
+        std::size_t vRead = 0;
+        if (mRequestSizeRead < sizeof(mRequestSize)) {
+            vRead = mRequestRing.read(reinterpret_cast<uint8_t*>(&mRequestSize) + mRequestSizeRead, sizeof(mRequestSize) - mRequestSizeRead);
+            mRequestSizeRead += vRead;
+            if (mRequestSizeRead == sizeof(mRequestSize)) {
+                if (mRequestSize > bda::cSharedMemoryMaxRequestSize) {
+                    throw(std::runtime_error("The request of " + std::to_string(mRequestSize) + " bytes is too large"));
+                }
+                mRequest.resize(mRequestSize);
+                mRequestRead = 0;
+            }
+        }
+        if (mRequestSizeRead == sizeof(mRequestSize)) {
+            const std::size_t vPayloadRead = mRequestRing.read(mRequest.data() + mRequestRead, mRequest.size() - mRequestRead);
+            mRequestRead += vPayloadRead;
+            vRead += vPayloadRead;
+        }
+        if (vRead > 0 && mRequestRing.takeWriterWaiting()) {
+            bda::signalEventFd(mClientNotify.get());
+        }
+        return mRequestSizeRead == sizeof(mRequestSize) && mRequestRead == mRequest.size();
+    }
 
-        boost::beast::async_detect_ssl(stream_, buffer_, boost::beast::bind_front_handler(&detect_session::on_detect, this->shared_from_this()));
+    void dispatch_request() {
+        mProcessing = true;
+        mRequestSizeRead = 0;
+
+        // The request stays in mRequest until the response arrived, and the
+        // response gets back onto our strand:
+        auto vSelf = shared_from_this();
+        bda::dispatchThriftMessage(*mContext, *mService, mRequest.data(), static_cast<uint32_t>(mRequest.size()),
+                                   std::chrono::steady_clock::now(), std::chrono::milliseconds(0), bda::ThriftTraceId(), mAccess,
+            [this, vSelf](const bool aSuccess, bda::ThriftResponse aResponse) {
+                boost::asio::dispatch(socket_.get_executor(), bda::bindRecyclingAllocator([this, vSelf, aSuccess, aResponse]() {
+                    on_processed(aSuccess, aResponse);
+                }));
+            });
     }
 
-    void on_detect(const boost::beast::error_code ec, bool result) {
-        if (ec) {
-            return fail(ec, "detect");
+    void on_processed(const bool aSuccess, const bda::ThriftResponse& aResponse) {
+        mProcessing = false;
+        if (!aSuccess) {
+            return close();
         }
 
-        if (result) {
-            // Launch SSL session
-            std::make_shared<ssl_http_session>(std::move(stream_), mSSLContext, std::move(buffer_), mHTTPDocumentRoot, mThriftProtocolFactory, mThriftProcessor)->run();
-        } else {
-            // Launch plain session
-            std::make_shared<plain_http_session>(std::move(stream_), std::move(buffer_), mHTTPDocumentRoot, mThriftProtocolFactory, mThriftProcessor)->run();
+        // A oneway call has no response, and the client does not wait for one:
+        if (aResponse.size() == 0) {
+            return process();
+        }
+
+        mResponse = aResponse;
+        mResponseSize = static_cast<uint32_t>(mResponse.size());
+        mOutputBuffers.clear();
+        mOutputBuffers.emplace_back(&mResponseSize, sizeof(mResponseSize));
+        mResponse.appendBuffers(mOutputBuffers);
+        mOutputBuffer = 0;
+        mOutputOffset = 0;
+        process();
+    }
+
+    // Write to the response ring, and return true if anything was written
+    bool write_response() {
+        std::size_t vWritten = 0;
+        while (mOutputBuffer < mOutputBuffers.size()) {
+            const boost::asio::const_buffer& vBuffer = mOutputBuffers[mOutputBuffer];
+            const std::size_t vSize = mResponseRing.write(static_cast<const uint8_t*>(vBuffer.data()) + mOutputOffset, vBuffer.size() - mOutputOffset);
+            vWritten += vSize;
+            mOutputOffset += vSize;
+            if (mOutputOffset < vBuffer.size()) {
+                break;
+            }
+            ++mOutputBuffer;
+            mOutputOffset = 0;
         }
+        if (vWritten > 0 && mResponseRing.takeReaderWaiting()) {
+            bda::signalEventFd(mClientNotify.get());
+        }
+        if (mOutputBuffer == mOutputBuffers.size()) {
+            mOutputBuffers.clear();
+            mOutputBuffer = 0;
+            mResponse.reset();
+        }
+        return vWritten > 0;
     }
 };
 
-// Accepts incoming connections and launches the sessions
-class HTTPConnectListener : public std::enable_shared_from_this<HTTPConnectListener> {
+#endif
+
+// Accepts incoming connections on a Unix domain socket and launches plain
+// sessions for them. Local clients do not need SSL, and the permissions of
+// the socket file control who may connect.
+class HTTPLocalListener : public std::enable_shared_from_this<HTTPLocalListener> {
+    using local_stream = boost::beast::basic_stream<boost::asio::local::stream_protocol>;
+
     std::shared_ptr<boost::asio::io_context> mIOContext;
-    boost::asio::ssl::context& mSSLContext;
-    boost::asio::ip::tcp::acceptor acceptor_;
-    const std::string& mHTTPDocumentRoot;
+    boost::asio::local::stream_protocol::acceptor acceptor_;
+    const std::string mSocketPath;
 
-    std::shared_ptr<apache::thrift::protocol::TProtocolFactory> mThriftProtocolFactory;
-    std::shared_ptr<apache::thrift::TProcessor> mThriftProcessor;
+    // Whether the clients exchange thrift messages through shared memory
+    // instead of speaking HTTP:
+    const bool mSharedMemory;
 
-public:
-    HTTPConnectListener(std::shared_ptr<boost::asio::io_context> aIOContext,
-                        boost::asio::ssl::context& aSSLContext,
-                        boost::asio::ip::tcp::endpoint endpoint,
-                        const std::string& aHTTPDocumentRoot,
-                        std::shared_ptr<apache::thrift::protocol::TProtocolFactory> aThriftProtocolFactory,
-                        std::shared_ptr<apache::thrift::TProcessor> aThriftProcessor)
-        : mIOContext(aIOContext), mSSLContext(aSSLContext), acceptor_(boost::asio::make_strand(*aIOContext)), mHTTPDocumentRoot(aHTTPDocumentRoot) {
-        mThriftProtocolFactory = aThriftProtocolFactory;
-        mThriftProcessor = aThriftProcessor;
+    // The socket file is removed at the end, unless the socket was handed
+    // to another process:
+    std::atomic<bool> mOwnsSocketFile{ true };
 
-        boost::beast::error_code ec;
+    std::shared_ptr<bda::ThriftSessionContext> mContext;
 
-        // Open the acceptor
-        acceptor_.open(endpoint.protocol(), ec);
-        if (ec) {
-            fail(ec, "open");
+public:
+    HTTPLocalListener(std::shared_ptr<boost::asio::io_context> aIOContext,
+                      const std::string& aSocketPath, const uint32_t aPermissions,
+                      std::shared_ptr<bda::ThriftSessionContext> aContext, const bool aSharedMemory = false)
+        : mIOContext(aIOContext), acceptor_(boost::asio::make_strand(*aIOContext)), mSocketPath(aSocketPath),
+          mSharedMemory(aSharedMemory), mContext(aContext) {
+        // Adopt the socket that a previous process or systemd already bound:
+        const int vInheritedSocket = bda::takeInheritedSocket(mSocketPath);
+        if (vInheritedSocket >= 0) {
+            boost::beast::error_code ec;
+            acceptor_.assign(boost::asio::local::stream_protocol(), vInheritedSocket, ec);
+            if (ec) {
+                ::close(vInheritedSocket);
+                throw(std::runtime_error("bda::HTTPLocalListener::HTTPLocalListener(): Could not adopt the socket of '" + mSocketPath + "': " + ec.message()));
+            }
             return;
         }
 
-        // Allow address reuse
-        acceptor_.set_option(boost::asio::socket_base::reuse_address(true), ec);
-        if (ec) {
-            fail(ec, "set_option");
-            return;
+        // Replace the socket file of a previous run, but nothing else:
+        struct stat vStat;
+        if (::lstat(mSocketPath.c_str(), &vStat) == 0) {
+            if (!S_ISSOCK(vStat.st_mode)) {
+                throw(std::runtime_error("bda::HTTPLocalListener::HTTPLocalListener(): The path '" + mSocketPath + "' exists and is not a socket"));
+            }
+            ::unlink(mSocketPath.c_str());
         }
 
-        // Bind to the server address
-        acceptor_.bind(endpoint, ec);
+        boost::beast::error_code ec;
+        const boost::asio::local::stream_protocol::endpoint vEndpoint(mSocketPath);
+        acceptor_.open(vEndpoint.protocol(), ec);
+        if (!ec) {
+            acceptor_.bind(vEndpoint, ec);
+        }
         if (ec) {
-            fail(ec, "bind");
-            return;
+            throw(std::runtime_error("bda::HTTPLocalListener::HTTPLocalListener(): Could not bind '" + mSocketPath + "': " + ec.message()));
+        }
+
+        // Restrict the socket file before listening, so that no connection
+        // is accepted with the default permissions:
+        if (::chmod(mSocketPath.c_str(), static_cast<mode_t>(aPermissions)) != 0) {
+            throw(std::runtime_error("bda::HTTPLocalListener::HTTPLocalListener(): Could not set the permissions of '" + mSocketPath + "'"));
         }
 
-        // Start listening for connections
         acceptor_.listen(boost::asio::socket_base::max_listen_connections, ec);
         if (ec) {
-            fail(ec, "listen");
-            return;
+            throw(std::runtime_error("bda::HTTPLocalListener::HTTPLocalListener(): Could not listen on '" + mSocketPath + "': " + ec.message()));
+        }
+    }
+
+    ~HTTPLocalListener() {
+        if (mOwnsSocketFile) {
+            ::unlink(mSocketPath.c_str());
         }
     }
 
@@ -957,18 +2849,42 @@ public:
         do_accept();
     }
 
+    // The listening socket, e.g. to hand it to another process
+    int native_handle() {
+        return acceptor_.native_handle();
+    }
+
+    // Stop accepting connections. The socket file is kept if aHandedOff,
+    // because the process that the socket was handed to still serves it.
+    void close(const bool aHandedOff) {
+        if (aHandedOff) {
+            mOwnsSocketFile = false;
+        }
+        boost::asio::post(acceptor_.get_executor(), [self = shared_from_this()]() {
+            boost::beast::error_code ec;
+            self->acceptor_.close(ec);
+        });
+    }
+
 private:
     void do_accept() {
         // The new connection gets its own strand
-        acceptor_.async_accept(boost::asio::make_strand(*mIOContext), boost::beast::bind_front_handler(&HTTPConnectListener::on_accept, shared_from_this()));
+        acceptor_.async_accept(boost::asio::make_strand(*mIOContext), bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&HTTPLocalListener::on_accept, shared_from_this())));
     }
 
-    void on_accept(const boost::beast::error_code ec, boost::asio::ip::tcp::socket socket) {
+    void on_accept(const boost::beast::error_code ec, boost::asio::local::stream_protocol::socket socket) {
+        if (!acceptor_.is_open()) {
+            return;
+        }
         if (ec) {
             fail(ec, "accept");
+        } else if (mSharedMemory) {
+#if defined(__linux__)
+            std::make_shared<shared_memory_session>(std::move(socket), mContext)->run();
+#endif
         } else {
-            // Create the detector http_session and run it
-            std::make_shared<detect_session>(std::move(socket), mSSLContext, mHTTPDocumentRoot, mThriftProtocolFactory, mThriftProcessor)->run();
+            // There is nothing to detect, local connections are always plain
+            std::allocate_shared<plain_http_session<local_stream>>(bda::RecyclingAllocator<plain_http_session<local_stream>>(), local_stream(std::move(socket)), boost::beast::flat_buffer(), mContext)->run();
         }
 
         // Accept another connection
@@ -976,19 +2892,125 @@ private:
     }
 };
 
+#if defined(__linux__)
+
+// Hands the listening sockets of the server to a successor process that
+// connects to its Unix domain socket (see bda::receiveListeningSockets()).
+// The successor then accepts the next handoff on the same path.
+class SocketHandoffListener : public std::enable_shared_from_this<SocketHandoffListener> {
+    boost::asio::local::stream_protocol::acceptor acceptor_;
+    const std::string mSocketPath;
+    bool mOwnsSocketFile = true;
+
+    // Returns the listening sockets to hand off, and is called once they
+    // were handed off:
+    std::function<std::vector<int>()> mListeningSockets;
+    std::function<void()> mHandedOff;
+
+public:
+    SocketHandoffListener(boost::asio::io_context& aIOContext, const std::string& aSocketPath,
+                          std::function<std::vector<int>()> aListeningSockets, std::function<void()> aHandedOff)
+        : acceptor_(boost::asio::make_strand(aIOContext)), mSocketPath(aSocketPath),
+          mListeningSockets(std::move(aListeningSockets)), mHandedOff(std::move(aHandedOff)) {
+        // Replace the socket file of a previous process, but nothing else:
+        struct stat vStat;
+        if (::lstat(mSocketPath.c_str(), &vStat) == 0) {
+            if (!S_ISSOCK(vStat.st_mode)) {
+                throw(std::runtime_error("bda::SocketHandoffListener::SocketHandoffListener(): The path '" + mSocketPath + "' exists and is not a socket"));
+            }
+            ::unlink(mSocketPath.c_str());
+        }
+
+        // Only processes of the same user may take over the sockets:
+        boost::beast::error_code ec;
+        const boost::asio::local::stream_protocol::endpoint vEndpoint(mSocketPath);
+        acceptor_.open(vEndpoint.protocol(), ec);
+        if (!ec) {
+            acceptor_.bind(vEndpoint, ec);
+        }
+        if (!ec && ::chmod(mSocketPath.c_str(), 0600) != 0) {
+            ec = boost::beast::error_code(errno, boost::system::generic_category());
+        }
+        if (!ec) {
+            acceptor_.listen(1, ec);
+        }
+        if (ec) {
+            throw(std::runtime_error("bda::SocketHandoffListener::SocketHandoffListener(): Could not listen on '" + mSocketPath + "': " + ec.message()));
+        }
+    }
+
+    ~SocketHandoffListener() {
+        if (mOwnsSocketFile) {
+            ::unlink(mSocketPath.c_str());
+        }
+    }
+
+    // Wait for a successor
+    void run() {
+        acceptor_.async_accept(bda::bindRecyclingAllocator(boost::beast::bind_front_handler(&SocketHandoffListener::on_accept, shared_from_this())));
+    }
+
+private:
+    void on_accept(const boost::beast::error_code ec, boost::asio::local::stream_protocol::socket socket) {
+        if (!acceptor_.is_open()) {
+            return;
+        }
+        if (ec) {
+            fail(ec, "handoff accept");
+            return run();
+        }
+
+        // Free the path before the successor learns that it took over, so
+        // that it can accept the next handoff there:
+        boost::beast::error_code vCloseError;
+        acceptor_.close(vCloseError);
+        ::unlink(mSocketPath.c_str());
+        mOwnsSocketFile = false;
+
+        try {
+            const std::vector<int> vSockets = mListeningSockets();
+            bda::sendFileDescriptors(socket.native_handle(), vSockets.data(), vSockets.size());
+        } catch (const std::exception& vException) {
+            BDAMessage(2, "SocketHandoffListener::on_accept(): Could not hand off the listening sockets: " + std::string(vException.what()) + "\n");
+            return;
+        }
+        BDAMessage(8, "SocketHandoffListener::on_accept(): Handed off the listening sockets.\n");
+        mHandedOff();
+    }
+};
+
+#endif
+
+#endif
+
 ThriftHTTPWSServer::ThriftHTTPWSServer(const std::string& aServerURL, const unsigned short aPort,
                                        const std::string& aHTTPDocumentRoot, const int aThreads,
                                        std::shared_ptr<apache::thrift::TProcessor> aThriftProcessor,
                                        const bda::ProtocolType aProtocolType)
     : mThreads(aThreads) {
-    // The SSL context is required to hold the SSL certificates
-    boost::asio::ssl::context vSSLContext{ boost::asio::ssl::context::tlsv12 };
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+    // All sockets use io_uring in this build, there is no epoll to fall back to:
+    if (!isIoUringAvailable()) {
+        throw(std::runtime_error("bda::ThriftHTTPWSServer::ThriftHTTPWSServer(): The library was built with BDA_IO_URING=ALL, but the kernel does not support io_uring"));
+    }
+#endif
+    mIOContext = std::make_shared<boost::asio::io_context>(mThreads);
+    mSessionContext = std::make_shared<bda::ThriftSessionContext>(mIOContext->get_executor());
+    mSessionContext->mHTTPDocumentRoot = aHTTPDocumentRoot;
+    mSessionContext->mDefaultService = std::make_shared<bda::ThriftService>();
+    mSessionContext->mDefaultService->mThriftProcessor = aThriftProcessor;
 
-    // This holds the self-signed certificate used by the server
-    load_server_certificate(vSSLContext);
+    // The SSL context is required to hold the SSL certificates. It is owned
+    // by the session context, because every SSL session refers to it.
+    mSessionContext->mSSLContext = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tlsv12);
 
+    // This holds the self-signed certificate used by the server
+    load_server_certificate(*mSessionContext->mSSLContext);
 
-    mIOContext = std::make_shared<boost::asio::io_context>(mThreads);
+#if defined(BDA_HAS_HTTP2)
+    // Offer HTTP/2 to clients that support it:
+    SSL_CTX_set_alpn_select_cb(mSessionContext->mSSLContext->native_handle(), &bda::select_alpn_protocol, nullptr);
+#endif
 
     // Create the thrift protocol for the transport. Note that we need to use
     // a thrift TMemoryBuffer for the transport because the actual send and
@@ -996,13 +3018,215 @@ ThriftHTTPWSServer::ThriftHTTPWSServer(const std::string& aServerURL, const unsi
     // a bit simplified and currently only supports TBinaryProtocol, because
     // the constructor for TJSONProtocol has different arguments. This could
     // be fixed easily.
-    std::shared_ptr<apache::thrift::protocol::TProtocolFactory> vThriftProtocolFactory = bda::createProtocolFactory(aProtocolType);
+    mSessionContext->mProtocolType = aProtocolType;
+    mSessionContext->mThriftProtocolFactory = bda::createProtocolFactory(aProtocolType);
 
     boost::asio::ip::tcp::endpoint vServerEndpoint{ boost::asio::ip::make_address(aServerURL.c_str()), aPort };
 
     // Create and launch a listening port
-    mConnectionListener = std::make_shared<bda::HTTPConnectListener>(mIOContext, vSSLContext, vServerEndpoint, aHTTPDocumentRoot,
-                                                                     vThriftProtocolFactory, aThriftProcessor);
+    mConnectionListener = std::make_shared<bda::HTTPConnectListener>(mIOContext, vServerEndpoint, mSessionContext);
+}
+
+ThriftHTTPWSServer::ThriftHTTPWSServer(const std::string& aServerURL, const unsigned short aPort,
+                                       const std::string& aHTTPDocumentRoot, const int aThreads,
+                                       std::shared_ptr<apache::thrift::async::TAsyncProcessor> aAsyncProcessor,
+                                       const bda::ProtocolType aProtocolType)
+    : ThriftHTTPWSServer(aServerURL, aPort, aHTTPDocumentRoot, aThreads, std::shared_ptr<apache::thrift::TProcessor>(), aProtocolType) {
+    mSessionContext->mDefaultService->mAsyncProcessor = aAsyncProcessor;
+}
+
+void ThriftHTTPWSServer::setBatchMode(const bool aEnabled, const bool aParallel) {
+    mSessionContext->mBatchEnabled = aEnabled;
+    mSessionContext->mBatchParallel = aParallel;
+}
+
+void ThriftHTTPWSServer::setFramedThriftMode(const bool aEnabled) {
+    mSessionContext->mFramedThriftEnabled = aEnabled;
+}
+
+void ThriftHTTPWSServer::setAccessManager(std::shared_ptr<bda::ThriftAccessManager> aAccessManager) {
+    mSessionContext->mAccessManager = aAccessManager;
+}
+
+void ThriftHTTPWSServer::setResponseCache(std::shared_ptr<bda::ThriftResponseCache> aResponseCache) {
+    mSessionContext->mResponseCache = aResponseCache;
+}
+
+void ThriftHTTPWSServer::setRequestCoalescer(std::shared_ptr<bda::ThriftRequestCoalescer> aRequestCoalescer) {
+    mSessionContext->mRequestCoalescer = aRequestCoalescer;
+}
+
+void ThriftHTTPWSServer::setExecutionPool(std::shared_ptr<bda::ThriftExecutionPool> aExecutionPool) {
+    mSessionContext->mDefaultService->mExecutionPool = aExecutionPool;
+}
+
+namespace {
+
+bda::ThriftService& registerService(bda::ThriftSessionContext& aContext, const std::string& aPath,
+                                    std::shared_ptr<bda::ThriftExecutionPool> aExecutionPool, const std::size_t aMaxConnections) {
+    if (aPath.empty() || aPath[0] != '/') {
+        throw(std::runtime_error("bda::ThriftHTTPWSServer::addService(): The path '" + aPath + "' is not absolute"));
+    }
+    if (aContext.mServices.count(aPath) > 0) {
+        throw(std::runtime_error("bda::ThriftHTTPWSServer::addService(): A service is already registered for '" + aPath + "'"));
+    }
+
+    std::shared_ptr<bda::ThriftService> vService = std::make_shared<bda::ThriftService>();
+    vService->mPath = aPath;
+    vService->mExecutionPool = aExecutionPool;
+    vService->mMaxConnections = aMaxConnections;
+    aContext.mServices[aPath] = vService;
+    return *vService;
+}
+
+}
+
+void ThriftHTTPWSServer::addService(const std::string& aPath, std::shared_ptr<apache::thrift::TProcessor> aThriftProcessor,
+                                    std::shared_ptr<bda::ThriftExecutionPool> aExecutionPool, const std::size_t aMaxConnections) {
+    registerService(*mSessionContext, aPath, aExecutionPool, aMaxConnections).mThriftProcessor = aThriftProcessor;
+}
+
+void ThriftHTTPWSServer::addService(const std::string& aPath, std::shared_ptr<apache::thrift::async::TAsyncProcessor> aAsyncProcessor,
+                                    std::shared_ptr<bda::ThriftExecutionPool> aExecutionPool, const std::size_t aMaxConnections) {
+    registerService(*mSessionContext, aPath, aExecutionPool, aMaxConnections).mAsyncProcessor = aAsyncProcessor;
+}
+
+void ThriftHTTPWSServer::setDeadlineMode(const bool aEnabled) {
+    mSessionContext->mDeadlinesEnabled = aEnabled;
+}
+
+uint64_t ThriftHTTPWSServer::expiredCalls() const {
+    return mSessionContext->mExpiredCalls.load();
+}
+
+void ThriftHTTPWSServer::setTracer(std::shared_ptr<bda::ThriftTracer> aTracer) {
+    mSessionContext->mTracer = aTracer;
+}
+
+void ThriftHTTPWSServer::setTrafficCapture(std::shared_ptr<bda::ThriftTrafficCapture> aTrafficCapture) {
+    mSessionContext->mTrafficCapture = aTrafficCapture;
+}
+
+void ThriftHTTPWSServer::setSlowCallLog(std::shared_ptr<bda::ThriftSlowCallLog> aSlowCallLog, const std::string& aHTTPPath) {
+    mSessionContext->mSlowCallLog = aSlowCallLog;
+    if (!aHTTPPath.empty()) {
+        std::weak_ptr<bda::ThriftSlowCallLog> vSlowCallLog = aSlowCallLog;
+        mSessionContext->mJSONEndpoints[aHTTPPath] = [vSlowCallLog]() {
+            std::ostringstream vDocument;
+            if (std::shared_ptr<bda::ThriftSlowCallLog> vLog = vSlowCallLog.lock()) {
+                vLog->writeJSON(vDocument);
+            }
+            return vDocument.str();
+        };
+    }
+}
+
+void ThriftHTTPWSServer::setEmbeddedDocumentRoot(const bda::ThriftEmbeddedDocumentRoot& aDocumentRoot, const bool aFallbackToDisk) {
+    mSessionContext->mEmbeddedDocumentRoot = &aDocumentRoot;
+    mSessionContext->mEmbeddedFallbackToDisk = aFallbackToDisk;
+}
+
+void ThriftHTTPWSServer::setMemoryBudget(const std::size_t aBytes) {
+    mSessionContext->mMemoryBudget = std::make_shared<bda::ThriftMemoryBudget>(aBytes);
+}
+
+std::size_t ThriftHTTPWSServer::bufferedBytes() const {
+    return mSessionContext->mMemoryBudget ? mSessionContext->mMemoryBudget->used() : 0;
+}
+
+uint64_t ThriftHTTPWSServer::throttledReads() const {
+    return mSessionContext->mMemoryBudget ? mSessionContext->mMemoryBudget->throttledReads() : 0;
+}
+
+std::size_t ThriftHTTPWSServer::throttledSessions() const {
+    return mSessionContext->mMemoryBudget ? mSessionContext->mMemoryBudget->waitingReads() : 0;
+}
+
+void ThriftHTTPWSServer::setProfiler(std::shared_ptr<bda::ThriftProfiler> aProfiler, const std::string& aHTTPPath) {
+    mSessionContext->mProfiler = aProfiler;
+    mSessionContext->mProfilerPath = aHTTPPath;
+}
+
+void ThriftHTTPWSServer::addLocalEndpoint(const std::string& aSocketPath, const uint32_t aPermissions) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    mLocalListeners.push_back(std::make_shared<bda::HTTPLocalListener>(mIOContext, aSocketPath, aPermissions, mSessionContext));
+#else
+    boost::ignore_unused(aSocketPath, aPermissions);
+    throw(std::runtime_error("bda::ThriftHTTPWSServer::addLocalEndpoint(): Unix domain sockets are not supported on this platform"));
+#endif
+}
+
+void ThriftHTTPWSServer::addSharedMemoryEndpoint(const std::string& aSocketPath, const uint32_t aPermissions) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS) && defined(__linux__)
+    mLocalListeners.push_back(std::make_shared<bda::HTTPLocalListener>(mIOContext, aSocketPath, aPermissions, mSessionContext, true));
+#else
+    boost::ignore_unused(aSocketPath, aPermissions);
+    throw(std::runtime_error("bda::ThriftHTTPWSServer::addSharedMemoryEndpoint(): Shared memory transports are only supported on Linux"));
+#endif
+}
+
+void ThriftHTTPWSServer::enableSocketHandoff(const std::string& aSocketPath, std::function<void()> aHandedOff) {
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS) && defined(__linux__)
+    mSocketHandoffListener = std::make_shared<bda::SocketHandoffListener>(*mIOContext, aSocketPath,
+        [this]() {
+            std::vector<int> vSockets;
+            vSockets.push_back(mConnectionListener->native_handle());
+            for (const std::shared_ptr<bda::HTTPLocalListener>& vLocalListener : mLocalListeners) {
+                vSockets.push_back(vLocalListener->native_handle());
+            }
+            return vSockets;
+        },
+        [this, aHandedOff]() {
+            stopAccepting(true);
+            if (aHandedOff) {
+                aHandedOff();
+            }
+        });
+#else
+    boost::ignore_unused(aSocketPath, aHandedOff);
+    throw(std::runtime_error("bda::ThriftHTTPWSServer::enableSocketHandoff(): Socket handoffs are only supported on Linux"));
+#endif
+}
+
+std::size_t ThriftHTTPWSServer::connections() const {
+    std::size_t vConnections = mSessionContext->mDefaultService->mConnections;
+    for (const auto& vService : mSessionContext->mServices) {
+        vConnections += vService.second->mConnections;
+    }
+    return vConnections;
+}
+
+std::size_t ThriftHTTPWSServer::requests() const {
+    return mSessionContext->mRequests;
+}
+
+bool ThriftHTTPWSServer::drain(const std::chrono::milliseconds aTimeout) {
+    stopAccepting(false);
+    const std::chrono::steady_clock::time_point vEnd = std::chrono::steady_clock::now() + aTimeout;
+    while (connections() > 0 || requests() > 0) {
+        if (std::chrono::steady_clock::now() >= vEnd) {
+            BDAMessage(2, "ThriftHTTPWSServer::drain(): " + std::to_string(connections()) + " connections and " + std::to_string(requests()) +
+                              " HTTP requests are still open.\n");
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return true;
+}
+
+void ThriftHTTPWSServer::stopAccepting(const bool aHandedOff) {
+    mConnectionListener->close();
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    for (const std::shared_ptr<bda::HTTPLocalListener>& vLocalListener : mLocalListeners) {
+        vLocalListener->close(aHandedOff);
+    }
+#else
+    boost::ignore_unused(aHandedOff);
+#endif
+}
+
+unsigned short ThriftHTTPWSServer::port() const {
+    return mConnectionListener->port();
 }
 
 void ThriftHTTPWSServer::asyncRun() {
@@ -1011,6 +3235,14 @@ void ThriftHTTPWSServer::asyncRun() {
 
 void ThriftHTTPWSServer::backgroundRun() {
     mConnectionListener->run();
+    for (const std::shared_ptr<bda::HTTPLocalListener>& vLocalListener : mLocalListeners) {
+        vLocalListener->run();
+    }
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS) && defined(__linux__)
+    if (mSocketHandoffListener) {
+        mSocketHandoffListener->run();
+    }
+#endif
 
     // Run the I/O service on the requested number of threads
     mWebServerThreads.reserve(mThreads - 1);
@@ -1037,6 +3269,20 @@ void ThriftHTTPWSServer::stop() {
 
     BDAMessage(8, "ThriftHTTPWSServer::stop(): Joining main server thread\n");
     mMainServerThread->join();
+
+    // The sessions that wait for memory would keep the context alive:
+    if (mSessionContext->mMemoryBudget) {
+        mSessionContext->mMemoryBudget->cancelWaitingReads();
+    }
+
+    // A running profile must not answer into the stopped io-context later:
+    if (mSessionContext->mProfiler) {
+        mSessionContext->mProfiler->stop();
+    }
+
+    if (mSessionContext->mTrafficCapture) {
+        mSessionContext->mTrafficCapture->flush();
+    }
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,41 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTINHERITEDSOCKETS_HH
+#define THRIFTINHERITEDSOCKETS_HH
+
+#include <boost/asio/ip/tcp.hpp>
+
+#include <string>
+
+namespace bda {
+
+/**
+ * @brief Remove and return the inherited listening socket that is bound to
+ * aEndpoint, from systemd or from receiveListeningSockets(), or -1 if there
+ * is none.
+ */
+int takeInheritedSocket(const boost::asio::ip::tcp::endpoint& aEndpoint);
+
+/** @brief Like above, for a Unix domain socket bound to aSocketPath. */
+int takeInheritedSocket(const std::string& aSocketPath);
+
+}
+
+#endif
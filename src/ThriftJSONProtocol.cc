@@ -0,0 +1,984 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftJSONProtocol.hh"
+
+#include <thrift/protocol/TProtocolException.h>
+#include <thrift/transport/TTransport.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BDA_JSON_SSE2 1
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define BDA_JSON_SSSE3 1
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace bda {
+
+namespace {
+
+using apache::thrift::protocol::TProtocolException;
+using apache::thrift::protocol::TType;
+
+const char cThriftNan[] = "NaN";
+const char cThriftInfinity[] = "Infinity";
+const char cThriftNegativeInfinity[] = "-Infinity";
+const int64_t cThriftVersion1 = 1;
+
+// The escape of a character below 0x30 in a JSON string, as in TJSONProtocol:
+// 0 is written as \u00XX, 1 as is, and anything else after a backslash.
+const uint8_t cJSONCharTable[0x30] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 'b', 't', 'n', 0, 'f', 'r', 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, '"', 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+};
+
+const char cBase64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// The 6-bit values of the base64 characters, 0xFF for all other characters:
+struct Base64Values {
+    uint8_t mValues[256];
+
+    Base64Values() {
+        std::memset(mValues, 0xFF, sizeof(mValues));
+        for (uint8_t vIdx = 0; vIdx < 64; ++vIdx) {
+            mValues[static_cast<uint8_t>(cBase64Chars[vIdx])] = vIdx;
+        }
+    }
+};
+const Base64Values cBase64Values;
+
+inline unsigned countTrailingZeros(const unsigned aMask) {
+#if defined(_MSC_VER)
+    unsigned long vIndex = 0;
+    _BitScanForward(&vIndex, aMask);
+    return static_cast<unsigned>(vIndex);
+#else
+    return static_cast<unsigned>(__builtin_ctz(aMask));
+#endif
+}
+
+char hexChar(const uint8_t aValue) {
+    const uint8_t vValue = aValue & 0x0F;
+    return static_cast<char>(vValue < 10 ? '0' + vValue : 'a' + vValue - 10);
+}
+
+uint8_t hexValue(const uint8_t aChar) {
+    if (aChar >= '0' && aChar <= '9') {
+        return aChar - '0';
+    } else if (aChar >= 'a' && aChar <= 'f') {
+        return aChar - 'a' + 10;
+    } else if (aChar >= 'A' && aChar <= 'F') {
+        return aChar - 'A' + 10;
+    }
+    throw(TProtocolException(TProtocolException::INVALID_DATA, "Expected hex val ([0-9a-f]); got '" + std::string(1, static_cast<char>(aChar)) + "'."));
+}
+
+void appendEscapedChar(std::string& aOutput, const uint8_t aChar) {
+    if (aChar == '\\') {
+        aOutput.append("\\\\", 2);
+    } else if (aChar >= 0x30 || cJSONCharTable[aChar] == 1) {
+        aOutput.push_back(static_cast<char>(aChar));
+    } else if (cJSONCharTable[aChar] > 1) {
+        aOutput.push_back('\\');
+        aOutput.push_back(static_cast<char>(cJSONCharTable[aChar]));
+    } else {
+        const char vEscape[6] = { '\\', 'u', '0', '0', hexChar(aChar >> 4), hexChar(aChar) };
+        aOutput.append(vEscape, sizeof(vEscape));
+    }
+}
+
+// Append aData escaped for a JSON string. Runs without characters to escape
+// (quote, backslash, control characters) are found 16 bytes at a time and
+// copied at once.
+void appendEscaped(std::string& aOutput, const char* aData, const std::size_t aSize) {
+    aOutput.reserve(aOutput.size() + aSize + 2);
+    std::size_t vRunStart = 0;
+    std::size_t vIdx = 0;
+#if defined(BDA_JSON_SSE2)
+    const __m128i vQuote = _mm_set1_epi8('"');
+    const __m128i vBackslash = _mm_set1_epi8('\\');
+    const __m128i vControl = _mm_set1_epi8(0x1F);
+    while (vIdx + 16 <= aSize) {
+        const __m128i vChars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aData + vIdx));
+        const __m128i vSpecial = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(vChars, vQuote), _mm_cmpeq_epi8(vChars, vBackslash)),
+                                              _mm_cmpeq_epi8(_mm_max_epu8(vChars, vControl), vControl));
+        unsigned vMask = static_cast<unsigned>(_mm_movemask_epi8(vSpecial));
+        while (vMask != 0) {
+            const std::size_t vPos = vIdx + countTrailingZeros(vMask);
+            aOutput.append(aData + vRunStart, vPos - vRunStart);
+            appendEscapedChar(aOutput, static_cast<uint8_t>(aData[vPos]));
+            vRunStart = vPos + 1;
+            vMask &= vMask - 1;
+        }
+        vIdx += 16;
+    }
+#endif
+    for (; vIdx < aSize; ++vIdx) {
+        const uint8_t vChar = static_cast<uint8_t>(aData[vIdx]);
+        if (vChar == '"' || vChar == '\\' || vChar < 0x20) {
+            aOutput.append(aData + vRunStart, vIdx - vRunStart);
+            appendEscapedChar(aOutput, vChar);
+            vRunStart = vIdx + 1;
+        }
+    }
+    aOutput.append(aData + vRunStart, aSize - vRunStart);
+}
+
+// The position of the first quote or backslash, or aSize if there is none:
+std::size_t findStringSpecial(const uint8_t* aData, const std::size_t aSize) {
+    std::size_t vIdx = 0;
+#if defined(BDA_JSON_SSE2)
+    const __m128i vQuote = _mm_set1_epi8('"');
+    const __m128i vBackslash = _mm_set1_epi8('\\');
+    for (; vIdx + 16 <= aSize; vIdx += 16) {
+        const __m128i vChars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aData + vIdx));
+        const unsigned vMask = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(vChars, vQuote), _mm_cmpeq_epi8(vChars, vBackslash))));
+        if (vMask != 0) {
+            return vIdx + countTrailingZeros(vMask);
+        }
+    }
+#endif
+    for (; vIdx < aSize; ++vIdx) {
+        if (aData[vIdx] == '"' || aData[vIdx] == '\\') {
+            return vIdx;
+        }
+    }
+    return aSize;
+}
+
+// Append the base64 encoding of aData without padding, as TJSONProtocol does:
+void appendBase64(std::string& aOutput, const uint8_t* aData, const std::size_t aSize) {
+    const std::size_t vRemainder = aSize % 3;
+    std::size_t vOffset = aOutput.size();
+    aOutput.resize(vOffset + aSize / 3 * 4 + (vRemainder ? vRemainder + 1 : 0));
+    char* vOutput = &aOutput[0];
+
+    std::size_t vIdx = 0;
+#if defined(BDA_JSON_SSSE3)
+    // Encode 12 bytes to 16 characters per step (W. Muła, "Base64 encoding
+    // with SIMD instructions"), loading 16 bytes:
+    const __m128i vShuffle = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i vShiftLUT = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    for (; vIdx + 16 <= aSize; vIdx += 12, vOffset += 16) {
+        const __m128i vInput = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(aData + vIdx)), vShuffle);
+        const __m128i vHigh = _mm_mulhi_epu16(_mm_and_si128(vInput, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        const __m128i vLow = _mm_mullo_epi16(_mm_and_si128(vInput, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        const __m128i vIndices = _mm_or_si128(vHigh, vLow);
+
+        __m128i vShift = _mm_subs_epu8(vIndices, _mm_set1_epi8(51));
+        vShift = _mm_or_si128(vShift, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), vIndices), _mm_set1_epi8(13)));
+        const __m128i vChars = _mm_add_epi8(_mm_shuffle_epi8(vShiftLUT, vShift), vIndices);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(vOutput + vOffset), vChars);
+    }
+#endif
+    for (; vIdx + 3 <= aSize; vIdx += 3, vOffset += 4) {
+        const uint32_t vBits = (static_cast<uint32_t>(aData[vIdx]) << 16) | (static_cast<uint32_t>(aData[vIdx + 1]) << 8) | aData[vIdx + 2];
+        vOutput[vOffset] = cBase64Chars[(vBits >> 18) & 0x3F];
+        vOutput[vOffset + 1] = cBase64Chars[(vBits >> 12) & 0x3F];
+        vOutput[vOffset + 2] = cBase64Chars[(vBits >> 6) & 0x3F];
+        vOutput[vOffset + 3] = cBase64Chars[vBits & 0x3F];
+    }
+    if (vRemainder > 0) {
+        const uint32_t vBits = (static_cast<uint32_t>(aData[vIdx]) << 16) | (vRemainder == 2 ? static_cast<uint32_t>(aData[vIdx + 1]) << 8 : 0);
+        vOutput[vOffset] = cBase64Chars[(vBits >> 18) & 0x3F];
+        vOutput[vOffset + 1] = cBase64Chars[(vBits >> 12) & 0x3F];
+        if (vRemainder == 2) {
+            vOutput[vOffset + 2] = cBase64Chars[(vBits >> 6) & 0x3F];
+        }
+    }
+}
+
+// Decode base64 with or without padding into aOutput, like TJSONProtocol a
+// single trailing character is ignored. Returns false on invalid characters.
+bool decodeBase64(const uint8_t* aData, std::size_t aSize, std::string& aOutput) {
+    for (unsigned vPadding = 0; vPadding < 2 && aSize > 0 && aData[aSize - 1] == '='; ++vPadding) {
+        --aSize;
+    }
+    const std::size_t vRemainder = aSize % 4;
+    const std::size_t vDecodedSize = aSize / 4 * 3 + (vRemainder > 1 ? vRemainder - 1 : 0);
+
+    // The vector path stores 16 bytes for every 12 decoded ones:
+    aOutput.resize(vDecodedSize + 4);
+    uint8_t* vOutput = reinterpret_cast<uint8_t*>(&aOutput[0]);
+    std::size_t vOffset = 0;
+
+    std::size_t vIdx = 0;
+#if defined(BDA_JSON_SSSE3)
+    // Map 16 characters to their 6-bit values and pack them into 12 bytes
+    // per step (W. Muła, D. Lemire, "Faster Base64 Encoding and Decoding
+    // using AVX2 Instructions"). Characters with the top bit set compare as
+    // negative, so they fall into none of the ranges:
+    for (; vIdx + 16 <= aSize; vIdx += 16, vOffset += 12) {
+        const __m128i vChars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aData + vIdx));
+        const __m128i vUpper = _mm_and_si128(_mm_cmpgt_epi8(vChars, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(vChars, _mm_set1_epi8('Z' + 1)));
+        const __m128i vLower = _mm_and_si128(_mm_cmpgt_epi8(vChars, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(vChars, _mm_set1_epi8('z' + 1)));
+        const __m128i vDigit = _mm_and_si128(_mm_cmpgt_epi8(vChars, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(vChars, _mm_set1_epi8('9' + 1)));
+        const __m128i vPlus = _mm_cmpeq_epi8(vChars, _mm_set1_epi8('+'));
+        const __m128i vSlash = _mm_cmpeq_epi8(vChars, _mm_set1_epi8('/'));
+        const __m128i vValid = _mm_or_si128(_mm_or_si128(_mm_or_si128(vUpper, vLower), _mm_or_si128(vDigit, vPlus)), vSlash);
+        if (_mm_movemask_epi8(vValid) != 0xFFFF) {
+            return false;
+        }
+
+        __m128i vShift = _mm_and_si128(vUpper, _mm_set1_epi8(-'A'));
+        vShift = _mm_or_si128(vShift, _mm_and_si128(vLower, _mm_set1_epi8(26 - 'a')));
+        vShift = _mm_or_si128(vShift, _mm_and_si128(vDigit, _mm_set1_epi8(52 - '0')));
+        vShift = _mm_or_si128(vShift, _mm_and_si128(vPlus, _mm_set1_epi8(62 - '+')));
+        vShift = _mm_or_si128(vShift, _mm_and_si128(vSlash, _mm_set1_epi8(63 - '/')));
+        const __m128i vValues = _mm_add_epi8(vChars, vShift);
+
+        const __m128i vPairs = _mm_maddubs_epi16(vValues, _mm_set1_epi32(0x01400140));
+        const __m128i vWords = _mm_madd_epi16(vPairs, _mm_set1_epi32(0x00011000));
+        const __m128i vBytes = _mm_shuffle_epi8(vWords, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(vOutput + vOffset), vBytes);
+    }
+#endif
+    const uint8_t* vValues = cBase64Values.mValues;
+    for (; vIdx + 4 <= aSize; vIdx += 4, vOffset += 3) {
+        const uint8_t v0 = vValues[aData[vIdx]], v1 = vValues[aData[vIdx + 1]], v2 = vValues[aData[vIdx + 2]], v3 = vValues[aData[vIdx + 3]];
+        if ((v0 | v1 | v2 | v3) & 0x80) {
+            return false;
+        }
+        const uint32_t vBits = (static_cast<uint32_t>(v0) << 18) | (static_cast<uint32_t>(v1) << 12) | (static_cast<uint32_t>(v2) << 6) | v3;
+        vOutput[vOffset] = static_cast<uint8_t>(vBits >> 16);
+        vOutput[vOffset + 1] = static_cast<uint8_t>(vBits >> 8);
+        vOutput[vOffset + 2] = static_cast<uint8_t>(vBits);
+    }
+    if (vRemainder > 1) {
+        const uint8_t v0 = vValues[aData[vIdx]], v1 = vValues[aData[vIdx + 1]], v2 = vRemainder == 3 ? vValues[aData[vIdx + 2]] : 0;
+        if ((v0 | v1 | v2) & 0x80) {
+            return false;
+        }
+        const uint32_t vBits = (static_cast<uint32_t>(v0) << 18) | (static_cast<uint32_t>(v1) << 12) | (static_cast<uint32_t>(v2) << 6);
+        vOutput[vOffset] = static_cast<uint8_t>(vBits >> 16);
+        if (vRemainder == 3) {
+            vOutput[vOffset + 1] = static_cast<uint8_t>(vBits >> 8);
+        }
+    }
+    aOutput.resize(vDecodedSize);
+    return true;
+}
+
+void appendUTF8(std::string& aOutput, const uint32_t aCodePoint) {
+    if (aCodePoint < 0x80) {
+        aOutput.push_back(static_cast<char>(aCodePoint));
+    } else if (aCodePoint < 0x800) {
+        aOutput.push_back(static_cast<char>(0xC0 | (aCodePoint >> 6)));
+        aOutput.push_back(static_cast<char>(0x80 | (aCodePoint & 0x3F)));
+    } else if (aCodePoint < 0x10000) {
+        aOutput.push_back(static_cast<char>(0xE0 | (aCodePoint >> 12)));
+        aOutput.push_back(static_cast<char>(0x80 | ((aCodePoint >> 6) & 0x3F)));
+        aOutput.push_back(static_cast<char>(0x80 | (aCodePoint & 0x3F)));
+    } else {
+        aOutput.push_back(static_cast<char>(0xF0 | (aCodePoint >> 18)));
+        aOutput.push_back(static_cast<char>(0x80 | ((aCodePoint >> 12) & 0x3F)));
+        aOutput.push_back(static_cast<char>(0x80 | ((aCodePoint >> 6) & 0x3F)));
+        aOutput.push_back(static_cast<char>(0x80 | (aCodePoint & 0x3F)));
+    }
+}
+
+const char* getTypeNameForTypeID(const TType aTypeID) {
+    switch (aTypeID) {
+        case apache::thrift::protocol::T_BOOL:
+            return "tf";
+        case apache::thrift::protocol::T_BYTE:
+            return "i8";
+        case apache::thrift::protocol::T_I16:
+            return "i16";
+        case apache::thrift::protocol::T_I32:
+            return "i32";
+        case apache::thrift::protocol::T_I64:
+            return "i64";
+        case apache::thrift::protocol::T_DOUBLE:
+            return "dbl";
+        case apache::thrift::protocol::T_STRING:
+            return "str";
+        case apache::thrift::protocol::T_STRUCT:
+            return "rec";
+        case apache::thrift::protocol::T_MAP:
+            return "map";
+        case apache::thrift::protocol::T_SET:
+            return "set";
+        case apache::thrift::protocol::T_LIST:
+            return "lst";
+        default:
+            throw(TProtocolException(TProtocolException::NOT_IMPLEMENTED, "Unrecognized type"));
+    }
+}
+
+TType getTypeIDForTypeName(const std::string& aName) {
+    if (aName == "tf") {
+        return apache::thrift::protocol::T_BOOL;
+    } else if (aName == "i8") {
+        return apache::thrift::protocol::T_BYTE;
+    } else if (aName == "i16") {
+        return apache::thrift::protocol::T_I16;
+    } else if (aName == "i32") {
+        return apache::thrift::protocol::T_I32;
+    } else if (aName == "i64") {
+        return apache::thrift::protocol::T_I64;
+    } else if (aName == "dbl") {
+        return apache::thrift::protocol::T_DOUBLE;
+    } else if (aName == "str") {
+        return apache::thrift::protocol::T_STRING;
+    } else if (aName == "rec") {
+        return apache::thrift::protocol::T_STRUCT;
+    } else if (aName == "map") {
+        return apache::thrift::protocol::T_MAP;
+    } else if (aName == "set") {
+        return apache::thrift::protocol::T_SET;
+    } else if (aName == "lst") {
+        return apache::thrift::protocol::T_LIST;
+    }
+    throw(TProtocolException(TProtocolException::NOT_IMPLEMENTED, "Unrecognized type"));
+}
+
+template<typename T>
+T narrowInteger(const int64_t aValue) {
+    if (aValue < static_cast<int64_t>(std::numeric_limits<T>::min()) || aValue > static_cast<int64_t>(std::numeric_limits<T>::max())) {
+        throw(TProtocolException(TProtocolException::INVALID_DATA, "Expected numeric value; got \"" + std::to_string(aValue) + "\""));
+    }
+    return static_cast<T>(aValue);
+}
+
+}
+
+ThriftJSONProtocol::ThriftJSONProtocol(std::shared_ptr<apache::thrift::transport::TTransport> aTransport)
+    : apache::thrift::protocol::TVirtualProtocol<ThriftJSONProtocol>(aTransport), mTransport(aTransport.get()) {
+}
+
+void ThriftJSONProtocol::pushContext(const bool aPair) {
+    Context vContext;
+    vContext.mPair = aPair;
+    mContexts.push_back(vContext);
+}
+
+void ThriftJSONProtocol::popContext() {
+    if (!mContexts.empty()) {
+        mContexts.pop_back();
+    }
+}
+
+bool ThriftJSONProtocol::appendSeparator() {
+    if (mContexts.empty()) {
+        return false;
+    }
+    Context& vContext = mContexts.back();
+    if (vContext.mFirst) {
+        vContext.mFirst = false;
+        vContext.mColon = true;
+        return vContext.mPair;
+    }
+    if (!vContext.mPair) {
+        mWriteBuffer.push_back(',');
+        return false;
+    }
+    mWriteBuffer.push_back(vContext.mColon ? ':' : ',');
+    vContext.mColon = !vContext.mColon;
+    return vContext.mColon;
+}
+
+uint32_t ThriftJSONProtocol::flushWriteBuffer() {
+    const uint32_t vSize = static_cast<uint32_t>(mWriteBuffer.size());
+    mTransport->write(reinterpret_cast<const uint8_t*>(mWriteBuffer.data()), vSize);
+    mWriteBuffer.clear();
+    return vSize;
+}
+
+void ThriftJSONProtocol::appendInteger(const int64_t aValue) {
+    const bool vQuote = appendSeparator();
+    if (vQuote) {
+        mWriteBuffer.push_back('"');
+    }
+    mWriteBuffer += std::to_string(aValue);
+    if (vQuote) {
+        mWriteBuffer.push_back('"');
+    }
+}
+
+void ThriftJSONProtocol::appendString(const char* aData, const std::size_t aSize) {
+    appendSeparator();
+    mWriteBuffer.push_back('"');
+    appendEscaped(mWriteBuffer, aData, aSize);
+    mWriteBuffer.push_back('"');
+}
+
+void ThriftJSONProtocol::appendStart(const char aChar, const bool aPair) {
+    appendSeparator();
+    mWriteBuffer.push_back(aChar);
+    pushContext(aPair);
+}
+
+void ThriftJSONProtocol::appendEnd(const char aChar) {
+    popContext();
+    mWriteBuffer.push_back(aChar);
+}
+
+uint32_t ThriftJSONProtocol::writeMessageBegin(const std::string& name, const apache::thrift::protocol::TMessageType messageType, const int32_t seqid) {
+    appendStart('[', false);
+    appendInteger(cThriftVersion1);
+    appendString(name.data(), name.size());
+    appendInteger(messageType);
+    appendInteger(seqid);
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeMessageEnd() {
+    appendEnd(']');
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeStructBegin(const char*) {
+    appendStart('{', true);
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeStructEnd() {
+    appendEnd('}');
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeFieldBegin(const char*, const apache::thrift::protocol::TType fieldType, const int16_t fieldId) {
+    appendInteger(fieldId);
+    appendStart('{', true);
+    const char* vTypeName = getTypeNameForTypeID(fieldType);
+    appendString(vTypeName, std::strlen(vTypeName));
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeFieldEnd() {
+    appendEnd('}');
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeFieldStop() {
+    return 0;
+}
+
+uint32_t ThriftJSONProtocol::writeMapBegin(const apache::thrift::protocol::TType keyType, const apache::thrift::protocol::TType valType, const uint32_t size) {
+    appendStart('[', false);
+    const char* vKeyTypeName = getTypeNameForTypeID(keyType);
+    appendString(vKeyTypeName, std::strlen(vKeyTypeName));
+    const char* vValueTypeName = getTypeNameForTypeID(valType);
+    appendString(vValueTypeName, std::strlen(vValueTypeName));
+    appendInteger(size);
+    appendStart('{', true);
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeMapEnd() {
+    appendEnd('}');
+    appendEnd(']');
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeListBegin(const apache::thrift::protocol::TType elemType, const uint32_t size) {
+    appendStart('[', false);
+    const char* vTypeName = getTypeNameForTypeID(elemType);
+    appendString(vTypeName, std::strlen(vTypeName));
+    appendInteger(size);
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeListEnd() {
+    appendEnd(']');
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeSetBegin(const apache::thrift::protocol::TType elemType, const uint32_t size) {
+    return writeListBegin(elemType, size);
+}
+
+uint32_t ThriftJSONProtocol::writeSetEnd() {
+    return writeListEnd();
+}
+
+uint32_t ThriftJSONProtocol::writeBool(const bool value) {
+    appendInteger(value ? 1 : 0);
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeByte(const int8_t byte) {
+    appendInteger(byte);
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeI16(const int16_t i16) {
+    appendInteger(i16);
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeI32(const int32_t i32) {
+    appendInteger(i32);
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeI64(const int64_t i64) {
+    appendInteger(i64);
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeDouble(const double dub) {
+    std::string vValue;
+    bool vSpecial = false;
+    if (std::isnan(dub)) {
+        vValue = cThriftNan;
+        vSpecial = true;
+    } else if (std::isinf(dub)) {
+        vValue = std::signbit(dub) ? cThriftNegativeInfinity : cThriftInfinity;
+        vSpecial = true;
+    } else {
+        // The same digits as TJSONProtocol, independent of the global locale:
+        std::ostringstream vStream;
+        vStream.imbue(std::locale::classic());
+        vStream.precision(std::numeric_limits<double>::digits10 + 2);
+        vStream << dub;
+        vValue = vStream.str();
+    }
+
+    const bool vQuote = appendSeparator() || vSpecial;
+    if (vQuote) {
+        mWriteBuffer.push_back('"');
+    }
+    mWriteBuffer += vValue;
+    if (vQuote) {
+        mWriteBuffer.push_back('"');
+    }
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeString(const std::string& str) {
+    appendString(str.data(), str.size());
+    return flushWriteBuffer();
+}
+
+uint32_t ThriftJSONProtocol::writeBinary(const std::string& str) {
+    appendSeparator();
+    mWriteBuffer.push_back('"');
+    appendBase64(mWriteBuffer, reinterpret_cast<const uint8_t*>(str.data()), str.size());
+    mWriteBuffer.push_back('"');
+    return flushWriteBuffer();
+}
+
+uint8_t ThriftJSONProtocol::peekByte() {
+    if (!mHasLookahead) {
+        mTransport->readAll(&mLookahead, 1);
+        mHasLookahead = true;
+    }
+    return mLookahead;
+}
+
+uint8_t ThriftJSONProtocol::readByteFromTransport() {
+    if (mHasLookahead) {
+        mHasLookahead = false;
+        return mLookahead;
+    }
+    uint8_t vByte = 0;
+    mTransport->readAll(&vByte, 1);
+    return vByte;
+}
+
+uint32_t ThriftJSONProtocol::readJSONSyntaxChar(const uint8_t aChar) {
+    const uint8_t vChar = readByteFromTransport();
+    if (vChar != aChar) {
+        throw(TProtocolException(TProtocolException::INVALID_DATA, "Expected '" + std::string(1, static_cast<char>(aChar)) + "'; got '" + std::string(1, static_cast<char>(vChar)) + "'."));
+    }
+    return 1;
+}
+
+bool ThriftJSONProtocol::readSeparator(uint32_t& aResult) {
+    if (mContexts.empty()) {
+        return false;
+    }
+    Context& vContext = mContexts.back();
+    if (vContext.mFirst) {
+        vContext.mFirst = false;
+        vContext.mColon = true;
+        return vContext.mPair;
+    }
+    if (!vContext.mPair) {
+        aResult += readJSONSyntaxChar(',');
+        return false;
+    }
+    aResult += readJSONSyntaxChar(vContext.mColon ? ':' : ',');
+    vContext.mColon = !vContext.mColon;
+    return vContext.mColon;
+}
+
+uint32_t ThriftJSONProtocol::readStart(const uint8_t aChar, const bool aPair) {
+    uint32_t vResult = 0;
+    readSeparator(vResult);
+    vResult += readJSONSyntaxChar(aChar);
+    pushContext(aPair);
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readEnd(const uint8_t aChar) {
+    const uint32_t vResult = readJSONSyntaxChar(aChar);
+    popContext();
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readJSONString(std::string& aString, const bool aSkipContext) {
+    uint32_t vResult = 0;
+    if (!aSkipContext) {
+        readSeparator(vResult);
+    }
+    vResult += readJSONSyntaxChar('"');
+    aString.clear();
+
+    // A UTF-16 high surrogate of a \u escape, waiting for its low surrogate:
+    uint32_t vHighSurrogate = 0;
+    while (true) {
+        // Copy runs of plain characters straight from the transport buffer:
+        uint32_t vAvailable = 1;
+        const uint8_t* vBuffer = mHasLookahead ? nullptr : mTransport->borrow(nullptr, &vAvailable);
+        if (vBuffer != nullptr) {
+            const std::size_t vRunSize = findStringSpecial(vBuffer, vAvailable);
+            if (vRunSize > 0) {
+                if (vHighSurrogate != 0) {
+                    throw(TProtocolException(TProtocolException::INVALID_DATA, "Missing UTF-16 low surrogate pair."));
+                }
+                aString.append(reinterpret_cast<const char*>(vBuffer), vRunSize);
+                mTransport->consume(static_cast<uint32_t>(vRunSize));
+                vResult += static_cast<uint32_t>(vRunSize);
+                if (vRunSize == vAvailable) {
+                    continue;
+                }
+            }
+        }
+
+        uint8_t vChar = readByteFromTransport();
+        ++vResult;
+        if (vChar == '"') {
+            break;
+        }
+        if (vChar == '\\') {
+            vChar = readByteFromTransport();
+            ++vResult;
+            if (vChar == 'u') {
+                uint8_t vHex[4];
+                for (uint8_t& vDigit : vHex) {
+                    vDigit = readByteFromTransport();
+                }
+                vResult += 4;
+                const uint32_t vCodeUnit = (hexValue(vHex[0]) << 12) | (hexValue(vHex[1]) << 8) | (hexValue(vHex[2]) << 4) | hexValue(vHex[3]);
+                if (vCodeUnit >= 0xD800 && vCodeUnit <= 0xDBFF) {
+                    if (vHighSurrogate != 0) {
+                        throw(TProtocolException(TProtocolException::INVALID_DATA, "Missing UTF-16 low surrogate pair."));
+                    }
+                    vHighSurrogate = vCodeUnit;
+                } else if (vCodeUnit >= 0xDC00 && vCodeUnit <= 0xDFFF) {
+                    if (vHighSurrogate == 0) {
+                        throw(TProtocolException(TProtocolException::INVALID_DATA, "Missing UTF-16 high surrogate pair."));
+                    }
+                    appendUTF8(aString, 0x10000 + ((vHighSurrogate - 0xD800) << 10) + (vCodeUnit - 0xDC00));
+                    vHighSurrogate = 0;
+                } else {
+                    if (vHighSurrogate != 0) {
+                        throw(TProtocolException(TProtocolException::INVALID_DATA, "Missing UTF-16 low surrogate pair."));
+                    }
+                    appendUTF8(aString, vCodeUnit);
+                }
+                continue;
+            }
+
+            static const char cEscapeChars[] = "\"\\/bfnrt";
+            static const char cEscapeCharValues[] = "\"\\/\b\f\n\r\t";
+            const char* vEscape = std::strchr(cEscapeChars, vChar);
+            if (vChar == 0 || vEscape == nullptr) {
+                throw(TProtocolException(TProtocolException::INVALID_DATA, "Expected control char, got '" + std::string(1, static_cast<char>(vChar)) + "'."));
+            }
+            vChar = static_cast<uint8_t>(cEscapeCharValues[vEscape - cEscapeChars]);
+        }
+        if (vHighSurrogate != 0) {
+            throw(TProtocolException(TProtocolException::INVALID_DATA, "Missing UTF-16 low surrogate pair."));
+        }
+        aString.push_back(static_cast<char>(vChar));
+    }
+    if (vHighSurrogate != 0) {
+        throw(TProtocolException(TProtocolException::INVALID_DATA, "Missing UTF-16 low surrogate pair."));
+    }
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readJSONNumericChars(std::string& aString) {
+    uint32_t vResult = 0;
+    aString.clear();
+    while (true) {
+        const uint8_t vChar = peekByte();
+        if (!((vChar >= '0' && vChar <= '9') || vChar == '+' || vChar == '-' || vChar == '.' || vChar == 'E' || vChar == 'e')) {
+            break;
+        }
+        aString.push_back(static_cast<char>(readByteFromTransport()));
+        ++vResult;
+    }
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readJSONInteger(int64_t& aValue) {
+    uint32_t vResult = 0;
+    const bool vQuoted = readSeparator(vResult);
+    if (vQuoted) {
+        vResult += readJSONSyntaxChar('"');
+    }
+    vResult += readJSONNumericChars(mReadBuffer);
+
+    errno = 0;
+    char* vEnd = nullptr;
+    const long long vValue = std::strtoll(mReadBuffer.c_str(), &vEnd, 10);
+    if (mReadBuffer.empty() || errno != 0 || vEnd != mReadBuffer.c_str() + mReadBuffer.size()) {
+        throw(TProtocolException(TProtocolException::INVALID_DATA, "Expected numeric value; got \"" + mReadBuffer + "\""));
+    }
+    aValue = static_cast<int64_t>(vValue);
+
+    if (vQuoted) {
+        vResult += readJSONSyntaxChar('"');
+    }
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readJSONDouble(double& aValue) {
+    uint32_t vResult = 0;
+    const bool vQuoted = readSeparator(vResult);
+    if (peekByte() == '"') {
+        vResult += readJSONString(mReadBuffer, true);
+        if (mReadBuffer == cThriftNan) {
+            aValue = std::numeric_limits<double>::quiet_NaN();
+            return vResult;
+        } else if (mReadBuffer == cThriftInfinity) {
+            aValue = std::numeric_limits<double>::infinity();
+            return vResult;
+        } else if (mReadBuffer == cThriftNegativeInfinity) {
+            aValue = -std::numeric_limits<double>::infinity();
+            return vResult;
+        } else if (!vQuoted) {
+            throw(TProtocolException(TProtocolException::INVALID_DATA, "Numeric data unexpectedly quoted"));
+        }
+    } else {
+        if (vQuoted) {
+            // This will throw, as an object key must be quoted:
+            vResult += readJSONSyntaxChar('"');
+        }
+        vResult += readJSONNumericChars(mReadBuffer);
+    }
+
+    std::istringstream vStream(mReadBuffer);
+    vStream.imbue(std::locale::classic());
+    vStream >> aValue;
+    if (mReadBuffer.empty() || vStream.fail() || !vStream.eof()) {
+        throw(TProtocolException(TProtocolException::INVALID_DATA, "Expected numeric value; got \"" + mReadBuffer + "\""));
+    }
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readMessageBegin(std::string& name, apache::thrift::protocol::TMessageType& messageType, int32_t& seqid) {
+    uint32_t vResult = readStart('[', false);
+    int64_t vValue = 0;
+    vResult += readJSONInteger(vValue);
+    if (vValue != cThriftVersion1) {
+        throw(TProtocolException(TProtocolException::BAD_VERSION, "Message contained bad version."));
+    }
+    vResult += readJSONString(name);
+    vResult += readJSONInteger(vValue);
+    messageType = static_cast<apache::thrift::protocol::TMessageType>(vValue);
+    vResult += readJSONInteger(vValue);
+    seqid = narrowInteger<int32_t>(vValue);
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readMessageEnd() {
+    return readEnd(']');
+}
+
+uint32_t ThriftJSONProtocol::readStructBegin(std::string&) {
+    return readStart('{', true);
+}
+
+uint32_t ThriftJSONProtocol::readStructEnd() {
+    return readEnd('}');
+}
+
+uint32_t ThriftJSONProtocol::readFieldBegin(std::string&, apache::thrift::protocol::TType& fieldType, int16_t& fieldId) {
+    if (peekByte() == '}') {
+        fieldType = apache::thrift::protocol::T_STOP;
+        return 0;
+    }
+    int64_t vValue = 0;
+    uint32_t vResult = readJSONInteger(vValue);
+    fieldId = narrowInteger<int16_t>(vValue);
+    vResult += readStart('{', true);
+    vResult += readJSONString(mReadBuffer);
+    fieldType = getTypeIDForTypeName(mReadBuffer);
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readFieldEnd() {
+    return readEnd('}');
+}
+
+uint32_t ThriftJSONProtocol::readMapBegin(apache::thrift::protocol::TType& keyType, apache::thrift::protocol::TType& valType, uint32_t& size) {
+    uint32_t vResult = readStart('[', false);
+    vResult += readJSONString(mReadBuffer);
+    keyType = getTypeIDForTypeName(mReadBuffer);
+    vResult += readJSONString(mReadBuffer);
+    valType = getTypeIDForTypeName(mReadBuffer);
+    vResult += readContainerSize(size);
+    vResult += readStart('{', true);
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readMapEnd() {
+    uint32_t vResult = readEnd('}');
+    vResult += readEnd(']');
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readListBegin(apache::thrift::protocol::TType& elemType, uint32_t& size) {
+    uint32_t vResult = readStart('[', false);
+    vResult += readJSONString(mReadBuffer);
+    elemType = getTypeIDForTypeName(mReadBuffer);
+    vResult += readContainerSize(size);
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readListEnd() {
+    return readEnd(']');
+}
+
+uint32_t ThriftJSONProtocol::readSetBegin(apache::thrift::protocol::TType& elemType, uint32_t& size) {
+    return readListBegin(elemType, size);
+}
+
+uint32_t ThriftJSONProtocol::readSetEnd() {
+    return readListEnd();
+}
+
+uint32_t ThriftJSONProtocol::readContainerSize(uint32_t& aSize) {
+    int64_t vValue = 0;
+    const uint32_t vResult = readJSONInteger(vValue);
+    if (vValue < 0) {
+        throw(TProtocolException(TProtocolException::NEGATIVE_SIZE));
+    } else if (vValue > static_cast<int64_t>(std::numeric_limits<uint32_t>::max())) {
+        throw(TProtocolException(TProtocolException::SIZE_LIMIT));
+    }
+    aSize = static_cast<uint32_t>(vValue);
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readBool(bool& value) {
+    int64_t vValue = 0;
+    const uint32_t vResult = readJSONInteger(vValue);
+    value = vValue != 0;
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readBool(std::vector<bool>::reference value) {
+    bool vValue = false;
+    const uint32_t vResult = readBool(vValue);
+    value = vValue;
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readByte(int8_t& byte) {
+    int64_t vValue = 0;
+    const uint32_t vResult = readJSONInteger(vValue);
+    byte = narrowInteger<int8_t>(vValue);
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readI16(int16_t& i16) {
+    int64_t vValue = 0;
+    const uint32_t vResult = readJSONInteger(vValue);
+    i16 = narrowInteger<int16_t>(vValue);
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readI32(int32_t& i32) {
+    int64_t vValue = 0;
+    const uint32_t vResult = readJSONInteger(vValue);
+    i32 = narrowInteger<int32_t>(vValue);
+    return vResult;
+}
+
+uint32_t ThriftJSONProtocol::readI64(int64_t& i64) {
+    return readJSONInteger(i64);
+}
+
+uint32_t ThriftJSONProtocol::readDouble(double& dub) {
+    return readJSONDouble(dub);
+}
+
+uint32_t ThriftJSONProtocol::readString(std::string& str) {
+    return readJSONString(str);
+}
+
+uint32_t ThriftJSONProtocol::readBinary(std::string& str) {
+    const uint32_t vResult = readJSONString(mReadBuffer);
+    if (!decodeBase64(reinterpret_cast<const uint8_t*>(mReadBuffer.data()), mReadBuffer.size(), str)) {
+        throw(TProtocolException(TProtocolException::INVALID_DATA, "Invalid base64 data"));
+    }
+    return vResult;
+}
+
+int ThriftJSONProtocol::getMinSerializedSize(apache::thrift::protocol::TType type) {
+    switch (type) {
+        case apache::thrift::protocol::T_STOP:
+        case apache::thrift::protocol::T_VOID:
+            return 0;
+        case apache::thrift::protocol::T_BOOL:
+        case apache::thrift::protocol::T_BYTE:
+        case apache::thrift::protocol::T_DOUBLE:
+        case apache::thrift::protocol::T_I16:
+        case apache::thrift::protocol::T_I32:
+        case apache::thrift::protocol::T_I64:
+            return 1;
+        case apache::thrift::protocol::T_STRING:
+        case apache::thrift::protocol::T_STRUCT:
+        case apache::thrift::protocol::T_MAP:
+        case apache::thrift::protocol::T_SET:
+        case apache::thrift::protocol::T_LIST:
+            return 2;
+        default:
+            throw(TProtocolException(TProtocolException::UNKNOWN, "unrecognized type code"));
+    }
+}
+
+std::shared_ptr<apache::thrift::protocol::TProtocol> ThriftJSONProtocolFactory::getProtocol(std::shared_ptr<apache::thrift::transport::TTransport> aTransport) {
+    return std::make_shared<bda::ThriftJSONProtocol>(aTransport);
+}
+
+}
@@ -0,0 +1,43 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "ThriftJSONString.hh"
+
+#include <cstdio>
+
+namespace bda {
+
+void writeJSONString(std::ostream& aStream, const char* aData, const std::size_t aSize) {
+    aStream << '"';
+    for (std::size_t vIdx = 0; vIdx < aSize; ++vIdx) {
+        const char vChar = aData[vIdx];
+        if (vChar == '"' || vChar == '\\') {
+            aStream << '\\' << vChar;
+        } else if (static_cast<unsigned char>(vChar) < 0x20) {
+            char vEscaped[8];
+            std::snprintf(vEscaped, sizeof(vEscaped), "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(vChar)));
+            aStream << vEscaped;
+        } else {
+            aStream << vChar;
+        }
+    }
+    aStream << '"';
+}
+
+}
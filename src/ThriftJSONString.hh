@@ -0,0 +1,47 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTJSONSTRING_HH
+#define THRIFTJSONSTRING_HH
+
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace bda {
+
+/**
+ * @brief Write a string as a quoted JSON string, escaping quotes,
+ * backslashes and control characters, e.g. for the diagnostics that the
+ * server writes as JSON.
+ */
+void writeJSONString(std::ostream& aStream, const char* aData, const std::size_t aSize);
+
+inline void writeJSONString(std::ostream& aStream, const std::string& aString) {
+    writeJSONString(aStream, aString.data(), aString.size());
+}
+
+inline void writeJSONString(std::ostream& aStream, const char* aString) {
+    writeJSONString(aStream, aString, std::strlen(aString));
+}
+
+}
+
+#endif
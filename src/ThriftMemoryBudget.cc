@@ -0,0 +1,74 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "ThriftMemoryBudget.hh"
+
+#include <utility>
+
+namespace bda {
+
+ThriftMemoryBudget::ThriftMemoryBudget(const std::size_t aLimit)
+    : mLimit(aLimit) {
+}
+
+void ThriftMemoryBudget::release(const std::size_t aBytes) {
+    const std::size_t vUsed = mUsed.fetch_sub(aBytes) - aBytes;
+    if (vUsed >= mLimit || mWaiting.load() == 0) {
+        return;
+    }
+
+    // All waiting reads resume at once, because any of them may wait for a
+    // client that sends nothing:
+    std::vector<std::function<void()>> vWaitingReads;
+    {
+        std::lock_guard<std::mutex> vLock(mMutex);
+        vWaitingReads.swap(mWaitingReads);
+        mWaiting = 0;
+    }
+    for (const std::function<void()>& vResume : vWaitingReads) {
+        vResume();
+    }
+}
+
+bool ThriftMemoryBudget::admitRead(std::function<void()> aResume) {
+    if (mUsed.load() < mLimit) {
+        return true;
+    }
+
+    // Count the read as waiting before checking again, so that a release in
+    // the meantime either sees it or is seen here:
+    std::lock_guard<std::mutex> vLock(mMutex);
+    ++mWaiting;
+    if (mUsed.load() < mLimit) {
+        --mWaiting;
+        return true;
+    }
+    mWaitingReads.push_back(std::move(aResume));
+    ++mThrottledReads;
+    return false;
+}
+
+void ThriftMemoryBudget::cancelWaitingReads() {
+    std::vector<std::function<void()>> vWaitingReads;
+    std::lock_guard<std::mutex> vLock(mMutex);
+    vWaitingReads.swap(mWaitingReads);
+    mWaiting = 0;
+}
+
+}
@@ -0,0 +1,148 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTMEMORYBUDGET_HH
+#define THRIFTMEMORYBUDGET_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace bda {
+
+/**
+ * @brief Counts the bytes that all sessions hold in message buffers and
+ * responses. While they hold more than the limit, sessions do not read
+ * further messages from their connections, but wait until enough memory is
+ * released. The messages that are already buffered are still processed,
+ * which releases their memory.
+ */
+class ThriftMemoryBudget {
+public:
+    explicit ThriftMemoryBudget(const std::size_t aLimit);
+
+    std::size_t limit() const {
+        return mLimit;
+    }
+
+    std::size_t used() const {
+        return mUsed.load(std::memory_order_relaxed);
+    }
+
+    void acquire(const std::size_t aBytes) {
+        mUsed.fetch_add(aBytes);
+    }
+
+    /** @brief Release aBytes, and resume the waiting reads once the sessions hold less than the limit. */
+    void release(const std::size_t aBytes);
+
+    /**
+     * @brief Returns true if a session may read another message now.
+     * Otherwise aResume is called, from the thread that releases the memory,
+     * when it may read.
+     */
+    bool admitRead(std::function<void()> aResume);
+
+    /** @brief The number of reads that waited for memory. */
+    uint64_t throttledReads() const {
+        return mThrottledReads.load(std::memory_order_relaxed);
+    }
+
+    /** @brief The number of reads that wait for memory now. */
+    std::size_t waitingReads() const {
+        return mWaiting.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Drop the waiting reads, e.g. when the server stops. */
+    void cancelWaitingReads();
+
+protected:
+    const std::size_t mLimit;
+    std::atomic<std::size_t> mUsed{ 0 };
+    std::atomic<uint64_t> mThrottledReads{ 0 };
+
+    // The waiting reads. Their number is also counted outside of the mutex,
+    // so that releasing memory only locks if there are waiting reads:
+    std::mutex mMutex;
+    std::vector<std::function<void()>> mWaitingReads;
+    std::atomic<std::size_t> mWaiting{ 0 };
+};
+
+/**
+ * @brief The bytes that a session or a stream holds from a memory budget.
+ * Without a budget, it counts nothing.
+ */
+class ThriftMemoryReservation {
+public:
+    ThriftMemoryReservation() = default;
+    explicit ThriftMemoryReservation(std::shared_ptr<bda::ThriftMemoryBudget> aBudget)
+        : mBudget(std::move(aBudget)) {
+    }
+
+    ThriftMemoryReservation(ThriftMemoryReservation&& aOther) noexcept
+        : mBudget(std::move(aOther.mBudget)), mBytes(aOther.mBytes) {
+        aOther.mBytes = 0;
+    }
+
+    ThriftMemoryReservation& operator=(ThriftMemoryReservation&& aOther) noexcept {
+        if (this != &aOther) {
+            resize(0);
+            mBudget = std::move(aOther.mBudget);
+            mBytes = aOther.mBytes;
+            aOther.mBytes = 0;
+        }
+        return *this;
+    }
+
+    ThriftMemoryReservation(const ThriftMemoryReservation&) = delete;
+    ThriftMemoryReservation& operator=(const ThriftMemoryReservation&) = delete;
+
+    ~ThriftMemoryReservation() {
+        resize(0);
+    }
+
+    /** @brief Hold aBytes from now on. */
+    void resize(const std::size_t aBytes) {
+        if (!mBudget || aBytes == mBytes) {
+            return;
+        }
+        if (aBytes > mBytes) {
+            mBudget->acquire(aBytes - mBytes);
+        } else {
+            mBudget->release(mBytes - aBytes);
+        }
+        mBytes = aBytes;
+    }
+
+    std::size_t size() const {
+        return mBytes;
+    }
+
+private:
+    std::shared_ptr<bda::ThriftMemoryBudget> mBudget;
+    std::size_t mBytes = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,475 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "ThriftMessageDispatcher.hh"
+#include "ThriftMessageHeader.hh"
+#include "ThriftSessionAccess.hh"
+#include "ThriftSessionContext.hh"
+
+#include "bda/ThriftCallDeadline.hh"
+
+#include <bda/Helpers.hh>
+
+#include <thrift/TApplicationException.h>
+#include <thrift/TProcessor.h>
+#include <thrift/async/TAsyncProcessor.h>
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TTransportException.h>
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace bda {
+
+std::size_t ThriftResponse::size() const {
+    if (mShared) {
+        return mShared->mData.size() - mShared->mSeqIdSize + mSeqId.size();
+    }
+    if (mTransport) {
+        std::size_t vSize = mTransport->available_read();
+        for (const bda::ThriftSharedSegment& vSegment : mSegments) {
+            vSize += vSegment.mBlob->size();
+        }
+        return vSize;
+    }
+    return 0;
+}
+
+void ThriftResponse::appendBuffers(std::vector<boost::asio::const_buffer>& aBuffers) const {
+    if (mShared) {
+        const char* vData = mShared->mData.data();
+        const std::size_t vSuffixOffset = mShared->mSeqIdOffset + mShared->mSeqIdSize;
+        aBuffers.emplace_back(vData, mShared->mSeqIdOffset);
+        aBuffers.emplace_back(mSeqId.data(), mSeqId.size());
+        aBuffers.emplace_back(vData + vSuffixOffset, mShared->mData.size() - vSuffixOffset);
+    } else if (mTransport) {
+        uint8_t* vOutputPtr = nullptr;
+        uint32_t vOutputSize = 0;
+        mTransport->getBuffer(&vOutputPtr, &vOutputSize);
+        std::size_t vOffset = 0;
+        for (const bda::ThriftSharedSegment& vSegment : mSegments) {
+            aBuffers.emplace_back(vOutputPtr + vOffset, vSegment.mOffset - vOffset);
+            aBuffers.emplace_back(vSegment.mBlob->data(), vSegment.mBlob->size());
+            vOffset = vSegment.mOffset;
+        }
+        aBuffers.emplace_back(vOutputPtr + vOffset, vOutputSize - vOffset);
+    }
+}
+
+void ThriftResponse::appendTo(std::string& aData) const {
+    if (mShared) {
+        const std::size_t vSuffixOffset = mShared->mSeqIdOffset + mShared->mSeqIdSize;
+        aData.append(mShared->mData, 0, mShared->mSeqIdOffset);
+        aData.append(mSeqId);
+        aData.append(mShared->mData, vSuffixOffset, std::string::npos);
+    } else if (mTransport) {
+        uint8_t* vOutputPtr = nullptr;
+        uint32_t vOutputSize = 0;
+        mTransport->getBuffer(&vOutputPtr, &vOutputSize);
+        std::size_t vOffset = 0;
+        for (const bda::ThriftSharedSegment& vSegment : mSegments) {
+            aData.append(reinterpret_cast<const char*>(vOutputPtr) + vOffset, vSegment.mOffset - vOffset);
+            aData.append(*vSegment.mBlob);
+            vOffset = vSegment.mOffset;
+        }
+        aData.append(reinterpret_cast<const char*>(vOutputPtr) + vOffset, vOutputSize - vOffset);
+    }
+}
+
+void ThriftResponse::reset() {
+    mTransport.reset();
+    mSegments.clear();
+    mShared.reset();
+    mSeqId.clear();
+    mMethod.clear();
+    mDispatchTime = mProcessStartTime = mProcessEndTime = std::chrono::steady_clock::time_point();
+}
+
+namespace {
+
+// Receives the in-memory-transport with the response of the processor, or
+// nullptr if processing failed, and the binary values that the handler
+// shared.
+using ThriftProcessedHandler = std::function<void(std::shared_ptr<apache::thrift::transport::TMemoryBuffer> aTransport,
+                                                  std::vector<bda::ThriftSharedSegment> aSegments)>;
+
+// Have the thrift processor of the service process the message and store
+// the response in a new in-memory-transport. A synchronous processor
+// completes before this function returns, an asynchronous processor
+// completes whenever its handler calls back, possibly on another thread.
+void processThriftMessage(bda::ThriftSessionContext& aContext, bda::ThriftService& aService,
+                          const uint8_t* aData, const uint32_t aSize, const ThriftProcessedHandler& aProcessed) {
+    // Construct a temporary in-memory-transport as a shallow copy of the
+    // input data, to avoid copying the data. The transport only observes
+    // the memory and never writes to it.
+    std::shared_ptr<apache::thrift::transport::TTransport> vInputTransport;
+    vInputTransport = std::make_shared<apache::thrift::transport::TMemoryBuffer>(const_cast<uint8_t*>(aData), aSize);
+    std::shared_ptr<apache::thrift::protocol::TProtocol> vInputProtocol = aContext.mThriftProtocolFactory->getProtocol(vInputTransport);
+
+
+    /** @todo fixme: Due to issue https://issues.apache.org/jira/browse/THRIFT-5108 we need to re-create the
+     * Transport after every write operation. This is quite inefficient, but how to improve it? We can not
+     * just "clear" the Tranport, and consume() does not free it.
+     */
+    std::shared_ptr<apache::thrift::transport::TMemoryBuffer> vOutputTransport = std::make_shared<apache::thrift::transport::TMemoryBuffer>();
+    std::shared_ptr<apache::thrift::protocol::TProtocol> vOutputProtocol = aContext.mThriftProtocolFactory->getProtocol(vOutputTransport);
+
+
+    bool vSuccess = false;
+    std::vector<bda::ThriftSharedSegment> vSegments;
+    try {
+        if (aService.mAsyncProcessor) {
+            // The callback holds the protocols, and thereby the transports,
+            // until the handler completed:
+            aService.mAsyncProcessor->process(
+                [vInputProtocol, vOutputProtocol, vOutputTransport, aProcessed](const bool aSuccess) {
+                    aProcessed(aSuccess ? vOutputTransport : nullptr, std::vector<bda::ThriftSharedSegment>());
+                },
+                vInputProtocol, vOutputProtocol);
+            return;
+        }
+
+        // Synchronous handlers may share large binary values instead of
+        // copying them, the response then references them:
+        const bool vShareBinaries = bda::ThriftSharedBinaryProtocol::supports(aContext.mProtocolType);
+        if (vShareBinaries) {
+            vOutputProtocol = std::make_shared<bda::ThriftSharedBinaryProtocol>(vOutputProtocol, aContext.mProtocolType, vOutputTransport.get(), &vSegments);
+        }
+        bda::ThriftSharedBinaryScope vSharedBinaryScope(vShareBinaries);
+
+        // Have the thrift processor process the message and respond to it
+        void* vProcessorConnectionContext = nullptr;
+        vSuccess = aService.mThriftProcessor->process(vInputProtocol, vOutputProtocol, vProcessorConnectionContext);
+    } catch (const apache::thrift::transport::TTransportException& ttx) {
+        switch (ttx.getType()) {
+            case apache::thrift::transport::TTransportException::END_OF_FILE:
+            case apache::thrift::transport::TTransportException::INTERRUPTED:
+            case apache::thrift::transport::TTransportException::TIMED_OUT:
+                // Client disconnected or was interrupted or did not respond within the receive timeout.
+                // No logging needed.  Done.
+                break;
+            default: {
+                // All other transport exceptions are logged.
+                // State of connection is unknown.  Done.
+                std::cerr << "TConnectedClient died: " << ttx.what() << std::endl;
+                break;
+            }
+        }
+    } catch (const apache::thrift::TException& tex) {
+        std::cerr << "TConnectedClient processing exception: " << tex.what() << std::endl;
+    } catch (const std::exception& vException) {
+        // The session must learn about the failure, otherwise it waits for
+        // the response forever:
+        BDAMessage(2, "bda::processThriftMessage(): Processing failed: '" + std::string(vException.what()) + "'.\n");
+    } catch (...) {
+        BDAMessage(2, "bda::processThriftMessage(): Processing failed with an unknown exception.\n");
+    }
+
+    aProcessed(vSuccess ? vOutputTransport : nullptr, std::move(vSegments));
+}
+
+// Copy a processor response, including the binary values the handler
+// shared, into a shared response, if it has a parsable header. Returns
+// nullptr otherwise.
+std::shared_ptr<bda::ThriftSerializedResponse> makeSerializedResponse(const bda::ProtocolType aProtocolType,
+                                                                      const bda::ThriftResponse& aProcessed,
+                                                                      int32_t& aMessageType) {
+    auto vResponse = std::make_shared<bda::ThriftSerializedResponse>();
+    aProcessed.appendTo(vResponse->mData);
+
+    bda::ThriftMessageHeader vHeader;
+    if (!bda::parseThriftMessageHeader(aProtocolType, reinterpret_cast<const uint8_t*>(vResponse->mData.data()),
+                                       static_cast<uint32_t>(vResponse->mData.size()), vHeader)) {
+        return nullptr;
+    }
+    aMessageType = vHeader.mType;
+
+    vResponse->mSeqIdOffset = vHeader.mSeqIdOffset;
+    vResponse->mSeqIdSize = vHeader.mSeqIdSize;
+    return vResponse;
+}
+
+// A single call on its way through the dispatcher:
+struct DispatchedCall {
+    const uint8_t* mData = nullptr;
+    uint32_t mSize = 0;
+    std::chrono::steady_clock::time_point mDeadline = std::chrono::steady_clock::time_point::max();
+    bda::ThriftTraceId mTraceId;
+    std::shared_ptr<bda::ThriftSessionAccess> mAccess;
+    std::chrono::steady_clock::time_point mDispatchTime;
+
+    // Calls to cacheable or coalescible methods are identified by the method
+    // name and the serialized arguments behind the message header:
+    bda::ThriftMessageHeader mHeader;
+    bool mHasHeader = false;
+    bool mCacheable = false;
+    bool mCoalescible = false;
+    std::string mArguments;
+    // The cache generation of the method before the lookup, so that an
+    // invalidation during processing keeps the response out of the cache:
+    std::uint64_t mCacheGeneration = 0;
+
+    bool isExpired() const {
+        return mHasHeader && mDeadline != std::chrono::steady_clock::time_point::max() &&
+               std::chrono::steady_clock::now() >= mDeadline;
+    }
+
+    void trace(bda::ThriftSessionContext& aContext, const bda::ThriftTraceStage aStage) const {
+        if (aContext.mTracer) {
+            aContext.mTracer->record(aStage, mTraceId, mHeader.mName, mHeader.mSeqId);
+        }
+    }
+
+    // Tell the session what the response is to, for its slow-call log:
+    void stamp(const bda::ThriftSessionContext& aContext, bda::ThriftResponse& aResponse) const {
+        if (aContext.mSlowCallLog) {
+            aResponse.mMethod = mHeader.mName;
+            aResponse.mDispatchTime = mDispatchTime;
+        }
+    }
+};
+
+// Answer a call without processing it. The client receives a
+// TApplicationException with the message, or nothing for oneway calls.
+void respondException(bda::ThriftSessionContext& aContext, const DispatchedCall& aCall, const std::string& aMessage,
+                      const bda::ThriftResponseHandler& aHandler) {
+    bda::ThriftResponse vResponse;
+    aCall.stamp(aContext, vResponse);
+    vResponse.mTransport = std::make_shared<apache::thrift::transport::TMemoryBuffer>();
+    if (aCall.mHeader.mType != apache::thrift::protocol::T_ONEWAY) {
+        std::shared_ptr<apache::thrift::protocol::TProtocol> vOutputProtocol = aContext.mThriftProtocolFactory->getProtocol(vResponse.mTransport);
+        const apache::thrift::TApplicationException vException(apache::thrift::TApplicationException::INTERNAL_ERROR, aMessage);
+        vOutputProtocol->writeMessageBegin(aCall.mHeader.mName, apache::thrift::protocol::T_EXCEPTION, aCall.mHeader.mSeqId);
+        vException.write(vOutputProtocol.get());
+        vOutputProtocol->writeMessageEnd();
+        vOutputProtocol->getTransport()->writeEnd();
+        vOutputProtocol->getTransport()->flush();
+    }
+    aHandler(true, std::move(vResponse));
+}
+
+// Answer a call whose deadline expired without processing it.
+void respondExpired(bda::ThriftSessionContext& aContext, const DispatchedCall& aCall, const bda::ThriftResponseHandler& aHandler) {
+    ++aContext.mExpiredCalls;
+    BDAMessage(10, "bda::dispatchThriftMessage(): Dropping call to '" + aCall.mHeader.mName + "', its deadline expired.\n");
+    respondException(aContext, aCall, "Deadline of '" + aCall.mHeader.mName + "' expired before processing", aHandler);
+}
+
+// Hand the response of a processed call to the cache, the waiting identical
+// calls and the handler.
+void respondProcessed(bda::ThriftSessionContext& aContext, const DispatchedCall& aCall,
+                      std::shared_ptr<apache::thrift::transport::TMemoryBuffer> aTransport,
+                      std::vector<bda::ThriftSharedSegment> aSegments,
+                      const std::chrono::steady_clock::time_point aProcessStartTime,
+                      const bda::ThriftResponseHandler& aHandler) {
+    bda::ThriftResponse vResponse;
+    vResponse.mTransport = aTransport;
+    vResponse.mSegments = std::move(aSegments);
+    aCall.stamp(aContext, vResponse);
+    if (aContext.mSlowCallLog) {
+        vResponse.mProcessStartTime = aProcessStartTime;
+        vResponse.mProcessEndTime = std::chrono::steady_clock::now();
+    }
+
+    std::shared_ptr<bda::ThriftSerializedResponse> vSharedResponse;
+    try {
+        int32_t vMessageType = 0;
+        if (vResponse.mTransport && (aCall.mCacheable || aCall.mCoalescible)) {
+            vSharedResponse = makeSerializedResponse(aContext.mProtocolType, vResponse, vMessageType);
+        }
+        if (aCall.mCacheable && vMessageType == apache::thrift::protocol::T_REPLY) {
+            aContext.mResponseCache->store(aCall.mHeader.mName, aCall.mArguments, vSharedResponse, aCall.mCacheGeneration);
+        }
+    } catch (...) {
+        // Never leave waiting calls behind:
+        if (aCall.mCoalescible) {
+            aContext.mRequestCoalescer->complete(aCall.mHeader.mName, aCall.mArguments, nullptr);
+        }
+        throw;
+    }
+
+    if (aCall.mCoalescible) {
+        aContext.mRequestCoalescer->complete(aCall.mHeader.mName, aCall.mArguments, vSharedResponse);
+    }
+
+    const bool vSuccess = vResponse.mTransport != nullptr;
+    aHandler(vSuccess, std::move(vResponse));
+}
+
+// Process the call with the synchronous or asynchronous processor of the
+// service, and respond once it completed.
+void processAndRespond(bda::ThriftSessionContext& aContext, bda::ThriftService& aService, const DispatchedCall& aCall,
+                       const bda::ThriftResponseHandler& aHandler) {
+    // A coalesced call may have identical calls with later deadlines
+    // waiting for it, so it is processed even if its own deadline expired:
+    if (!aCall.mCoalescible && aCall.isExpired()) {
+        return respondExpired(aContext, aCall, aHandler);
+    }
+
+    bda::ThriftSessionContext* vContext = &aContext;
+    try {
+        // The deadline is visible to the handler while it runs on this
+        // thread; asynchronous handlers must keep it themselves.
+        bda::ThriftCallDeadlineScope vDeadlineScope(aCall.mDeadline);
+        bda::ThriftSessionAccessScope vAccessScope(aContext.mAccessManager.get(), aCall.mAccess.get());
+        aCall.trace(aContext, bda::ThriftTraceStage::ProcessStart);
+        const std::chrono::steady_clock::time_point vProcessStartTime = aContext.mSlowCallLog
+            ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        processThriftMessage(aContext, aService, aCall.mData, aCall.mSize,
+            [vContext, aCall, aHandler, vProcessStartTime](std::shared_ptr<apache::thrift::transport::TMemoryBuffer> aTransport,
+                                                           std::vector<bda::ThriftSharedSegment> aSegments) {
+                aCall.trace(*vContext, bda::ThriftTraceStage::ProcessEnd);
+                respondProcessed(*vContext, aCall, aTransport, std::move(aSegments), vProcessStartTime, aHandler);
+            });
+    } catch (...) {
+        // Never leave waiting calls behind:
+        if (aCall.mCoalescible) {
+            aContext.mRequestCoalescer->complete(aCall.mHeader.mName, aCall.mArguments, nullptr);
+        }
+        throw;
+    }
+}
+
+}
+
+void dispatchThriftMessage(bda::ThriftSessionContext& aContext, bda::ThriftService& aService, const uint8_t* aData,
+                           const uint32_t aSize, const std::chrono::steady_clock::time_point aReceiveTime,
+                           const std::chrono::milliseconds aCallTimeout, const bda::ThriftTraceId& aTraceId, std::shared_ptr<bda::ThriftSessionAccess> aAccess,
+                           bda::ThriftResponseHandler aHandler) {
+    DispatchedCall vCall;
+    vCall.mData = aData;
+    vCall.mSize = aSize;
+    vCall.mDeadline = aCallTimeout.count() > 0 ? aReceiveTime + aCallTimeout : std::chrono::steady_clock::time_point::max();
+    vCall.mTraceId = aTraceId;
+    vCall.mAccess = std::move(aAccess);
+    if (aContext.mSlowCallLog) {
+        vCall.mDispatchTime = std::chrono::steady_clock::now();
+    }
+
+    // A deadline envelope overrides the timeout of the connection. Both
+    // count from the receive time, so neither a batch nor the queue of the
+    // execution pool extends them:
+    if (aContext.mDeadlinesEnabled && bda::isDeadlineEnvelope(aData, aSize)) {
+        std::chrono::milliseconds vTimeout(0);
+        bda::parseDeadlineEnvelope(aData, aSize, vTimeout, vCall.mData, vCall.mSize);
+        vCall.mDeadline = aReceiveTime + vTimeout;
+    }
+
+    // The message header identifies cacheable and coalescible calls, the
+    // priority class of the method, the call to answer on expiry or denial,
+    // and the method of the trace and the slow-call log:
+    const bool vHasDeadline = vCall.mDeadline != std::chrono::steady_clock::time_point::max();
+    vCall.mHasHeader = (aContext.mResponseCache || aContext.mRequestCoalescer || aService.mExecutionPool || vHasDeadline ||
+                        aContext.mTracer || aContext.mSlowCallLog || aContext.mAccessManager) &&
+                       bda::parseThriftMessageHeader(aContext.mProtocolType, vCall.mData, vCall.mSize, vCall.mHeader) &&
+                       (vCall.mHeader.mType == apache::thrift::protocol::T_CALL || vCall.mHeader.mType == apache::thrift::protocol::T_ONEWAY);
+    const bool vIsCall = vCall.mHasHeader && vCall.mHeader.mType == apache::thrift::protocol::T_CALL;
+    vCall.mCacheable = vIsCall && aContext.mResponseCache && aContext.mResponseCache->isCacheable(vCall.mHeader.mName);
+    vCall.mCoalescible = vIsCall && aContext.mRequestCoalescer && aContext.mRequestCoalescer->isCoalescible(vCall.mHeader.mName);
+    vCall.trace(aContext, bda::ThriftTraceStage::Dispatch);
+
+    if (vCall.isExpired()) {
+        return respondExpired(aContext, vCall, aHandler);
+    }
+
+    // Every call is checked against the grant of its session, before it can
+    // be answered from the cache or join an identical call:
+    if (aContext.mAccessManager) {
+        if (!vCall.mHasHeader) {
+            BDAMessage(2, "bda::dispatchThriftMessage(): Rejecting a message without a valid header.\n");
+            return aHandler(false, bda::ThriftResponse());
+        }
+        const std::shared_ptr<const bda::ThriftAccessGrant> vGrant = vCall.mAccess ? vCall.mAccess->grant() : nullptr;
+        if (!aContext.mAccessManager->isPermitted(vGrant.get(), vCall.mHeader.mName)) {
+            BDAMessage(9, "bda::dispatchThriftMessage(): Denying call to '" + vCall.mHeader.mName + "'.\n");
+            return respondException(aContext, vCall, "Access to '" + vCall.mHeader.mName + "' denied", aHandler);
+        }
+    }
+
+    // Methods of different services may have the same name, so the key of a
+    // routed service starts with its path. Handlers may answer depending on
+    // currentThriftPrincipal(), so with an access manager, calls of
+    // different principals never share a response:
+    if (vCall.mCacheable || vCall.mCoalescible) {
+        if (!aService.mPath.empty() || aContext.mAccessManager) {
+            vCall.mArguments.assign(aService.mPath);
+            vCall.mArguments.push_back('\0');
+        }
+        if (aContext.mAccessManager) {
+            const std::shared_ptr<const bda::ThriftAccessGrant> vGrant = vCall.mAccess ? vCall.mAccess->grant() : nullptr;
+            if (vGrant) {
+                vCall.mArguments.append(vGrant->principal());
+            }
+            vCall.mArguments.push_back('\0');
+        }
+        vCall.mArguments.append(reinterpret_cast<const char*>(vCall.mData) + vCall.mHeader.mSize, vCall.mSize - vCall.mHeader.mSize);
+    }
+
+    if (vCall.mCacheable) {
+        vCall.mCacheGeneration = aContext.mResponseCache->generation(vCall.mHeader.mName);
+        std::shared_ptr<const bda::ThriftSerializedResponse> vCachedResponse = aContext.mResponseCache->lookup(vCall.mHeader.mName, vCall.mArguments);
+        if (vCachedResponse) {
+            BDAMessage(12, "bda::dispatchThriftMessage(): Answering '" + vCall.mHeader.mName + "' from the response cache.\n");
+            bda::ThriftResponse vResponse;
+            vCall.stamp(aContext, vResponse);
+            vResponse.mShared = vCachedResponse;
+            vResponse.mSeqId = bda::encodeThriftSeqId(aContext.mProtocolType, vCall.mHeader.mSeqId);
+            return aHandler(true, std::move(vResponse));
+        }
+    }
+
+    if (vCall.mCoalescible) {
+        const std::string vSeqId = bda::encodeThriftSeqId(aContext.mProtocolType, vCall.mHeader.mSeqId);
+        bda::ThriftResponse vStampedResponse;
+        vCall.stamp(aContext, vStampedResponse);
+        const bool vFirstCall = aContext.mRequestCoalescer->join(vCall.mHeader.mName, vCall.mArguments,
+            [aHandler, vSeqId, vStampedResponse](std::shared_ptr<const bda::ThriftSerializedResponse> aSharedResponse) {
+                bda::ThriftResponse vResponse = vStampedResponse;
+                vResponse.mShared = aSharedResponse;
+                vResponse.mSeqId = vSeqId;
+                aHandler(aSharedResponse != nullptr, std::move(vResponse));
+            });
+        if (!vFirstCall) {
+            BDAMessage(12, "bda::dispatchThriftMessage(): Waiting for an identical call to '" + vCall.mHeader.mName + "'.\n");
+            return;
+        }
+    }
+
+    // The pool runs the call later on one of its threads. The handler keeps
+    // the session, and thereby the context, the service and the message
+    // data, alive.
+    if (aService.mExecutionPool) {
+        const std::size_t vPriorityClass = vCall.mHasHeader ? aService.mExecutionPool->priorityOf(vCall.mHeader.mName) : 0;
+        bda::ThriftSessionContext* vContext = &aContext;
+        bda::ThriftService* vService = &aService;
+        aService.mExecutionPool->submit(vPriorityClass, [vContext, vService, vCall, aHandler]() {
+            processAndRespond(*vContext, *vService, vCall, aHandler);
+        });
+        return;
+    }
+
+    processAndRespond(aContext, aService, vCall, aHandler);
+}
+
+}
@@ -0,0 +1,130 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTMESSAGEDISPATCHER_HH
+#define THRIFTMESSAGEDISPATCHER_HH
+
+#include "ThriftSharedBinaryProtocol.hh"
+
+#include "bda/ThriftResponseCache.hh"
+#include "bda/ThriftTracer.hh"
+
+#include <boost/asio/buffer.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// forward declarations:
+namespace apache {
+namespace thrift {
+namespace transport {
+class TMemoryBuffer;
+}
+}
+}
+namespace bda {
+class ThriftSessionAccess;
+struct ThriftService;
+struct ThriftSessionContext;
+}
+
+namespace bda {
+
+/**
+ * @brief The serialized response to a single thrift call. It either holds
+ * the in-memory-transport the processor wrote to, and the shared binary
+ * values between its bytes, or a response that is shared with other calls
+ * (for example from the response cache), which is sent with the sequence id
+ * of this call patched in.
+ */
+struct ThriftResponse {
+    std::shared_ptr<apache::thrift::transport::TMemoryBuffer> mTransport;
+
+    // The binary values that the handler shared instead of copying them into
+    // the transport (see bda/ThriftSharedBinary.hh), in the order of their
+    // offsets:
+    std::vector<bda::ThriftSharedSegment> mSegments;
+
+    std::shared_ptr<const bda::ThriftSerializedResponse> mShared;
+    std::string mSeqId;
+
+    // The method, and when the call was dispatched and processed, if the
+    // context has a slow-call log. The processor times stay unset for calls
+    // that were not processed, e.g. cached ones:
+    std::string mMethod;
+    std::chrono::steady_clock::time_point mDispatchTime;
+    std::chrono::steady_clock::time_point mProcessStartTime;
+    std::chrono::steady_clock::time_point mProcessEndTime;
+
+    /** @brief The size of the serialized response in bytes. */
+    std::size_t size() const;
+
+    /**
+     * @brief Append the buffers that make up the response. The buffers refer
+     * to the memory of this object and do not copy the response.
+     */
+    void appendBuffers(std::vector<boost::asio::const_buffer>& aBuffers) const;
+
+    /** @brief Append a copy of the response to aData. */
+    void appendTo(std::string& aData) const;
+
+    void reset();
+};
+
+/**
+ * @brief Receives the response to a dispatched message. aSuccess is false if
+ * the message could not be processed and the connection should end.
+ */
+using ThriftResponseHandler = std::function<void(const bool aSuccess, bda::ThriftResponse aResponse)>;
+
+/**
+ * @brief Process a single serialized thrift message with the processor of
+ * the service, answer it from the response cache, or wait for an identical
+ * call that is already in flight. The processor runs on the execution pool
+ * of the service if there is one. The handler is called at
+ * most once, either before this function returns or later from another
+ * thread, and it is only dropped without a call if the pool was stopped.
+ * The message data must stay valid until the handler was called.
+ *
+ * The deadline of the call is aCallTimeout, or the timeout of its deadline
+ * envelope, after aReceiveTime, the time when the session read the message.
+ * Calls that are still waiting when it expired are answered with an
+ * exception instead (see bda/ThriftCallDeadline.hh). Pass a zero
+ * aCallTimeout for no deadline besides the envelope.
+ *
+ * The stages of the call are recorded as aTraceId if the context has a tracer.
+ *
+ * If the context has an access manager, calls that the grant of aAccess does
+ * not permit are answered with an exception instead, and a login call may
+ * set the grant (see bda/ThriftAccessManager.hh). aAccess may be nullptr
+ * otherwise.
+ */
+void dispatchThriftMessage(bda::ThriftSessionContext& aContext, bda::ThriftService& aService, const uint8_t* aData,
+                           const uint32_t aSize, const std::chrono::steady_clock::time_point aReceiveTime,
+                           const std::chrono::milliseconds aCallTimeout, const bda::ThriftTraceId& aTraceId, std::shared_ptr<bda::ThriftSessionAccess> aAccess,
+                           bda::ThriftResponseHandler aHandler);
+
+}
+
+#endif
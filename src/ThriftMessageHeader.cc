@@ -0,0 +1,239 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "ThriftMessageHeader.hh"
+
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace bda {
+
+namespace {
+
+int32_t readInt32(const uint8_t* aData) {
+    return static_cast<int32_t>((static_cast<uint32_t>(aData[0]) << 24) | (static_cast<uint32_t>(aData[1]) << 16) |
+                                (static_cast<uint32_t>(aData[2]) << 8) | static_cast<uint32_t>(aData[3]));
+}
+
+// TBinaryProtocol: either the strict header
+//   [0x80 0x01 0x00 type] [i32 name length] [name] [i32 seqid]
+// or the old header without version
+//   [i32 name length] [name] [i8 type] [i32 seqid]
+bool parseBinaryMessageHeader(const uint8_t* aData, const std::size_t aSize, bda::ThriftMessageHeader& aHeader) {
+    if (aSize < 4) {
+        return false;
+    }
+    const int32_t vFirstWord = readInt32(aData);
+    std::size_t vOffset = 4;
+
+    int64_t vNameSize = 0;
+    if (vFirstWord < 0) {
+        if ((static_cast<uint32_t>(vFirstWord) & 0xffff0000) != 0x80010000) {
+            return false;
+        }
+        aHeader.mType = static_cast<int32_t>(static_cast<uint32_t>(vFirstWord) & 0x000000ff);
+        if (aSize - vOffset < 4) {
+            return false;
+        }
+        vNameSize = readInt32(aData + vOffset);
+        vOffset += 4;
+    } else {
+        vNameSize = vFirstWord;
+    }
+
+    if (vNameSize < 0 || static_cast<uint64_t>(vNameSize) > aSize - vOffset) {
+        return false;
+    }
+    aHeader.mName.assign(reinterpret_cast<const char*>(aData + vOffset), static_cast<std::size_t>(vNameSize));
+    vOffset += static_cast<std::size_t>(vNameSize);
+
+    if (vFirstWord >= 0) {
+        if (aSize - vOffset < 1) {
+            return false;
+        }
+        aHeader.mType = aData[vOffset];
+        vOffset += 1;
+    }
+
+    if (aSize - vOffset < 4) {
+        return false;
+    }
+    aHeader.mSeqId = readInt32(aData + vOffset);
+    aHeader.mSeqIdOffset = vOffset;
+    aHeader.mSeqIdSize = 4;
+    aHeader.mSize = vOffset + 4;
+    return true;
+}
+
+// Read an unsigned varint of at most 32 bits at aOffset, and advance aOffset
+// behind it.
+bool readVarint32(const uint8_t* aData, const std::size_t aSize, std::size_t& aOffset, uint32_t& aValue) {
+    aValue = 0;
+    for (int vShift = 0; vShift < 35; vShift += 7) {
+        if (aOffset >= aSize) {
+            return false;
+        }
+        const uint8_t vByte = aData[aOffset++];
+        aValue |= static_cast<uint32_t>(vByte & 0x7F) << vShift;
+        if ((vByte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// TCompactProtocol:
+//   [0x82] [type << 5 | 0x01] [varint seqid] [varint name length] [name]
+bool parseCompactMessageHeader(const uint8_t* aData, const std::size_t aSize, bda::ThriftMessageHeader& aHeader) {
+    if (aSize < 2 || aData[0] != 0x82 || (aData[1] & 0x1F) != 0x01) {
+        return false;
+    }
+    aHeader.mType = (aData[1] >> 5) & 0x07;
+    std::size_t vOffset = 2;
+
+    uint32_t vValue = 0;
+    aHeader.mSeqIdOffset = vOffset;
+    if (!readVarint32(aData, aSize, vOffset, vValue)) {
+        return false;
+    }
+    aHeader.mSeqId = static_cast<int32_t>(vValue);
+    aHeader.mSeqIdSize = vOffset - aHeader.mSeqIdOffset;
+
+    if (!readVarint32(aData, aSize, vOffset, vValue) || vValue > aSize - vOffset) {
+        return false;
+    }
+    aHeader.mName.assign(reinterpret_cast<const char*>(aData + vOffset), vValue);
+    aHeader.mSize = vOffset + vValue;
+    return true;
+}
+
+// Parse a decimal JSON integer at aOffset, and advance aOffset behind it.
+bool parseJSONInteger(const uint8_t* aData, const std::size_t aSize, std::size_t& aOffset, int64_t& aValue) {
+    const std::size_t vStart = aOffset;
+    bool vNegative = false;
+    if (aOffset < aSize && aData[aOffset] == '-') {
+        vNegative = true;
+        ++aOffset;
+    }
+    int64_t vValue = 0;
+    while (aOffset < aSize && aData[aOffset] >= '0' && aData[aOffset] <= '9') {
+        vValue = vValue * 10 + (aData[aOffset] - '0');
+        if (vValue > std::numeric_limits<uint32_t>::max()) {
+            return false;
+        }
+        ++aOffset;
+    }
+    if (aOffset == vStart || (vNegative && aOffset == vStart + 1)) {
+        return false;
+    }
+    aValue = vNegative ? -vValue : vValue;
+    return true;
+}
+
+bool expectJSONCharacter(const uint8_t* aData, const std::size_t aSize, std::size_t& aOffset, const char aCharacter) {
+    if (aOffset >= aSize || aData[aOffset] != static_cast<uint8_t>(aCharacter)) {
+        return false;
+    }
+    ++aOffset;
+    return true;
+}
+
+// TJSONProtocol: [version,"name",type,seqid,{arguments}]
+bool parseJSONMessageHeader(const uint8_t* aData, const std::size_t aSize, bda::ThriftMessageHeader& aHeader) {
+    std::size_t vOffset = 0;
+    int64_t vValue = 0;
+
+    if (!expectJSONCharacter(aData, aSize, vOffset, '[') || !parseJSONInteger(aData, aSize, vOffset, vValue) ||
+        vValue != 1 || !expectJSONCharacter(aData, aSize, vOffset, ',') || !expectJSONCharacter(aData, aSize, vOffset, '"')) {
+        return false;
+    }
+
+    // Method names are plain identifiers, escape sequences are not supported:
+    const std::size_t vNameStart = vOffset;
+    while (vOffset < aSize && aData[vOffset] != '"') {
+        if (aData[vOffset] == '\\') {
+            return false;
+        }
+        ++vOffset;
+    }
+    aHeader.mName.assign(reinterpret_cast<const char*>(aData + vNameStart), vOffset - vNameStart);
+
+    if (!expectJSONCharacter(aData, aSize, vOffset, '"') || !expectJSONCharacter(aData, aSize, vOffset, ',') ||
+        !parseJSONInteger(aData, aSize, vOffset, vValue) || !expectJSONCharacter(aData, aSize, vOffset, ',')) {
+        return false;
+    }
+    aHeader.mType = static_cast<int32_t>(vValue);
+
+    aHeader.mSeqIdOffset = vOffset;
+    if (!parseJSONInteger(aData, aSize, vOffset, vValue)) {
+        return false;
+    }
+    aHeader.mSeqId = static_cast<int32_t>(vValue);
+    aHeader.mSeqIdSize = vOffset - aHeader.mSeqIdOffset;
+
+    if (!expectJSONCharacter(aData, aSize, vOffset, ',')) {
+        return false;
+    }
+    aHeader.mSize = vOffset;
+    return true;
+}
+
+}
+
+bool parseThriftMessageHeader(const bda::ProtocolType aProtocolType, const uint8_t* aData, const std::size_t aSize,
+                              bda::ThriftMessageHeader& aHeader) {
+    switch (aProtocolType) {
+        case bda::ProtocolType::BINARY:
+            return parseBinaryMessageHeader(aData, aSize, aHeader);
+        case bda::ProtocolType::COMPACT:
+            return parseCompactMessageHeader(aData, aSize, aHeader);
+        case bda::ProtocolType::JSON:
+            return parseJSONMessageHeader(aData, aSize, aHeader);
+        default:
+            return false;
+    }
+}
+
+std::string encodeThriftSeqId(const bda::ProtocolType aProtocolType, const int32_t aSeqId) {
+    switch (aProtocolType) {
+        case bda::ProtocolType::BINARY: {
+            const uint32_t vSeqId = static_cast<uint32_t>(aSeqId);
+            const char vBytes[4] = { static_cast<char>((vSeqId >> 24) & 0xFF), static_cast<char>((vSeqId >> 16) & 0xFF),
+                                     static_cast<char>((vSeqId >> 8) & 0xFF), static_cast<char>(vSeqId & 0xFF) };
+            return std::string(vBytes, sizeof(vBytes));
+        }
+        case bda::ProtocolType::COMPACT: {
+            std::string vBytes;
+            uint32_t vSeqId = static_cast<uint32_t>(aSeqId);
+            while (vSeqId >= 0x80) {
+                vBytes.push_back(static_cast<char>((vSeqId & 0x7F) | 0x80));
+                vSeqId >>= 7;
+            }
+            vBytes.push_back(static_cast<char>(vSeqId));
+            return vBytes;
+        }
+        case bda::ProtocolType::JSON:
+            return std::to_string(aSeqId);
+        default:
+            throw(std::runtime_error("bda::encodeThriftSeqId(): ProtocolType not understood"));
+    }
+}
+
+}
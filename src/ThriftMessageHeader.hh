@@ -0,0 +1,63 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTMESSAGEHEADER_HH
+#define THRIFTMESSAGEHEADER_HH
+
+#include "bda/ThriftHelper.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace bda {
+
+/**
+ * @brief The header of a serialized thrift message, i.e. everything that
+ * TProtocol::readMessageBegin() reads, plus the location of the fields in
+ * the serialized data. The header is parsed directly from the bytes, so
+ * that the server can inspect a message without running the processor.
+ */
+struct ThriftMessageHeader {
+    std::string mName;
+    int32_t mType = 0;
+    int32_t mSeqId = 0;
+
+    // Position and size of the encoded sequence id in the message:
+    std::size_t mSeqIdOffset = 0;
+    std::size_t mSeqIdSize = 0;
+
+    // Size of the header, i.e. the offset where the arguments start:
+    std::size_t mSize = 0;
+};
+
+/**
+ * @brief Parse the message header of a serialized thrift message in the
+ * given protocol. Returns false if the data does not start with a valid
+ * message header.
+ */
+bool parseThriftMessageHeader(const bda::ProtocolType aProtocolType, const uint8_t* aData, const std::size_t aSize,
+                              bda::ThriftMessageHeader& aHeader);
+
+/** @brief Encode a sequence id the way the protocol stores it in a message header. */
+std::string encodeThriftSeqId(const bda::ProtocolType aProtocolType, const int32_t aSeqId);
+
+}
+
+#endif
@@ -0,0 +1,398 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftProfiler.hh"
+
+#include <bda/Helpers.hh>
+
+#if defined(__linux__) && defined(__GLIBC__)
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#if defined(BDA_HAS_GPERFTOOLS)
+#include <gperftools/profiler.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace bda {
+
+std::atomic<bool> ThriftProfiler::sHeapSampling{ false };
+
+namespace {
+
+// Only one profile runs in the process at a time, because the CPU profile
+// uses the process-wide SIGPROF timer:
+std::atomic<bool> sProfiling{ false };
+
+#if defined(__linux__) && defined(__GLIBC__)
+
+constexpr std::size_t cMaxFrames = 32;
+constexpr std::size_t cMaxSamples = 65536;
+
+struct Sample {
+    uint64_t mWeight;
+    std::size_t mFrames;
+    void* mFrame[cMaxFrames];
+};
+
+// The samples of the running profile, written by signal handlers and
+// allocating threads. Slots are claimed with sNextSample, and the samples
+// beyond the capacity are dropped:
+std::unique_ptr<Sample[]> sSamples;
+std::size_t sSampleCapacity = 0;
+std::atomic<std::size_t> sNextSample{ 0 };
+std::atomic<unsigned> sSampleWriters{ 0 };
+std::atomic<bool> sCPUSampling{ false };
+std::atomic<std::size_t> sHeapSampleBytes{ 0 };
+
+thread_local int64_t tHeapCountdown = 0;
+thread_local bool tInHeapSample = false;
+
+// Record the stack of the calling thread without its own aSkipFrames
+// innermost frames. This is async-signal-safe once backtrace() was called
+// outside of a signal handler, which loads the unwinder:
+__attribute__((noinline)) void recordSample(const uint64_t aWeight, const int aSkipFrames, const std::atomic<bool>& aSampling) {
+    ++sSampleWriters;
+    if (aSampling.load()) {
+        const std::size_t vIndex = sNextSample.fetch_add(1, std::memory_order_relaxed);
+        if (vIndex < sSampleCapacity) {
+            void* vFrames[cMaxFrames + 4];
+            const int vDepth = ::backtrace(vFrames, static_cast<int>(cMaxFrames) + aSkipFrames + 1);
+            Sample& vSample = sSamples[vIndex];
+            vSample.mWeight = aWeight;
+            vSample.mFrames = 0;
+            for (int vFrame = aSkipFrames + 1; vFrame < vDepth; ++vFrame) {
+                vSample.mFrame[vSample.mFrames++] = vFrames[vFrame];
+            }
+        }
+    }
+    --sSampleWriters;
+}
+
+__attribute__((noinline)) void onProfileSignal(int) {
+    const int vErrno = errno;
+    // Skip the handler and the signal trampoline:
+    recordSample(1, 2, sCPUSampling);
+    errno = vErrno;
+}
+
+// Allocate the samples of a profile, before sampling starts:
+void prepareSamples(const std::size_t aCapacity) {
+    sSampleCapacity = std::max<std::size_t>(1, std::min(aCapacity, cMaxSamples));
+    sSamples.reset(new Sample[sSampleCapacity]);
+    sNextSample = 0;
+
+    // The first call of backtrace() loads the unwinder, which may allocate:
+    void* vFrame = nullptr;
+    ::backtrace(&vFrame, 1);
+}
+
+// Stop sampling, and wait for the threads that are still recording:
+void stopSampling(std::atomic<bool>& aSampling) {
+    aSampling = false;
+    while (sSampleWriters.load() > 0) {
+        std::this_thread::yield();
+    }
+}
+
+std::string symbolize(void* aAddress) {
+    Dl_info vInfo;
+    if (::dladdr(aAddress, &vInfo) && vInfo.dli_sname) {
+        int vStatus = 0;
+        std::unique_ptr<char, void (*)(void*)> vDemangled(abi::__cxa_demangle(vInfo.dli_sname, nullptr, nullptr, &vStatus), &std::free);
+        return vStatus == 0 && vDemangled ? std::string(vDemangled.get()) : std::string(vInfo.dli_sname);
+    }
+
+    // Functions that are not exported are named by their module and offset:
+    std::ostringstream vName;
+    if (vInfo.dli_fname) {
+        const std::string vModule(vInfo.dli_fname);
+        vName << vModule.substr(vModule.rfind('/') + 1) << "+0x" << std::hex
+              << (static_cast<char*>(aAddress) - static_cast<char*>(vInfo.dli_fbase));
+    } else {
+        vName << aAddress;
+    }
+    return vName.str();
+}
+
+// Write the samples as folded stacks, outermost frame first, the heaviest
+// stacks first:
+std::string foldSamples() {
+    const std::size_t vRecorded = sNextSample.load();
+    const std::size_t vSamples = std::min(vRecorded, sSampleCapacity);
+    if (vRecorded > vSamples) {
+        BDAMessage(4, "bda::ThriftProfiler: Dropped " + std::to_string(vRecorded - vSamples) + " of " + std::to_string(vRecorded) + " samples.\n");
+    }
+
+    std::map<std::vector<void*>, uint64_t> vStacks;
+    for (std::size_t vIndex = 0; vIndex < vSamples; ++vIndex) {
+        const Sample& vSample = sSamples[vIndex];
+        std::vector<void*> vStack(vSample.mFrame, vSample.mFrame + vSample.mFrames);
+        std::reverse(vStack.begin(), vStack.end());
+        vStacks[std::move(vStack)] += vSample.mWeight;
+    }
+    sSamples.reset();
+    sSampleCapacity = 0;
+
+    // Stacks that differ only in their addresses within a function are the
+    // same stack of names:
+    std::map<void*, std::string> vNames;
+    std::map<std::string, uint64_t> vNamedStacks;
+    for (const auto& vStack : vStacks) {
+        std::string vLine;
+        for (std::size_t vFrame = 0; vFrame < vStack.first.size(); ++vFrame) {
+            // Return addresses point behind the call, into the next line or
+            // even the next function:
+            void* vAddress = vStack.first[vFrame];
+            if (vFrame + 1 < vStack.first.size()) {
+                vAddress = static_cast<char*>(vAddress) - 1;
+            }
+            auto vNameIt = vNames.find(vAddress);
+            if (vNameIt == vNames.end()) {
+                std::string vName = symbolize(vAddress);
+                std::replace(vName.begin(), vName.end(), ';', ':');
+                vNameIt = vNames.emplace(vAddress, std::move(vName)).first;
+            }
+            if (!vLine.empty()) {
+                vLine += ';';
+            }
+            vLine += vNameIt->second;
+        }
+        vNamedStacks[std::move(vLine)] += vStack.second;
+    }
+    std::vector<std::pair<std::string, uint64_t>> vLines(vNamedStacks.begin(), vNamedStacks.end());
+    std::sort(vLines.begin(), vLines.end(), [](const std::pair<std::string, uint64_t>& aLeft, const std::pair<std::string, uint64_t>& aRight) {
+        return aLeft.second > aRight.second;
+    });
+
+    std::string vFolded;
+    for (const std::pair<std::string, uint64_t>& vLine : vLines) {
+        vFolded += vLine.first + ' ' + std::to_string(vLine.second) + '\n';
+    }
+    return vFolded;
+}
+
+#endif
+
+}
+
+ThriftProfiler::ThriftProfiler(const std::chrono::seconds aMaxDuration, const unsigned aSamplesPerSecond, const std::size_t aHeapSampleBytes)
+    : mMaxDuration(aMaxDuration), mSamplesPerSecond(std::max(1u, std::min(aSamplesPerSecond, 10000u))),
+      mHeapSampleBytes(std::max<std::size_t>(1, aHeapSampleBytes)) {
+}
+
+ThriftProfiler::~ThriftProfiler() {
+    stop();
+}
+
+bool ThriftProfiler::supports(const Type aType, const Format aFormat) {
+#if defined(__linux__) && defined(__GLIBC__)
+    if (aFormat == Format::Folded) {
+        return true;
+    }
+#endif
+#if defined(BDA_HAS_GPERFTOOLS)
+    if (aType == Type::CPU && aFormat == Format::PProf) {
+        return true;
+    }
+#endif
+    (void)aType;
+    (void)aFormat;
+    return false;
+}
+
+bool ThriftProfiler::start(const Type aType, const Format aFormat, std::chrono::milliseconds aDuration,
+                           std::function<void(const bool aSuccess, std::string aProfile)> aDone) {
+    if (!supports(aType, aFormat)) {
+        throw(std::invalid_argument("bda::ThriftProfiler::start(): This profile type is not available in this format in this build"));
+    }
+
+    std::lock_guard<std::mutex> vThreadLock(mThreadMutex);
+    {
+        std::lock_guard<std::mutex> vLock(mMutex);
+        if (mStopping) {
+            return false;
+        }
+    }
+    if (sProfiling.exchange(true)) {
+        return false;
+    }
+
+    // The thread of the last profile of this profiler has released the
+    // process, and may only be reporting its result:
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+
+    aDuration = std::max(std::chrono::milliseconds(0), std::min<std::chrono::milliseconds>(aDuration, mMaxDuration));
+    mThread = std::thread([this, aType, aFormat, aDuration, aDone]() {
+        BDAMessage(4, "bda::ThriftProfiler: Profiling for " + std::to_string(aDuration.count()) + " ms.\n");
+        bool vSuccess = true;
+        std::string vProfile;
+        try {
+            vProfile = aType == Type::CPU ? profileCPU(aFormat, aDuration) : profileHeap(aDuration);
+        } catch (const std::exception& vException) {
+            BDAMessage(2, std::string(vException.what()) + "\n");
+            vSuccess = false;
+        }
+        sProfiling = false;
+        aDone(vSuccess, std::move(vProfile));
+    });
+    return true;
+}
+
+void ThriftProfiler::stop() {
+    {
+        std::lock_guard<std::mutex> vLock(mMutex);
+        mStopping = true;
+    }
+    mStopCondition.notify_all();
+
+    std::lock_guard<std::mutex> vThreadLock(mThreadMutex);
+    if (mThread.joinable()) {
+        // The owner of the last reference may be the callback of the profile:
+        if (mThread.get_id() == std::this_thread::get_id()) {
+            mThread.detach();
+        } else {
+            mThread.join();
+        }
+    }
+}
+
+void ThriftProfiler::sleepFor(const std::chrono::milliseconds aDuration) {
+    std::unique_lock<std::mutex> vLock(mMutex);
+    mStopCondition.wait_for(vLock, aDuration, [this]() {
+        return mStopping;
+    });
+}
+
+std::string ThriftProfiler::profileCPU(const Format aFormat, const std::chrono::milliseconds aDuration) {
+#if defined(BDA_HAS_GPERFTOOLS)
+    if (aFormat == Format::PProf) {
+        char vPath[] = "/tmp/bda-profile-XXXXXX";
+        const int vFile = ::mkstemp(vPath);
+        if (vFile < 0) {
+            throw(std::runtime_error("bda::ThriftProfiler::profileCPU(): Could not create a temporary file for the profile"));
+        }
+        ::close(vFile);
+        if (!ProfilerStart(vPath)) {
+            std::remove(vPath);
+            throw(std::runtime_error("bda::ThriftProfiler::profileCPU(): Could not start the gperftools CPU profiler"));
+        }
+        sleepFor(aDuration);
+        ProfilerStop();
+
+        std::ifstream vStream(vPath, std::ios::binary);
+        std::string vProfile((std::istreambuf_iterator<char>(vStream)), std::istreambuf_iterator<char>());
+        std::remove(vPath);
+        return vProfile;
+    }
+#endif
+
+#if defined(__linux__) && defined(__GLIBC__)
+    (void)aFormat;
+    const std::size_t vSeconds = static_cast<std::size_t>(std::chrono::duration_cast<std::chrono::seconds>(aDuration).count()) + 1;
+    prepareSamples(vSeconds * mSamplesPerSecond * std::max(1u, std::thread::hardware_concurrency()));
+
+    // The handler stays installed, it does nothing without the timer:
+    struct sigaction vAction = {};
+    vAction.sa_handler = &onProfileSignal;
+    vAction.sa_flags = SA_RESTART;
+    sigemptyset(&vAction.sa_mask);
+    if (::sigaction(SIGPROF, &vAction, nullptr) != 0) {
+        throw(std::runtime_error("bda::ThriftProfiler::profileCPU(): Could not install the SIGPROF handler"));
+    }
+
+    // The timer counts the CPU time of all threads of the process:
+    const long vIntervalUS = 1000000L / static_cast<long>(mSamplesPerSecond);
+    struct itimerval vTimer = {};
+    vTimer.it_interval.tv_sec = vIntervalUS / 1000000L;
+    vTimer.it_interval.tv_usec = vIntervalUS % 1000000L;
+    vTimer.it_value = vTimer.it_interval;
+    sCPUSampling = true;
+    if (::setitimer(ITIMER_PROF, &vTimer, nullptr) != 0) {
+        stopSampling(sCPUSampling);
+        throw(std::runtime_error("bda::ThriftProfiler::profileCPU(): Could not start the profiling timer"));
+    }
+    sleepFor(aDuration);
+
+    const struct itimerval vStopped = {};
+    ::setitimer(ITIMER_PROF, &vStopped, nullptr);
+    stopSampling(sCPUSampling);
+    return foldSamples();
+#else
+    (void)aFormat;
+    (void)aDuration;
+    throw(std::runtime_error("bda::ThriftProfiler::profileCPU(): CPU profiles are only supported on Linux"));
+#endif
+}
+
+std::string ThriftProfiler::profileHeap(const std::chrono::milliseconds aDuration) {
+#if defined(__linux__) && defined(__GLIBC__)
+    prepareSamples(cMaxSamples);
+    sHeapSampleBytes = mHeapSampleBytes;
+    sHeapSampling = true;
+    sleepFor(aDuration);
+    stopSampling(sHeapSampling);
+    return foldSamples();
+#else
+    (void)aDuration;
+    throw(std::runtime_error("bda::ThriftProfiler::profileHeap(): Heap profiles are only supported on Linux"));
+#endif
+}
+
+void ThriftProfiler::recordAllocation(const std::size_t aSize) noexcept {
+#if defined(__linux__) && defined(__GLIBC__)
+    // Every thread samples the allocation that crosses the next multiple of
+    // the sample distance, weighted by the bytes since its last sample:
+    tHeapCountdown -= static_cast<int64_t>(aSize);
+    if (tHeapCountdown > 0 || tInHeapSample) {
+        return;
+    }
+    const int64_t vDistance = static_cast<int64_t>(sHeapSampleBytes.load(std::memory_order_relaxed));
+    const int64_t vSamples = 1 + (-tHeapCountdown) / vDistance;
+    tHeapCountdown += vSamples * vDistance;
+
+    // Skip this function, and guard against allocations of the unwinder:
+    tInHeapSample = true;
+    recordSample(static_cast<uint64_t>(vSamples * vDistance), 1, sHeapSampling);
+    tInHeapSample = false;
+#else
+    (void)aSize;
+#endif
+}
+
+}
@@ -0,0 +1,75 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftRequestCoalescer.hh"
+
+#include "ThriftCallKey.hh"
+
+#include <string>
+#include <utility>
+
+namespace bda {
+
+void ThriftRequestCoalescer::setCoalescible(const std::string& aMethodName) {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    mCoalescibleMethods.insert(aMethodName);
+}
+
+bool ThriftRequestCoalescer::isCoalescible(const std::string& aMethodName) const {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    return mCoalescibleMethods.find(aMethodName) != mCoalescibleMethods.end();
+}
+
+bool ThriftRequestCoalescer::join(const std::string& aMethodName, const std::string& aArguments, Waiter aWaiter) {
+    std::string vKey = bda::makeThriftCallKey(aMethodName, aArguments);
+
+    std::lock_guard<std::mutex> vLock(mMutex);
+    const auto vInFlightIt = mInFlight.find(vKey);
+    if (vInFlightIt != mInFlight.end()) {
+        vInFlightIt->second.push_back(std::move(aWaiter));
+        ++mCoalescedCalls;
+        return false;
+    }
+
+    mInFlight.emplace(std::move(vKey), std::vector<Waiter>());
+    ++mProcessedCalls;
+    return true;
+}
+
+void ThriftRequestCoalescer::complete(const std::string& aMethodName, const std::string& aArguments,
+                                      std::shared_ptr<const bda::ThriftSerializedResponse> aResponse) {
+    std::vector<Waiter> vWaiters;
+    {
+        std::lock_guard<std::mutex> vLock(mMutex);
+        const auto vInFlightIt = mInFlight.find(bda::makeThriftCallKey(aMethodName, aArguments));
+        if (vInFlightIt == mInFlight.end()) {
+            return;
+        }
+        vWaiters.swap(vInFlightIt->second);
+        mInFlight.erase(vInFlightIt);
+    }
+
+    // The waiters are called without holding the lock, so that they can
+    // immediately issue new calls:
+    for (const Waiter& vWaiter : vWaiters) {
+        vWaiter(aResponse);
+    }
+}
+
+}
@@ -0,0 +1,149 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftResponseCache.hh"
+
+#include "ThriftCallKey.hh"
+
+#include <iterator>
+#include <string>
+
+namespace bda {
+
+ThriftResponseCache::ThriftResponseCache(const std::size_t aMaxBytes)
+    : mMaxBytes(aMaxBytes) {
+}
+
+void ThriftResponseCache::setCacheable(const std::string& aMethodName, const std::chrono::milliseconds aTimeToLive) {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    mTimeToLive[aMethodName] = aTimeToLive;
+}
+
+bool ThriftResponseCache::isCacheable(const std::string& aMethodName) const {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    return mTimeToLive.find(aMethodName) != mTimeToLive.end();
+}
+
+std::shared_ptr<const bda::ThriftSerializedResponse> ThriftResponseCache::lookup(const std::string& aMethodName, const std::string& aArguments) {
+    const std::string vKey = bda::makeThriftCallKey(aMethodName, aArguments);
+
+    std::lock_guard<std::mutex> vLock(mMutex);
+    const auto vIndexIt = mIndex.find(vKey);
+    if (vIndexIt == mIndex.end()) {
+        ++mMisses;
+        return nullptr;
+    }
+
+    const auto vEntryIt = vIndexIt->second;
+    if (vEntryIt->mExpiry <= std::chrono::steady_clock::now()) {
+        erase(vEntryIt);
+        ++mMisses;
+        return nullptr;
+    }
+
+    // Move the entry to the front of the least recently used list:
+    mEntries.splice(mEntries.begin(), mEntries, vEntryIt);
+    ++mHits;
+    return vEntryIt->mResponse;
+}
+
+std::uint64_t ThriftResponseCache::generation(const std::string& aMethodName) const {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    return lockedGeneration(aMethodName);
+}
+
+void ThriftResponseCache::store(const std::string& aMethodName, const std::string& aArguments,
+                                std::shared_ptr<const bda::ThriftSerializedResponse> aResponse, const std::uint64_t aGeneration) {
+    if (!aResponse) {
+        return;
+    }
+
+    Entry vEntry;
+    vEntry.mKey = bda::makeThriftCallKey(aMethodName, aArguments);
+    vEntry.mMethodNameSize = aMethodName.size();
+    vEntry.mResponse = aResponse;
+
+    const std::size_t vEntryBytes = vEntry.mKey.size() + aResponse->mData.size();
+    if (vEntryBytes > mMaxBytes) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> vLock(mMutex);
+    const auto vTimeToLiveIt = mTimeToLive.find(aMethodName);
+    if (vTimeToLiveIt == mTimeToLive.end()) {
+        return;
+    }
+    // The response may have been computed from data that changed since:
+    if (lockedGeneration(aMethodName) != aGeneration) {
+        return;
+    }
+    vEntry.mExpiry = std::chrono::steady_clock::now() + vTimeToLiveIt->second;
+    const auto vIndexIt = mIndex.find(vEntry.mKey);
+    if (vIndexIt != mIndex.end()) {
+        erase(vIndexIt->second);
+    }
+
+    // Evict the least recently used entries until the new one fits:
+    while (!mEntries.empty() && mBytes + vEntryBytes > mMaxBytes) {
+        erase(std::prev(mEntries.end()));
+    }
+
+    mEntries.push_front(std::move(vEntry));
+    mIndex.emplace(mEntries.front().mKey, mEntries.begin());
+    mBytes += vEntryBytes;
+}
+
+void ThriftResponseCache::invalidate(const std::string& aMethodName) {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    ++mInvalidations[aMethodName];
+    for (auto vEntryIt = mEntries.begin(); vEntryIt != mEntries.end();) {
+        const auto vNextIt = std::next(vEntryIt);
+        if (vEntryIt->mMethodNameSize == aMethodName.size() && vEntryIt->mKey.compare(0, aMethodName.size(), aMethodName) == 0) {
+            erase(vEntryIt);
+        }
+        vEntryIt = vNextIt;
+    }
+}
+
+void ThriftResponseCache::clear() {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    ++mClears;
+    mIndex.clear();
+    mEntries.clear();
+    mBytes = 0;
+}
+
+std::size_t ThriftResponseCache::sizeBytes() const {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    return mBytes;
+}
+
+std::uint64_t ThriftResponseCache::lockedGeneration(const std::string& aMethodName) const {
+    // Both counts only grow, so their sum changes with either of them:
+    const auto vInvalidationsIt = mInvalidations.find(aMethodName);
+    return mClears + (vInvalidationsIt != mInvalidations.end() ? vInvalidationsIt->second : 0);
+}
+
+void ThriftResponseCache::erase(std::list<Entry>::iterator aEntry) {
+    mBytes -= aEntry->mKey.size() + aEntry->mResponse->mData.size();
+    mIndex.erase(aEntry->mKey);
+    mEntries.erase(aEntry);
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTSESSIONACCESS_HH
+#define THRIFTSESSIONACCESS_HH
+
+#include "bda/ThriftAccessManager.hh"
+
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace bda {
+
+/**
+ * @brief The grant of a session, if it authenticated. Calls of the same
+ * session may run concurrently on the execution pool, and a login call may
+ * replace the grant while others are checked.
+ */
+class ThriftSessionAccess {
+public:
+    ThriftSessionAccess() = default;
+    explicit ThriftSessionAccess(std::shared_ptr<const bda::ThriftAccessGrant> aGrant)
+        : mGrant(std::move(aGrant)) {
+    }
+
+    std::shared_ptr<const bda::ThriftAccessGrant> grant() const {
+        std::lock_guard<std::mutex> vLock(mMutex);
+        return mGrant;
+    }
+
+    void setGrant(std::shared_ptr<const bda::ThriftAccessGrant> aGrant) {
+        std::lock_guard<std::mutex> vLock(mMutex);
+        mGrant = std::move(aGrant);
+    }
+
+private:
+    mutable std::mutex mMutex;
+    std::shared_ptr<const bda::ThriftAccessGrant> mGrant;
+};
+
+/**
+ * @brief Makes the access manager and the session of the call that runs on
+ * the current thread available to loginThriftSession() and
+ * currentThriftPrincipal(), and restores the previous ones at the end.
+ */
+class ThriftSessionAccessScope {
+public:
+    ThriftSessionAccessScope(bda::ThriftAccessManager* aAccessManager, bda::ThriftSessionAccess* aAccess);
+    ~ThriftSessionAccessScope();
+
+    ThriftSessionAccessScope(const ThriftSessionAccessScope&) = delete;
+    ThriftSessionAccessScope& operator=(const ThriftSessionAccessScope&) = delete;
+
+private:
+    bda::ThriftAccessManager* mPreviousAccessManager;
+    bda::ThriftSessionAccess* mPreviousAccess;
+};
+
+}
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTSESSIONCONTEXT_HH
+#define THRIFTSESSIONCONTEXT_HH
+
+#include "bda/ThriftAccessManager.hh"
+#include "bda/ThriftEmbeddedDocumentRoot.hh"
+#include "bda/ThriftExecutionPool.hh"
+#include "bda/ThriftHelper.hh"
+#include "bda/ThriftProfiler.hh"
+#include "bda/ThriftRequestCoalescer.hh"
+#include "bda/ThriftResponseCache.hh"
+#include "bda/ThriftSlowCallLog.hh"
+#include "bda/ThriftTracer.hh"
+#include "bda/ThriftTrafficCapture.hh"
+
+#include "ThriftMemoryBudget.hh"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ssl/context.hpp>
+
+#include <boost/beast/core/string.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+// forward declarations:
+namespace apache {
+namespace thrift {
+class TProcessor;
+namespace async {
+class TAsyncProcessor;
+}
+namespace protocol {
+class TProtocolFactory;
+}
+}
+}
+
+namespace bda {
+
+/**
+ * @brief A thrift service that is served on one WebSocket upgrade path, with
+ * its own processor, optional execution pool and connection limit.
+ */
+struct ThriftService {
+    // The upgrade path, which is empty for the default service that serves
+    // all paths without a service of their own:
+    std::string mPath;
+
+    // Either a synchronous processor, or an asynchronous processor whose
+    // handlers complete the calls through callbacks without blocking:
+    std::shared_ptr<apache::thrift::TProcessor> mThriftProcessor;
+    std::shared_ptr<apache::thrift::async::TAsyncProcessor> mAsyncProcessor;
+
+    // Optional thread pool with priority classes that runs the processor
+    // instead of the server threads:
+    std::shared_ptr<bda::ThriftExecutionPool> mExecutionPool;
+
+    // The maximum number of concurrent connections, or 0 for no limit:
+    std::size_t mMaxConnections = 0;
+    std::atomic<std::size_t> mConnections{ 0 };
+
+    /** @brief Count a new connection, or return false if the limit is reached. */
+    bool tryAcquireConnection() {
+        std::size_t vConnections = mConnections.load();
+        do {
+            if (mMaxConnections > 0 && vConnections >= mMaxConnections) {
+                return false;
+            }
+        } while (!mConnections.compare_exchange_weak(vConnections, vConnections + 1));
+        return true;
+    }
+
+    void releaseConnection() {
+        --mConnections;
+    }
+};
+
+/**
+ * @brief The state that a ThriftHTTPWSServer shares with its listener and
+ * all HTTP and WebSocket sessions. It is created once by the server and
+ * handed down to every session, so that new settings do not need to be
+ * threaded through all session constructors.
+ * @note The settings must not be modified after the server was started.
+ */
+struct ThriftSessionContext {
+    explicit ThriftSessionContext(boost::asio::io_context::executor_type aWorkExecutor)
+        : mWorkExecutor(aWorkExecutor) {
+    }
+
+    std::string mHTTPDocumentRoot;
+
+    // Optional files that were embedded at build time, served instead of
+    // the files of the document root, which is only used for other paths
+    // if mEmbeddedFallbackToDisk:
+    const bda::ThriftEmbeddedDocumentRoot* mEmbeddedDocumentRoot = nullptr;
+    bool mEmbeddedFallbackToDisk = true;
+
+    // The SSL context is required to hold the SSL certificates
+    std::shared_ptr<boost::asio::ssl::context> mSSLContext;
+
+    bda::ProtocolType mProtocolType = bda::ProtocolType::BINARY;
+    std::shared_ptr<apache::thrift::protocol::TProtocolFactory> mThriftProtocolFactory;
+
+    // The services by upgrade path, and the service for all other paths:
+    std::map<std::string, std::shared_ptr<bda::ThriftService>> mServices;
+    std::shared_ptr<bda::ThriftService> mDefaultService;
+
+    // The executor of the server threads, used for work that does not need
+    // to run on the strand of a session:
+    boost::asio::io_context::executor_type mWorkExecutor;
+
+    // Accept batch envelopes (see bda/ThriftBatchEnvelope.hh) in WebSocket
+    // sessions, and optionally process the contained calls concurrently:
+    bool mBatchEnabled = false;
+    bool mBatchParallel = false;
+
+    // Serve thrift clients that send TFramedTransport frames directly over
+    // TCP, next to HTTP and WebSocket on the same port:
+    bool mFramedThriftEnabled = false;
+
+    // Optional authentication of the sessions and check of every call:
+    std::shared_ptr<bda::ThriftAccessManager> mAccessManager;
+
+    // Optional cache for the responses of idempotent methods:
+    std::shared_ptr<bda::ThriftResponseCache> mResponseCache;
+
+    // Optional single-flight deduplication of identical concurrent calls:
+    std::shared_ptr<bda::ThriftRequestCoalescer> mRequestCoalescer;
+
+    // Accept call deadlines (see bda/ThriftCallDeadline.hh), and count the
+    // calls that were dropped because their deadline expired:
+    bool mDeadlinesEnabled = false;
+    std::atomic<uint64_t> mExpiredCalls{ 0 };
+
+    // Optional per-stage tracing of every message, and the source of the
+    // connection ids of the traces:
+    std::shared_ptr<bda::ThriftTracer> mTracer;
+    std::atomic<uint64_t> mNextConnectionId{ 1 };
+
+    // The HTTP/1.1 and HTTP/2 requests in flight, from their dispatch until
+    // their response was written, that ThriftHTTPWSServer::drain() waits for:
+    std::atomic<std::size_t> mRequests{ 0 };
+
+    // Optional capture of the messages of the WebSocket sessions, which
+    // also needs connection ids:
+    std::shared_ptr<bda::ThriftTrafficCapture> mTrafficCapture;
+
+    // Optional log of the calls that took longer than its threshold:
+    std::shared_ptr<bda::ThriftSlowCallLog> mSlowCallLog;
+
+    // HTTP paths that are answered with the JSON document of a function
+    // instead of a file, e.g. the slow-call log:
+    std::map<std::string, std::function<std::string()>> mJSONEndpoints;
+
+    // Optional budget of the memory that the sessions hold in message
+    // buffers and responses:
+    std::shared_ptr<bda::ThriftMemoryBudget> mMemoryBudget;
+
+    // Optional profiler, that profiles are requested from on its HTTP path:
+    std::shared_ptr<bda::ThriftProfiler> mProfiler;
+    std::string mProfilerPath;
+
+    /** @brief Returns the service for the target of an upgrade request, ignoring the query. */
+    std::shared_ptr<bda::ThriftService> findService(const boost::beast::string_view aTarget) const {
+        const boost::beast::string_view vPath = aTarget.substr(0, aTarget.find('?'));
+        const auto vServiceIt = mServices.find(std::string(vPath));
+        return vServiceIt != mServices.end() ? vServiceIt->second : mDefaultService;
+    }
+};
+
+/**
+ * @brief Counts an HTTP request in ThriftSessionContext::mRequests while it
+ * lives. Every copy counts again, so that the guard can be captured by the
+ * handlers of a call.
+ */
+class ThriftRequestGuard {
+public:
+    ThriftRequestGuard() = default;
+    explicit ThriftRequestGuard(std::shared_ptr<ThriftSessionContext> aContext)
+        : mContext(std::move(aContext)) {
+        acquire();
+    }
+
+    ThriftRequestGuard(const ThriftRequestGuard& aOther)
+        : mContext(aOther.mContext) {
+        acquire();
+    }
+
+    ThriftRequestGuard& operator=(ThriftRequestGuard aOther) noexcept {
+        std::swap(mContext, aOther.mContext);
+        return *this;
+    }
+
+    ~ThriftRequestGuard() {
+        if (mContext) {
+            --mContext->mRequests;
+        }
+    }
+
+private:
+    void acquire() {
+        if (mContext) {
+            ++mContext->mRequests;
+        }
+    }
+
+    std::shared_ptr<ThriftSessionContext> mContext;
+};
+
+}
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftSharedBinary.hh"
+
+#include "ThriftSharedBinaryProtocol.hh"
+
+#include <thrift/transport/TBufferTransports.h>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace bda {
+
+namespace {
+
+// The binary values that the handlers on this thread shared in the current
+// scope, or nullptr outside of a scope:
+thread_local std::vector<std::pair<const std::string*, std::shared_ptr<const std::string>>>* tSharedBinaries = nullptr;
+
+}
+
+bool shareBinary(std::string& aValue, std::shared_ptr<const std::string> aBlob) {
+    if (!tSharedBinaries) {
+        aValue = *aBlob;
+        return false;
+    }
+    aValue.clear();
+    tSharedBinaries->emplace_back(&aValue, std::move(aBlob));
+    return true;
+}
+
+ThriftSharedBinaryScope::ThriftSharedBinaryScope(const bool aActive)
+    : mPreviousSharedBinaries(tSharedBinaries) {
+    tSharedBinaries = aActive ? &mSharedBinaries : nullptr;
+}
+
+ThriftSharedBinaryScope::~ThriftSharedBinaryScope() {
+    tSharedBinaries = mPreviousSharedBinaries;
+}
+
+std::shared_ptr<const std::string> ThriftSharedBinaryScope::take(const std::string& aValue) {
+    if (!tSharedBinaries || tSharedBinaries->empty()) {
+        return nullptr;
+    }
+    const auto vSharedBinaryIt = std::find_if(tSharedBinaries->begin(), tSharedBinaries->end(),
+        [&aValue](const std::pair<const std::string*, std::shared_ptr<const std::string>>& aSharedBinary) {
+            return aSharedBinary.first == &aValue;
+        });
+    if (vSharedBinaryIt == tSharedBinaries->end()) {
+        return nullptr;
+    }
+    std::shared_ptr<const std::string> vBlob = std::move(vSharedBinaryIt->second);
+    tSharedBinaries->erase(vSharedBinaryIt);
+    return vBlob;
+}
+
+ThriftSharedBinaryProtocol::ThriftSharedBinaryProtocol(std::shared_ptr<apache::thrift::protocol::TProtocol> aProtocol, const bda::ProtocolType aProtocolType,
+                                                       apache::thrift::transport::TMemoryBuffer* aTransport, std::vector<bda::ThriftSharedSegment>* aSegments)
+    : apache::thrift::protocol::TProtocolDecorator(aProtocol), mProtocolType(aProtocolType), mTransport(aTransport), mSegments(aSegments) {
+}
+
+bool ThriftSharedBinaryProtocol::supports(const bda::ProtocolType aProtocolType) {
+    return aProtocolType == bda::ProtocolType::BINARY || aProtocolType == bda::ProtocolType::COMPACT;
+}
+
+uint32_t ThriftSharedBinaryProtocol::writeBinary_virt(const std::string& str) {
+    std::shared_ptr<const std::string> vBlob = ThriftSharedBinaryScope::take(str);
+    if (!vBlob) {
+        return apache::thrift::protocol::TProtocolDecorator::writeBinary_virt(str);
+    }
+
+    // Write the length the way the protocol does, the blob follows it:
+    const uint32_t vBlobSize = static_cast<uint32_t>(vBlob->size());
+    uint32_t vSize = 0;
+    if (mProtocolType == bda::ProtocolType::COMPACT) {
+        uint8_t vVarint[5];
+        uint32_t vValue = vBlobSize;
+        while (vValue >= 0x80) {
+            vVarint[vSize++] = static_cast<uint8_t>((vValue & 0x7F) | 0x80);
+            vValue >>= 7;
+        }
+        vVarint[vSize++] = static_cast<uint8_t>(vValue);
+        mTransport->write(vVarint, vSize);
+    } else {
+        vSize = apache::thrift::protocol::TProtocolDecorator::writeI32_virt(static_cast<int32_t>(vBlobSize));
+    }
+
+    bda::ThriftSharedSegment vSegment;
+    vSegment.mOffset = mTransport->available_read();
+    vSegment.mBlob = std::move(vBlob);
+    mSegments->push_back(std::move(vSegment));
+    return vSize + vBlobSize;
+}
+
+}
@@ -0,0 +1,99 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTSHAREDBINARYPROTOCOL_HH
+#define THRIFTSHAREDBINARYPROTOCOL_HH
+
+#include "bda/ThriftHelper.hh"
+
+#include <thrift/protocol/TProtocolDecorator.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// forward declarations:
+namespace apache {
+namespace thrift {
+namespace transport {
+class TMemoryBuffer;
+}
+}
+}
+
+namespace bda {
+
+/**
+ * @brief A binary value that a response references instead of containing
+ * it. It belongs at mOffset in the serialized response, behind its length.
+ */
+struct ThriftSharedSegment {
+    std::size_t mOffset = 0;
+    std::shared_ptr<const std::string> mBlob;
+};
+
+/**
+ * @brief Lets the handlers that run on the current thread share binary
+ * values with bda::shareBinary() while the processor runs, if aActive. The
+ * shared values that the processor did not write are dropped at the end.
+ */
+class ThriftSharedBinaryScope {
+public:
+    explicit ThriftSharedBinaryScope(const bool aActive);
+    ~ThriftSharedBinaryScope();
+
+    ThriftSharedBinaryScope(const ThriftSharedBinaryScope&) = delete;
+    ThriftSharedBinaryScope& operator=(const ThriftSharedBinaryScope&) = delete;
+
+    /** @brief Remove and return the blob shared for aValue, or nullptr. */
+    static std::shared_ptr<const std::string> take(const std::string& aValue);
+
+private:
+    std::vector<std::pair<const std::string*, std::shared_ptr<const std::string>>> mSharedBinaries;
+    std::vector<std::pair<const std::string*, std::shared_ptr<const std::string>>>* mPreviousSharedBinaries = nullptr;
+};
+
+/**
+ * @brief Writes the binary values that were shared in the current scope as
+ * their length followed by a segment in aSegments, and everything else
+ * through the decorated protocol into aTransport, which must be the
+ * transport of the decorated protocol. Only protocols that write binary
+ * values as raw bytes are supported, i.e. binary and compact.
+ */
+class ThriftSharedBinaryProtocol : public apache::thrift::protocol::TProtocolDecorator {
+public:
+    ThriftSharedBinaryProtocol(std::shared_ptr<apache::thrift::protocol::TProtocol> aProtocol, const bda::ProtocolType aProtocolType,
+                               apache::thrift::transport::TMemoryBuffer* aTransport, std::vector<bda::ThriftSharedSegment>* aSegments);
+
+    /** @brief Returns true if binary values of the protocol can be shared. */
+    static bool supports(const bda::ProtocolType aProtocolType);
+
+    uint32_t writeBinary_virt(const std::string& str) override;
+
+private:
+    const bda::ProtocolType mProtocolType;
+    apache::thrift::transport::TMemoryBuffer* mTransport;
+    std::vector<bda::ThriftSharedSegment>* mSegments;
+};
+
+}
+
+#endif
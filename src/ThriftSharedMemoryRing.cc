@@ -0,0 +1,223 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "ThriftSharedMemoryRing.hh"
+
+#if defined(__linux__)
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace bda {
+
+std::size_t SharedMemoryRing::write(const uint8_t* aData, const std::size_t aSize) {
+    const std::size_t vSize = std::min(aSize, writable());
+    if (vSize == 0) {
+        return 0;
+    }
+
+    // Copy in up to two parts, if the data wraps around the end of the ring:
+    const std::size_t vOffset = static_cast<std::size_t>(mWritePosition & (mCapacity - 1));
+    const std::size_t vFirstSize = std::min(vSize, static_cast<std::size_t>(mCapacity) - vOffset);
+    std::memcpy(mData + vOffset, aData, vFirstSize);
+    std::memcpy(mData, aData + vFirstSize, vSize - vFirstSize);
+
+    mWritePosition += vSize;
+    mControl->mWritePosition.store(mWritePosition);
+    return vSize;
+}
+
+std::size_t SharedMemoryRing::read(uint8_t* aData, const std::size_t aSize) {
+    const std::size_t vSize = std::min(aSize, readable());
+    if (vSize == 0) {
+        return 0;
+    }
+
+    const std::size_t vOffset = static_cast<std::size_t>(mReadPosition & (mCapacity - 1));
+    const std::size_t vFirstSize = std::min(vSize, static_cast<std::size_t>(mCapacity) - vOffset);
+    std::memcpy(aData, mData + vOffset, vFirstSize);
+    std::memcpy(aData + vFirstSize, mData, vSize - vFirstSize);
+
+    mReadPosition += vSize;
+    mControl->mReadPosition.store(mReadPosition);
+    return vSize;
+}
+
+std::size_t SharedMemoryRing::readable() const {
+    const uint64_t vReadable = mControl->mWritePosition.load() - mReadPosition;
+    if (vReadable > mCapacity) {
+        throw(std::runtime_error("bda::SharedMemoryRing::readable(): The peer published an invalid write position"));
+    }
+    return static_cast<std::size_t>(vReadable);
+}
+
+std::size_t SharedMemoryRing::writable() const {
+    const uint64_t vUsed = mWritePosition - mControl->mReadPosition.load();
+    if (vUsed > mCapacity) {
+        throw(std::runtime_error("bda::SharedMemoryRing::writable(): The peer published an invalid read position"));
+    }
+    return static_cast<std::size_t>(mCapacity - vUsed);
+}
+
+bool SharedMemoryRing::prepareReaderWait() {
+    // Both sides publish before they check the other one (sequentially
+    // consistent), so either the writer sees the flag or we see the data:
+    mControl->mReaderWaiting.store(1);
+    if (readable() > 0) {
+        mControl->mReaderWaiting.store(0);
+        return false;
+    }
+    return true;
+}
+
+bool SharedMemoryRing::prepareWriterWait() {
+    mControl->mWriterWaiting.store(1);
+    if (writable() > 0) {
+        mControl->mWriterWaiting.store(0);
+        return false;
+    }
+    return true;
+}
+
+FileDescriptor& FileDescriptor::operator=(FileDescriptor&& aOther) noexcept {
+    if (this != &aOther) {
+        reset();
+        mFd = aOther.release();
+    }
+    return *this;
+}
+
+void FileDescriptor::reset() {
+    if (mFd >= 0) {
+        ::close(mFd);
+        mFd = -1;
+    }
+}
+
+SharedMemoryMapping::SharedMemoryMapping(const int aFd, const std::size_t aSize)
+    : mSize(aSize) {
+    void* vData = ::mmap(nullptr, aSize, PROT_READ | PROT_WRITE, MAP_SHARED, aFd, 0);
+    if (vData == MAP_FAILED) {
+        throw(std::runtime_error("bda::SharedMemoryMapping::SharedMemoryMapping(): Could not map " + std::to_string(aSize) + " bytes: " + std::strerror(errno)));
+    }
+    mData = static_cast<uint8_t*>(vData);
+}
+
+SharedMemoryMapping::~SharedMemoryMapping() {
+    ::munmap(mData, mSize);
+}
+
+SharedMemoryRing SharedMemoryMapping::requestRing() const {
+    const uint64_t vCapacity = header()->mRingCapacity;
+    return SharedMemoryRing(&header()->mRequestRing, mData + cSharedMemoryDataOffset, vCapacity);
+}
+
+SharedMemoryRing SharedMemoryMapping::responseRing() const {
+    const uint64_t vCapacity = header()->mRingCapacity;
+    return SharedMemoryRing(&header()->mResponseRing, mData + cSharedMemoryDataOffset + vCapacity, vCapacity);
+}
+
+void sendFileDescriptors(const int aSocket, const int* aFds, const std::size_t aCount) {
+    char vByte = 0;
+    struct iovec vData = { &vByte, 1 };
+
+    alignas(struct cmsghdr) char vControl[CMSG_SPACE(sizeof(int) * cMaxFileDescriptors)];
+    if (aCount > cMaxFileDescriptors) {
+        throw(std::runtime_error("bda::sendFileDescriptors(): Too many file descriptors"));
+    }
+    struct msghdr vMessage;
+    std::memset(&vMessage, 0, sizeof(vMessage));
+    vMessage.msg_iov = &vData;
+    vMessage.msg_iovlen = 1;
+    vMessage.msg_control = vControl;
+    vMessage.msg_controllen = CMSG_SPACE(sizeof(int) * aCount);
+
+    struct cmsghdr* vHeader = CMSG_FIRSTHDR(&vMessage);
+    vHeader->cmsg_level = SOL_SOCKET;
+    vHeader->cmsg_type = SCM_RIGHTS;
+    vHeader->cmsg_len = CMSG_LEN(sizeof(int) * aCount);
+    std::memcpy(CMSG_DATA(vHeader), aFds, sizeof(int) * aCount);
+
+    ssize_t vResult = 0;
+    do {
+        vResult = ::sendmsg(aSocket, &vMessage, MSG_NOSIGNAL);
+    } while (vResult < 0 && errno == EINTR);
+    if (vResult != 1) {
+        throw(std::runtime_error(std::string("bda::sendFileDescriptors(): Could not send: ") + std::strerror(errno)));
+    }
+}
+
+std::size_t receiveFileDescriptors(const int aSocket, FileDescriptor* aFds, const std::size_t aMaxCount) {
+    char vByte = 0;
+    struct iovec vData = { &vByte, 1 };
+
+    alignas(struct cmsghdr) char vControl[CMSG_SPACE(sizeof(int) * cMaxFileDescriptors)];
+    struct msghdr vMessage;
+    std::memset(&vMessage, 0, sizeof(vMessage));
+    vMessage.msg_iov = &vData;
+    vMessage.msg_iovlen = 1;
+    vMessage.msg_control = vControl;
+    vMessage.msg_controllen = sizeof(vControl);
+
+    ssize_t vResult = 0;
+    do {
+        vResult = ::recvmsg(aSocket, &vMessage, MSG_CMSG_CLOEXEC);
+    } while (vResult < 0 && errno == EINTR);
+    if (vResult != 1) {
+        throw(std::runtime_error("bda::receiveFileDescriptors(): Could not receive: " + std::string(vResult < 0 ? std::strerror(errno) : "connection closed")));
+    }
+
+    // Take ownership of all received descriptors, also of any beyond aMaxCount:
+    std::size_t vCount = 0;
+    for (struct cmsghdr* vHeader = CMSG_FIRSTHDR(&vMessage); vHeader != nullptr; vHeader = CMSG_NXTHDR(&vMessage, vHeader)) {
+        if (vHeader->cmsg_level != SOL_SOCKET || vHeader->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        const std::size_t vFds = (vHeader->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (std::size_t vIdx = 0; vIdx < vFds; ++vIdx) {
+            int vFd = -1;
+            std::memcpy(&vFd, CMSG_DATA(vHeader) + vIdx * sizeof(int), sizeof(int));
+            FileDescriptor vDescriptor(vFd);
+            if (vCount < aMaxCount) {
+                aFds[vCount++] = std::move(vDescriptor);
+            }
+        }
+    }
+    return vCount;
+}
+
+void signalEventFd(const int aFd) {
+    const uint64_t vValue = 1;
+    ssize_t vResult = 0;
+    do {
+        vResult = ::write(aFd, &vValue, sizeof(vValue));
+    } while (vResult < 0 && errno == EINTR);
+}
+
+}
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFTSHAREDMEMORYRING_HH
+#define THRIFTSHAREDMEMORYRING_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace bda {
+
+// The shared memory of a connection starts with a header page, followed by
+// the request ring and the response ring of mRingCapacity bytes each. Every
+// message in a ring is framed by its size as a native 32 bit integer.
+constexpr uint32_t cSharedMemoryMagic = 0x42444153;
+constexpr uint32_t cSharedMemoryVersion = 1;
+constexpr std::size_t cSharedMemoryDataOffset = 4096;
+
+// The largest request the server accepts, as it is copied out of the ring:
+constexpr uint32_t cSharedMemoryMaxRequestSize = 64 * 1024 * 1024;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "The rings need address-free atomics between processes");
+
+// The positions of a ring, which only ever grow, and whether its reader or
+// writer sleeps until the other side wakes it through its eventfd:
+struct SharedMemoryRingControl {
+    alignas(64) std::atomic<uint64_t> mWritePosition;
+    std::atomic<uint32_t> mReaderWaiting;
+    alignas(64) std::atomic<uint64_t> mReadPosition;
+    std::atomic<uint32_t> mWriterWaiting;
+};
+
+struct SharedMemoryHeader {
+    uint32_t mMagic;
+    uint32_t mVersion;
+    uint64_t mRingCapacity;
+    SharedMemoryRingControl mRequestRing;
+    SharedMemoryRingControl mResponseRing;
+};
+static_assert(sizeof(SharedMemoryHeader) <= cSharedMemoryDataOffset, "The header must fit into its page");
+
+/** @brief The size of the shared memory for rings of aRingCapacity bytes. */
+inline std::size_t sharedMemorySize(const uint64_t aRingCapacity) {
+    return cSharedMemoryDataOffset + 2 * static_cast<std::size_t>(aRingCapacity);
+}
+
+/**
+ * @brief One side of a single-producer single-consumer byte ring in shared
+ * memory. Each side keeps its own position locally and only publishes it,
+ * so that a peer can not make it read or write outside of the ring.
+ */
+class SharedMemoryRing {
+public:
+    SharedMemoryRing() = default;
+    SharedMemoryRing(SharedMemoryRingControl* aControl, uint8_t* aData, const uint64_t aCapacity)
+        : mControl(aControl), mData(aData), mCapacity(aCapacity) {
+    }
+
+    /** @brief Copy up to aSize bytes into the ring, and return the number of bytes copied. */
+    std::size_t write(const uint8_t* aData, const std::size_t aSize);
+
+    /** @brief Copy up to aSize bytes out of the ring, and return the number of bytes copied. */
+    std::size_t read(uint8_t* aData, const std::size_t aSize);
+
+    std::size_t readable() const;
+    std::size_t writable() const;
+
+    /**
+     * @brief Announce that the reader sleeps until the writer wakes it, and
+     * return false if data arrived in the meantime, so that it must not sleep.
+     */
+    bool prepareReaderWait();
+    bool prepareWriterWait();
+
+    /** @brief Return whether the sleeping reader must be woken, after a write. */
+    bool takeReaderWaiting() {
+        return mControl->mReaderWaiting.exchange(0) != 0;
+    }
+
+    /** @brief Return whether the sleeping writer must be woken, after a read. */
+    bool takeWriterWaiting() {
+        return mControl->mWriterWaiting.exchange(0) != 0;
+    }
+
+protected:
+    SharedMemoryRingControl* mControl = nullptr;
+    uint8_t* mData = nullptr;
+    uint64_t mCapacity = 0;
+    uint64_t mReadPosition = 0;
+    uint64_t mWritePosition = 0;
+};
+
+/** @brief Owns a file descriptor, e.g. of a memfd or an eventfd. */
+class FileDescriptor {
+public:
+    FileDescriptor() = default;
+    explicit FileDescriptor(const int aFd)
+        : mFd(aFd) {
+    }
+    FileDescriptor(FileDescriptor&& aOther) noexcept
+        : mFd(aOther.release()) {
+    }
+    FileDescriptor& operator=(FileDescriptor&& aOther) noexcept;
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+    ~FileDescriptor() {
+        reset();
+    }
+
+    int get() const {
+        return mFd;
+    }
+
+    int release() {
+        const int vFd = mFd;
+        mFd = -1;
+        return vFd;
+    }
+
+    void reset();
+
+protected:
+    int mFd = -1;
+};
+
+/** @brief Owns a shared mapping of a memfd. */
+class SharedMemoryMapping {
+public:
+    SharedMemoryMapping(const int aFd, const std::size_t aSize);
+    SharedMemoryMapping(const SharedMemoryMapping&) = delete;
+    SharedMemoryMapping& operator=(const SharedMemoryMapping&) = delete;
+    ~SharedMemoryMapping();
+
+    uint8_t* data() const {
+        return mData;
+    }
+
+    SharedMemoryHeader* header() const {
+        return reinterpret_cast<SharedMemoryHeader*>(mData);
+    }
+
+    /** @brief The rings for the requests and responses. */
+    SharedMemoryRing requestRing() const;
+    SharedMemoryRing responseRing() const;
+
+protected:
+    uint8_t* mData = nullptr;
+    std::size_t mSize = 0;
+};
+
+// The most file descriptors that can be sent at once:
+constexpr std::size_t cMaxFileDescriptors = 16;
+
+/** @brief Send up to cMaxFileDescriptors file descriptors with a single byte over a Unix domain socket. */
+void sendFileDescriptors(const int aSocket, const int* aFds, const std::size_t aCount);
+
+/**
+ * @brief Receive up to aMaxCount file descriptors that were sent with
+ * sendFileDescriptors(), and return their number. Throws if nothing could
+ * be received, e.g. because the peer closed the socket.
+ */
+std::size_t receiveFileDescriptors(const int aSocket, FileDescriptor* aFds, const std::size_t aMaxCount);
+
+/** @brief Wake the peer that sleeps on the eventfd aFd. */
+void signalEventFd(const int aFd);
+
+}
+
+#endif
@@ -0,0 +1,258 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftSharedMemoryTransport.hh"
+
+#include "ThriftSharedMemoryRing.hh"
+
+#include <thrift/transport/TTransportException.h>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace bda {
+
+using apache::thrift::transport::TTransportException;
+
+#if defined(__linux__)
+
+struct ThriftSharedMemoryTransport::Connection {
+    bda::FileDescriptor mSocket;
+    bda::FileDescriptor mServerEvent;
+    bda::FileDescriptor mClientEvent;
+    std::unique_ptr<bda::SharedMemoryMapping> mMapping;
+    bda::SharedMemoryRing mRequestRing;
+    bda::SharedMemoryRing mResponseRing;
+};
+
+ThriftSharedMemoryTransport::ThriftSharedMemoryTransport(const std::string& aSocketPath, const uint64_t aRingCapacity)
+    : mSocketPath(aSocketPath), mRingCapacity(aRingCapacity) {
+}
+
+ThriftSharedMemoryTransport::~ThriftSharedMemoryTransport() = default;
+
+bool ThriftSharedMemoryTransport::isOpen() const {
+    return mConnection != nullptr;
+}
+
+void ThriftSharedMemoryTransport::open() {
+    if (mConnection) {
+        return;
+    }
+    if (mRingCapacity < 4096 || (mRingCapacity & (mRingCapacity - 1)) != 0) {
+        throw(TTransportException(TTransportException::BAD_ARGS, "bda::ThriftSharedMemoryTransport::open(): The ring capacity must be a power of two of at least 4096"));
+    }
+
+    auto vConnection = std::unique_ptr<Connection>(new Connection());
+    struct sockaddr_un vAddress;
+    std::memset(&vAddress, 0, sizeof(vAddress));
+    vAddress.sun_family = AF_UNIX;
+    if (mSocketPath.size() >= sizeof(vAddress.sun_path)) {
+        throw(TTransportException(TTransportException::BAD_ARGS, "bda::ThriftSharedMemoryTransport::open(): The socket path is too long"));
+    }
+    std::memcpy(vAddress.sun_path, mSocketPath.c_str(), mSocketPath.size());
+    vConnection->mSocket = bda::FileDescriptor(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if (vConnection->mSocket.get() < 0 || ::connect(vConnection->mSocket.get(), reinterpret_cast<struct sockaddr*>(&vAddress), sizeof(vAddress)) != 0) {
+        throw(TTransportException(TTransportException::NOT_OPEN, "bda::ThriftSharedMemoryTransport::open(): Could not connect to '" + mSocketPath + "': " + std::strerror(errno)));
+    }
+
+    // The memory is zero-initialized, which is also the initial state of the
+    // rings. The server only maps memory whose size is sealed:
+    bda::FileDescriptor vMemory(::memfd_create("bda-thrift", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (vMemory.get() < 0 || ::ftruncate(vMemory.get(), static_cast<off_t>(bda::sharedMemorySize(mRingCapacity))) != 0 ||
+        ::fcntl(vMemory.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        throw(TTransportException(TTransportException::NOT_OPEN, std::string("bda::ThriftSharedMemoryTransport::open(): Could not create the shared memory: ") + std::strerror(errno)));
+    }
+    vConnection->mMapping.reset(new bda::SharedMemoryMapping(vMemory.get(), bda::sharedMemorySize(mRingCapacity)));
+    bda::SharedMemoryHeader* vHeader = vConnection->mMapping->header();
+    vHeader->mMagic = bda::cSharedMemoryMagic;
+    vHeader->mVersion = bda::cSharedMemoryVersion;
+    vHeader->mRingCapacity = mRingCapacity;
+    vConnection->mRequestRing = vConnection->mMapping->requestRing();
+    vConnection->mResponseRing = vConnection->mMapping->responseRing();
+
+    vConnection->mServerEvent = bda::FileDescriptor(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    vConnection->mClientEvent = bda::FileDescriptor(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (vConnection->mServerEvent.get() < 0 || vConnection->mClientEvent.get() < 0) {
+        throw(TTransportException(TTransportException::NOT_OPEN, std::string("bda::ThriftSharedMemoryTransport::open(): Could not create the eventfds: ") + std::strerror(errno)));
+    }
+
+    // Hand the memory and the eventfds to the server, and wait until it
+    // mapped the memory:
+    const int vFds[3] = { vMemory.get(), vConnection->mServerEvent.get(), vConnection->mClientEvent.get() };
+    char vAcknowledge = 0;
+    try {
+        bda::sendFileDescriptors(vConnection->mSocket.get(), vFds, 3);
+    } catch (const std::exception& vException) {
+        throw(TTransportException(TTransportException::NOT_OPEN, vException.what()));
+    }
+    if (::recv(vConnection->mSocket.get(), &vAcknowledge, 1, 0) != 1) {
+        throw(TTransportException(TTransportException::NOT_OPEN, "bda::ThriftSharedMemoryTransport::open(): The server did not accept the shared memory"));
+    }
+
+    mConnection = std::move(vConnection);
+    mReadBuffer.clear();
+    mReadOffset = 0;
+}
+
+void ThriftSharedMemoryTransport::close() {
+    mConnection.reset();
+}
+
+uint32_t ThriftSharedMemoryTransport::read(uint8_t* buf, uint32_t len) {
+    if (mReadOffset == mReadBuffer.size()) {
+        uint32_t vSize = 0;
+        readFromRing(reinterpret_cast<uint8_t*>(&vSize), sizeof(vSize));
+        mReadBuffer.resize(vSize);
+        readFromRing(mReadBuffer.data(), vSize);
+        mReadOffset = 0;
+    }
+
+    const uint32_t vSize = static_cast<uint32_t>(std::min<std::size_t>(len, mReadBuffer.size() - mReadOffset));
+    std::memcpy(buf, mReadBuffer.data() + mReadOffset, vSize);
+    mReadOffset += vSize;
+    return vSize;
+}
+
+void ThriftSharedMemoryTransport::write(const uint8_t* buf, uint32_t len) {
+    mWriteBuffer.insert(mWriteBuffer.end(), buf, buf + len);
+}
+
+void ThriftSharedMemoryTransport::flush() {
+    const uint32_t vSize = static_cast<uint32_t>(mWriteBuffer.size());
+    writeToRing(reinterpret_cast<const uint8_t*>(&vSize), sizeof(vSize));
+    writeToRing(mWriteBuffer.data(), mWriteBuffer.size());
+    mWriteBuffer.clear();
+}
+
+void ThriftSharedMemoryTransport::writeToRing(const uint8_t* aData, std::size_t aSize) {
+    if (!mConnection) {
+        throw(TTransportException(TTransportException::NOT_OPEN, "bda::ThriftSharedMemoryTransport::writeToRing(): The transport is not open"));
+    }
+    bda::SharedMemoryRing& vRing = mConnection->mRequestRing;
+    while (aSize > 0) {
+        const std::size_t vWritten = vRing.write(aData, aSize);
+        if (vWritten > 0) {
+            aData += vWritten;
+            aSize -= vWritten;
+            if (vRing.takeReaderWaiting()) {
+                bda::signalEventFd(mConnection->mServerEvent.get());
+            }
+        } else if (vRing.prepareWriterWait()) {
+            waitForServer();
+        }
+    }
+}
+
+void ThriftSharedMemoryTransport::readFromRing(uint8_t* aData, std::size_t aSize) {
+    if (!mConnection) {
+        throw(TTransportException(TTransportException::NOT_OPEN, "bda::ThriftSharedMemoryTransport::readFromRing(): The transport is not open"));
+    }
+    bda::SharedMemoryRing& vRing = mConnection->mResponseRing;
+    while (aSize > 0) {
+        const std::size_t vRead = vRing.read(aData, aSize);
+        if (vRead > 0) {
+            aData += vRead;
+            aSize -= vRead;
+            if (vRing.takeWriterWaiting()) {
+                bda::signalEventFd(mConnection->mServerEvent.get());
+            }
+        } else if (vRing.prepareReaderWait()) {
+            waitForServer();
+        }
+    }
+}
+
+void ThriftSharedMemoryTransport::waitForServer() {
+    // The server only writes to the socket by closing it:
+    struct pollfd vFds[2] = { { mConnection->mClientEvent.get(), POLLIN, 0 }, { mConnection->mSocket.get(), POLLIN | POLLRDHUP, 0 } };
+    int vResult = 0;
+    do {
+        vResult = ::poll(vFds, 2, -1);
+    } while (vResult < 0 && errno == EINTR);
+    if (vResult < 0 || vFds[1].revents != 0) {
+        mConnection.reset();
+        throw(TTransportException(TTransportException::END_OF_FILE, "bda::ThriftSharedMemoryTransport::waitForServer(): The server closed the connection"));
+    }
+
+    uint64_t vValue = 0;
+    if (::read(mConnection->mClientEvent.get(), &vValue, sizeof(vValue)) < 0 && errno != EAGAIN) {
+        throw(TTransportException(TTransportException::UNKNOWN, std::string("bda::ThriftSharedMemoryTransport::waitForServer(): ") + std::strerror(errno)));
+    }
+}
+
+#else
+
+struct ThriftSharedMemoryTransport::Connection {
+};
+
+ThriftSharedMemoryTransport::ThriftSharedMemoryTransport(const std::string& aSocketPath, const uint64_t aRingCapacity)
+    : mSocketPath(aSocketPath), mRingCapacity(aRingCapacity) {
+}
+
+ThriftSharedMemoryTransport::~ThriftSharedMemoryTransport() = default;
+
+bool ThriftSharedMemoryTransport::isOpen() const {
+    return false;
+}
+
+void ThriftSharedMemoryTransport::open() {
+    throw(TTransportException(TTransportException::NOT_OPEN, "bda::ThriftSharedMemoryTransport::open(): Shared memory transports are only supported on Linux"));
+}
+
+void ThriftSharedMemoryTransport::close() {
+}
+
+uint32_t ThriftSharedMemoryTransport::read(uint8_t*, uint32_t) {
+    throw(TTransportException(TTransportException::NOT_OPEN));
+}
+
+void ThriftSharedMemoryTransport::write(const uint8_t*, uint32_t) {
+    throw(TTransportException(TTransportException::NOT_OPEN));
+}
+
+void ThriftSharedMemoryTransport::flush() {
+    throw(TTransportException(TTransportException::NOT_OPEN));
+}
+
+void ThriftSharedMemoryTransport::writeToRing(const uint8_t*, std::size_t) {
+}
+
+void ThriftSharedMemoryTransport::readFromRing(uint8_t*, std::size_t) {
+}
+
+void ThriftSharedMemoryTransport::waitForServer() {
+}
+
+#endif
+
+}
@@ -0,0 +1,114 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftSlowCallLog.hh"
+
+#include "ThriftJSONString.hh"
+
+#include <bda/Helpers.hh>
+
+#include <algorithm>
+#include <ctime>
+#include <sstream>
+
+namespace bda {
+
+namespace {
+
+std::string formatStages(const bda::ThriftSlowCallLog::Entry& aEntry) {
+    std::ostringstream vStages;
+    vStages << "total " << aEntry.mTotal.count() << " us (dispatch " << aEntry.mDispatch.count() << ", queue " << aEntry.mQueue.count()
+            << ", process " << aEntry.mProcess.count() << ", respond " << aEntry.mRespond.count() << ", write " << aEntry.mWrite.count() << ")";
+    return vStages.str();
+}
+
+}
+
+ThriftSlowCallLog::ThriftSlowCallLog(const std::chrono::microseconds aThreshold, const std::size_t aCapacity,
+                                     const unsigned aMaxLoggedPerSecond)
+    : mThreshold(aThreshold), mCapacity(std::max<std::size_t>(1, aCapacity)), mMaxLoggedPerSecond(aMaxLoggedPerSecond) {
+}
+
+void ThriftSlowCallLog::record(Entry aEntry) {
+    ++mSlowCalls;
+
+    std::string vMessage;
+    const std::chrono::steady_clock::time_point vNow = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> vLock(mMutex);
+        if (vNow - mLogSecond >= std::chrono::seconds(1)) {
+            mLogSecond = vNow;
+            mLoggedInSecond = 0;
+        }
+        if (mLoggedInSecond < mMaxLoggedPerSecond) {
+            ++mLoggedInSecond;
+            vMessage = "bda::ThriftSlowCallLog::record(): Slow call to '" + aEntry.mMethod + "' from " + aEntry.mPeer + ", request " +
+                       std::to_string(aEntry.mRequestSize) + " bytes, response " + std::to_string(aEntry.mResponseSize) + " bytes, " + formatStages(aEntry);
+            if (mSuppressed > 0) {
+                vMessage += ", " + std::to_string(mSuppressed) + " slow calls were not logged before";
+                mSuppressed = 0;
+            }
+            vMessage += ".\n";
+        } else {
+            ++mSuppressed;
+        }
+
+        mEntries.push_back(std::move(aEntry));
+        if (mEntries.size() > mCapacity) {
+            mEntries.pop_front();
+        }
+    }
+
+    if (!vMessage.empty()) {
+        BDAMessage(2, vMessage);
+    }
+}
+
+std::vector<ThriftSlowCallLog::Entry> ThriftSlowCallLog::entries() const {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    return std::vector<Entry>(mEntries.begin(), mEntries.end());
+}
+
+void ThriftSlowCallLog::writeJSON(std::ostream& aStream) const {
+    const std::vector<Entry> vEntries = entries();
+    aStream << "[";
+    for (auto vEntryIt = vEntries.rbegin(); vEntryIt != vEntries.rend(); ++vEntryIt) {
+        const std::time_t vTime = std::chrono::system_clock::to_time_t(vEntryIt->mTime);
+        std::tm vUTCTime{};
+#if defined(_WIN32)
+        gmtime_s(&vUTCTime, &vTime);
+#else
+        gmtime_r(&vTime, &vUTCTime);
+#endif
+        char vTimeString[32];
+        std::strftime(vTimeString, sizeof(vTimeString), "%Y-%m-%dT%H:%M:%SZ", &vUTCTime);
+
+        aStream << (vEntryIt == vEntries.rbegin() ? "\n" : ",\n") << "{\"time\":\"" << vTimeString << "\",\"method\":";
+        writeJSONString(aStream, vEntryIt->mMethod);
+        aStream << ",\"peer\":";
+        writeJSONString(aStream, vEntryIt->mPeer);
+        aStream << ",\"request_bytes\":" << vEntryIt->mRequestSize << ",\"response_bytes\":" << vEntryIt->mResponseSize
+                << ",\"total_us\":" << vEntryIt->mTotal.count() << ",\"dispatch_us\":" << vEntryIt->mDispatch.count()
+                << ",\"queue_us\":" << vEntryIt->mQueue.count() << ",\"process_us\":" << vEntryIt->mProcess.count()
+                << ",\"respond_us\":" << vEntryIt->mRespond.count() << ",\"write_us\":" << vEntryIt->mWrite.count() << "}";
+    }
+    aStream << "\n]\n";
+}
+
+}
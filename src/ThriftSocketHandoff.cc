@@ -0,0 +1,179 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftSocketHandoff.hh"
+
+#include "ThriftInheritedSockets.hh"
+#include "ThriftSharedMemoryRing.hh"
+
+#include <bda/Helpers.hh>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bda {
+
+#if defined(__linux__)
+
+namespace {
+
+// The first file descriptor that systemd passes (SD_LISTEN_FDS_START):
+constexpr int cSystemdFirstSocket = 3;
+
+// The inherited listening sockets that no server adopted yet:
+std::mutex sInheritedSocketsMutex;
+std::vector<int> sInheritedSockets;
+bool sSystemdSocketsTaken = false;
+
+// Take over the sockets of systemd socket activation, once. The variables
+// are removed, so that child processes do not take them as well. The mutex
+// must be locked.
+void takeSystemdSockets() {
+    if (sSystemdSocketsTaken) {
+        return;
+    }
+    sSystemdSocketsTaken = true;
+
+    const char* vListenPid = std::getenv("LISTEN_PID");
+    const char* vListenFds = std::getenv("LISTEN_FDS");
+    if (!vListenPid || !vListenFds || std::strtol(vListenPid, nullptr, 10) != static_cast<long>(::getpid())) {
+        return;
+    }
+    const long vSockets = std::strtol(vListenFds, nullptr, 10);
+    for (int vFd = cSystemdFirstSocket; vFd < cSystemdFirstSocket + vSockets; ++vFd) {
+        ::fcntl(vFd, F_SETFD, FD_CLOEXEC);
+        sInheritedSockets.push_back(vFd);
+    }
+    ::unsetenv("LISTEN_PID");
+    ::unsetenv("LISTEN_FDS");
+    ::unsetenv("LISTEN_FDNAMES");
+    BDAMessage(8, "bda::takeInheritedSocket(): Took " + std::to_string(vSockets) + " sockets from systemd.\n");
+}
+
+// Remove and return the first inherited listening socket whose address
+// matches, or -1:
+template<class Matches>
+int takeInheritedSocketIf(Matches&& aMatches) {
+    std::lock_guard<std::mutex> vLock(sInheritedSocketsMutex);
+    takeSystemdSockets();
+    for (auto vSocketIt = sInheritedSockets.begin(); vSocketIt != sInheritedSockets.end(); ++vSocketIt) {
+        int vType = 0;
+        int vListening = 0;
+        socklen_t vOptionSize = sizeof(int);
+        if (::getsockopt(*vSocketIt, SOL_SOCKET, SO_TYPE, &vType, &vOptionSize) != 0 || vType != SOCK_STREAM) {
+            continue;
+        }
+        vOptionSize = sizeof(int);
+        if (::getsockopt(*vSocketIt, SOL_SOCKET, SO_ACCEPTCONN, &vListening, &vOptionSize) != 0 || !vListening) {
+            continue;
+        }
+        struct sockaddr_storage vAddress;
+        socklen_t vAddressSize = sizeof(vAddress);
+        if (::getsockname(*vSocketIt, reinterpret_cast<struct sockaddr*>(&vAddress), &vAddressSize) != 0 ||
+            !aMatches(vAddress, vAddressSize)) {
+            continue;
+        }
+        const int vSocket = *vSocketIt;
+        sInheritedSockets.erase(vSocketIt);
+        return vSocket;
+    }
+    return -1;
+}
+
+}
+
+int takeInheritedSocket(const boost::asio::ip::tcp::endpoint& aEndpoint) {
+    return takeInheritedSocketIf([&aEndpoint](const struct sockaddr_storage& aAddress, const socklen_t aAddressSize) {
+        if (aAddress.ss_family != AF_INET && aAddress.ss_family != AF_INET6) {
+            return false;
+        }
+        boost::asio::ip::tcp::endpoint vEndpoint;
+        std::memcpy(vEndpoint.data(), &aAddress, aAddressSize);
+        vEndpoint.resize(aAddressSize);
+        return vEndpoint == aEndpoint;
+    });
+}
+
+int takeInheritedSocket(const std::string& aSocketPath) {
+    return takeInheritedSocketIf([&aSocketPath](const struct sockaddr_storage& aAddress, const socklen_t aAddressSize) {
+        const struct sockaddr_un& vAddress = reinterpret_cast<const struct sockaddr_un&>(aAddress);
+        return aAddress.ss_family == AF_UNIX && aAddressSize > offsetof(struct sockaddr_un, sun_path) &&
+               aSocketPath == std::string(vAddress.sun_path, ::strnlen(vAddress.sun_path, aAddressSize - offsetof(struct sockaddr_un, sun_path)));
+    });
+}
+
+std::size_t receiveListeningSockets(const std::string& aSocketPath) {
+    struct sockaddr_un vAddress;
+    std::memset(&vAddress, 0, sizeof(vAddress));
+    vAddress.sun_family = AF_UNIX;
+    if (aSocketPath.size() >= sizeof(vAddress.sun_path)) {
+        throw(std::runtime_error("bda::receiveListeningSockets(): The socket path is too long"));
+    }
+    std::memcpy(vAddress.sun_path, aSocketPath.c_str(), aSocketPath.size());
+    bda::FileDescriptor vSocket(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if (vSocket.get() < 0) {
+        throw(std::runtime_error(std::string("bda::receiveListeningSockets(): Could not create a socket: ") + std::strerror(errno)));
+    }
+
+    // Nobody to take over from, e.g. at the first start:
+    if (::connect(vSocket.get(), reinterpret_cast<struct sockaddr*>(&vAddress), sizeof(vAddress)) != 0) {
+        BDAMessage(8, "bda::receiveListeningSockets(): No server accepts handoffs on '" + aSocketPath + "'.\n");
+        return 0;
+    }
+
+    bda::FileDescriptor vSockets[bda::cMaxFileDescriptors];
+    const std::size_t vCount = bda::receiveFileDescriptors(vSocket.get(), vSockets, bda::cMaxFileDescriptors);
+    std::lock_guard<std::mutex> vLock(sInheritedSocketsMutex);
+    for (std::size_t vIdx = 0; vIdx < vCount; ++vIdx) {
+        sInheritedSockets.push_back(vSockets[vIdx].release());
+    }
+    BDAMessage(8, "bda::receiveListeningSockets(): Received " + std::to_string(vCount) + " listening sockets.\n");
+    return vCount;
+}
+
+#else
+
+int takeInheritedSocket(const boost::asio::ip::tcp::endpoint&) {
+    return -1;
+}
+
+int takeInheritedSocket(const std::string&) {
+    return -1;
+}
+
+std::size_t receiveListeningSockets(const std::string&) {
+    throw(std::runtime_error("bda::receiveListeningSockets(): Socket handoffs are only supported on Linux"));
+}
+
+#endif
+
+}
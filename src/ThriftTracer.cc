@@ -0,0 +1,200 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftTracer.hh"
+
+#include "ThriftJSONString.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace bda {
+
+namespace {
+
+std::atomic<uint64_t> gNextTracerId{ 1 };
+
+// The buffer of the tracer that this thread recorded to last:
+struct ThreadBufferCache {
+    uint64_t mTracerId = 0;
+    void* mBuffer = nullptr;
+};
+
+thread_local ThreadBufferCache tThreadBufferCache;
+
+const char* stageName(const bda::ThriftTraceStage aStage) {
+    switch (aStage) {
+        case bda::ThriftTraceStage::ReadComplete:
+            return "read complete";
+        case bda::ThriftTraceStage::Dispatch:
+            return "dispatch";
+        case bda::ThriftTraceStage::ProcessStart:
+            return "process start";
+        case bda::ThriftTraceStage::ProcessEnd:
+            return "process end";
+        case bda::ThriftTraceStage::WriteStart:
+            return "write start";
+        case bda::ThriftTraceStage::WriteComplete:
+            return "write complete";
+    }
+    return "unknown";
+}
+
+// Chrome traces are in microseconds:
+void writeTimestamp(std::ostream& aStream, const uint64_t aTimeNS) {
+    char vTimestamp[32];
+    std::snprintf(vTimestamp, sizeof(vTimestamp), "%llu.%03u", static_cast<unsigned long long>(aTimeNS / 1000), static_cast<unsigned>(aTimeNS % 1000));
+    aStream << vTimestamp;
+}
+
+}
+
+ThriftTracer::ThriftTracer(const std::size_t aEventsPerThread)
+    : mEventsPerThread(std::max<std::size_t>(1, aEventsPerThread)), mTracerId(gNextTracerId++) {
+}
+
+ThriftTracer::ThreadBuffer& ThriftTracer::threadBuffer() {
+    if (tThreadBufferCache.mTracerId == mTracerId) {
+        return *static_cast<ThreadBuffer*>(tThreadBufferCache.mBuffer);
+    }
+
+    std::lock_guard<std::mutex> vLock(mMutex);
+    std::unique_ptr<ThreadBuffer>& vBuffer = mThreadBuffers[std::this_thread::get_id()];
+    if (!vBuffer) {
+        vBuffer.reset(new ThreadBuffer());
+        vBuffer->mEvents.reset(new Event[mEventsPerThread]);
+        vBuffer->mThreadIdx = mThreadBuffers.size();
+    }
+    tThreadBufferCache.mTracerId = mTracerId;
+    tThreadBufferCache.mBuffer = vBuffer.get();
+    return *vBuffer;
+}
+
+void ThriftTracer::record(const bda::ThriftTraceStage aStage, const bda::ThriftTraceId& aId,
+                          const std::string& aMethod, const int32_t aSeqId) {
+    if (!isEnabled()) {
+        return;
+    }
+
+    const uint64_t vTimeNS = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+
+    ThreadBuffer& vBuffer = threadBuffer();
+    std::lock_guard<std::mutex> vLock(vBuffer.mMutex);
+    Event& vEvent = vBuffer.mEvents[vBuffer.mNext];
+    vEvent.mTimeNS = vTimeNS;
+    vEvent.mConnection = aId.mConnection;
+    vEvent.mMessage = aId.mMessage;
+    vEvent.mSeqId = aSeqId;
+    vEvent.mStage = aStage;
+    const std::size_t vMethodSize = std::min(aMethod.size(), sizeof(vEvent.mMethod) - 1);
+    std::memcpy(vEvent.mMethod, aMethod.data(), vMethodSize);
+    vEvent.mMethod[vMethodSize] = '\0';
+
+    vBuffer.mNext = (vBuffer.mNext + 1) % mEventsPerThread;
+    vBuffer.mSize = std::min(vBuffer.mSize + 1, mEventsPerThread);
+}
+
+void ThriftTracer::writeChromeTrace(std::ostream& aStream) const {
+    // Copy the events of all threads, so that recording is only blocked
+    // while a buffer is copied:
+    std::vector<std::pair<std::size_t, Event>> vEvents;
+    {
+        std::lock_guard<std::mutex> vLock(mMutex);
+        for (const auto& vThreadBuffer : mThreadBuffers) {
+            ThreadBuffer& vBuffer = *vThreadBuffer.second;
+            std::lock_guard<std::mutex> vBufferLock(vBuffer.mMutex);
+            const std::size_t vFirst = (vBuffer.mNext + mEventsPerThread - vBuffer.mSize) % mEventsPerThread;
+            for (std::size_t vIdx = 0; vIdx < vBuffer.mSize; ++vIdx) {
+                vEvents.emplace_back(vBuffer.mThreadIdx, vBuffer.mEvents[(vFirst + vIdx) % mEventsPerThread]);
+            }
+        }
+    }
+    std::sort(vEvents.begin(), vEvents.end(), [](const std::pair<std::size_t, Event>& aLeft, const std::pair<std::size_t, Event>& aRight) {
+        return aLeft.second.mTimeNS < aRight.second.mTimeNS;
+    });
+
+    // The span of a message lasts from its first to its last stage, and is
+    // named after the method of its calls:
+    struct Span {
+        uint64_t mBeginNS = 0;
+        uint64_t mEndNS = 0;
+        std::size_t mBeginThreadIdx = 0;
+        std::size_t mEndThreadIdx = 0;
+        std::string mMethod;
+    };
+    std::map<std::pair<uint64_t, uint64_t>, Span> vSpans;
+
+    aStream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool vFirstEvent = true;
+    for (const std::pair<std::size_t, Event>& vThreadEvent : vEvents) {
+        const Event& vEvent = vThreadEvent.second;
+        aStream << (vFirstEvent ? "\n" : ",\n");
+        vFirstEvent = false;
+        aStream << "{\"name\":\"" << stageName(vEvent.mStage) << "\",\"cat\":\"thrift\",\"ph\":\"i\",\"s\":\"t\",\"ts\":";
+        writeTimestamp(aStream, vEvent.mTimeNS);
+        aStream << ",\"pid\":1,\"tid\":" << vThreadEvent.first << ",\"args\":{\"connection\":" << vEvent.mConnection
+                << ",\"message\":" << vEvent.mMessage << ",\"method\":";
+        writeJSONString(aStream, vEvent.mMethod);
+        aStream << ",\"seqid\":" << vEvent.mSeqId << "}}";
+
+        auto vInserted = vSpans.emplace(std::make_pair(vEvent.mConnection, vEvent.mMessage), Span());
+        Span& vSpan = vInserted.first->second;
+        if (vInserted.second) {
+            vSpan.mBeginNS = vEvent.mTimeNS;
+            vSpan.mBeginThreadIdx = vThreadEvent.first;
+        }
+        vSpan.mEndNS = vEvent.mTimeNS;
+        vSpan.mEndThreadIdx = vThreadEvent.first;
+        if (vSpan.mMethod.empty()) {
+            vSpan.mMethod = vEvent.mMethod;
+        }
+    }
+
+    for (const auto& vIdSpan : vSpans) {
+        const Span& vSpan = vIdSpan.second;
+        const std::string vId = std::to_string(vIdSpan.first.first) + "." + std::to_string(vIdSpan.first.second);
+        const std::string vName = vSpan.mMethod.empty() ? std::string("message") : vSpan.mMethod;
+        for (const bool vBegin : { true, false }) {
+            aStream << (vFirstEvent ? "\n" : ",\n");
+            vFirstEvent = false;
+            aStream << "{\"name\":";
+            writeJSONString(aStream, vName);
+            aStream << ",\"cat\":\"thrift\",\"ph\":\"" << (vBegin ? 'b' : 'e') << "\",\"id\":\"" << vId << "\",\"ts\":";
+            writeTimestamp(aStream, vBegin ? vSpan.mBeginNS : vSpan.mEndNS);
+            aStream << ",\"pid\":1,\"tid\":" << (vBegin ? vSpan.mBeginThreadIdx : vSpan.mEndThreadIdx) << "}";
+        }
+    }
+    aStream << "\n]}\n";
+}
+
+void ThriftTracer::clear() {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    for (const auto& vThreadBuffer : mThreadBuffers) {
+        std::lock_guard<std::mutex> vBufferLock(vThreadBuffer.second->mMutex);
+        vThreadBuffer.second->mNext = 0;
+        vThreadBuffer.second->mSize = 0;
+    }
+}
+
+}
@@ -0,0 +1,159 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftTrafficCapture.hh"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace bda {
+
+namespace {
+
+// The file starts with the magic and the version of the format. Every
+// record is a byte with the type in bits 0-1, the binary flag in bit 2 and
+// the protocol in bits 4-5, followed by the time since the previous record
+// in microseconds, the connection id and the size of the data as LEB128
+// varints, and the data:
+const char cMagic[] = { 'B', 'D', 'A', 'T', 'C', 'A', 'P', 1 };
+
+constexpr uint8_t cTypeMask = 0x03;
+constexpr uint8_t cBinaryFlag = 0x04;
+constexpr unsigned cProtocolShift = 4;
+constexpr uint8_t cProtocolMask = 0x03;
+
+constexpr uint64_t cMaxRecordSize = uint64_t(1) << 31;
+
+void appendVarint(std::string& aBuffer, uint64_t aValue) {
+    while (aValue >= 0x80) {
+        aBuffer.push_back(static_cast<char>((aValue & 0x7f) | 0x80));
+        aValue >>= 7;
+    }
+    aBuffer.push_back(static_cast<char>(aValue));
+}
+
+bool readVarint(std::istream& aStream, uint64_t& aValue) {
+    aValue = 0;
+    for (unsigned vShift = 0; vShift < 64; vShift += 7) {
+        const int vByte = aStream.get();
+        if (vByte == std::char_traits<char>::eof()) {
+            return false;
+        }
+        aValue |= static_cast<uint64_t>(vByte & 0x7f) << vShift;
+        if ((vByte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+ThriftTrafficCapture::ThriftTrafficCapture(const std::string& aFilePath, const uint64_t aMaxBytes)
+    : mMaxBytes(aMaxBytes), mStartTime(std::chrono::steady_clock::now()), mFile(aFilePath, std::ios::binary | std::ios::trunc) {
+    if (!mFile) {
+        throw(std::runtime_error("bda::ThriftTrafficCapture::ThriftTrafficCapture(): Cannot create the capture file '" + aFilePath + "'"));
+    }
+    mFile.write(cMagic, sizeof(cMagic));
+    mBytesWritten = sizeof(cMagic);
+}
+
+void ThriftTrafficCapture::recordOpen(const uint64_t aConnection, const std::string& aTarget, const bda::ProtocolType aProtocolType) {
+    const uint8_t vFlags = static_cast<uint8_t>((static_cast<uint8_t>(aProtocolType) & cProtocolMask) << cProtocolShift);
+    record(RecordType::Open, aConnection, vFlags, aTarget.data(), aTarget.size());
+}
+
+void ThriftTrafficCapture::recordMessage(const uint64_t aConnection, const void* aData, const std::size_t aSize, const bool aBinary) {
+    record(RecordType::Message, aConnection, aBinary ? cBinaryFlag : 0, aData, aSize);
+}
+
+void ThriftTrafficCapture::recordClose(const uint64_t aConnection) {
+    record(RecordType::Close, aConnection, 0, nullptr, 0);
+}
+
+void ThriftTrafficCapture::record(const RecordType aType, const uint64_t aConnection, const uint8_t aFlags, const void* aData, const std::size_t aSize) {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    if (mFull) {
+        mDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // The time is taken under the lock, so that the records are in order:
+    const std::chrono::microseconds vTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mStartTime);
+    mRecord.clear();
+    mRecord.push_back(static_cast<char>(static_cast<uint8_t>(aType) | aFlags));
+    appendVarint(mRecord, static_cast<uint64_t>((vTime - mLastTime).count()));
+    appendVarint(mRecord, aConnection);
+    appendVarint(mRecord, aSize);
+    if (mBytesWritten + mRecord.size() + aSize > mMaxBytes) {
+        // Stop at the first record that does not fit, a later smaller one
+        // would leave a gap in the traffic of its connection:
+        mFull = true;
+        mDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    mLastTime = vTime;
+    mFile.write(mRecord.data(), static_cast<std::streamsize>(mRecord.size()));
+    if (aSize > 0) {
+        mFile.write(static_cast<const char*>(aData), static_cast<std::streamsize>(aSize));
+    }
+    mBytesWritten += mRecord.size() + aSize;
+}
+
+void ThriftTrafficCapture::flush() {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    mFile.flush();
+}
+
+uint64_t ThriftTrafficCapture::bytesWritten() const {
+    std::lock_guard<std::mutex> vLock(mMutex);
+    return mBytesWritten;
+}
+
+ThriftTrafficCapture::Reader::Reader(std::istream& aStream)
+    : mStream(aStream) {
+    char vMagic[sizeof(cMagic)];
+    if (!mStream.read(vMagic, sizeof(vMagic)) || !std::equal(vMagic, vMagic + sizeof(vMagic), cMagic)) {
+        throw(std::runtime_error("bda::ThriftTrafficCapture::Reader::Reader(): The stream is no traffic capture of this version"));
+    }
+}
+
+bool ThriftTrafficCapture::Reader::next(Record& aRecord) {
+    const int vFlags = mStream.get();
+    if (vFlags == std::char_traits<char>::eof()) {
+        return false;
+    }
+    uint64_t vTimeDelta = 0;
+    uint64_t vSize = 0;
+    if (!readVarint(mStream, vTimeDelta) || !readVarint(mStream, aRecord.mConnection) || !readVarint(mStream, vSize) ||
+        (vFlags & cTypeMask) > static_cast<uint8_t>(RecordType::Close) || vSize > cMaxRecordSize) {
+        throw(std::runtime_error("bda::ThriftTrafficCapture::Reader::next(): The record is truncated or corrupt"));
+    }
+    aRecord.mType = static_cast<RecordType>(vFlags & cTypeMask);
+    mTime += std::chrono::microseconds(vTimeDelta);
+    aRecord.mTime = mTime;
+    aRecord.mBinary = (vFlags & cBinaryFlag) != 0;
+    aRecord.mProtocolType = static_cast<bda::ProtocolType>((vFlags >> cProtocolShift) & cProtocolMask);
+    aRecord.mData.resize(static_cast<std::size_t>(vSize));
+    if (vSize > 0 && !mStream.read(&aRecord.mData[0], static_cast<std::streamsize>(vSize))) {
+        throw(std::runtime_error("bda::ThriftTrafficCapture::Reader::next(): The record is truncated or corrupt"));
+    }
+    return true;
+}
+
+}
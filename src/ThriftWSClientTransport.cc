@@ -0,0 +1,510 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftWSClientTransport.hh"
+
+#include "ThriftMessageHeader.hh"
+
+#include <bda/Helpers.hh>
+
+#include <thrift/transport/TTransportException.h>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/beast/websocket/ssl.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace bda {
+
+using apache::thrift::transport::TTransportException;
+
+namespace {
+
+// Nothing to set up for plain connections:
+void prepareTLS(boost::beast::tcp_stream&, const bda::ThriftWSClientOptions&) {
+}
+
+// Send the host name for SNI, and verify that the certificate is for it:
+void prepareTLS(boost::beast::ssl_stream<boost::beast::tcp_stream>& aStream, const bda::ThriftWSClientOptions& aOptions) {
+    if (!SSL_set_tlsext_host_name(aStream.native_handle(), aOptions.mHost.c_str())) {
+        throw(TTransportException(TTransportException::NOT_OPEN, "bda::ThriftWSConnectionPool: Could not set the TLS host name '" + aOptions.mHost + "'"));
+    }
+    if (aOptions.mVerifyPeer && !SSL_set1_host(aStream.native_handle(), aOptions.mHost.c_str())) {
+        throw(TTransportException(TTransportException::NOT_OPEN, "bda::ThriftWSConnectionPool: Could not verify the host name '" + aOptions.mHost + "'"));
+    }
+}
+
+template<class Handler>
+void handshakeTLS(boost::beast::tcp_stream&, Handler&& aHandler) {
+    aHandler(boost::beast::error_code());
+}
+
+template<class Handler>
+void handshakeTLS(boost::beast::ssl_stream<boost::beast::tcp_stream>& aStream, Handler&& aHandler) {
+    boost::beast::get_lowest_layer(aStream).expires_after(std::chrono::seconds(30));
+    aStream.async_handshake(boost::asio::ssl::stream_base::client, std::forward<Handler>(aHandler));
+}
+
+}
+
+// One WebSocket connection of the pool. It writes the calls one after the
+// other, reads the responses as they come, and matches them to their calls
+// by the sequence ids that it gave the calls. All members are only used on
+// the strand of the connection, except for the counters.
+class ThriftWSConnectionPool::Connection : public std::enable_shared_from_this<ThriftWSConnectionPool::Connection> {
+public:
+    Connection(boost::asio::io_context& aIOContext, boost::asio::ssl::context* aSSLContext, const bda::ThriftWSClientOptions& aOptions)
+        : mOptions(aOptions), mStrand(boost::asio::make_strand(aIOContext)), mResolver(mStrand) {
+        if (aSSLContext) {
+            mSSLWebSocket.reset(new boost::beast::websocket::stream<boost::beast::ssl_stream<boost::beast::tcp_stream>>(mStrand, *aSSLContext));
+        } else {
+            mWebSocket.reset(new boost::beast::websocket::stream<boost::beast::tcp_stream>(mStrand));
+        }
+    }
+
+    // The calls in flight, which the pool counts when it picks the
+    // connection, and whether the connection failed or was closed:
+    std::atomic<std::size_t> mCalls{ 0 };
+    std::atomic<bool> mBroken{ false };
+
+    void start() {
+        mResolver.async_resolve(mOptions.mHost, std::to_string(mOptions.mPort),
+            boost::beast::bind_front_handler(&Connection::on_resolve, shared_from_this()));
+    }
+
+    // Send a call, from any thread. The call is written once the connection
+    // is open.
+    void call(std::string aMessage, const bda::ThriftMessageHeader& aHeader, ResponseHandler aHandler) {
+        auto vSelf = shared_from_this();
+        auto vMessage = std::make_shared<std::string>(std::move(aMessage));
+        boost::asio::post(mStrand, [this, vSelf, vMessage, aHeader, aHandler]() {
+            if (mClosed) {
+                --mCalls;
+                aHandler(std::make_exception_ptr(TTransportException(TTransportException::NOT_OPEN, "bda::ThriftWSConnectionPool: The connection to " + endpoint() + " is closed")), std::string());
+                return;
+            }
+
+            // Replace the sequence id of the client with one that is unique on
+            // this connection, and keep the original for the response:
+            const int32_t vSeqId = static_cast<int32_t>(mNextSeqId++);
+            Outgoing vOutgoing;
+            vOutgoing.mMessage = std::move(*vMessage);
+            const std::string vClientSeqId = vOutgoing.mMessage.substr(aHeader.mSeqIdOffset, aHeader.mSeqIdSize);
+            vOutgoing.mMessage.replace(aHeader.mSeqIdOffset, aHeader.mSeqIdSize, bda::encodeThriftSeqId(mOptions.mProtocolType, vSeqId));
+            if (aHeader.mType == apache::thrift::protocol::T_ONEWAY) {
+                vOutgoing.mOnewayHandler = aHandler;
+            } else {
+                mPendingCalls[vSeqId] = PendingCall{ vClientSeqId, aHandler };
+            }
+            mWriteQueue.push_back(std::move(vOutgoing));
+
+            if (mOpen && !mWriting) {
+                do_write();
+            }
+        });
+    }
+
+    // Close the connection and fail its calls, from any thread
+    void close() {
+        boost::asio::post(mStrand, boost::beast::bind_front_handler(&Connection::shutdown, shared_from_this(),
+            TTransportException(TTransportException::INTERRUPTED, "bda::ThriftWSConnectionPool: The pool was closed")));
+    }
+
+private:
+    struct Outgoing {
+        std::string mMessage;
+        ResponseHandler mOnewayHandler;
+    };
+
+    struct PendingCall {
+        std::string mClientSeqId;
+        ResponseHandler mHandler;
+    };
+
+    std::string endpoint() const {
+        return mOptions.mHost + ":" + std::to_string(mOptions.mPort);
+    }
+
+    // Run aFunction with the WebSocket stream of this connection:
+    template<class Function>
+    void with_websocket(Function&& aFunction) {
+        if (mSSLWebSocket) {
+            aFunction(*mSSLWebSocket);
+        } else {
+            aFunction(*mWebSocket);
+        }
+    }
+
+    void on_resolve(const boost::beast::error_code ec, boost::asio::ip::tcp::resolver::results_type aResults) {
+        if (ec) {
+            return fail(ec, "resolve");
+        }
+        with_websocket([this, &aResults](auto& aWebSocket) {
+            try {
+                prepareTLS(aWebSocket.next_layer(), mOptions);
+            } catch (const TTransportException& vException) {
+                return shutdown(vException);
+            }
+            boost::beast::get_lowest_layer(aWebSocket).expires_after(std::chrono::seconds(30));
+            boost::beast::get_lowest_layer(aWebSocket).async_connect(aResults,
+                boost::beast::bind_front_handler(&Connection::on_connect, shared_from_this()));
+        });
+    }
+
+    void on_connect(const boost::beast::error_code ec, const boost::asio::ip::tcp::endpoint&) {
+        if (ec) {
+            return fail(ec, "connect");
+        }
+        with_websocket([this](auto& aWebSocket) {
+            boost::beast::get_lowest_layer(aWebSocket).socket().set_option(boost::asio::ip::tcp::no_delay(true));
+            handshakeTLS(aWebSocket.next_layer(), boost::beast::bind_front_handler(&Connection::on_tls_handshake, shared_from_this()));
+        });
+    }
+
+    void on_tls_handshake(const boost::beast::error_code ec) {
+        if (ec) {
+            return fail(ec, "TLS handshake");
+        }
+        with_websocket([this](auto& aWebSocket) {
+            // The WebSocket has its own timeouts:
+            boost::beast::get_lowest_layer(aWebSocket).expires_never();
+            aWebSocket.set_option(boost::beast::websocket::stream_base::timeout::suggested(boost::beast::role_type::client));
+            if (mOptions.mCompression) {
+                boost::beast::websocket::permessage_deflate vDeflate;
+                vDeflate.client_enable = true;
+                aWebSocket.set_option(vDeflate);
+            }
+            if (!mOptions.mAccessToken.empty()) {
+                const std::string vAuthorization = "Bearer " + mOptions.mAccessToken;
+                aWebSocket.set_option(boost::beast::websocket::stream_base::decorator(
+                    [vAuthorization](boost::beast::websocket::request_type& aRequest) {
+                        aRequest.set(boost::beast::http::field::authorization, vAuthorization);
+                    }));
+            }
+            aWebSocket.read_message_max(mOptions.mMaxMessageSize);
+            aWebSocket.binary(true);
+            aWebSocket.auto_fragment(false);
+            aWebSocket.async_handshake(endpoint(), mOptions.mPath,
+                boost::beast::bind_front_handler(&Connection::on_handshake, shared_from_this()));
+        });
+    }
+
+    void on_handshake(const boost::beast::error_code ec) {
+        if (ec) {
+            return fail(ec, "WebSocket handshake");
+        }
+        BDAMessage(12, "bda::ThriftWSConnectionPool: Connected to " + endpoint() + ".\n");
+        mOpen = true;
+        do_read();
+        if (!mWriteQueue.empty()) {
+            do_write();
+        }
+    }
+
+    void do_write() {
+        mWriting = true;
+        with_websocket([this](auto& aWebSocket) {
+            aWebSocket.async_write(boost::asio::buffer(mWriteQueue.front().mMessage),
+                boost::beast::bind_front_handler(&Connection::on_write, shared_from_this()));
+        });
+    }
+
+    void on_write(const boost::beast::error_code ec, const std::size_t) {
+        mWriting = false;
+        if (ec) {
+            return fail(ec, "write");
+        }
+        ResponseHandler vOnewayHandler = std::move(mWriteQueue.front().mOnewayHandler);
+        mWriteQueue.pop_front();
+        if (!mWriteQueue.empty()) {
+            do_write();
+        }
+
+        // A oneway call is complete once it was sent:
+        if (vOnewayHandler) {
+            --mCalls;
+            vOnewayHandler(nullptr, std::string());
+        }
+    }
+
+    void do_read() {
+        with_websocket([this](auto& aWebSocket) {
+            aWebSocket.async_read(mBuffer, boost::beast::bind_front_handler(&Connection::on_read, shared_from_this()));
+        });
+    }
+
+    void on_read(const boost::beast::error_code ec, const std::size_t) {
+        if (ec) {
+            return fail(ec, "read");
+        }
+
+        const auto vBufferData = mBuffer.data();
+        const uint8_t* vData = static_cast<const uint8_t*>(vBufferData.data());
+        const std::size_t vSize = vBufferData.size();
+        // Older servers answer a oneway call with an empty message, which
+        // belongs to no pending call:
+        if (vSize == 0) {
+            return do_read();
+        }
+        bda::ThriftMessageHeader vHeader;
+        if (!bda::parseThriftMessageHeader(mOptions.mProtocolType, vData, vSize, vHeader)) {
+            return shutdown(TTransportException(TTransportException::CORRUPTED_DATA, "bda::ThriftWSConnectionPool: Received an invalid response from " + endpoint()));
+        }
+        const auto vPendingCallIt = mPendingCalls.find(vHeader.mSeqId);
+        if (vPendingCallIt == mPendingCalls.end()) {
+            return shutdown(TTransportException(TTransportException::CORRUPTED_DATA, "bda::ThriftWSConnectionPool: Received a response to an unknown call from " + endpoint()));
+        }
+        PendingCall vCall = std::move(vPendingCallIt->second);
+        mPendingCalls.erase(vPendingCallIt);
+
+        // The response gets the sequence id of the client back:
+        std::string vResponse;
+        vResponse.reserve(vSize - vHeader.mSeqIdSize + vCall.mClientSeqId.size());
+        vResponse.append(reinterpret_cast<const char*>(vData), vHeader.mSeqIdOffset);
+        vResponse.append(vCall.mClientSeqId);
+        vResponse.append(reinterpret_cast<const char*>(vData) + vHeader.mSeqIdOffset + vHeader.mSeqIdSize, vSize - vHeader.mSeqIdOffset - vHeader.mSeqIdSize);
+        mBuffer.consume(vSize);
+
+        do_read();
+        --mCalls;
+        vCall.mHandler(nullptr, std::move(vResponse));
+    }
+
+    void fail(const boost::beast::error_code ec, const char* aWhat) {
+        if (mClosed) {
+            return;
+        }
+        // The server also closes idle connections, so this is only an error
+        // for the calls in flight, which receive the exception:
+        BDAMessage(9, "bda::ThriftWSConnectionPool: The connection to " + endpoint() + " failed in " + aWhat + ": '" + ec.message() + "'.\n");
+        shutdown(TTransportException(TTransportException::END_OF_FILE, "bda::ThriftWSConnectionPool: The connection to " + endpoint() + " failed in " + aWhat + ": " + ec.message()));
+    }
+
+    // Close the socket, and fail all calls in flight with aException
+    void shutdown(const TTransportException& aException) {
+        if (mClosed) {
+            return;
+        }
+        mClosed = true;
+        mBroken = true;
+        mOpen = false;
+
+        mResolver.cancel();
+        with_websocket([](auto& aWebSocket) {
+            boost::beast::error_code ec;
+            boost::beast::get_lowest_layer(aWebSocket).socket().close(ec);
+        });
+
+        std::vector<ResponseHandler> vHandlers;
+        for (Outgoing& vOutgoing : mWriteQueue) {
+            if (vOutgoing.mOnewayHandler) {
+                vHandlers.push_back(std::move(vOutgoing.mOnewayHandler));
+            }
+        }
+        for (auto& vPendingCall : mPendingCalls) {
+            vHandlers.push_back(std::move(vPendingCall.second.mHandler));
+        }
+        mWriteQueue.clear();
+        mPendingCalls.clear();
+        mCalls -= vHandlers.size();
+
+        const std::exception_ptr vError = std::make_exception_ptr(aException);
+        for (ResponseHandler& vHandler : vHandlers) {
+            vHandler(vError, std::string());
+        }
+    }
+
+    const bda::ThriftWSClientOptions& mOptions;
+    boost::asio::strand<boost::asio::io_context::executor_type> mStrand;
+    boost::asio::ip::tcp::resolver mResolver;
+    std::unique_ptr<boost::beast::websocket::stream<boost::beast::tcp_stream>> mWebSocket;
+    std::unique_ptr<boost::beast::websocket::stream<boost::beast::ssl_stream<boost::beast::tcp_stream>>> mSSLWebSocket;
+
+    bool mOpen = false;
+    bool mWriting = false;
+    bool mClosed = false;
+    std::deque<Outgoing> mWriteQueue;
+    std::unordered_map<int32_t, PendingCall> mPendingCalls;
+    uint32_t mNextSeqId = 0;
+    boost::beast::flat_buffer mBuffer;
+};
+
+struct ThriftWSConnectionPool::State {
+    boost::asio::io_context mIOContext;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> mWorkGuard{ mIOContext.get_executor() };
+    std::unique_ptr<boost::asio::ssl::context> mSSLContext;
+    std::vector<std::thread> mThreads;
+
+    mutable std::mutex mMutex;
+    std::vector<std::shared_ptr<ThriftWSConnectionPool::Connection>> mConnections;
+};
+
+ThriftWSConnectionPool::ThriftWSConnectionPool(const bda::ThriftWSClientOptions& aOptions)
+    : mOptions(aOptions), mProtocolFactory(bda::createProtocolFactory(aOptions.mProtocolType)), mState(new State()) {
+    if (mOptions.mMaxConnections == 0 || mOptions.mMaxCallsPerConnection == 0 || mOptions.mThreads == 0) {
+        throw(std::runtime_error("bda::ThriftWSConnectionPool::ThriftWSConnectionPool(): The pool needs at least one connection, call and thread"));
+    }
+
+    if (mOptions.mTLS) {
+        mState->mSSLContext.reset(new boost::asio::ssl::context(boost::asio::ssl::context::tls_client));
+        if (mOptions.mVerifyPeer) {
+            mState->mSSLContext->set_verify_mode(boost::asio::ssl::verify_peer);
+            if (mOptions.mCAFile.empty()) {
+                mState->mSSLContext->set_default_verify_paths();
+            } else {
+                mState->mSSLContext->load_verify_file(mOptions.mCAFile);
+            }
+        } else {
+            mState->mSSLContext->set_verify_mode(boost::asio::ssl::verify_none);
+        }
+    }
+
+    for (unsigned vIdx = 0; vIdx < mOptions.mThreads; ++vIdx) {
+        mState->mThreads.emplace_back([this]() {
+            mState->mIOContext.run();
+        });
+    }
+}
+
+ThriftWSConnectionPool::~ThriftWSConnectionPool() {
+    {
+        std::lock_guard<std::mutex> vLock(mState->mMutex);
+        for (const std::shared_ptr<Connection>& vConnection : mState->mConnections) {
+            vConnection->close();
+        }
+        mState->mConnections.clear();
+    }
+
+    // The threads return once the closed connections completed:
+    mState->mWorkGuard.reset();
+    for (std::thread& vThread : mState->mThreads) {
+        vThread.join();
+    }
+}
+
+void ThriftWSConnectionPool::asyncSend(std::string aMessage, ResponseHandler aHandler) {
+    bda::ThriftMessageHeader vHeader;
+    if (!bda::parseThriftMessageHeader(mOptions.mProtocolType, reinterpret_cast<const uint8_t*>(aMessage.data()), aMessage.size(), vHeader) ||
+        (vHeader.mType != apache::thrift::protocol::T_CALL && vHeader.mType != apache::thrift::protocol::T_ONEWAY)) {
+        throw(TTransportException(TTransportException::BAD_ARGS, "bda::ThriftWSConnectionPool::asyncSend(): The message is not a thrift call"));
+    }
+
+    // Use the connection with the fewest calls in flight, unless all have
+    // enough calls and the pool may open another one:
+    std::shared_ptr<Connection> vConnection;
+    {
+        std::lock_guard<std::mutex> vLock(mState->mMutex);
+        std::vector<std::shared_ptr<Connection>>& vConnections = mState->mConnections;
+        vConnections.erase(std::remove_if(vConnections.begin(), vConnections.end(),
+                                          [](const std::shared_ptr<Connection>& aConnection) { return aConnection->mBroken.load(); }),
+                           vConnections.end());
+
+        for (const std::shared_ptr<Connection>& vCandidate : vConnections) {
+            if (!vConnection || vCandidate->mCalls < vConnection->mCalls) {
+                vConnection = vCandidate;
+            }
+        }
+        if (!vConnection || (vConnection->mCalls >= mOptions.mMaxCallsPerConnection && vConnections.size() < mOptions.mMaxConnections)) {
+            vConnection = std::make_shared<Connection>(mState->mIOContext, mState->mSSLContext.get(), mOptions);
+            vConnections.push_back(vConnection);
+            vConnection->start();
+        }
+        ++vConnection->mCalls;
+    }
+    vConnection->call(std::move(aMessage), vHeader, std::move(aHandler));
+}
+
+std::future<std::string> ThriftWSConnectionPool::asyncSend(std::string aMessage) {
+    auto vPromise = std::make_shared<std::promise<std::string>>();
+    std::future<std::string> vFuture = vPromise->get_future();
+    asyncSend(std::move(aMessage), [vPromise](std::exception_ptr aError, std::string aResponse) {
+        if (aError) {
+            vPromise->set_exception(aError);
+        } else {
+            vPromise->set_value(std::move(aResponse));
+        }
+    });
+    return vFuture;
+}
+
+std::size_t ThriftWSConnectionPool::connections() const {
+    std::lock_guard<std::mutex> vLock(mState->mMutex);
+    return static_cast<std::size_t>(std::count_if(mState->mConnections.begin(), mState->mConnections.end(),
+                                                  [](const std::shared_ptr<Connection>& aConnection) { return !aConnection->mBroken.load(); }));
+}
+
+ThriftWSClientTransport::ThriftWSClientTransport(std::shared_ptr<bda::ThriftWSConnectionPool> aPool)
+    : mPool(aPool) {
+}
+
+bool ThriftWSClientTransport::isOpen() const {
+    return true;
+}
+
+void ThriftWSClientTransport::open() {
+}
+
+void ThriftWSClientTransport::close() {
+    mWriteBuffer.clear();
+    mReadBuffer.clear();
+    mReadOffset = 0;
+}
+
+uint32_t ThriftWSClientTransport::read(uint8_t* buf, uint32_t len) {
+    const uint32_t vSize = static_cast<uint32_t>(std::min<std::size_t>(len, mReadBuffer.size() - mReadOffset));
+    std::memcpy(buf, mReadBuffer.data() + mReadOffset, vSize);
+    mReadOffset += vSize;
+    return vSize;
+}
+
+void ThriftWSClientTransport::write(const uint8_t* buf, uint32_t len) {
+    mWriteBuffer.append(reinterpret_cast<const char*>(buf), len);
+}
+
+void ThriftWSClientTransport::flush() {
+    if (mWriteBuffer.empty()) {
+        return;
+    }
+    std::string vRequest;
+    vRequest.swap(mWriteBuffer);
+
+    // Rethrows the exception that failed the call:
+    mReadBuffer = mPool->asyncSend(std::move(vRequest)).get();
+    mReadOffset = 0;
+}
+
+}
@@ -0,0 +1,70 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "AllocationCounter.hh"
+
+#include "bda/ThriftProfiler.hh"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> gAllocations{ 0 };
+
+void* countedAllocate(const std::size_t aSize) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    bda::ThriftProfiler::sampleAllocation(aSize);
+    void* vPointer = std::malloc(aSize > 0 ? aSize : 1);
+    if (!vPointer) {
+        throw std::bad_alloc();
+    }
+    return vPointer;
+}
+
+}
+
+uint64_t globalAllocations() {
+    return gAllocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t aSize) {
+    return countedAllocate(aSize);
+}
+
+void* operator new[](std::size_t aSize) {
+    return countedAllocate(aSize);
+}
+
+void operator delete(void* aPointer) noexcept {
+    std::free(aPointer);
+}
+
+void operator delete[](void* aPointer) noexcept {
+    std::free(aPointer);
+}
+
+void operator delete(void* aPointer, std::size_t) noexcept {
+    std::free(aPointer);
+}
+
+void operator delete[](void* aPointer, std::size_t) noexcept {
+    std::free(aPointer);
+}
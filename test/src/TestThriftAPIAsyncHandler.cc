@@ -0,0 +1,97 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "TestThriftAPIAsyncHandler.hh"
+
+#include "bda/ThriftAwaitable.hh"
+#include "bda/ThriftHelper.hh"
+
+#include <bda/Helpers.hh>
+
+#include <boost/asio/steady_timer.hpp>
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+#include <boost/asio/use_awaitable.hpp>
+#endif
+
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+TestThriftAPIAsyncHandler::TestThriftAPIAsyncHandler(boost::asio::io_context::executor_type aExecutor, const std::chrono::milliseconds aDelay)
+    : mExecutor(aExecutor), mDelay(aDelay) {
+    for (size_t vIdx = 0; vIdx < 8; ++vIdx) {
+        const size_t vDataSize = static_cast<size_t>(std::pow(10.0, static_cast<double>(vIdx)) + 0.5);
+        mData.emplace_back(vDataSize, 'a');
+    }
+}
+
+void TestThriftAPIAsyncHandler::ping(std::function<void(const int32_t& aResult)> cob,
+                                     std::function<void(apache::thrift::TDelayedException* aException)> /* exn_cob */,
+                                     const int32_t aTestValue) {
+    BDAMessage(8, "TestThriftAPIAsyncHandler::ping() called.\n");
+    cob(~aTestValue);
+}
+
+void TestThriftAPIAsyncHandler::fetchData(std::function<void(const std::string& aData)> cob,
+                                          std::function<void(apache::thrift::TDelayedException* aException)> exn_cob,
+                                          const int64_t aDataSizeIdx) {
+    BDAMessage(10, "TestThriftAPIAsyncHandler::fetchData(" + std::to_string(aDataSizeIdx) + ") called.\n");
+    if (aDataSizeIdx < 0 || static_cast<size_t>(aDataSizeIdx) >= mData.size()) {
+        const std::runtime_error vError("fetchData(): Data size index " + std::to_string(aDataSizeIdx) + " not defined.");
+        return exn_cob(apache::thrift::TDelayedException::delayException(vError));
+    }
+    const std::string& vData = mData[aDataSizeIdx];
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+    auto vLoadData = [](boost::asio::io_context::executor_type aExecutor, const std::chrono::milliseconds aDelay,
+                        const std::string& aData) -> boost::asio::awaitable<std::string> {
+        boost::asio::steady_timer vTimer(aExecutor, aDelay);
+        co_await vTimer.async_wait(boost::asio::use_awaitable);
+        co_return aData;
+    };
+    bda::completeThriftCall(mExecutor, vLoadData(mExecutor, mDelay, vData), cob, exn_cob);
+#else
+    auto vTimer = std::make_shared<boost::asio::steady_timer>(mExecutor, mDelay);
+    vTimer->async_wait([vTimer, cob, exn_cob, &vData](const boost::system::error_code& aError) {
+        if (aError) {
+            return exn_cob(apache::thrift::TDelayedException::delayException(std::runtime_error("fetchData(): " + aError.message())));
+        }
+        cob(vData);
+    });
+#endif
+}
+
+void TestThriftAPIAsyncHandler::triggerCustomException(std::function<void()> /* cob */,
+                                                       std::function<void(apache::thrift::TDelayedException* aException)> exn_cob) {
+    exn_cob(apache::thrift::TDelayedException::delayException(
+        bda::generateThriftException<TestThriftAPI::CustomException>("TestThriftAPIAsyncHandler::triggerCustomException(): Throwing a TestThriftAPI::CustomException() as expected")));
+}
+
+void TestThriftAPIAsyncHandler::triggerAPIException(std::function<void()> /* cob */,
+                                                    std::function<void(apache::thrift::TDelayedException* aException)> exn_cob) {
+    TestThriftAPI::std_runtime_error vInternalRuntimeError;
+    vInternalRuntimeError._what = "TestThriftAPIAsyncHandler::triggerAPIException(): Throwing a TestThriftAPI::std_runtime_error() as expected";
+    exn_cob(apache::thrift::TDelayedException::delayException(vInternalRuntimeError));
+}
+
+void TestThriftAPIAsyncHandler::triggerServerException(std::function<void()> /* cob */,
+                                                       std::function<void(apache::thrift::TDelayedException* aException)> exn_cob) {
+    exn_cob(apache::thrift::TDelayedException::delayException(
+        std::runtime_error("TestThriftAPIAsyncHandler::triggerServerException(): Throwing a std::runtime_error() as expected")));
+}
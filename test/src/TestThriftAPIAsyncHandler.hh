@@ -0,0 +1,75 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef TESTTHRIFTAPIASYNCHANDLER_HH
+#define TESTTHRIFTAPIASYNCHANDLER_HH
+
+#include "TestThriftAPI.h"
+
+#include <boost/asio/io_context.hpp>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief An asynchronous handler for the TestThriftAPIAsyncProcessor that
+ * the thrift compiler generates with the cob_style option. fetchData
+ * simulates waiting on a database or a file with a timer, and completes
+ * the call when the timer expires, without blocking a thread meanwhile.
+ * When built as C++20, fetchData is a coroutine.
+ */
+class TestThriftAPIAsyncHandler : public TestThriftAPI::TestThriftAPICobSvIf {
+public:
+    TestThriftAPIAsyncHandler(boost::asio::io_context::executor_type aExecutor, const std::chrono::milliseconds aDelay);
+    virtual ~TestThriftAPIAsyncHandler() = default;
+
+    /** @brief Connection test helper method. */
+    void ping(std::function<void(const int32_t& aResult)> cob,
+              std::function<void(apache::thrift::TDelayedException* aException)> exn_cob,
+              const int32_t aTestValue) override;
+
+    /** @brief Benchmark method, send a data block of given size 10^aDataSizeIdx after the delay */
+    void fetchData(std::function<void(const std::string& aData)> cob,
+                   std::function<void(apache::thrift::TDelayedException* aException)> exn_cob,
+                   const int64_t aDataSizeIdx) override;
+
+    /** @brief Always fails with a TestThriftAPI::CustomException. */
+    void triggerCustomException(std::function<void()> cob,
+                                std::function<void(apache::thrift::TDelayedException* aException)> exn_cob) override;
+
+    /** @brief Always fails with a TestThriftAPI::std_runtime_error. */
+    void triggerAPIException(std::function<void()> cob,
+                             std::function<void(apache::thrift::TDelayedException* aException)> exn_cob) override;
+
+    /** @brief Always fails with a std::runtime_error. */
+    void triggerServerException(std::function<void()> cob,
+                                std::function<void(apache::thrift::TDelayedException* aException)> exn_cob) override;
+
+protected:
+    // The executor of the timers that simulate the waiting:
+    boost::asio::io_context::executor_type mExecutor;
+    const std::chrono::milliseconds mDelay;
+
+    // blocks of random data of different size:
+    std::vector<std::string> mData;
+};
+
+#endif
@@ -20,13 +20,14 @@
 #include "TestThriftAPIHandler.hh"
 
 #include "bda/ThriftHelper.hh"
+#include "bda/ThriftSharedBinary.hh"
 
 #include <bda/Helpers.hh>
 
 TestThriftAPIHandler::TestThriftAPIHandler() {
     for (size_t vIdx = 0; vIdx < 8; ++vIdx) {
         const size_t vDataSize = static_cast<size_t>(std::pow(10.0, static_cast<double>(vIdx)) + 0.5);
-        mData.emplace_back(vDataSize, 'a');
+        mData.push_back(std::make_shared<const std::string>(vDataSize, 'a'));
     }
 }
 
@@ -42,7 +43,7 @@ void TestThriftAPIHandler::fetchData(std::string& aData, const int64_t aDataSize
     if (aDataSizeIdx < 0 || static_cast<size_t>(aDataSizeIdx) >= mData.size()) {
         throw(std::runtime_error("fetchData(): Data size index " + std::to_string(aDataSizeIdx) + " not defined."));
     }
-    aData = mData[aDataSizeIdx];
+    bda::shareBinary(aData, mData[aDataSizeIdx]);
 }
 
 void TestThriftAPIHandler::triggerCustomException() {
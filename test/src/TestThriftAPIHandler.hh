@@ -24,6 +24,7 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -49,8 +50,8 @@ public:
     void triggerServerException() override;
 
 protected:
-    // blocks of random data of different size:
-    std::vector<std::string> mData;
+    // blocks of random data of different size, shared with the responses:
+    std::vector<std::shared_ptr<const std::string>> mData;
 };
 
 #endif
@@ -0,0 +1,284 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftCallDeadline.hh"
+
+#include <bda/Helpers.hh>
+
+#include "TestThriftAPI.h"
+
+#include <thrift/TApplicationException.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// A group of connections that all call the same method in a closed loop,
+// given on the command line as <method>:<connections>[:<fetchData size index>]
+struct LoadGroup {
+    std::string mMethod;
+    unsigned mConnections = 1;
+    int64_t mDataSizeIdx = 0;
+
+    std::mutex mMutex;
+    std::vector<double> mLatenciesUS;
+    uint64_t mErrors = 0;
+};
+
+void ParseCommandLineArguments(boost::program_options::variables_map& aParsedCmdLineOptionsMap, std::vector<std::string>& aNonParsedCmdLineOptions, const int argc, char** const argv) {
+    // Declare command line options.
+    boost::program_options::options_description vCMDLineStdOptions("Allowed options");
+    // clang-format off
+    vCMDLineStdOptions.add_options()
+        ("help,h",                                                                                              "this help message")
+        ("verbose,v",       boost::program_options::value<uint8_t>()->default_value(6),                         "verbosity (higher numbers mean more verbose)")
+        ("host",            boost::program_options::value<std::string>()->default_value("127.0.0.1"),           "server host")
+        ("port,p",          boost::program_options::value<uint16_t>()->default_value(9090),                     "server port")
+        ("path",            boost::program_options::value<std::string>()->default_value("/"),                   "WebSocket upgrade path of the service")
+        ("unix-socket",     boost::program_options::value<std::string>(),                                       "connect to this Unix domain socket instead of host and port")
+        ("duration-sec,s",  boost::program_options::value<uint32_t>()->default_value(10),                       "duration of the measurement (seconds)")
+        ("call-timeout-ms", boost::program_options::value<uint32_t>()->default_value(0),                        "send every call with a deadline envelope (0 disables)")
+        ("token",           boost::program_options::value<std::string>(),                                       "authenticate every connection with this access token")
+        ("load",            boost::program_options::value<std::vector<std::string>>()->composing(),             "load group <method>:<connections>[:<size index>], method is ping or fetchData");
+    // clang-format on
+
+
+    const auto vParsedCmdLineOptions = boost::program_options::command_line_parser(argc, argv).options(vCMDLineStdOptions).allow_unregistered().run();
+    boost::program_options::store(vParsedCmdLineOptions, aParsedCmdLineOptionsMap);
+    boost::program_options::notify(aParsedCmdLineOptionsMap);
+    aNonParsedCmdLineOptions = boost::program_options::collect_unrecognized(vParsedCmdLineOptions.options, boost::program_options::include_positional);
+
+    if (aParsedCmdLineOptionsMap.count("help")) {
+        std::cout << vCMDLineStdOptions;
+        std::exit(0);
+    }
+}
+
+std::unique_ptr<LoadGroup> ParseLoadGroup(const std::string& aSpecification) {
+    std::unique_ptr<LoadGroup> vGroup(new LoadGroup());
+    const std::size_t vFirstColon = aSpecification.find(':');
+    vGroup->mMethod = aSpecification.substr(0, vFirstColon);
+    if (vFirstColon != std::string::npos) {
+        const std::size_t vSecondColon = aSpecification.find(':', vFirstColon + 1);
+        vGroup->mConnections = static_cast<unsigned>(std::stoul(aSpecification.substr(vFirstColon + 1, vSecondColon - vFirstColon - 1)));
+        if (vSecondColon != std::string::npos) {
+            vGroup->mDataSizeIdx = std::stoll(aSpecification.substr(vSecondColon + 1));
+        }
+    }
+    if (vGroup->mMethod != "ping" && vGroup->mMethod != "fetchData") {
+        throw(std::runtime_error("ParseLoadGroup(): Unknown method '" + vGroup->mMethod + "'"));
+    }
+    return vGroup;
+}
+
+// Call the method of the group on the connected WebSocket until aStop is
+// set, and record the latency of every call.
+template<class WebSocket>
+void RunCalls(WebSocket& aWebSocket, LoadGroup& aGroup, const std::chrono::milliseconds aCallTimeout, const std::atomic<bool>& aStop,
+              std::vector<double>& aLatenciesUS, uint64_t& aErrors) {
+    // The client writes the call into one memory buffer, and reads the
+    // response from another one:
+    std::shared_ptr<apache::thrift::transport::TMemoryBuffer> vOutputTransport = std::make_shared<apache::thrift::transport::TMemoryBuffer>();
+    std::shared_ptr<apache::thrift::transport::TMemoryBuffer> vInputTransport = std::make_shared<apache::thrift::transport::TMemoryBuffer>();
+    TestThriftAPI::TestThriftAPIClient vClient(std::make_shared<apache::thrift::protocol::TBinaryProtocol>(vInputTransport),
+                                               std::make_shared<apache::thrift::protocol::TBinaryProtocol>(vOutputTransport));
+
+    boost::beast::flat_buffer vBuffer;
+    std::string vEnvelope;
+    std::string vData;
+    int32_t vPingValue = 0;
+    while (!aStop.load()) {
+        const auto vStart = std::chrono::steady_clock::now();
+        if (aGroup.mMethod == "ping") {
+            vClient.send_ping(++vPingValue);
+        } else {
+            vClient.send_fetchData(aGroup.mDataSizeIdx);
+        }
+
+        uint8_t* vRequestPtr = nullptr;
+        uint32_t vRequestSize = 0;
+        vOutputTransport->getBuffer(&vRequestPtr, &vRequestSize);
+        if (aCallTimeout.count() > 0) {
+            bda::makeDeadlineEnvelope(vEnvelope, aCallTimeout, vRequestPtr, vRequestSize);
+            aWebSocket.write(boost::asio::buffer(vEnvelope));
+        } else {
+            aWebSocket.write(boost::asio::buffer(vRequestPtr, vRequestSize));
+        }
+        vOutputTransport->resetBuffer();
+
+        vBuffer.clear();
+        aWebSocket.read(vBuffer);
+        vInputTransport->resetBuffer(static_cast<uint8_t*>(vBuffer.data().data()), static_cast<uint32_t>(vBuffer.size()));
+        try {
+            if (aGroup.mMethod == "ping") {
+                if (vClient.recv_ping() != ~vPingValue) {
+                    ++aErrors;
+                }
+            } else {
+                vClient.recv_fetchData(vData);
+            }
+        } catch (const apache::thrift::TApplicationException&) {
+            // e.g. the deadline of the call expired on the server
+            ++aErrors;
+            continue;
+        }
+        const auto vEnd = std::chrono::steady_clock::now();
+        aLatenciesUS.push_back(std::chrono::duration<double, std::micro>(vEnd - vStart).count());
+    }
+}
+
+// Run one connection of the group until aStop is set, over TCP or over the
+// Unix domain socket aSocketPath if it is not empty.
+void RunConnection(LoadGroup& aGroup, const std::string& aHost, const uint16_t aPort, const std::string& aSocketPath, const std::string& aPath,
+                   const std::string& aToken, const std::chrono::milliseconds aCallTimeout, const std::atomic<bool>& aStop) {
+    // Send the access token with the upgrade request:
+    const auto vDecorator = [aToken](boost::beast::websocket::request_type& aRequest) {
+        if (!aToken.empty()) {
+            aRequest.set(boost::beast::http::field::authorization, "Bearer " + aToken);
+        }
+    };
+
+    std::vector<double> vLatenciesUS;
+    uint64_t vErrors = 0;
+    try {
+        boost::asio::io_context vIOContext;
+        if (aSocketPath.empty()) {
+            boost::asio::ip::tcp::resolver vResolver(vIOContext);
+            boost::beast::websocket::stream<boost::asio::ip::tcp::socket> vWebSocket(vIOContext);
+            boost::asio::connect(vWebSocket.next_layer(), vResolver.resolve(aHost, std::to_string(aPort)));
+            vWebSocket.set_option(boost::beast::websocket::stream_base::decorator(vDecorator));
+            vWebSocket.handshake(aHost + ":" + std::to_string(aPort), aPath);
+            vWebSocket.binary(true);
+            RunCalls(vWebSocket, aGroup, aCallTimeout, aStop, vLatenciesUS, vErrors);
+            vWebSocket.close(boost::beast::websocket::close_code::normal);
+        } else {
+            boost::beast::websocket::stream<boost::asio::local::stream_protocol::socket> vWebSocket(vIOContext);
+            vWebSocket.next_layer().connect(boost::asio::local::stream_protocol::endpoint(aSocketPath));
+            vWebSocket.set_option(boost::beast::websocket::stream_base::decorator(vDecorator));
+            vWebSocket.handshake("localhost", aPath);
+            vWebSocket.binary(true);
+            RunCalls(vWebSocket, aGroup, aCallTimeout, aStop, vLatenciesUS, vErrors);
+            vWebSocket.close(boost::beast::websocket::close_code::normal);
+        }
+    } catch (const std::exception& vException) {
+        BDAMessage(2, "RunConnection(): Connection of '" + aGroup.mMethod + "' failed: '" + vException.what() + "'.\n");
+        ++vErrors;
+    }
+
+    std::lock_guard<std::mutex> vLock(aGroup.mMutex);
+    aGroup.mLatenciesUS.insert(aGroup.mLatenciesUS.end(), vLatenciesUS.begin(), vLatenciesUS.end());
+    aGroup.mErrors += vErrors;
+}
+
+double Percentile(const std::vector<double>& aSortedValues, const double aPercentile) {
+    if (aSortedValues.empty()) {
+        return 0.0;
+    }
+    const std::size_t vIdx = static_cast<std::size_t>(aPercentile / 100.0 * static_cast<double>(aSortedValues.size() - 1) + 0.5);
+    return aSortedValues[std::min(vIdx, aSortedValues.size() - 1)];
+}
+
+int main(int argc, char** argv) {
+    // Parse command line options:
+    boost::program_options::variables_map vParsedCmdLineOptionsMap;
+    std::vector<std::string> vNonParsedCmdLineOptions;
+    ParseCommandLineArguments(vParsedCmdLineOptionsMap, vNonParsedCmdLineOptions, argc, argv);
+
+    // Validate the arguments:
+    if (vNonParsedCmdLineOptions.size() > 0) {
+        std::cerr << "ThriftHTTPWSLoadGenerator(): Received additional argument(s) " << vNonParsedCmdLineOptions.front() << std::endl;
+        std::exit(1);
+    } else if (vParsedCmdLineOptionsMap.count("load") < 1) {
+        std::cerr << "ThriftHTTPWSLoadGenerator(): Missing required argument --load" << std::endl;
+        std::exit(1);
+    }
+
+    std::vector<std::unique_ptr<LoadGroup>> vGroups;
+    for (const std::string& vSpecification : vParsedCmdLineOptionsMap["load"].as<std::vector<std::string>>()) {
+        vGroups.push_back(ParseLoadGroup(vSpecification));
+    }
+
+    const std::string vHost = vParsedCmdLineOptionsMap["host"].as<std::string>();
+    const uint16_t vPort = vParsedCmdLineOptionsMap["port"].as<uint16_t>();
+    const std::string vPath = vParsedCmdLineOptionsMap["path"].as<std::string>();
+    const std::string vSocketPath = vParsedCmdLineOptionsMap.count("unix-socket") ? vParsedCmdLineOptionsMap["unix-socket"].as<std::string>() : std::string();
+    const uint32_t vDurationSec = vParsedCmdLineOptionsMap["duration-sec"].as<uint32_t>();
+    const std::chrono::milliseconds vCallTimeout(vParsedCmdLineOptionsMap["call-timeout-ms"].as<uint32_t>());
+    const std::string vToken = vParsedCmdLineOptionsMap.count("token") ? vParsedCmdLineOptionsMap["token"].as<std::string>() : std::string();
+
+
+    // Run all connections of all groups at the same time:
+    std::atomic<bool> vStop(false);
+    std::vector<std::thread> vThreads;
+    for (const std::unique_ptr<LoadGroup>& vGroup : vGroups) {
+        for (unsigned vIdx = 0; vIdx < vGroup->mConnections; ++vIdx) {
+            vThreads.emplace_back(RunConnection, std::ref(*vGroup), vHost, vPort, vSocketPath, vPath, vToken, vCallTimeout, std::cref(vStop));
+        }
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(vDurationSec));
+    vStop = true;
+    for (std::thread& vThread : vThreads) {
+        vThread.join();
+    }
+
+
+    // Report the throughput and the latency distribution of every group:
+    std::cout << std::left << std::setw(24) << "group" << std::right << std::setw(12) << "calls/s" << std::setw(12) << "p50 (us)"
+              << std::setw(12) << "p90 (us)" << std::setw(12) << "p99 (us)" << std::setw(12) << "max (us)" << std::setw(8) << "errors" << std::endl;
+    for (const std::unique_ptr<LoadGroup>& vGroup : vGroups) {
+        std::sort(vGroup->mLatenciesUS.begin(), vGroup->mLatenciesUS.end());
+        std::string vName = vGroup->mMethod + ":" + std::to_string(vGroup->mConnections);
+        if (vGroup->mMethod == "fetchData") {
+            vName += ":" + std::to_string(vGroup->mDataSizeIdx);
+        }
+        const double vCallsPerSec = vDurationSec > 0 ? static_cast<double>(vGroup->mLatenciesUS.size()) / vDurationSec : 0.0;
+        std::cout << std::left << std::setw(24) << vName << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(12) << vCallsPerSec
+                  << std::setw(12) << Percentile(vGroup->mLatenciesUS, 50.0)
+                  << std::setw(12) << Percentile(vGroup->mLatenciesUS, 90.0)
+                  << std::setw(12) << Percentile(vGroup->mLatenciesUS, 99.0)
+                  << std::setw(12) << (vGroup->mLatenciesUS.empty() ? 0.0 : vGroup->mLatenciesUS.back())
+                  << std::setw(8) << vGroup->mErrors << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,520 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftHTTPWSServer.hh"
+#include "bda/ThriftJSONProtocol.hh"
+#include "bda/ThriftSharedMemoryTransport.hh"
+#include "bda/ThriftWSClientTransport.hh"
+
+#include <bda/Helpers.hh>
+
+#include "TestThriftAPI.h"
+#include "TestThriftAPIHandler.hh"
+
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TJSONProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TSocket.h>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/program_options.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// A measured value of a scenario, higher is better:
+struct PerfResult {
+    std::string mMetric;
+    double mValue = 0.0;
+};
+
+// A WebSocket connection with a thrift client that calls over memory buffers:
+class PerfClient {
+public:
+    PerfClient(boost::asio::io_context& aIOContext, const unsigned short aPort)
+        : mWebSocket(aIOContext),
+          mOutputTransport(std::make_shared<apache::thrift::transport::TMemoryBuffer>()),
+          mInputTransport(std::make_shared<apache::thrift::transport::TMemoryBuffer>()),
+          mClient(std::make_shared<apache::thrift::protocol::TBinaryProtocol>(mInputTransport),
+                  std::make_shared<apache::thrift::protocol::TBinaryProtocol>(mOutputTransport)) {
+        boost::asio::ip::tcp::resolver vResolver(aIOContext);
+        boost::asio::connect(mWebSocket.next_layer(), vResolver.resolve("127.0.0.1", std::to_string(aPort)));
+        mWebSocket.handshake("127.0.0.1:" + std::to_string(aPort), "/");
+        mWebSocket.binary(true);
+    }
+
+    ~PerfClient() {
+        boost::beast::error_code ec;
+        mWebSocket.close(boost::beast::websocket::close_code::normal, ec);
+    }
+
+    int32_t ping(const int32_t aValue) {
+        mClient.send_ping(aValue);
+        roundTrip();
+        return mClient.recv_ping();
+    }
+
+    void fetchData(std::string& aData, const int64_t aDataSizeIdx) {
+        mClient.send_fetchData(aDataSizeIdx);
+        roundTrip();
+        mClient.recv_fetchData(aData);
+    }
+
+private:
+    void roundTrip() {
+        uint8_t* vRequestPtr = nullptr;
+        uint32_t vRequestSize = 0;
+        mOutputTransport->getBuffer(&vRequestPtr, &vRequestSize);
+        mWebSocket.write(boost::asio::buffer(vRequestPtr, vRequestSize));
+        mOutputTransport->resetBuffer();
+
+        mBuffer.clear();
+        mWebSocket.read(mBuffer);
+        mInputTransport->resetBuffer(static_cast<uint8_t*>(mBuffer.data().data()), static_cast<uint32_t>(mBuffer.size()));
+    }
+
+    boost::beast::websocket::stream<boost::asio::ip::tcp::socket> mWebSocket;
+    std::shared_ptr<apache::thrift::transport::TMemoryBuffer> mOutputTransport;
+    std::shared_ptr<apache::thrift::transport::TMemoryBuffer> mInputTransport;
+    TestThriftAPI::TestThriftAPIClient mClient;
+    boost::beast::flat_buffer mBuffer;
+};
+
+// Run aIteration on aThreads threads in a closed loop for aDuration, after
+// a short warm-up, and return the number of completed iterations per second.
+double RunClosedLoop(const unsigned aThreads, const std::chrono::milliseconds aDuration,
+                     const std::function<std::function<void()>()>& aMakeIteration) {
+    std::atomic<bool> vMeasure(false);
+    std::atomic<bool> vStop(false);
+    std::atomic<uint64_t> vIterations(0);
+    std::atomic<uint64_t> vErrors(0);
+
+    std::vector<std::thread> vThreads;
+    for (unsigned vIdx = 0; vIdx < aThreads; ++vIdx) {
+        vThreads.emplace_back([&]() {
+            try {
+                std::function<void()> vIteration = aMakeIteration();
+                while (!vStop.load()) {
+                    vIteration();
+                    if (vMeasure.load()) {
+                        ++vIterations;
+                    }
+                }
+            } catch (const std::exception& vException) {
+                BDAMessage(2, "RunClosedLoop(): Iteration failed: '" + std::string(vException.what()) + "'.\n");
+                ++vErrors;
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(aDuration / 5);
+    vMeasure = true;
+    const auto vStart = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(aDuration);
+    const uint64_t vMeasuredIterations = vIterations.load();
+    const double vSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - vStart).count();
+    vStop = true;
+    for (std::thread& vThread : vThreads) {
+        vThread.join();
+    }
+
+    // A scenario with failed iterations has no meaningful rate:
+    return vErrors > 0 ? 0.0 : static_cast<double>(vMeasuredIterations) / vSeconds;
+}
+
+// Serialize a fetchData response with aWriter and read it back with aReader,
+// as the server and a browser client do with the JSON protocol:
+std::string RoundTripFetchData(const std::string& aData, apache::thrift::transport::TMemoryBuffer& aTransport,
+                               apache::thrift::protocol::TProtocol& aWriter, apache::thrift::protocol::TProtocol& aReader) {
+    aTransport.resetBuffer();
+    TestThriftAPI::TestThriftAPI_fetchData_result vResult;
+    vResult.__set_success(aData);
+    aWriter.writeMessageBegin("fetchData", apache::thrift::protocol::T_REPLY, 1);
+    vResult.write(&aWriter);
+    aWriter.writeMessageEnd();
+    const std::string vMessage = aTransport.getBufferAsString();
+
+    std::string vName;
+    apache::thrift::protocol::TMessageType vMessageType;
+    int32_t vSeqId = 0;
+    TestThriftAPI::TestThriftAPI_fetchData_result vReadResult;
+    aReader.readMessageBegin(vName, vMessageType, vSeqId);
+    vReadResult.read(&aReader);
+    aReader.readMessageEnd();
+    if (vReadResult.success != aData) {
+        throw(std::runtime_error("Wrong fetchData response after JSON round trip"));
+    }
+    return vMessage;
+}
+
+// Throughput of the JSON protocol for the fetchData responses, in process,
+// for bda::ThriftJSONProtocol and the stock TJSONProtocol. Both must write
+// the same bytes and read the messages of each other, otherwise this throws.
+std::vector<PerfResult> RunJSONProtocolScenarios(const std::chrono::milliseconds aDuration) {
+    std::vector<PerfResult> vResults;
+    const std::vector<std::pair<int64_t, std::string>> vSizes = { { 2, "100B" }, { 4, "10KB" }, { 6, "1MB" } };
+    for (const std::pair<int64_t, std::string>& vSize : vSizes) {
+        auto vData = std::make_shared<std::string>();
+        TestThriftAPIHandler().fetchData(*vData, vSize.first);
+
+        auto vTransport = std::make_shared<apache::thrift::transport::TMemoryBuffer>();
+        bda::ThriftJSONProtocol vProtocol(vTransport);
+        apache::thrift::protocol::TJSONProtocol vStockProtocol(vTransport);
+        if (RoundTripFetchData(*vData, *vTransport, vProtocol, vStockProtocol) != RoundTripFetchData(*vData, *vTransport, vStockProtocol, vProtocol)) {
+            throw(std::runtime_error("bda::ThriftJSONProtocol and TJSONProtocol write different " + vSize.second + " fetchData responses"));
+        }
+
+        const double vMegaBytes = static_cast<double>(vData->size()) / (1024.0 * 1024.0);
+        const double vCallsPerSec = RunClosedLoop(1, aDuration, [vData]() {
+            auto vTransport = std::make_shared<apache::thrift::transport::TMemoryBuffer>();
+            auto vProtocol = std::make_shared<bda::ThriftJSONProtocol>(vTransport);
+            return [vData, vTransport, vProtocol]() {
+                RoundTripFetchData(*vData, *vTransport, *vProtocol, *vProtocol);
+            };
+        });
+        vResults.push_back({ "json_fetchData_" + vSize.second + "_mb_per_sec", vCallsPerSec * vMegaBytes });
+
+        const double vStockCallsPerSec = RunClosedLoop(1, aDuration, [vData]() {
+            auto vTransport = std::make_shared<apache::thrift::transport::TMemoryBuffer>();
+            auto vProtocol = std::make_shared<apache::thrift::protocol::TJSONProtocol>(vTransport);
+            return [vData, vTransport, vProtocol]() {
+                RoundTripFetchData(*vData, *vTransport, *vProtocol, *vProtocol);
+            };
+        });
+        vResults.push_back({ "json_stock_fetchData_" + vSize.second + "_mb_per_sec", vStockCallsPerSec * vMegaBytes });
+    }
+    return vResults;
+}
+
+std::vector<PerfResult> RunScenarios(const unsigned short aPort, const std::string& aSharedMemoryPath, const std::chrono::milliseconds aDuration) {
+    std::vector<PerfResult> vResults;
+
+    // Round trips of a small call on persistent connections:
+    vResults.push_back({ "ping_calls_per_sec", RunClosedLoop(4, aDuration, [aPort]() {
+        auto vIOContext = std::make_shared<boost::asio::io_context>();
+        auto vClient = std::make_shared<PerfClient>(*vIOContext, aPort);
+        auto vValue = std::make_shared<int32_t>(0);
+        return [vIOContext, vClient, vValue]() {
+            const int32_t vExpected = ~(++*vValue);
+            if (vClient->ping(*vValue) != vExpected) {
+                throw(std::runtime_error("Wrong ping response"));
+            }
+        };
+    }) });
+
+    // Small calls of 16 threads that share the connections of a client
+    // pool, and 16 pipelined asynchronous calls at a time:
+    bda::ThriftWSClientOptions vPoolOptions;
+    vPoolOptions.mPort = aPort;
+    auto vPool = std::make_shared<bda::ThriftWSConnectionPool>(vPoolOptions);
+    vResults.push_back({ "pool_ping_calls_per_sec", RunClosedLoop(16, aDuration, [vPool]() {
+        auto vClient = std::make_shared<TestThriftAPI::TestThriftAPIClient>(
+            std::make_shared<apache::thrift::protocol::TBinaryProtocol>(std::make_shared<bda::ThriftWSClientTransport>(vPool)));
+        auto vValue = std::make_shared<int32_t>(0);
+        return [vClient, vValue]() {
+            const int32_t vExpected = ~(++*vValue);
+            if (vClient->ping(*vValue) != vExpected) {
+                throw(std::runtime_error("Wrong ping response"));
+            }
+        };
+    }) });
+    vResults.push_back({ "pool_async_ping_calls_per_sec", 16.0 * RunClosedLoop(1, aDuration, [vPool]() {
+        return [vPool]() {
+            std::vector<std::future<int32_t>> vResponses;
+            for (int32_t vValue = 0; vValue < 16; ++vValue) {
+                vResponses.push_back(vPool->asyncCall<TestThriftAPI::TestThriftAPIClient>(
+                    [vValue](TestThriftAPI::TestThriftAPIClient& aClient) { aClient.send_ping(vValue); },
+                    [](TestThriftAPI::TestThriftAPIClient& aClient) { return aClient.recv_ping(); }));
+            }
+            for (int32_t vValue = 0; vValue < 16; ++vValue) {
+                if (vResponses[vValue].get() != ~vValue) {
+                    throw(std::runtime_error("Wrong ping response"));
+                }
+            }
+        };
+    }) });
+    vPool.reset();
+
+    // Throughput of responses of 100 B, 10 KB and 1 MB:
+    const std::vector<std::pair<int64_t, std::string>> vSizes = { { 2, "100B" }, { 4, "10KB" }, { 6, "1MB" }, { 7, "10MB" } };
+    for (const std::pair<int64_t, std::string>& vSize : vSizes) {
+        const int64_t vDataSizeIdx = vSize.first;
+        const double vCallsPerSec = RunClosedLoop(4, aDuration, [aPort, vDataSizeIdx]() {
+            auto vIOContext = std::make_shared<boost::asio::io_context>();
+            auto vClient = std::make_shared<PerfClient>(*vIOContext, aPort);
+            auto vData = std::make_shared<std::string>();
+            return [vIOContext, vClient, vData, vDataSizeIdx]() {
+                vClient->fetchData(*vData, vDataSizeIdx);
+            };
+        });
+        const double vBytes = std::pow(10.0, static_cast<double>(vDataSizeIdx));
+        vResults.push_back({ "fetchData_" + vSize.second + "_mb_per_sec", vCallsPerSec * vBytes / (1024.0 * 1024.0) });
+    }
+
+    // The same calls by native clients that send TFramedTransport frames
+    // directly over TCP, to compare with the WebSocket ones above:
+    const auto vMakeFramedClient = [aPort]() {
+        auto vTransport = std::make_shared<apache::thrift::transport::TFramedTransport>(std::make_shared<apache::thrift::transport::TSocket>("127.0.0.1", aPort));
+        vTransport->open();
+        return std::make_shared<TestThriftAPI::TestThriftAPIClient>(std::make_shared<apache::thrift::protocol::TBinaryProtocol>(vTransport));
+    };
+    vResults.push_back({ "framed_ping_calls_per_sec", RunClosedLoop(4, aDuration, [vMakeFramedClient]() {
+        auto vClient = vMakeFramedClient();
+        auto vValue = std::make_shared<int32_t>(0);
+        return [vClient, vValue]() {
+            const int32_t vExpected = ~(++*vValue);
+            if (vClient->ping(*vValue) != vExpected) {
+                throw(std::runtime_error("Wrong ping response"));
+            }
+        };
+    }) });
+    for (const std::pair<int64_t, std::string>& vSize : vSizes) {
+        const int64_t vDataSizeIdx = vSize.first;
+        const double vCallsPerSec = RunClosedLoop(4, aDuration, [vMakeFramedClient, vDataSizeIdx]() {
+            auto vClient = vMakeFramedClient();
+            auto vData = std::make_shared<std::string>();
+            return [vClient, vData, vDataSizeIdx]() {
+                vClient->fetchData(*vData, vDataSizeIdx);
+            };
+        });
+        const double vBytes = std::pow(10.0, static_cast<double>(vDataSizeIdx));
+        vResults.push_back({ "framed_fetchData_" + vSize.second + "_mb_per_sec", vCallsPerSec * vBytes / (1024.0 * 1024.0) });
+    }
+
+    // Throughput of large responses through shared memory, to compare with
+    // the WebSocket ones above:
+    if (!aSharedMemoryPath.empty()) {
+        for (const std::pair<int64_t, std::string>& vSize : vSizes) {
+            const int64_t vDataSizeIdx = vSize.first;
+            if (vDataSizeIdx < 6) {
+                continue;
+            }
+            const double vCallsPerSec = RunClosedLoop(4, aDuration, [aSharedMemoryPath, vDataSizeIdx]() {
+                auto vTransport = std::make_shared<bda::ThriftSharedMemoryTransport>(aSharedMemoryPath);
+                auto vClient = std::make_shared<TestThriftAPI::TestThriftAPIClient>(std::make_shared<apache::thrift::protocol::TBinaryProtocol>(vTransport));
+                vTransport->open();
+                auto vData = std::make_shared<std::string>();
+                return [vTransport, vClient, vData, vDataSizeIdx]() {
+                    vClient->fetchData(*vData, vDataSizeIdx);
+                };
+            });
+            const double vBytes = std::pow(10.0, static_cast<double>(vDataSizeIdx));
+            vResults.push_back({ "shm_fetchData_" + vSize.second + "_mb_per_sec", vCallsPerSec * vBytes / (1024.0 * 1024.0) });
+        }
+    }
+
+    // A new connection with WebSocket upgrade for every call:
+    vResults.push_back({ "connection_churn_per_sec", RunClosedLoop(2, aDuration, [aPort]() {
+        auto vIOContext = std::make_shared<boost::asio::io_context>();
+        return [vIOContext, aPort]() {
+            PerfClient vClient(*vIOContext, aPort);
+            vClient.ping(1);
+        };
+    }) });
+
+    // A new TLS connection with a full handshake for every iteration:
+    vResults.push_back({ "tls_handshakes_per_sec", RunClosedLoop(2, aDuration, [aPort]() {
+        auto vIOContext = std::make_shared<boost::asio::io_context>();
+        auto vSSLContext = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tlsv12_client);
+        vSSLContext->set_verify_mode(boost::asio::ssl::verify_none);
+        return [vIOContext, vSSLContext, aPort]() {
+            boost::asio::ssl::stream<boost::asio::ip::tcp::socket> vStream(*vIOContext, *vSSLContext);
+            vStream.next_layer().connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), aPort));
+            vStream.handshake(boost::asio::ssl::stream_base::client);
+            boost::beast::error_code ec;
+            vStream.next_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+        };
+    }) });
+
+    const std::vector<PerfResult> vJSONResults = RunJSONProtocolScenarios(aDuration);
+    vResults.insert(vResults.end(), vJSONResults.begin(), vJSONResults.end());
+    return vResults;
+}
+
+// Compare the results with the baseline, and return false on a regression
+// beyond the tolerance of a metric. Metrics without a recorded value are
+// skipped:
+bool CompareWithBaseline(const std::vector<PerfResult>& aResults, const boost::property_tree::ptree& aBaseline) {
+    const double vDefaultTolerance = aBaseline.get<double>("tolerance", 0.5);
+
+    bool vPassed = true;
+    std::cout << std::left << std::setw(32) << "metric" << std::right << std::setw(14) << "baseline" << std::setw(14) << "result"
+              << std::setw(10) << "ratio" << "  status" << std::endl;
+    for (const PerfResult& vResult : aResults) {
+        const boost::optional<const boost::property_tree::ptree&> vMetric = aBaseline.get_child_optional(boost::property_tree::ptree::path_type("metrics/" + vResult.mMetric, '/'));
+        std::cout << std::left << std::setw(32) << vResult.mMetric << std::right << std::fixed << std::setprecision(1);
+        if (!vMetric || !vMetric->get_optional<double>("value")) {
+            std::cout << std::setw(14) << "-" << std::setw(14) << vResult.mValue << std::setw(10) << "-" << "  skipped, no baseline" << std::endl;
+            continue;
+        }
+
+        const double vBaseline = vMetric->get<double>("value");
+        const double vTolerance = vMetric->get<double>("tolerance", vDefaultTolerance);
+        const double vRatio = vBaseline > 0.0 ? vResult.mValue / vBaseline : 1.0;
+        const bool vRegressed = vRatio < 1.0 - vTolerance;
+        vPassed = vPassed && !vRegressed;
+        std::cout << std::setw(14) << vBaseline << std::setw(14) << vResult.mValue << std::setprecision(2) << std::setw(10) << vRatio
+                  << (vRegressed ? "  REGRESSION" : "  ok") << std::endl;
+    }
+    return vPassed;
+}
+
+// Write the results as the new baseline, keeping the tolerances:
+void WriteBaseline(const std::string& aBaselineFile, const std::vector<PerfResult>& aResults, const boost::property_tree::ptree& aBaseline) {
+    const double vDefaultTolerance = aBaseline.get<double>("tolerance", 0.5);
+    std::ofstream vStream(aBaselineFile);
+    vStream << "{\n    \"tolerance\": " << vDefaultTolerance << ",\n    \"metrics\": {";
+    for (std::size_t vIdx = 0; vIdx < aResults.size(); ++vIdx) {
+        const double vTolerance = aBaseline.get<double>(boost::property_tree::ptree::path_type("metrics/" + aResults[vIdx].mMetric + "/tolerance", '/'), vDefaultTolerance);
+        vStream << (vIdx == 0 ? "\n" : ",\n") << "        \"" << aResults[vIdx].mMetric << "\": { \"value\": " << std::fixed << std::setprecision(1)
+                << aResults[vIdx].mValue << ", \"tolerance\": " << std::setprecision(2) << vTolerance << " }";
+    }
+    vStream << "\n    }\n}\n";
+}
+
+void ParseCommandLineArguments(boost::program_options::variables_map& aParsedCmdLineOptionsMap, std::vector<std::string>& aNonParsedCmdLineOptions, const int argc, char** const argv) {
+    // Declare command line options.
+    boost::program_options::options_description vCMDLineStdOptions("Allowed options");
+    // clang-format off
+    vCMDLineStdOptions.add_options()
+        ("help,h",                                                                                  "this help message")
+        ("verbose,v",       boost::program_options::value<uint8_t>()->default_value(6),             "verbosity (higher numbers mean more verbose)")
+        ("baseline,b",      boost::program_options::value<std::string>(),                           "baseline JSON file to compare with")
+        ("measured,m",      boost::program_options::value<std::string>(),                           "JSON file with the values measured on this machine, they override the baseline")
+        ("update-baseline",                                                                         "write the results to the measured file, or else the baseline file, instead of comparing")
+        ("duration-ms",     boost::program_options::value<uint32_t>()->default_value(2000),         "measurement duration of every scenario (milliseconds)")
+        ("threads,t",       boost::program_options::value<uint8_t>()->default_value(4),            "number of server threads");
+    // clang-format on
+
+
+    const auto vParsedCmdLineOptions = boost::program_options::command_line_parser(argc, argv).options(vCMDLineStdOptions).allow_unregistered().run();
+    boost::program_options::store(vParsedCmdLineOptions, aParsedCmdLineOptionsMap);
+    boost::program_options::notify(aParsedCmdLineOptionsMap);
+    aNonParsedCmdLineOptions = boost::program_options::collect_unrecognized(vParsedCmdLineOptions.options, boost::program_options::include_positional);
+
+    if (aParsedCmdLineOptionsMap.count("help")) {
+        std::cout << vCMDLineStdOptions;
+        std::exit(0);
+    }
+}
+
+int main(int argc, char** argv) {
+    // Parse command line options:
+    boost::program_options::variables_map vParsedCmdLineOptionsMap;
+    std::vector<std::string> vNonParsedCmdLineOptions;
+    ParseCommandLineArguments(vParsedCmdLineOptionsMap, vNonParsedCmdLineOptions, argc, argv);
+
+    // Validate the arguments:
+    if (vNonParsedCmdLineOptions.size() > 0) {
+        std::cerr << "ThriftHTTPWSPerfTest(): Received additional argument(s) " << vNonParsedCmdLineOptions.front() << std::endl;
+        return 1;
+    } else if (vParsedCmdLineOptionsMap.count("baseline") < 1) {
+        std::cerr << "ThriftHTTPWSPerfTest(): Missing required argument --baseline" << std::endl;
+        return 1;
+    }
+
+    const std::string vBaselineFile = vParsedCmdLineOptionsMap["baseline"].as<std::string>();
+    boost::property_tree::ptree vBaseline;
+    try {
+        boost::property_tree::read_json(vBaselineFile, vBaseline);
+    } catch (const std::exception& vException) {
+        if (!vParsedCmdLineOptionsMap.count("update-baseline")) {
+            std::cerr << "ThriftHTTPWSPerfTest(): Could not read the baseline: " << vException.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // The values measured on this machine, if they were recorded already:
+    const std::string vMeasuredFile = vParsedCmdLineOptionsMap.count("measured") ? vParsedCmdLineOptionsMap["measured"].as<std::string>() : std::string();
+    if (!vMeasuredFile.empty() && std::ifstream(vMeasuredFile).good()) {
+        boost::property_tree::ptree vMeasured;
+        try {
+            boost::property_tree::read_json(vMeasuredFile, vMeasured);
+        } catch (const std::exception& vException) {
+            std::cerr << "ThriftHTTPWSPerfTest(): Could not read the measured values: " << vException.what() << std::endl;
+            return 1;
+        }
+        for (const auto& vMetric : vMeasured.get_child("metrics", boost::property_tree::ptree())) {
+            const boost::optional<double> vValue = vMetric.second.get_optional<double>("value");
+            if (vValue) {
+                vBaseline.put(boost::property_tree::ptree::path_type("metrics/" + vMetric.first + "/value", '/'), *vValue);
+            }
+        }
+    }
+
+
+    // The server runs in this process, on a port that the operating system
+    // chooses, and is only reachable over loopback:
+    std::shared_ptr<apache::thrift::TProcessor> vThriftProcessor = std::make_shared<TestThriftAPI::TestThriftAPIProcessor>(std::make_shared<TestThriftAPIHandler>());
+    bda::ThriftHTTPWSServer vThriftHTTPWSServer("127.0.0.1", 0, ".", vParsedCmdLineOptionsMap["threads"].as<uint8_t>(),
+                                                vThriftProcessor, bda::ProtocolType::BINARY);
+    vThriftHTTPWSServer.setFramedThriftMode(true);
+    const unsigned short vPort = vThriftHTTPWSServer.port();
+    if (vPort == 0) {
+        std::cerr << "ThriftHTTPWSPerfTest(): The server could not bind to a loopback port" << std::endl;
+        return 1;
+    }
+    std::string vSharedMemoryPath;
+#if defined(__linux__)
+    vSharedMemoryPath = "/tmp/ThriftHTTPWSPerfTest-" + std::to_string(vPort) + ".shm";
+    vThriftHTTPWSServer.addSharedMemoryEndpoint(vSharedMemoryPath, 0600);
+#endif
+    vThriftHTTPWSServer.asyncRun();
+
+    std::vector<PerfResult> vResults;
+    try {
+        vResults = RunScenarios(vPort, vSharedMemoryPath, std::chrono::milliseconds(vParsedCmdLineOptionsMap["duration-ms"].as<uint32_t>()));
+    } catch (const std::exception& vException) {
+        vThriftHTTPWSServer.stop();
+        std::cerr << "ThriftHTTPWSPerfTest(): " << vException.what() << std::endl;
+        return 1;
+    }
+    vThriftHTTPWSServer.stop();
+
+
+    if (vParsedCmdLineOptionsMap.count("update-baseline")) {
+        const std::string vUpdateFile = vMeasuredFile.empty() ? vBaselineFile : vMeasuredFile;
+        WriteBaseline(vUpdateFile, vResults, vBaseline);
+        std::cout << "ThriftHTTPWSPerfTest(): Wrote the baseline '" << vUpdateFile << "'" << std::endl;
+        return 0;
+    }
+    return CompareWithBaseline(vResults, vBaseline) ? 0 : 1;
+}
@@ -0,0 +1,462 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "bda/ThriftTrafficCapture.hh"
+
+#include <bda/Helpers.hh>
+
+#include "ThriftMessageHeader.hh"
+
+#include <thrift/protocol/TProtocol.h>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// The latencies of the replayed calls of one method
+struct MethodStatistics {
+    std::vector<double> mLatenciesUS;
+    uint64_t mErrors = 0;
+};
+
+// The settings and results of a replay, shared by all connections. All
+// connections run on one thread, so no locking is needed.
+struct Replay {
+    boost::asio::io_context mIOContext;
+    std::string mHost;
+    uint16_t mPort = 0;
+    std::string mToken;
+    // Captured times are divided by the speed, zero replays as fast as possible:
+    double mSpeed = 1.0;
+    std::chrono::steady_clock::time_point mStartTime;
+
+    std::map<std::string, MethodStatistics> mMethods;
+    // How late the messages were sent compared to the capture:
+    std::vector<double> mSendLagsUS;
+    uint64_t mMessages = 0;
+    uint64_t mFailedConnections = 0;
+
+    // The replay ends when all connections are done, or when nothing was
+    // sent or received for the drain time after the last captured message:
+    std::size_t mActiveConnections = 0;
+    std::chrono::steady_clock::duration mDrainTime{ 0 };
+    std::chrono::steady_clock::time_point mLastMessageTime;
+    std::chrono::steady_clock::time_point mLastActivityTime;
+    std::unique_ptr<boost::asio::steady_timer> mDrainTimer;
+
+    void startDrainTimer() {
+        mDrainTimer->expires_at(std::max(mLastMessageTime, mLastActivityTime) + mDrainTime);
+        mDrainTimer->async_wait([this](const boost::beast::error_code ec) {
+            if (ec) {
+                return;
+            }
+            if (std::chrono::steady_clock::now() < mLastActivityTime + mDrainTime) {
+                return startDrainTimer();
+            }
+            BDAMessage(2, "ThriftHTTPWSReplay(): Stopping with " + std::to_string(mActiveConnections) + " unfinished connections.\n");
+            mIOContext.stop();
+        });
+    }
+
+    void connectionDone() {
+        if (--mActiveConnections == 0) {
+            mDrainTimer->cancel();
+        }
+    }
+
+    std::chrono::steady_clock::time_point scheduled(const std::chrono::microseconds aTime) const {
+        if (mSpeed <= 0.0) {
+            return mStartTime;
+        }
+        return mStartTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::micro>(aTime.count() / mSpeed));
+    }
+};
+
+// A captured message, and what is needed to match its response
+struct ReplayMessage {
+    std::chrono::microseconds mTime{ 0 };
+    std::string mData;
+    bool mBinary = true;
+    std::string mMethod;
+    bool mHasSeqId = false;
+    int32_t mSeqId = 0;
+    bool mOneway = false;
+};
+
+// Replays the messages of one captured connection on its own WebSocket, at
+// the captured times. Responses are matched to the calls by their sequence
+// ids, and in order for messages without a plain thrift header, e.g. batch
+// envelopes.
+class ReplayConnection : public std::enable_shared_from_this<ReplayConnection> {
+public:
+    ReplayConnection(Replay& aReplay, const std::string& aTarget, const bda::ProtocolType aProtocolType, const std::chrono::microseconds aOpenTime)
+        : mReplay(aReplay), mTarget(aTarget), mProtocolType(aProtocolType), mOpenTime(aOpenTime),
+          mResolver(aReplay.mIOContext), mWebSocket(aReplay.mIOContext), mTimer(aReplay.mIOContext) {
+    }
+
+    void addMessage(const bda::ThriftTrafficCapture::Record& aRecord) {
+        ReplayMessage vMessage;
+        vMessage.mTime = aRecord.mTime;
+        vMessage.mData = aRecord.mData;
+        vMessage.mBinary = aRecord.mBinary;
+        bda::ThriftMessageHeader vHeader;
+        if (bda::parseThriftMessageHeader(mProtocolType, reinterpret_cast<const uint8_t*>(vMessage.mData.data()), vMessage.mData.size(), vHeader)) {
+            vMessage.mMethod = vHeader.mName;
+            vMessage.mHasSeqId = true;
+            vMessage.mSeqId = vHeader.mSeqId;
+            vMessage.mOneway = vHeader.mType == apache::thrift::protocol::T_ONEWAY;
+        } else {
+            vMessage.mMethod = "(envelope)";
+        }
+        mMessages.push_back(std::move(vMessage));
+    }
+
+    void start() {
+        auto vSelf = shared_from_this();
+        mTimer.expires_at(mReplay.scheduled(mOpenTime));
+        mTimer.async_wait([this, vSelf](const boost::beast::error_code) {
+            mResolver.async_resolve(mReplay.mHost, std::to_string(mReplay.mPort), boost::beast::bind_front_handler(&ReplayConnection::on_resolve, vSelf));
+        });
+    }
+
+    // Count the calls that were not answered when the replay ends:
+    void finish() {
+        for (const Pending& vPending : mPending) {
+            ++mReplay.mMethods[vPending.mMethod].mErrors;
+        }
+        mPending.clear();
+    }
+
+private:
+    struct Pending {
+        std::string mMethod;
+        bool mHasSeqId = false;
+        int32_t mSeqId = 0;
+        std::chrono::steady_clock::time_point mSendTime;
+    };
+
+    void done() {
+        if (!mDone) {
+            mDone = true;
+            mReplay.connectionDone();
+        }
+    }
+
+    void fail(const boost::beast::error_code aError, const char* aWhat) {
+        if (mDone) {
+            return;
+        }
+        BDAMessage(2, "ReplayConnection::fail(): " + std::string(aWhat) + " of '" + mTarget + "' failed: '" + aError.message() + "'.\n");
+        ++mReplay.mFailedConnections;
+        mTimer.cancel();
+        boost::beast::get_lowest_layer(mWebSocket).close();
+        done();
+    }
+
+    void on_resolve(const boost::beast::error_code ec, const boost::asio::ip::tcp::resolver::results_type aResults) {
+        if (ec) {
+            return fail(ec, "resolve");
+        }
+        boost::beast::get_lowest_layer(mWebSocket).async_connect(aResults, boost::beast::bind_front_handler(&ReplayConnection::on_connect, shared_from_this()));
+    }
+
+    void on_connect(const boost::beast::error_code ec, const boost::asio::ip::tcp::endpoint) {
+        if (ec) {
+            return fail(ec, "connect");
+        }
+        const std::string vToken = mReplay.mToken;
+        mWebSocket.set_option(boost::beast::websocket::stream_base::decorator([vToken](boost::beast::websocket::request_type& aRequest) {
+            if (!vToken.empty()) {
+                aRequest.set(boost::beast::http::field::authorization, "Bearer " + vToken);
+            }
+        }));
+        mWebSocket.async_handshake(mReplay.mHost + ":" + std::to_string(mReplay.mPort), mTarget,
+                                   boost::beast::bind_front_handler(&ReplayConnection::on_handshake, shared_from_this()));
+    }
+
+    void on_handshake(const boost::beast::error_code ec) {
+        if (ec) {
+            return fail(ec, "handshake");
+        }
+        do_read();
+        send_next();
+    }
+
+    void send_next() {
+        if (mNext == mMessages.size()) {
+            return close_if_done();
+        }
+        mTimer.expires_at(mReplay.scheduled(mMessages[mNext].mTime));
+        mTimer.async_wait(boost::beast::bind_front_handler(&ReplayConnection::on_timer, shared_from_this()));
+    }
+
+    void on_timer(const boost::beast::error_code ec) {
+        if (ec) {
+            return;
+        }
+        const ReplayMessage& vMessage = mMessages[mNext];
+        const std::chrono::steady_clock::time_point vNow = std::chrono::steady_clock::now();
+        mReplay.mSendLagsUS.push_back(std::chrono::duration<double, std::micro>(vNow - mReplay.scheduled(vMessage.mTime)).count());
+        if (!vMessage.mOneway) {
+            mPending.push_back(Pending{ vMessage.mMethod, vMessage.mHasSeqId, vMessage.mSeqId, vNow });
+        }
+        mWebSocket.binary(vMessage.mBinary);
+        mWebSocket.async_write(boost::asio::buffer(vMessage.mData), boost::beast::bind_front_handler(&ReplayConnection::on_write, shared_from_this()));
+    }
+
+    void on_write(const boost::beast::error_code ec, const std::size_t) {
+        if (ec) {
+            return fail(ec, "write");
+        }
+        mReplay.mLastActivityTime = std::chrono::steady_clock::now();
+        ++mReplay.mMessages;
+        ++mNext;
+        send_next();
+    }
+
+    void do_read() {
+        mWebSocket.async_read(mBuffer, boost::beast::bind_front_handler(&ReplayConnection::on_read, shared_from_this()));
+    }
+
+    void on_read(const boost::beast::error_code ec, const std::size_t) {
+        if (ec == boost::beast::websocket::error::closed || ec == boost::asio::error::operation_aborted) {
+            return;
+        }
+        if (ec) {
+            return fail(ec, "read");
+        }
+        const std::chrono::steady_clock::time_point vNow = std::chrono::steady_clock::now();
+        mReplay.mLastActivityTime = vNow;
+
+        // Older servers answer oneway calls with an empty message, which
+        // belongs to no call:
+        if (mBuffer.size() == 0) {
+            return do_read();
+        }
+
+        // Match the response to its call by the sequence id, or else to the
+        // oldest call without one:
+        bda::ThriftMessageHeader vHeader;
+        const bool vHasHeader = bda::parseThriftMessageHeader(mProtocolType, static_cast<const uint8_t*>(mBuffer.data().data()), mBuffer.size(), vHeader);
+        auto vPendingIt = std::find_if(mPending.begin(), mPending.end(), [vHasHeader, &vHeader](const Pending& aPending) {
+            return vHasHeader && aPending.mHasSeqId && aPending.mSeqId == vHeader.mSeqId;
+        });
+        if (vPendingIt == mPending.end()) {
+            vPendingIt = std::find_if(mPending.begin(), mPending.end(), [](const Pending& aPending) {
+                return !aPending.mHasSeqId;
+            });
+        }
+        if (vPendingIt != mPending.end()) {
+            MethodStatistics& vStatistics = mReplay.mMethods[vPendingIt->mMethod];
+            if (vHasHeader && vHeader.mType == apache::thrift::protocol::T_EXCEPTION) {
+                ++vStatistics.mErrors;
+            } else {
+                vStatistics.mLatenciesUS.push_back(std::chrono::duration<double, std::micro>(vNow - vPendingIt->mSendTime).count());
+            }
+            mPending.erase(vPendingIt);
+        }
+        mBuffer.consume(mBuffer.size());
+
+        do_read();
+        close_if_done();
+    }
+
+    void close_if_done() {
+        if (mNext < mMessages.size() || !mPending.empty() || mClosing) {
+            return;
+        }
+        mClosing = true;
+        auto vSelf = shared_from_this();
+        mWebSocket.async_close(boost::beast::websocket::close_code::normal, [this, vSelf](const boost::beast::error_code) {
+            done();
+        });
+    }
+
+    Replay& mReplay;
+    const std::string mTarget;
+    const bda::ProtocolType mProtocolType;
+    const std::chrono::microseconds mOpenTime;
+
+    std::vector<ReplayMessage> mMessages;
+    std::size_t mNext = 0;
+    std::deque<Pending> mPending;
+    bool mClosing = false;
+    bool mDone = false;
+
+    boost::asio::ip::tcp::resolver mResolver;
+    boost::beast::websocket::stream<boost::beast::tcp_stream> mWebSocket;
+    boost::asio::steady_timer mTimer;
+    boost::beast::flat_buffer mBuffer;
+};
+
+void ParseCommandLineArguments(boost::program_options::variables_map& aParsedCmdLineOptionsMap, std::vector<std::string>& aNonParsedCmdLineOptions, const int argc, char** const argv) {
+    // Declare command line options.
+    boost::program_options::options_description vCMDLineStdOptions("Allowed options");
+    // clang-format off
+    vCMDLineStdOptions.add_options()
+        ("help,h",                                                                                              "this help message")
+        ("verbose,v",       boost::program_options::value<uint8_t>()->default_value(6),                         "verbosity (higher numbers mean more verbose)")
+        ("capture,c",       boost::program_options::value<std::string>(),                                       "traffic capture file to replay")
+        ("host",            boost::program_options::value<std::string>()->default_value("127.0.0.1"),           "server host")
+        ("port,p",          boost::program_options::value<uint16_t>()->default_value(9090),                     "server port")
+        ("speed,s",         boost::program_options::value<double>()->default_value(1.0),                        "replay speed relative to the capture (0 replays as fast as possible)")
+        ("drain-sec",       boost::program_options::value<uint32_t>()->default_value(10),                       "stop when nothing was sent or received for this long after the last message (seconds)")
+        ("token",           boost::program_options::value<std::string>(),                                       "authenticate every connection with this access token");
+    // clang-format on
+
+
+    const auto vParsedCmdLineOptions = boost::program_options::command_line_parser(argc, argv).options(vCMDLineStdOptions).allow_unregistered().run();
+    boost::program_options::store(vParsedCmdLineOptions, aParsedCmdLineOptionsMap);
+    boost::program_options::notify(aParsedCmdLineOptionsMap);
+    aNonParsedCmdLineOptions = boost::program_options::collect_unrecognized(vParsedCmdLineOptions.options, boost::program_options::include_positional);
+
+    if (aParsedCmdLineOptionsMap.count("help")) {
+        std::cout << vCMDLineStdOptions;
+        std::exit(0);
+    }
+}
+
+double Percentile(const std::vector<double>& aSortedValues, const double aPercentile) {
+    if (aSortedValues.empty()) {
+        return 0.0;
+    }
+    const std::size_t vIdx = static_cast<std::size_t>(aPercentile / 100.0 * static_cast<double>(aSortedValues.size() - 1) + 0.5);
+    return aSortedValues[std::min(vIdx, aSortedValues.size() - 1)];
+}
+
+int main(int argc, char** argv) {
+    // Parse command line options:
+    boost::program_options::variables_map vParsedCmdLineOptionsMap;
+    std::vector<std::string> vNonParsedCmdLineOptions;
+    ParseCommandLineArguments(vParsedCmdLineOptionsMap, vNonParsedCmdLineOptions, argc, argv);
+
+    // Validate the arguments:
+    if (vNonParsedCmdLineOptions.size() > 0) {
+        std::cerr << "ThriftHTTPWSReplay(): Received additional argument(s) " << vNonParsedCmdLineOptions.front() << std::endl;
+        std::exit(1);
+    } else if (vParsedCmdLineOptionsMap.count("capture") < 1) {
+        std::cerr << "ThriftHTTPWSReplay(): Missing required argument --capture" << std::endl;
+        std::exit(1);
+    }
+
+    Replay vReplay;
+    vReplay.mHost = vParsedCmdLineOptionsMap["host"].as<std::string>();
+    vReplay.mPort = vParsedCmdLineOptionsMap["port"].as<uint16_t>();
+    vReplay.mSpeed = vParsedCmdLineOptionsMap["speed"].as<double>();
+    vReplay.mToken = vParsedCmdLineOptionsMap.count("token") ? vParsedCmdLineOptionsMap["token"].as<std::string>() : std::string();
+    const std::chrono::seconds vDrainTime(vParsedCmdLineOptionsMap["drain-sec"].as<uint32_t>());
+
+
+    // Load the connections of the capture with their messages:
+    std::vector<std::shared_ptr<ReplayConnection>> vConnections;
+    std::chrono::microseconds vLastTime{ 0 };
+    try {
+        const std::string vCapturePath = vParsedCmdLineOptionsMap["capture"].as<std::string>();
+        std::ifstream vCaptureFile(vCapturePath, std::ios::binary);
+        if (!vCaptureFile) {
+            throw(std::runtime_error("Cannot open '" + vCapturePath + "'"));
+        }
+        bda::ThriftTrafficCapture::Reader vReader(vCaptureFile);
+        std::map<uint64_t, std::shared_ptr<ReplayConnection>> vOpenConnections;
+        bda::ThriftTrafficCapture::Record vRecord;
+        while (vReader.next(vRecord)) {
+            if (vRecord.mType == bda::ThriftTrafficCapture::RecordType::Open) {
+                vConnections.push_back(std::make_shared<ReplayConnection>(vReplay, vRecord.mData, vRecord.mProtocolType, vRecord.mTime));
+                vOpenConnections[vRecord.mConnection] = vConnections.back();
+            } else if (vRecord.mType == bda::ThriftTrafficCapture::RecordType::Message) {
+                const auto vConnectionIt = vOpenConnections.find(vRecord.mConnection);
+                if (vConnectionIt != vOpenConnections.end()) {
+                    vConnectionIt->second->addMessage(vRecord);
+                    vLastTime = vRecord.mTime;
+                }
+            } else {
+                vOpenConnections.erase(vRecord.mConnection);
+            }
+        }
+    } catch (const std::exception& vException) {
+        std::cerr << "ThriftHTTPWSReplay(): Failed to load the capture: " << vException.what() << std::endl;
+        std::exit(1);
+    }
+    BDAMessage(6, "ThriftHTTPWSReplay(): Replaying " + std::to_string(vConnections.size()) + " connections.\n");
+
+
+    // Replay all connections on one thread:
+    vReplay.mStartTime = std::chrono::steady_clock::now();
+    vReplay.mActiveConnections = vConnections.size();
+    vReplay.mDrainTime = vDrainTime;
+    vReplay.mLastMessageTime = vReplay.scheduled(vLastTime);
+    vReplay.mLastActivityTime = vReplay.mStartTime;
+    vReplay.mDrainTimer.reset(new boost::asio::steady_timer(vReplay.mIOContext));
+    vReplay.startDrainTimer();
+    if (vConnections.empty()) {
+        vReplay.mDrainTimer->cancel();
+    }
+    for (const std::shared_ptr<ReplayConnection>& vConnection : vConnections) {
+        vConnection->start();
+    }
+    vReplay.mIOContext.run();
+    const double vDurationSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - vReplay.mStartTime).count();
+    for (const std::shared_ptr<ReplayConnection>& vConnection : vConnections) {
+        vConnection->finish();
+    }
+
+
+    // Report the latency distribution of every method:
+    std::sort(vReplay.mSendLagsUS.begin(), vReplay.mSendLagsUS.end());
+    std::cout << "replayed " << vReplay.mMessages << " messages on " << vConnections.size() << " connections in " << std::fixed << std::setprecision(1)
+              << vDurationSec << " s, " << vReplay.mFailedConnections << " failed connections";
+    if (vReplay.mSpeed > 0.0) {
+        // a large lag means that the replay could not keep up with the capture:
+        std::cout << ", send lag p99 " << std::setprecision(0) << Percentile(vReplay.mSendLagsUS, 99.0) << " us";
+    }
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(24) << "method" << std::right << std::setw(12) << "calls" << std::setw(12) << "p50 (us)"
+              << std::setw(12) << "p90 (us)" << std::setw(12) << "p99 (us)" << std::setw(12) << "max (us)" << std::setw(8) << "errors" << std::endl;
+    for (auto& vMethod : vReplay.mMethods) {
+        std::vector<double>& vLatenciesUS = vMethod.second.mLatenciesUS;
+        std::sort(vLatenciesUS.begin(), vLatenciesUS.end());
+        std::cout << std::left << std::setw(24) << vMethod.first << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(12) << vLatenciesUS.size()
+                  << std::setw(12) << Percentile(vLatenciesUS, 50.0)
+                  << std::setw(12) << Percentile(vLatenciesUS, 90.0)
+                  << std::setw(12) << Percentile(vLatenciesUS, 99.0)
+                  << std::setw(12) << (vLatenciesUS.empty() ? 0.0 : vLatenciesUS.back())
+                  << std::setw(8) << vMethod.second.mErrors << std::endl;
+    }
+
+    return 0;
+}
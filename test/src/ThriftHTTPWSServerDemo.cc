@@ -17,25 +17,44 @@
  * under the License.
  */
 
+#include "bda/ThriftAccessManager.hh"
+#include "bda/ThriftEmbeddedDocumentRoot.hh"
+#include "bda/ThriftExecutionPool.hh"
 #include "bda/ThriftHTTPWSServer.hh"
+#include "bda/ThriftProfiler.hh"
+#include "bda/ThriftRequestCoalescer.hh"
+#include "bda/ThriftResponseCache.hh"
+#include "bda/ThriftSlowCallLog.hh"
+#include "bda/ThriftSocketHandoff.hh"
+#include "bda/ThriftTracer.hh"
+#include "bda/ThriftTrafficCapture.hh"
 
 #include <bda/Helpers.hh>
 
+#include "AllocationCounter.hh"
 #include "TestThriftAPI.h"
+#include "TestThriftAPIAsyncHandler.hh"
 #include "TestThriftAPIHandler.hh"
+#include "demoDocumentRoot.hh"
 
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/protocol/TJSONProtocol.h>
 
+#include <boost/asio/executor_work_guard.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/program_options.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <exception>
+#include <fstream>
 #include <iostream>
 #include <limits>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 
 void ParseCommandLineArguments(boost::program_options::variables_map& aParsedCmdLineOptionsMap, std::vector<std::string>& aNonParsedCmdLineOptions, const int argc, char** const argv) {
@@ -48,8 +67,27 @@ void ParseCommandLineArguments(boost::program_options::variables_map& aParsedCmd
         ("interface,i",      boost::program_options::value<std::string>()->default_value("0.0.0.0"),                         "network interface")
         ("port,p",           boost::program_options::value<uint16_t>()->default_value(9090),                                 "network port")
         ("http-directory,d", boost::program_options::value<std::string>(),                                                   "http document root directory")
+        ("embedded",                                                                                                         "serve the browser client that was embedded at build time, other paths from --http-directory")
+        ("unix-socket",      boost::program_options::value<std::string>(),                                                   "also listen on this Unix domain socket")
+        ("shm-socket",       boost::program_options::value<std::string>(),                                                   "accept shared memory clients on this Unix domain socket")
+        ("framed",                                                                                                           "also serve TFramedTransport clients on the TCP port")
+        ("handoff-socket",   boost::program_options::value<std::string>(),                                                   "take over the listening sockets of a running demo on this Unix domain socket, and hand them to the next one")
         ("threads,t",        boost::program_options::value<uint8_t>()->default_value(8),                                     "number of threads")
         ("uptime-sec,u",     boost::program_options::value<uint32_t>()->default_value(std::numeric_limits<uint32_t>::max()), "automatic shutdown after (seconds)")
+        ("batch",                                                                                                            "accept batch envelopes of multiple calls")
+        ("batch-parallel",                                                                                                   "process the calls of a batch in parallel")
+        ("coalesce",                                                                                                         "coalesce identical concurrent fetchData calls")
+        ("deadlines",                                                                                                        "accept call deadlines and drop expired calls")
+        ("pool-threads",     boost::program_options::value<uint8_t>()->default_value(0),                                     "run the handlers on a pool with priority classes (0 disables)")
+        ("service",          boost::program_options::value<std::vector<std::string>>()->composing(),                          "serve another instance of the API on this path, with its own pool of 2 threads")
+        ("async-delay-ms",   boost::program_options::value<uint32_t>()->default_value(0),                                    "serve an asynchronous API on /async, whose fetchData waits this long (0 disables)")
+        ("trace-file",       boost::program_options::value<std::string>(),                                                   "write a Chrome trace of the last messages of every thread to this file at shutdown")
+        ("capture-file",     boost::program_options::value<std::string>(),                                                   "record the WebSocket messages of all clients into this file, for ThriftHTTPWSReplay")
+        ("slow-call-ms",     boost::program_options::value<uint32_t>()->default_value(0),                                    "log calls slower than this, and serve them on /slowcalls (0 disables)")
+        ("profile-path",     boost::program_options::value<std::string>(),                                                   "serve CPU and heap profiles on this path, e.g. /debug/profile")
+        ("memory-budget-mb", boost::program_options::value<uint32_t>()->default_value(0),                                    "stop reading messages while the sessions buffer more than this (MB, 0 disables)")
+        ("cache-mb",         boost::program_options::value<uint32_t>()->default_value(0),                                    "response cache size for fetchData (MB, 0 disables)")
+        ("access-token",     boost::program_options::value<std::string>(),                                                   "require this bearer token for all calls but ping")
         ("logfile,l",        boost::program_options::value<std::string>(),                                                   "logfile (overwrites existing)");
     // clang-format on
 
@@ -96,23 +134,164 @@ int main(int argc, char** argv) {
     const uint16_t ServerPort = vParsedCmdLineOptionsMap["port"].as<uint16_t>();
     const std::string vHTTPDocumentRoot = vParsedCmdLineOptionsMap["http-directory"].as<std::string>();
     const uint8_t vThreads = vParsedCmdLineOptionsMap["threads"].as<uint8_t>();
+    // A running demo keeps serving its connections while this one takes
+    // over its listening sockets:
+    if (vParsedCmdLineOptionsMap.count("handoff-socket")) {
+        bda::receiveListeningSockets(vParsedCmdLineOptionsMap["handoff-socket"].as<std::string>());
+    }
     bda::ThriftHTTPWSServer vThriftHTTPWSServer(vServerAddress, ServerPort, vHTTPDocumentRoot, vThreads,
                                             vThriftProcessor, bda::ProtocolType::BINARY);
+    std::atomic<bool> vHandedOff(false);
+    if (vParsedCmdLineOptionsMap.count("handoff-socket")) {
+        vThriftHTTPWSServer.enableSocketHandoff(vParsedCmdLineOptionsMap["handoff-socket"].as<std::string>(), [&vHandedOff]() {
+            vHandedOff = true;
+        });
+    }
+    if (vParsedCmdLineOptionsMap.count("unix-socket")) {
+        vThriftHTTPWSServer.addLocalEndpoint(vParsedCmdLineOptionsMap["unix-socket"].as<std::string>());
+    }
+    if (vParsedCmdLineOptionsMap.count("shm-socket")) {
+        vThriftHTTPWSServer.addSharedMemoryEndpoint(vParsedCmdLineOptionsMap["shm-socket"].as<std::string>());
+    }
+    if (vParsedCmdLineOptionsMap.count("framed")) {
+        vThriftHTTPWSServer.setFramedThriftMode(true);
+    }
+    if (vParsedCmdLineOptionsMap.count("access-token")) {
+        const std::string vAccessToken = vParsedCmdLineOptionsMap["access-token"].as<std::string>();
+        std::shared_ptr<bda::ThriftAccessManager> vAccessManager = std::make_shared<bda::ThriftAccessManager>(
+            [vAccessToken](const std::string& aToken, bda::ThriftCredentials& aCredentials) {
+                aCredentials.mPrincipal = "demo";
+                return aToken == vAccessToken;
+            });
+        vAccessManager->setPublic("ping");
+        vAccessManager->setTokenCookie("token");
+        vThriftHTTPWSServer.setAccessManager(vAccessManager);
+    }
+    if (vParsedCmdLineOptionsMap.count("batch")) {
+        vThriftHTTPWSServer.setBatchMode(true, vParsedCmdLineOptionsMap.count("batch-parallel") > 0);
+    }
+    const uint32_t vCacheMB = vParsedCmdLineOptionsMap["cache-mb"].as<uint32_t>();
+    if (vCacheMB > 0) {
+        std::shared_ptr<bda::ThriftResponseCache> vResponseCache = std::make_shared<bda::ThriftResponseCache>(static_cast<std::size_t>(vCacheMB) * 1024 * 1024);
+        vResponseCache->setCacheable("fetchData", std::chrono::seconds(60));
+        vThriftHTTPWSServer.setResponseCache(vResponseCache);
+    }
+    std::shared_ptr<bda::ThriftRequestCoalescer> vRequestCoalescer;
+    if (vParsedCmdLineOptionsMap.count("coalesce")) {
+        vRequestCoalescer = std::make_shared<bda::ThriftRequestCoalescer>();
+        vRequestCoalescer->setCoalescible("fetchData");
+        vThriftHTTPWSServer.setRequestCoalescer(vRequestCoalescer);
+    }
+    if (vParsedCmdLineOptionsMap.count("service")) {
+        for (const std::string& vServicePath : vParsedCmdLineOptionsMap["service"].as<std::vector<std::string>>()) {
+            std::shared_ptr<apache::thrift::TProcessor> vServiceProcessor = std::make_shared<TestThriftAPI::TestThriftAPIProcessor>(std::make_shared<TestThriftAPIHandler>());
+            vThriftHTTPWSServer.addService(vServicePath, vServiceProcessor, std::make_shared<bda::ThriftExecutionPool>(2));
+        }
+    }
+    // The asynchronous handler waits on timers of a single extra thread,
+    // no matter how many calls wait at the same time:
+    boost::asio::io_context vAsyncIOContext;
+    auto vAsyncWorkGuard = boost::asio::make_work_guard(vAsyncIOContext);
+    std::thread vAsyncThread;
+    const uint32_t vAsyncDelayMS = vParsedCmdLineOptionsMap["async-delay-ms"].as<uint32_t>();
+    if (vAsyncDelayMS > 0) {
+        std::shared_ptr<TestThriftAPIAsyncHandler> vAsyncHandler = std::make_shared<TestThriftAPIAsyncHandler>(vAsyncIOContext.get_executor(), std::chrono::milliseconds(vAsyncDelayMS));
+        vThriftHTTPWSServer.addService("/async", std::make_shared<TestThriftAPI::TestThriftAPIAsyncProcessor>(vAsyncHandler));
+        vAsyncThread = std::thread([&vAsyncIOContext]() {
+            vAsyncIOContext.run();
+        });
+    }
+    if (vParsedCmdLineOptionsMap.count("deadlines")) {
+        vThriftHTTPWSServer.setDeadlineMode(true);
+    }
+    const uint32_t vSlowCallMS = vParsedCmdLineOptionsMap["slow-call-ms"].as<uint32_t>();
+    if (vSlowCallMS > 0) {
+        vThriftHTTPWSServer.setSlowCallLog(std::make_shared<bda::ThriftSlowCallLog>(std::chrono::milliseconds(vSlowCallMS)), "/slowcalls");
+    }
+    const uint32_t vMemoryBudgetMB = vParsedCmdLineOptionsMap["memory-budget-mb"].as<uint32_t>();
+    if (vMemoryBudgetMB > 0) {
+        vThriftHTTPWSServer.setMemoryBudget(static_cast<std::size_t>(vMemoryBudgetMB) * 1024 * 1024);
+    }
+    if (vParsedCmdLineOptionsMap.count("capture-file")) {
+        vThriftHTTPWSServer.setTrafficCapture(std::make_shared<bda::ThriftTrafficCapture>(vParsedCmdLineOptionsMap["capture-file"].as<std::string>()));
+    }
+    if (vParsedCmdLineOptionsMap.count("embedded")) {
+        vThriftHTTPWSServer.setEmbeddedDocumentRoot(demoDocumentRoot());
+        BDAMessage(2, "Demo: Serving " + std::to_string(demoDocumentRoot().size()) + " embedded files.\n");
+    }
+    if (vParsedCmdLineOptionsMap.count("profile-path")) {
+        vThriftHTTPWSServer.setProfiler(std::make_shared<bda::ThriftProfiler>(), vParsedCmdLineOptionsMap["profile-path"].as<std::string>());
+    }
+    std::shared_ptr<bda::ThriftTracer> vTracer;
+    if (vParsedCmdLineOptionsMap.count("trace-file")) {
+        vTracer = std::make_shared<bda::ThriftTracer>();
+        vThriftHTTPWSServer.setTracer(vTracer);
+    }
+    const uint8_t vPoolThreads = vParsedCmdLineOptionsMap["pool-threads"].as<uint8_t>();
+    if (vPoolThreads > 0) {
+        // Keep ping responsive while fetchData saturates the pool: ping is
+        // preferred 8:1, and fetchData may never occupy the last thread.
+        std::shared_ptr<bda::ThriftExecutionPool> vExecutionPool = std::make_shared<bda::ThriftExecutionPool>(vPoolThreads);
+        const std::size_t vHighPriority = vExecutionPool->addPriorityClass("high", 8);
+        const std::size_t vBulkPriority = vExecutionPool->addPriorityClass("bulk", 1, std::max<std::size_t>(1, vPoolThreads - 1));
+        vExecutionPool->setMethodPriority("ping", vHighPriority);
+        vExecutionPool->setMethodPriority("fetchData", vBulkPriority);
+        vThriftHTTPWSServer.setExecutionPool(vExecutionPool);
+    }
     BDAMessage(2, "Demo: Webserver constructed\n");
 
 
     BDAMessage(2, "Demo: Will start the webserver\n");
     vThriftHTTPWSServer.asyncRun();
     BDAMessage(2, "Demo: Webserver started\n");
+    const uint64_t vStartAllocations = globalAllocations();
+    const auto vStartTime = std::chrono::steady_clock::now();
 
 
-    // Sleep for a while, before shutting down the server
-    std::this_thread::sleep_for(std::chrono::seconds(vParsedCmdLineOptionsMap["uptime-sec"].as<uint32_t>()));
+    // Sleep for a while, or until a successor took over, before shutting
+    // down the server
+    const auto vEndTime = vStartTime + std::chrono::seconds(vParsedCmdLineOptionsMap["uptime-sec"].as<uint32_t>());
+    while (!vHandedOff && std::chrono::steady_clock::now() < vEndTime) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (vHandedOff) {
+        BDAMessage(2, "Demo: Handed off the listening sockets, draining " + std::to_string(vThriftHTTPWSServer.connections()) + " connections\n");
+        vThriftHTTPWSServer.drain(std::chrono::seconds(30));
+    }
+
 
+    // Report the allocation rate, e.g. while the load generator runs:
+    const double vUptimeSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - vStartTime).count();
+    const uint64_t vAllocations = globalAllocations() - vStartAllocations;
+    BDAMessage(2, "Demo: " + std::to_string(vAllocations) + " heap allocations, " +
+                      std::to_string(static_cast<uint64_t>(static_cast<double>(vAllocations) / std::max(vUptimeSec, 1e-3))) + " per second\n");
 
     BDAMessage(2, "Demo: Will request the webserver to end\n");
     vThriftHTTPWSServer.stop();
     BDAMessage(2, "Demo: Webserver ended\n");
 
+    vAsyncWorkGuard.reset();
+    vAsyncIOContext.stop();
+    if (vAsyncThread.joinable()) {
+        vAsyncThread.join();
+    }
+
+    if (vMemoryBudgetMB > 0) {
+        BDAMessage(2, "Demo: " + std::to_string(vThriftHTTPWSServer.throttledReads()) + " reads waited for memory of the budget\n");
+    }
+    if (vParsedCmdLineOptionsMap.count("deadlines")) {
+        BDAMessage(2, "Demo: Dropped " + std::to_string(vThriftHTTPWSServer.expiredCalls()) + " calls with expired deadlines\n");
+    }
+    if (vTracer) {
+        const std::string vTraceFile = vParsedCmdLineOptionsMap["trace-file"].as<std::string>();
+        std::ofstream vTraceStream(vTraceFile);
+        vTracer->writeChromeTrace(vTraceStream);
+        BDAMessage(2, "Demo: Wrote the trace to '" + vTraceFile + "'\n");
+    }
+    if (vRequestCoalescer) {
+        BDAMessage(2, "Demo: Processed " + std::to_string(vRequestCoalescer->processedCalls()) + " and coalesced " +
+                          std::to_string(vRequestCoalescer->coalescedCalls()) + " fetchData calls\n");
+    }
+
     return 0;
 }